@@ -0,0 +1,206 @@
+// Times building the BVH of 100k boxes, keeping it up to date as they move, and querying it
+// with a frustum, rays and boxes, against going through every box :
+//
+//   bvh_bench [count] [margin]
+//
+// Checks that the BVH finds what the linear searches find.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/frustum.hpp>
+#include <common/culling.hpp>
+#include <common/bvh.hpp>
+
+// Rays and boxes of each query benchmark
+#define QUERY_COUNT 200
+
+// Objects moving each frame, and frames
+#define MOVER_COUNT 300
+#define FRAME_COUNT 100
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Scene {
+	std::vector<glm::vec3> boxMins;
+	std::vector<glm::vec3> boxMaxs;
+};
+
+// Nearest box along the ray, with every box grown by margin as the leaves are
+static int raycastLinear(const Scene & scene, float margin, const glm::vec3 & origin, const glm::vec3 & direction, float maxDistance, float & out_distance){
+	int nearest = BVH_NONE;
+	out_distance = maxDistance;
+	glm::vec3 inverse = 1.0f / direction;
+	for ( size_t i=0; i<scene.boxMins.size(); i++ ){
+		glm::vec3 a = (scene.boxMins[i] - glm::vec3(margin) - origin) * inverse;
+		glm::vec3 b = (scene.boxMaxs[i] + glm::vec3(margin) - origin) * inverse;
+		glm::vec3 near = glm::min(a, b), far = glm::max(a, b);
+		float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		float exit = std::min(std::min(far.x, far.y), far.z);
+		if ( enter <= exit && enter < out_distance ){
+			out_distance = enter;
+			nearest = (int)i;
+		}
+	}
+	return nearest;
+}
+
+static size_t queryBoxLinear(const Scene & scene, float margin, const glm::vec3 & boxMin, const glm::vec3 & boxMax){
+	size_t count = 0;
+	for ( size_t i=0; i<scene.boxMins.size(); i++ ){
+		if ( glm::all(glm::lessThanEqual(scene.boxMins[i] - glm::vec3(margin), boxMax)) &&
+		     glm::all(glm::greaterThanEqual(scene.boxMaxs[i] + glm::vec3(margin), boxMin)) )
+			count++;
+	}
+	return count;
+}
+
+static glm::vec3 randomPoint(std::mt19937 & random){
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	return glm::vec3(uniform(random) * 1000.0f, uniform(random) * 100.0f, uniform(random) * 1000.0f);
+}
+
+// Frustum, ray and box queries, against the linear searches
+static void benchQueries(const Bvh & bvh, const Scene & scene, std::mt19937 & random){
+	size_t count = scene.boxMins.size();
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 500.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 20.0f, 30.0f), glm::vec3(0.0f, 0.0f, -100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum;
+	extractFrustum(projection * view, frustum);
+	std::vector<int> objects;
+	double startTime = getTime();
+	queryBvhFrustum(bvh, frustum, objects);
+	double bvhTime = getTime() - startTime;
+
+	BoxArrays boxes;
+	resizeBoxArrays(boxes, count);
+	for ( size_t i=0; i<count; i++ )
+		setBox(boxes, i, (scene.boxMins[i] + scene.boxMaxs[i]) * 0.5f, (scene.boxMaxs[i] - scene.boxMins[i]) * 0.5f + glm::vec3(bvh.margin));
+	std::vector<unsigned char> visible(count);
+	startTime = getTime();
+	size_t visibleCount = cullBoxes(frustum, boxes, &visible[0]);
+	double linearTime = getTime() - startTime;
+	std::vector<unsigned char> found(count, 0);
+	for ( size_t i=0; i<objects.size(); i++ )
+		found[objects[i]] = 1;
+	printf("  frustum : %8.3f ms, cullBoxes %8.3f ms : %zu visible, same : %s\n",
+		bvhTime, linearTime, objects.size(), found == visible && objects.size() == visibleCount ? "yes" : "NO");
+
+	bvhTime = linearTime = 0.0;
+	int mismatches = 0;
+	for ( int i=0; i<QUERY_COUNT; i++ ){
+		glm::vec3 origin = randomPoint(random);
+		glm::vec3 direction = glm::normalize(glm::vec3(uniform(random), uniform(random) * 0.1f, uniform(random)) + glm::vec3(1e-3f));
+		float bvhDistance, linearDistance;
+		startTime = getTime();
+		int bvhHit = raycastBvh(bvh, origin, direction, 3000.0f, bvhDistance);
+		bvhTime += getTime() - startTime;
+		startTime = getTime();
+		int linearHit = raycastLinear(scene, bvh.margin, origin, direction, 3000.0f, linearDistance);
+		linearTime += getTime() - startTime;
+		// Boxes hit at the same distance may come in any order
+		if ( bvhHit != linearHit && !(bvhHit != BVH_NONE && linearHit != BVH_NONE && fabsf(bvhDistance - linearDistance) < 1e-3f) )
+			mismatches++;
+	}
+	printf("  ray     : %8.4f ms, linear %9.4f ms, per ray, %d different hits\n", bvhTime / QUERY_COUNT, linearTime / QUERY_COUNT, mismatches);
+
+	bvhTime = linearTime = 0.0;
+	mismatches = 0;
+	for ( int i=0; i<QUERY_COUNT; i++ ){
+		glm::vec3 center = randomPoint(random);
+		objects.clear();
+		startTime = getTime();
+		queryBvhBox(bvh, center - glm::vec3(20.0f), center + glm::vec3(20.0f), objects);
+		bvhTime += getTime() - startTime;
+		startTime = getTime();
+		size_t linearCount = queryBoxLinear(scene, bvh.margin, center - glm::vec3(20.0f), center + glm::vec3(20.0f));
+		linearTime += getTime() - startTime;
+		if ( objects.size() != linearCount )
+			mismatches++;
+	}
+	printf("  box     : %8.4f ms, linear %9.4f ms, per 40 m box, %d different counts\n", bvhTime / QUERY_COUNT, linearTime / QUERY_COUNT, mismatches);
+}
+
+int main( int argc, char * argv[] )
+{
+	size_t count = argc > 1 ? (size_t)atol(argv[1]) : 100000;
+	float margin = argc > 2 ? (float)atof(argv[2]) : 0.5f;
+	if ( count < 2 || margin < 0.0f ){
+		printf("Usage : bvh_bench [count] [margin]\n");
+		return 1;
+	}
+
+	// Boxes of 1 to 5 m over a field of 2 km
+	std::mt19937 random(2);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	Scene scene;
+	for ( size_t i=0; i<count; i++ ){
+		glm::vec3 center = randomPoint(random);
+		glm::vec3 extent(1.5f + uniform(random));
+		scene.boxMins.push_back(center - extent);
+		scene.boxMaxs.push_back(center + extent);
+	}
+
+	Bvh bvh;
+	double startTime = getTime();
+	buildBvh(bvh, scene.boxMins, scene.boxMaxs, margin);
+	printf("%zu boxes, margin %g : SAH build %.1f ms, %zu nodes, cost %.2f\n", count, margin, getTime() - startTime, bvh.nodes.size(), getBvhCost(bvh));
+	benchQueries(bvh, scene, random);
+
+	// A few hundred objects moving each frame
+	double totalTime = 0.0, worstTime = 0.0;
+	size_t changedCount = 0;
+	std::uniform_int_distribution<size_t> object(0, count - 1);
+	for ( int frame=0; frame<FRAME_COUNT; frame++ ){
+		std::vector<size_t> movers;
+		std::vector<glm::vec3> offsets;
+		for ( int i=0; i<MOVER_COUNT; i++ ){
+			movers.push_back(object(random));
+			offsets.push_back(glm::vec3(uniform(random) * 10.0f, uniform(random), uniform(random) * 10.0f));
+		}
+		startTime = getTime();
+		for ( int i=0; i<MOVER_COUNT; i++ ){
+			size_t o = movers[i];
+			scene.boxMins[o] += offsets[i];
+			scene.boxMaxs[o] += offsets[i];
+			changedCount += updateBvhObject(bvh, (int)o, scene.boxMins[o], scene.boxMaxs[o]) ? 1 : 0;
+		}
+		double time = getTime() - startTime;
+		totalTime += time;
+		worstTime = std::max(worstTime, time);
+	}
+	printf("%d objects moving for %d frames : updates %.3f ms a frame on average, %.3f ms at worst, %zu leaves changed, cost %.2f\n",
+		MOVER_COUNT, FRAME_COUNT, totalTime / FRAME_COUNT, worstTime, changedCount, getBvhCost(bvh));
+	benchQueries(bvh, scene, random);
+
+	// Everything moving a little
+	for ( size_t i=0; i<count; i++ ){
+		glm::vec3 offset(uniform(random), 0.0f, uniform(random));
+		scene.boxMins[i] += offset;
+		scene.boxMaxs[i] += offset;
+	}
+	startTime = getTime();
+	refitBvh(bvh, scene.boxMins, scene.boxMaxs);
+	double refitTime = getTime() - startTime;
+	Bvh rebuilt;
+	startTime = getTime();
+	buildBvh(rebuilt, scene.boxMins, scene.boxMaxs, margin);
+	printf("All objects moving : refit %.2f ms, cost %.2f ; rebuild %.1f ms, cost %.2f\n", refitTime, getBvhCost(bvh), getTime() - startTime, getBvhCost(rebuilt));
+	benchQueries(bvh, scene, random);
+	return 0;
+}
@@ -0,0 +1,83 @@
+// Times cullBoxes on each path this CPU runs, over a million boxes scattered around a camera,
+// and checks that every path finds the same boxes visible :
+//
+//   culling_bench [count]
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/frustum.hpp>
+#include <common/culling.hpp>
+
+// Each cull is done this many times, and the fastest one counts
+#define CULL_RUNS 20
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main( int argc, char * argv[] )
+{
+	size_t count = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+	if ( count == 0 ){
+		printf("Usage : culling_bench [count]\n");
+		return 1;
+	}
+
+	// Unit cubes of the model space, scaled, rotated and moved by their model matrix as
+	// Model bounds are, over a field of 2 km
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	BoxArrays boxes;
+	resizeBoxArrays(boxes, count);
+	for ( size_t i=0; i<count; i++ ){
+		glm::vec3 position(uniform(random) * 1000.0f, uniform(random) * 100.0f, uniform(random) * 1000.0f);
+		glm::vec3 axis = glm::normalize(glm::vec3(uniform(random), uniform(random), uniform(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+		model = glm::rotate(model, uniform(random) * 3.14159265f, axis);
+		model = glm::scale(model, glm::vec3(2.0f + uniform(random)));
+		glm::vec3 center, extent;
+		transformBox(model, glm::vec3(-1.0f), glm::vec3(1.0f), center, extent);
+		setBox(boxes, i, center, extent);
+	}
+
+	// A camera above the field, looking along it
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 500.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 20.0f, 30.0f), glm::vec3(0.0f, 0.0f, -100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum;
+	extractFrustum(projection * view, frustum);
+
+	printf("%zu boxes, widest path on this CPU : %s\n", count, getCullingPathName(getCullingPath()));
+	std::vector<unsigned char> reference(count);
+	double scalarTime = 0.0;
+	for ( int p=CULLING_PATH_SCALAR; p<=(int)getCullingPath(); p++ ){
+		CullingPath path = (CullingPath)p;
+		std::vector<unsigned char> visible(count);
+		size_t visibleCount = 0;
+		double best = -1.0;
+		for ( int run=0; run<CULL_RUNS; run++ ){
+			double startTime = getTime();
+			visibleCount = cullBoxes(frustum, boxes, &visible[0], path);
+			double time = getTime() - startTime;
+			if ( best < 0.0 || time < best )
+				best = time;
+		}
+		if ( path == CULLING_PATH_SCALAR ){
+			reference = visible;
+			scalarTime = best;
+		}
+		printf("  %-6s : %8.3f ms, %5.2f ns per box, %4.1fx the scalar path : %zu visible, %zu culled, same as scalar : %s\n",
+			getCullingPathName(path), best, best * 1e6 / count, scalarTime / best, visibleCount, count - visibleCount,
+			visible == reference ? "yes" : "NO");
+	}
+	return 0;
+}
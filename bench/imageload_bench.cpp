@@ -0,0 +1,287 @@
+// Times openImage, in milliseconds per megapixel, on BMP, TGA and PNG files :
+//
+//   imageload_bench [image ...]
+//
+// Run from the repository root. Without files, reads screenshots of the tutorials as PNG,
+// and writes the first one as 24 and 8 bit BMP and as raw and RLE TGA, removed when done.
+// Then checks that a PNG with more Huffman code lengths than deflate allows is refused.
+// Images stored the way OpenGL reads them are used in place : their pixels are only read
+// from the file when they are uploaded, which this doesn't time.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Include GLEW, for the formats
+#include <GL/glew.h>
+
+#include <common/texture.hpp>
+#include <common/imageloader.hpp>
+
+// Each image is opened this many times, and the fastest one counts
+#define OPEN_RUNS 7
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Bottom row first, without padding, in BGR order
+struct Pixels {
+	unsigned int width;
+	unsigned int height;
+	std::vector<unsigned char> bgr;
+};
+
+static bool getPixels(const char * path, Pixels & out_pixels){
+	Image image;
+	if ( !openImage(path, image) )
+		return false;
+	unsigned int channels = image.format == GL_RGB || image.format == GL_BGR ? 3 : 4;
+	bool bgr = image.format == GL_BGR || image.format == GL_BGRA;
+	out_pixels.width = image.width;
+	out_pixels.height = image.height;
+	out_pixels.bgr.resize((size_t)image.width * image.height * 3);
+	unsigned int stride = getImageRowStride(image);
+	for ( unsigned int y=0; y<image.height; y++ ){
+		for ( unsigned int x=0; x<image.width; x++ ){
+			const unsigned char * in = image.pixels + (size_t)y * stride + x * channels;
+			unsigned char * out = &out_pixels.bgr[((size_t)y * image.width + x) * 3];
+			out[0] = in[bgr ? 0 : 2];
+			out[1] = in[1];
+			out[2] = in[bgr ? 2 : 0];
+		}
+	}
+	closeImage(image);
+	return true;
+}
+
+static void putU16(std::vector<unsigned char> & out, unsigned int value){
+	out.push_back((unsigned char)value);
+	out.push_back((unsigned char)(value >> 8));
+}
+
+static void putU32(std::vector<unsigned char> & out, unsigned int value){
+	putU16(out, value & 0xFFFF);
+	putU16(out, value >> 16);
+}
+
+static bool writeFile(const char * path, const std::vector<unsigned char> & data){
+	FILE * file = fopen(path, "wb");
+	if ( !file )
+		return false;
+	bool written = fwrite(&data[0], 1, data.size(), file) == data.size();
+	return (fclose(file) == 0) && written;
+}
+
+// 24 bits, or 8 bits of grey with a palette
+static bool writeBMP(const char * path, const Pixels & pixels, bool grey){
+	unsigned int channels = grey ? 1 : 3;
+	unsigned int paletteSize = grey ? 256 * 4 : 0;
+	unsigned int stride = getTextureRowStride(pixels.width, channels);
+	unsigned int imageSize = stride * pixels.height;
+	std::vector<unsigned char> data;
+	data.push_back('B');
+	data.push_back('M');
+	putU32(data, 54 + paletteSize + imageSize);
+	putU32(data, 0);
+	putU32(data, 54 + paletteSize);
+	putU32(data, 40);
+	putU32(data, pixels.width);
+	putU32(data, pixels.height);
+	putU16(data, 1);
+	putU16(data, channels * 8);
+	putU32(data, 0);                    // Uncompressed
+	putU32(data, imageSize);
+	putU32(data, 2835);
+	putU32(data, 2835);
+	putU32(data, grey ? 256 : 0);
+	putU32(data, 0);
+	for ( unsigned int i=0; i<paletteSize/4; i++ )
+		putU32(data, i * 0x010101);
+	for ( unsigned int y=0; y<pixels.height; y++ ){
+		size_t rowStart = data.size();
+		for ( unsigned int x=0; x<pixels.width; x++ ){
+			const unsigned char * texel = &pixels.bgr[((size_t)y * pixels.width + x) * 3];
+			if ( grey )
+				data.push_back((unsigned char)((texel[0] * 29 + texel[1] * 150 + texel[2] * 77) >> 8));
+			else
+				data.insert(data.end(), texel, texel + 3);
+		}
+		data.resize(rowStart + stride, 0);
+	}
+	return writeFile(path, data);
+}
+
+// 24 bits, bottom row first, raw or run length encoded
+static bool writeTGA(const char * path, const Pixels & pixels, bool rle){
+	std::vector<unsigned char> data(12, 0);
+	data[2] = rle ? 10 : 2;             // True color
+	putU16(data, pixels.width);
+	putU16(data, pixels.height);
+	data.push_back(24);
+	data.push_back(0);                  // Bottom row first
+	for ( unsigned int y=0; y<pixels.height; y++ ){
+		const unsigned char * row = &pixels.bgr[(size_t)y * pixels.width * 3];
+		if ( !rle ){
+			data.insert(data.end(), row, row + pixels.width * 3);
+			continue;
+		}
+		// Packets don't cross rows
+		unsigned int x = 0;
+		while ( x < pixels.width ){
+			unsigned int run = 1;
+			while ( x + run < pixels.width && run < 128 && memcmp(row + (x + run) * 3, row + x * 3, 3) == 0 )
+				run++;
+			if ( run > 1 ){
+				data.push_back((unsigned char)(0x80 | (run - 1)));
+				data.insert(data.end(), row + x * 3, row + x * 3 + 3);
+				x += run;
+				continue;
+			}
+			unsigned int count = 1;
+			while ( x + count < pixels.width && count < 128 &&
+			        (x + count + 1 >= pixels.width || memcmp(row + (x + count) * 3, row + (x + count + 1) * 3, 3) != 0) )
+				count++;
+			data.push_back((unsigned char)(count - 1));
+			data.insert(data.end(), row + x * 3, row + (x + count) * 3);
+			x += count;
+		}
+	}
+	return writeFile(path, data);
+}
+
+static void putU32BigEndian(std::vector<unsigned char> & out, unsigned int value){
+	for ( int shift=24; shift>=0; shift-=8 )
+		out.push_back((unsigned char)(value >> shift));
+}
+
+// Least significant bit first, as deflate packs them
+static void putBits(std::vector<unsigned char> & out, unsigned int & bitCount, unsigned int value, unsigned int count){
+	for ( unsigned int i=0; i<count; i++, bitCount++ ){
+		if ( bitCount % 8 == 0 )
+			out.push_back(0);
+		out.back() |= (unsigned char)(((value >> i) & 1) << (bitCount % 8));
+	}
+}
+
+// A 1x1 PNG whose dynamic block declares 288 literal and 32 distance codes, 320 lengths
+// when deflate has at most 286 and 30, and sends all 320 of them as runs of zeros
+static bool writeCorruptPNG(const char * path){
+	std::vector<unsigned char> stream;
+	stream.push_back(0x78);
+	stream.push_back(0x01);
+	unsigned int bitCount = 16;
+	putBits(stream, bitCount, 1, 1);    // Last block
+	putBits(stream, bitCount, 2, 2);    // Dynamic Huffman
+	putBits(stream, bitCount, 31, 5);   // 257 + 31 literal codes
+	putBits(stream, bitCount, 31, 5);   // 1 + 31 distance codes
+	putBits(stream, bitCount, 15, 4);   // 19 code length codes
+	// Code lengths come as 16, 17, 18, 0, ... : 18 and 0 get one bit, 18 being '1'
+	for ( int i=0; i<19; i++ )
+		putBits(stream, bitCount, i == 2 || i == 3 ? 1 : 0, 3);
+	const unsigned int repeats[3] = { 138, 138, 44 };
+	for ( int i=0; i<3; i++ ){
+		putBits(stream, bitCount, 1, 1);
+		putBits(stream, bitCount, repeats[i] - 11, 7);
+	}
+	stream.resize(stream.size() + 8, 0);
+
+	const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	std::vector<unsigned char> data(signature, signature + 8);
+	// CRCs aren't checked by the loader
+	putU32BigEndian(data, 13);
+	data.insert(data.end(), "IHDR", "IHDR" + 4);
+	putU32BigEndian(data, 1);
+	putU32BigEndian(data, 1);
+	const unsigned char header[5] = { 8, 2, 0, 0, 0 };  // 8 bit RGB
+	data.insert(data.end(), header, header + 5);
+	putU32BigEndian(data, 0);
+	putU32BigEndian(data, (unsigned int)stream.size());
+	data.insert(data.end(), "IDAT", "IDAT" + 4);
+	data.insert(data.end(), stream.begin(), stream.end());
+	putU32BigEndian(data, 0);
+	putU32BigEndian(data, 0);
+	data.insert(data.end(), "IEND", "IEND" + 4);
+	putU32BigEndian(data, 0);
+	return writeFile(path, data);
+}
+
+int main( int argc, char * argv[] )
+{
+	std::vector<std::string> paths;
+	for ( int i=1; i<argc; i++ )
+		paths.push_back(argv[i]);
+	std::vector<std::string> written;
+	if ( paths.empty() ){
+		paths.push_back("tutorial08_basic_shading/screenshots/diffuse_ambiant_specular.PNG");
+		paths.push_back("tutorial13_normal_mapping/screenshots/normalmapping.PNG");
+		paths.push_back("misc05_picking/screenshots/ref.png");
+		paths.push_back("tutorial05_textured_cube/screenshots/uv_mapping_blender.png");
+		paths.push_back("playground/res/tile_bw.png");
+
+		Pixels pixels;
+		if ( !getPixels(paths[0].c_str(), pixels) )
+			return 1;
+		const char * names[] = { "imageload_bench_24.bmp", "imageload_bench_8.bmp", "imageload_bench.tga", "imageload_bench_rle.tga" };
+		bool ok = writeBMP(names[0], pixels, false) && writeBMP(names[1], pixels, true) &&
+			writeTGA(names[2], pixels, false) && writeTGA(names[3], pixels, true);
+		written.assign(names, names + 4);
+		paths.insert(paths.end(), written.begin(), written.end());
+		if ( !ok ){
+			printf("Could not write the BMP and TGA files\n");
+			for ( size_t i=0; i<written.size(); i++ )
+				remove(written[i].c_str());
+			return 1;
+		}
+	}
+
+	printf("%-66s %11s %10s %10s %s\n", "image", "size", "open", "per MP", "pixels");
+	for ( size_t i=0; i<paths.size(); i++ ){
+		const char * path = paths[i].c_str();
+		double best = -1.0;
+		Image image;
+		bool mapped = false;
+		unsigned int width = 0, height = 0;
+		for ( int run=0; run<OPEN_RUNS; run++ ){
+			double startTime = getTime();
+			if ( !openImage(path, image) )
+				break;
+			double time = getTime() - startTime;
+			mapped = image.mapped;
+			width = image.width;
+			height = image.height;
+			closeImage(image);
+			if ( best < 0.0 || time < best )
+				best = time;
+		}
+		if ( best < 0.0 ){
+			printf("Could not open %s\n", path);
+			continue;
+		}
+		double megapixels = (double)width * height / 1e6;
+		printf("%-66s %5ux%-5u %7.3f ms %7.3f ms %s\n", path, width, height, best, best / megapixels, mapped ? "in the file" : "decoded");
+	}
+
+	for ( size_t i=0; i<written.size(); i++ )
+		remove(written[i].c_str());
+	if ( !written.empty() ){
+		const char * corruptPath = "imageload_bench_corrupt.png";
+		Image image;
+		if ( !writeCorruptPNG(corruptPath) ){
+			printf("Could not write %s\n", corruptPath);
+			return 1;
+		}
+		bool refused = !openImage(corruptPath, image);
+		if ( !refused )
+			closeImage(image);
+		remove(corruptPath);
+		printf("PNG with 320 code lengths refused : %s\n", refused ? "yes" : "NO");
+		if ( !refused )
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,166 @@
+// Times the job system's overheads : queuing and running empty jobs, workers stealing them,
+// parallelFor against a plain loop at several grain sizes, and a small frame graph. Then
+// the scaling of a particle update over 1 to N threads :
+//
+//   jobsystem_bench [workers]
+//
+// workers : threads besides the main one, one per other hardware thread by default.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <common/jobsystem.hpp>
+#include <common/parallel.hpp>
+
+// Jobs queued at once : less than a queue holds, so that none runs right away
+#define JOB_BATCH 1024
+#define JOB_COUNT (1 << 20)
+
+#define PARTICLE_COUNT (1 << 20)
+#define PARTICLE_STEPS 20
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void emptyJob(void *){
+}
+
+// Queued by the main thread, which runs them as it waits, unless workers steal them first
+static double benchPushPop(){
+	JobCounter counter;
+	double startTime = getTime();
+	for ( int i=0; i<JOB_COUNT; i+=JOB_BATCH ){
+		for ( int j=0; j<JOB_BATCH; j++ )
+			runJob(emptyJob, NULL, counter);
+		waitForJobs(counter);
+	}
+	return (getTime() - startTime) * 1e6 / JOB_COUNT;
+}
+
+// Queued by the main thread, which then waits without running any : the workers steal all
+static double benchSteal(){
+	JobCounter counter;
+	double startTime = getTime();
+	for ( int i=0; i<JOB_COUNT; i+=JOB_BATCH ){
+		for ( int j=0; j<JOB_BATCH; j++ )
+			runJob(emptyJob, NULL, counter);
+		while ( counter.count.load() != 0 )
+			std::this_thread::yield();
+	}
+	return (getTime() - startTime) * 1e6 / JOB_COUNT;
+}
+
+struct Particle {
+	float position[3];
+	float velocity[3];
+	float life;
+	float size;
+};
+
+static void updateParticles(std::vector<Particle> & particles, size_t begin, size_t end){
+	const float dt = 0.016f;
+	for ( size_t i=begin; i<end; i++ ){
+		Particle & p = particles[i];
+		p.velocity[1] -= 9.81f * dt * 0.5f;
+		for ( int k=0; k<3; k++ )
+			p.position[k] += p.velocity[k] * dt;
+		if ( p.position[1] < 0.0f ){
+			p.position[1] = -p.position[1];
+			p.velocity[1] = -p.velocity[1] * 0.5f;
+		}
+		p.life -= dt;
+		p.size = p.life > 0.0f ? p.size : 0.0f;
+	}
+}
+
+int main( int argc, char * argv[] )
+{
+	startJobSystem(argc > 1 ? (unsigned int)atoi(argv[1]) : 0);
+	unsigned int threadCount = getJobThreadCount();
+	printf("%u job threads, %u hardware threads\n", threadCount, getHardwareThreadCount());
+
+	// Best of 3, the first run also warms the workers up
+	double pushPop = 0.0, steal = 0.0;
+	for ( int run=0; run<3; run++ ){
+		double time = benchPushPop();
+		pushPop = run == 0 || time < pushPop ? time : pushPop;
+		time = benchSteal();
+		steal = run == 0 || time < steal ? time : steal;
+	}
+	printf("  empty job, queued and run or stolen : %6.1f ns\n", pushPop);
+	printf("  empty job, stolen by a worker       : %6.1f ns\n", steal);
+
+	// parallelFor of a light body against a plain loop, and of an empty body : all that is
+	// left is the cost of handing out ranges
+	std::vector<float> values(PARTICLE_COUNT, 1.0f);
+	double startTime = getTime();
+	for ( int step=0; step<PARTICLE_STEPS; step++ )
+		for ( size_t i=0; i<values.size(); i++ )
+			values[i] = values[i] * 0.5f + 1.0f;
+	double loopTime = (getTime() - startTime) / PARTICLE_STEPS;
+	printf("  plain loop over %d floats : %.3f ms\n", PARTICLE_COUNT, loopTime);
+	const size_t grainSizes[] = { 256, 1024, 4096, 16384, 65536 };
+	for ( size_t g=0; g<sizeof(grainSizes)/sizeof(grainSizes[0]); g++ ){
+		startTime = getTime();
+		for ( int step=0; step<PARTICLE_STEPS; step++ ){
+			parallelFor(values.size(), grainSizes[g], [&](size_t begin, size_t end){
+				for ( size_t i=begin; i<end; i++ )
+					values[i] = values[i] * 0.5f + 1.0f;
+			});
+		}
+		double time = (getTime() - startTime) / PARTICLE_STEPS;
+		startTime = getTime();
+		for ( int step=0; step<PARTICLE_STEPS; step++ )
+			parallelFor(values.size(), grainSizes[g], [](size_t, size_t){});
+		double emptyTime = (getTime() - startTime) / PARTICLE_STEPS;
+		printf("  parallelFor, grain %6zu : %.3f ms, %.2fx the loop ; %.1f ns per range with an empty body\n", grainSizes[g], time,
+			loopTime / time, emptyTime * 1e6 / (values.size() / grainSizes[g]));
+	}
+
+	// A frame graph : two tasks on one, and one on both
+	const int frameCount = 10000;
+	startTime = getTime();
+	for ( int frame=0; frame<frameCount; frame++ ){
+		FrameGraph graph;
+		int a = addFrameTask(graph, [](){});
+		int b = addFrameTask(graph, [](){}, &a, 1);
+		int c = addFrameTask(graph, [](){}, &a, 1);
+		int bc[2] = { b, c };
+		int d = addFrameTask(graph, [](){}, bc, 2);
+		runFrameGraph(graph);
+		waitForFrameTask(graph, d);
+		finishFrameGraph(graph);
+	}
+	printf("  frame graph of 4 empty tasks : %.2f us a frame\n", (getTime() - startTime) * 1000.0 / frameCount);
+
+	// Scaling of a particle update
+	std::vector<Particle> particles(PARTICLE_COUNT);
+	for ( size_t i=0; i<particles.size(); i++ ){
+		Particle p = { { 0.0f, 10.0f, 0.0f }, { (float)(i % 100) * 0.01f, 1.0f, 0.0f }, 5.0f, 1.0f };
+		particles[i] = p;
+	}
+	double oneThreadTime = 0.0;
+	printf("Particle update, %d particles\n", PARTICLE_COUNT);
+	for ( unsigned int threads=1; threads<=threadCount; threads++ ){
+		startTime = getTime();
+		for ( int step=0; step<PARTICLE_STEPS; step++ ){
+			parallelFor(particles.size(), 4096, [&](size_t begin, size_t end){
+				updateParticles(particles, begin, end);
+			}, threads);
+		}
+		double time = (getTime() - startTime) / PARTICLE_STEPS;
+		if ( threads == 1 )
+			oneThreadTime = time;
+		printf("  %2u threads : %.3f ms a step, %.2fx\n", threads, time, oneThreadTime / time);
+	}
+
+	stopJobSystem();
+	return 0;
+}
@@ -0,0 +1,179 @@
+// Builds the meshlets of meshes as Mesh bakes them, prints their statistics, and times
+// cullMeshlets on the CPU from views around each mesh :
+//
+//   meshlet_bench [file.obj ...]
+//
+// Run from the repository root. Without files, reads suzanne and room from the tutorials and
+// generates a sphere of a million triangles.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/objloader.hpp>
+#include <common/vboindexer.hpp>
+#include <common/meshoptimizer.hpp>
+#include <common/frustum.hpp>
+#include <common/meshlet.hpp>
+
+// Rings and segments of the generated sphere : 2 x 512 x 1024 triangles, less the poles
+#define SPHERE_RINGS 512
+#define SPHERE_SEGMENTS 1024
+
+// Views, each culled this many times
+#define VIEW_COUNT 64
+#define CULL_RUNS 20
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void makeSphere(std::vector<unsigned int> & out_indices, std::vector<glm::vec3> & out_positions){
+	for ( int ring=0; ring<=SPHERE_RINGS; ring++ ){
+		float theta = ring * 3.14159265f / SPHERE_RINGS;
+		for ( int segment=0; segment<=SPHERE_SEGMENTS; segment++ ){
+			float phi = segment * 2.0f * 3.14159265f / SPHERE_SEGMENTS;
+			out_positions.push_back(glm::vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)));
+		}
+	}
+	for ( int ring=0; ring<SPHERE_RINGS; ring++ ){
+		for ( int segment=0; segment<SPHERE_SEGMENTS; segment++ ){
+			unsigned int a = ring * (SPHERE_SEGMENTS + 1) + segment;
+			unsigned int b = a + SPHERE_SEGMENTS + 1;
+			// Counter-clockwise seen from outside
+			if ( ring != 0 ){
+				out_indices.push_back(a); out_indices.push_back(a + 1); out_indices.push_back(b);
+			}
+			if ( ring != SPHERE_RINGS - 1 ){
+				out_indices.push_back(a + 1); out_indices.push_back(b + 1); out_indices.push_back(b);
+			}
+		}
+	}
+}
+
+static bool loadMesh(const char * path, std::vector<unsigned int> & out_indices, std::vector<glm::vec3> & out_positions){
+	std::vector<glm::vec3> vertices, normals, indexedNormals;
+	std::vector<glm::vec2> uvs, indexedUvs;
+	if ( !loadOBJ(path, vertices, uvs, normals) )
+		return false;
+	indexVBO(vertices, uvs, normals, out_indices, out_positions, indexedUvs, indexedNormals);
+	return !out_indices.empty();
+}
+
+struct CullResult {
+	double time;            // Per cull, in microseconds
+	double meshlets;        // Visible, on average over the views
+	double triangles;       // Drawn
+	double ranges;          // Given to glMultiDrawElements
+};
+
+// Random views from outside the bounding sphere to near its center
+static CullResult cullViews(const std::vector<Meshlet> & meshlets, const glm::vec3 & center, float radius, bool cullBackFaces){
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.01f * radius, 100.0f * radius);
+	CullResult result = { 0.0, 0.0, 0.0, 0.0 };
+	DrawRanges ranges;
+	for ( int view=0; view<VIEW_COUNT; view++ ){
+		glm::vec3 direction = glm::normalize(glm::vec3(uniform(random), uniform(random), uniform(random)));
+		glm::vec3 cameraPosition = center + direction * radius * (2.0f + uniform(random));
+		glm::vec3 target = center + glm::vec3(uniform(random), uniform(random), uniform(random)) * radius * 0.3f;
+		Frustum frustum;
+		extractFrustum(projection * glm::lookAt(cameraPosition, target, glm::vec3(0.0f, 1.0f, 0.0f)), frustum);
+
+		size_t visible = 0;
+		double startTime = getTime();
+		for ( int run=0; run<CULL_RUNS; run++ ){
+			ranges.counts.clear();
+			ranges.offsets.clear();
+			visible = cullMeshlets(meshlets, frustum, cameraPosition, sizeof(unsigned int), ranges, cullBackFaces);
+		}
+		result.time += (getTime() - startTime) * 1000.0 / CULL_RUNS / VIEW_COUNT;
+		result.meshlets += (double)visible / VIEW_COUNT;
+		for ( size_t i=0; i<ranges.counts.size(); i++ )
+			result.triangles += ranges.counts[i] / 3.0 / VIEW_COUNT;
+		result.ranges += (double)ranges.counts.size() / VIEW_COUNT;
+	}
+	return result;
+}
+
+static void reportMesh(const char * name, std::vector<unsigned int> & indices, const std::vector<glm::vec3> & positions){
+	// As Mesh bakes level 0
+	optimizeVertexCache(indices, positions.size());
+	std::vector<Meshlet> meshlets;
+	double startTime = getTime();
+	buildMeshlets(meshlets, indices, positions);
+	double buildTime = getTime() - startTime;
+	startTime = getTime();
+	optimizeMeshletOverdraw(meshlets, indices, positions);
+	double orderTime = getTime() - startTime;
+
+	size_t vertexCount = 0, maxVertexCount = 0, maxTriangleCount = 0, coneCount = 0;
+	for ( size_t i=0; i<meshlets.size(); i++ ){
+		vertexCount += meshlets[i].vertexCount;
+		if ( meshlets[i].vertexCount > maxVertexCount ) maxVertexCount = meshlets[i].vertexCount;
+		if ( meshlets[i].triangleCount > maxTriangleCount ) maxTriangleCount = meshlets[i].triangleCount;
+		if ( meshlets[i].coneCutoff < 1.0f ) coneCount++;
+	}
+	size_t triangleCount = indices.size() / 3;
+	printf("%s : %zu vertices, %zu triangles\n", name, positions.size(), triangleCount);
+	printf("  %zu meshlets in %.1f ms, ordered in %.1f ms : %.1f vertices and %.1f triangles each on average, at most %zu and %zu\n",
+		meshlets.size(), buildTime, orderTime, vertexCount / (double)meshlets.size(), triangleCount / (double)meshlets.size(),
+		maxVertexCount, maxTriangleCount);
+	printf("  %zu with a normal cone (%.1f%%), %.2f vertex transforms per triangle\n",
+		coneCount, coneCount * 100.0 / meshlets.size(), vertexCount / (double)triangleCount);
+
+	glm::vec3 boundsMin = positions[0], boundsMax = positions[0];
+	for ( size_t i=0; i<positions.size(); i++ ){
+		boundsMin = glm::min(boundsMin, positions[i]);
+		boundsMax = glm::max(boundsMax, positions[i]);
+	}
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+	const char * names[] = { "frustum", "frustum and cones" };
+	for ( int cones=0; cones<2; cones++ ){
+		CullResult result = cullViews(meshlets, center, radius, cones != 0);
+		printf("  %-17s : %8.2f us per cull, %5.1f ns per meshlet, %5.1f%% of meshlets and %5.1f%% of triangles drawn in %.1f ranges\n",
+			names[cones], result.time, result.time * 1000.0 / meshlets.size(), result.meshlets * 100.0 / meshlets.size(),
+			result.triangles * 100.0 / triangleCount, result.ranges);
+	}
+}
+
+int main( int argc, char * argv[] )
+{
+	std::vector<std::string> paths;
+	for ( int i=1; i<argc; i++ )
+		paths.push_back(argv[i]);
+	bool sphere = paths.empty();
+	if ( paths.empty() ){
+		paths.push_back("tutorial08_basic_shading/suzanne.obj");
+		paths.push_back("tutorial15_lightmaps/room.obj");
+	}
+
+	for ( size_t i=0; i<paths.size(); i++ ){
+		std::vector<unsigned int> indices;
+		std::vector<glm::vec3> positions;
+		if ( !loadMesh(paths[i].c_str(), indices, positions) ){
+			printf("Could not load %s\n", paths[i].c_str());
+			continue;
+		}
+		reportMesh(paths[i].c_str(), indices, positions);
+	}
+	if ( sphere ){
+		std::vector<unsigned int> indices;
+		std::vector<glm::vec3> positions;
+		makeSphere(indices, positions);
+		reportMesh("sphere", indices, positions);
+	}
+	return 0;
+}
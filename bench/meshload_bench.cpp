@@ -0,0 +1,172 @@
+// Times how long the playground's meshes take to be ready to draw, without and with their
+// .meshcache :
+//
+//   meshload_bench [file.obj ...]
+//
+// Run from the repository root. Without files, loads the playground scene, cube and floor,
+// and suzanne and room from the tutorials. Caches the benchmark writes are removed when done.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Include GLFW
+#include <GLFW/glfw3.h>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include <common/objloader.hpp>
+#include <common/vboindexer.hpp>
+#include <playground/Mesh.hpp>
+
+// Each load is done this many times, and the fastest one counts
+#define LOAD_RUNS 5
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool fileExists(const char * path){
+	FILE * file = fopen(path, "rb");
+	if ( !file )
+		return false;
+	fclose(file);
+	return true;
+}
+
+// What Mesh did before the cache : parse, index, upload
+static double timeParse(const char * path){
+	double startTime = getTime();
+	std::vector<glm::vec3> vertices, indexedVertices, normals, indexedNormals;
+	std::vector<glm::vec2> uvs, indexedUvs;
+	std::vector<unsigned int> indices;
+	if ( !loadOBJ(path, vertices, uvs, normals) )
+		return -1.0;
+	indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUvs, indexedNormals);
+
+	GLuint buffers[4];
+	glGenBuffers(4, buffers);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(glm::vec3), indexedVertices.empty() ? NULL : &indexedVertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+	glBufferData(GL_ARRAY_BUFFER, indexedUvs.size() * sizeof(glm::vec2), indexedUvs.empty() ? NULL : &indexedUvs[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[2]);
+	glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(glm::vec3), indexedNormals.empty() ? NULL : &indexedNormals[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[3]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+	glFinish();
+	double time = getTime() - startTime;
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glDeleteBuffers(4, buffers);
+	return time;
+}
+
+// A Mesh, baked then stored in the cache when there is none, or read from it
+static double timeMesh(const char * path){
+	double startTime = getTime();
+	Mesh * mesh = NULL;
+	try {
+		mesh = new Mesh(path);
+	} catch ( const LoadException & ) {
+		return -1.0;
+	}
+	glFinish();
+	double time = getTime() - startTime;
+	delete mesh;
+	return time;
+}
+
+template <typename Function>
+static double fastest(Function function){
+	double best = -1.0;
+	for ( int run=0; run<LOAD_RUNS; run++ ){
+		double time = function();
+		if ( time < 0.0 )
+			return -1.0;
+		if ( best < 0.0 || time < best )
+			best = time;
+	}
+	return best;
+}
+
+int main( int argc, char * argv[] )
+{
+	std::vector<std::string> paths;
+	for ( int i=1; i<argc; i++ )
+		paths.push_back(argv[i]);
+	if ( paths.empty() ){
+		paths.push_back("playground/res/cube.obj");
+		paths.push_back("playground/res/floor.obj");
+		paths.push_back("tutorial08_basic_shading/suzanne.obj");
+		paths.push_back("tutorial15_lightmaps/room.obj");
+	}
+
+	if( !glfwInit() )
+	{
+		fprintf( stderr, "Failed to initialize GLFW\n" );
+		return -1;
+	}
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	GLFWwindow * window = glfwCreateWindow(64, 64, "meshload_bench", NULL, NULL);
+	if( window == NULL ){
+		fprintf( stderr, "Failed to open GLFW window. The playground needs OpenGL 4.5.\n" );
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK) {
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		return -1;
+	}
+
+	printf("%-40s %12s %12s %12s %9s\n", "file", "parse", "first load", "cached", "speedup");
+	double totals[3] = { 0.0, 0.0, 0.0 };
+	for ( size_t i=0; i<paths.size(); i++ ){
+		const char * path = paths[i].c_str();
+		std::string cachePath = paths[i] + ".meshcache";
+		if ( !fileExists(path) ){
+			printf("Could not open %s\n", path);
+			continue;
+		}
+		bool hadCache = fileExists(cachePath.c_str());
+
+		double parseTime = fastest([&](){ return timeParse(path); });
+		double bakeTime = fastest([&](){
+			remove(cachePath.c_str());
+			return timeMesh(path);
+		});
+		double cachedTime = fastest([&](){ return timeMesh(path); });
+		if ( !hadCache )
+			remove(cachePath.c_str());
+		if ( parseTime < 0.0 || bakeTime < 0.0 || cachedTime < 0.0 ){
+			printf("Could not load %s\n", path);
+			continue;
+		}
+
+		printf("%-40s %9.2f ms %9.2f ms %9.2f ms %8.1fx\n", path, parseTime, bakeTime, cachedTime, parseTime / cachedTime);
+		totals[0] += parseTime;
+		totals[1] += bakeTime;
+		totals[2] += cachedTime;
+	}
+	printf("%-40s %9.2f ms %9.2f ms %9.2f ms %8.1fx\n", "all", totals[0], totals[1], totals[2], totals[0] / totals[2]);
+	printf("parse : loadOBJ, indexVBO and upload, as Mesh did before the cache\n");
+	printf("first load : Mesh without a cache, which bakes the detail levels and meshlets and writes it\n");
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return 0;
+}
@@ -0,0 +1,162 @@
+// Builds the detail levels of meshes the way Mesh bakes them, and reports for each level its
+// triangle count, the error simplifyMesh gives and the error measured against the full mesh :
+//
+//   meshlod_bench [file.obj ...]
+//
+// Run from the repository root. Without files, reads suzanne and room from the tutorials.
+// The measured error is the largest distance from a vertex of the full mesh to a level,
+// found by brute force : it is skipped on meshes where that would take too long.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include <common/objloader.hpp>
+#include <common/vboindexer.hpp>
+#include <common/meshoptimizer.hpp>
+#include <common/meshsimplify.hpp>
+
+// As in Mesh
+#define MAX_LOD_COUNT 4
+#define MAX_LOD_ERROR 0.05f         // Of the bounding box diagonal
+
+// Vertices times triangles above which the error isn't measured
+#define MAX_MEASURE_WORK 2e9
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Closest point of triangle abc to p (Real-Time Collision Detection, 5.1.5)
+static glm::vec3 closestPointOnTriangle(const glm::vec3 & p, const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c){
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if ( d1 <= 0.0f && d2 <= 0.0f ) return a;
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if ( d3 >= 0.0f && d4 <= d3 ) return b;
+	float vc = d1 * d4 - d3 * d2;
+	if ( vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f ) return a + ab * (d1 / (d1 - d3));
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if ( d6 >= 0.0f && d5 <= d6 ) return c;
+	float vb = d5 * d2 - d1 * d6;
+	if ( vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f ) return a + ac * (d2 / (d2 - d6));
+	float va = d3 * d6 - d5 * d4;
+	if ( va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f ) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	float denominator = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// Largest distance from a vertex used by the full mesh to the triangles of level
+static float measureError(const std::vector<unsigned int> & full, const std::vector<unsigned int> & level, const std::vector<glm::vec3> & positions){
+	std::vector<bool> used(positions.size(), false);
+	for ( size_t i=0; i<full.size(); i++ )
+		used[full[i]] = true;
+	float worst = 0.0f;
+	for ( size_t v=0; v<positions.size(); v++ ){
+		if ( !used[v] )
+			continue;
+		float best = -1.0f;
+		for ( size_t t=0; t<level.size(); t+=3 ){
+			glm::vec3 closest = closestPointOnTriangle(positions[v], positions[level[t]], positions[level[t+1]], positions[level[t+2]]);
+			float distance = glm::length(closest - positions[v]);
+			if ( best < 0.0f || distance < best )
+				best = distance;
+		}
+		if ( best > worst )
+			worst = best;
+	}
+	return worst;
+}
+
+static bool reportMesh(const char * path){
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	if ( !loadOBJ(path, vertices, uvs, normals) )
+		return false;
+	std::vector<glm::vec3> indexedVertices;
+	std::vector<glm::vec2> indexedUvs;
+	std::vector<glm::vec3> indexedNormals;
+	std::vector<unsigned int> indices;
+	indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUvs, indexedNormals);
+	if ( indices.empty() ){
+		printf("%s has no triangles\n", path);
+		return false;
+	}
+
+	glm::vec3 boundsMin = indexedVertices[0];
+	glm::vec3 boundsMax = indexedVertices[0];
+	for ( size_t i=0; i<indexedVertices.size(); i++ ){
+		boundsMin = glm::min(boundsMin, indexedVertices[i]);
+		boundsMax = glm::max(boundsMax, indexedVertices[i]);
+	}
+	float diagonal = glm::length(boundsMax - boundsMin);
+
+	// The chain Mesh bakes : each level from the full mesh, with about half the triangles
+	// of the previous one, until a level isn't simple enough to be worth it
+	double startTime = getTime();
+	std::vector< std::vector<unsigned int> > levels(1, indices);
+	std::vector<float> levelErrors(1, 0.0f);
+	std::vector<size_t> targets(1, indices.size() / 3);
+	while ( levels.size() < MAX_LOD_COUNT ){
+		std::vector<unsigned int> level;
+		size_t target = levels.back().size() / 6 * 3;
+		float error = simplifyMesh(level, indices, indexedVertices, target, diagonal * MAX_LOD_ERROR);
+		if ( level.size() * 10 > levels.back().size() * 8 )
+			break;
+		levels.push_back(level);
+		levelErrors.push_back(error);
+		targets.push_back(target / 3);
+	}
+	double simplifyTime = getTime() - startTime;
+
+	VertexCacheStatistics before = analyzeVertexCache(indices, indexedVertices.size());
+	startTime = getTime();
+	for ( size_t i=0; i<levels.size(); i++ )
+		optimizeVertexCache(levels[i], indexedVertices.size());
+	double optimizeTime = getTime() - startTime;
+	VertexCacheStatistics after = analyzeVertexCache(levels[0], indexedVertices.size());
+
+	printf("%s : %zu vertices, %zu triangles, bounding box diagonal %g\n", path, indexedVertices.size(), indices.size() / 3, diagonal);
+	printf("  simplified in %.1f ms, vertex cache optimized in %.1f ms : ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		simplifyTime, optimizeTime, before.acmr, after.acmr, before.atvr, after.atvr);
+	printf("  level %10s %10s %8s %12s %12s %10s\n", "triangles", "target", "of full", "error", "measured", "of diag");
+	for ( size_t i=0; i<levels.size(); i++ ){
+		size_t triangles = levels[i].size() / 3;
+		double work = (double)indexedVertices.size() * triangles;
+		if ( work <= MAX_MEASURE_WORK ){
+			float measured = measureError(indices, levels[i], indexedVertices);
+			printf("  %5zu %10zu %10zu %7.1f%% %12g %12g %9.3f%%\n", i, triangles, targets[i], triangles * 100.0 / (indices.size() / 3),
+				levelErrors[i], measured, measured * 100.0 / diagonal);
+		}else{
+			printf("  %5zu %10zu %10zu %7.1f%% %12g %12s %10s\n", i, triangles, targets[i], triangles * 100.0 / (indices.size() / 3),
+				levelErrors[i], "-", "-");
+		}
+	}
+	return true;
+}
+
+int main( int argc, char * argv[] )
+{
+	std::vector<std::string> paths;
+	for ( int i=1; i<argc; i++ )
+		paths.push_back(argv[i]);
+	if ( paths.empty() ){
+		paths.push_back("tutorial08_basic_shading/suzanne.obj");
+		paths.push_back("tutorial15_lightmaps/room.obj");
+	}
+
+	bool failed = false;
+	for ( size_t i=0; i<paths.size(); i++ )
+		failed = !reportMesh(paths[i].c_str()) || failed;
+	return failed ? 1 : 0;
+}
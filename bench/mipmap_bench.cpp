@@ -0,0 +1,106 @@
+// Times buildMipmaps on a 4096x4096 RGB and RGBA texture, with the box and Kaiser filters, on
+// each path this CPU runs, in megapixels of level 0 per second :
+//
+//   mipmap_bench [size] [threads]
+//
+// threads : see parallelFor, all the job threads by default.
+// Checks that every path gives the same levels as the scalar one, within 1.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Include GLEW, for the formats
+#include <GL/glew.h>
+
+#include <common/texture.hpp>
+#include <common/mipmap.hpp>
+#include <common/jobsystem.hpp>
+
+// Each chain is built this many times, and the fastest one counts
+#define BUILD_RUNS 3
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Level 0 only, as readImage leaves it
+static void makeTexture(unsigned int size, unsigned int channels, TextureData & out_data){
+	out_data.width = size;
+	out_data.height = size;
+	out_data.internalFormat = channels == 3 ? GL_RGB : GL_RGBA;
+	out_data.format = channels == 3 ? GL_BGR : GL_BGRA;
+	out_data.type = GL_UNSIGNED_BYTE;
+	out_data.pixels.resize((size_t)getTextureRowStride(size, channels) * size);
+	std::mt19937 random(channels);
+	for ( size_t i=0; i<out_data.pixels.size(); i++ )
+		out_data.pixels[i] = (unsigned char)(random() >> 24);
+	out_data.levelOffsets.clear();
+	out_data.levelOffsets.push_back(0);
+	out_data.levelOffsets.push_back((unsigned int)out_data.pixels.size());
+	out_data.fileOffset = 0;
+	out_data.generateMipmaps = true;
+}
+
+int main( int argc, char * argv[] )
+{
+	unsigned int size = argc > 1 ? (unsigned int)atoi(argv[1]) : 4096;
+	unsigned int threads = argc > 2 ? (unsigned int)atoi(argv[2]) : 0;
+	if ( size < 2 ){
+		printf("Usage : mipmap_bench [size] [threads]\n");
+		return 1;
+	}
+	startJobSystem();
+	printf("%ux%u, %u job threads, widest path on this CPU : %s\n", size, size, getJobThreadCount(), getMipmapPathName(getMipmapPath()));
+
+	const char * filterNames[2] = { "box", "kaiser" };
+	bool allSame = true;
+	for ( unsigned int channels=3; channels<=4; channels++ ){
+		TextureData source;
+		makeTexture(size, channels, source);
+		for ( int filter=MIPMAP_FILTER_BOX; filter<=MIPMAP_FILTER_KAISER; filter++ ){
+			TextureData reference;
+			double scalarTime = 0.0;
+			for ( int p=MIPMAP_PATH_SCALAR; p<=(int)getMipmapPath(); p++ ){
+				MipmapOptions options;
+				options.filter = (MipmapFilter)filter;
+				options.path = (MipmapPath)p;
+				options.threadCount = threads;
+				TextureData data;
+				double best = -1.0;
+				for ( int run=0; run<BUILD_RUNS; run++ ){
+					data = source;
+					double startTime = getTime();
+					buildMipmaps(data, options);
+					double time = getTime() - startTime;
+					if ( best < 0.0 || time < best )
+						best = time;
+				}
+				int largestDifference = 0;
+				if ( p == MIPMAP_PATH_SCALAR ){
+					reference = data;
+					scalarTime = best;
+				}
+				else if ( data.levelOffsets != reference.levelOffsets ){
+					largestDifference = 256;
+				}
+				else {
+					for ( size_t i=0; i<data.pixels.size(); i++ )
+						largestDifference = std::max(largestDifference, abs(data.pixels[i] - reference.pixels[i]));
+				}
+				allSame = allSame && largestDifference <= 1;
+				printf("  %-4s %-6s %-6s : %8.1f ms, %6.1f MP/s, %4.1fx the scalar path, %zu levels, largest difference with scalar %d\n",
+					channels == 3 ? "RGB" : "RGBA", filterNames[filter], getMipmapPathName((MipmapPath)p), best,
+					(double)size * size / 1000.0 / best, scalarTime / best, data.levelOffsets.size() - 1, largestDifference);
+			}
+		}
+	}
+
+	stopJobSystem();
+	return allSame ? 0 : 1;
+}
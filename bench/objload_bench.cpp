@@ -0,0 +1,199 @@
+// Times loadOBJ against the original fscanf loader, in megabytes of OBJ text per second, then
+// loadOBJ on 1 to N threads :
+//
+//   objload_bench [-threads N] [file.obj ...]
+//
+// Run from the repository root. Without files, reads suzanne and room from the tutorials,
+// and a grid of 10 million triangles written to objload_bench_grid.obj, removed when done.
+// N is the number of hardware threads by default.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include <common/objloader.hpp>
+#include <common/parallel.hpp>
+
+// Side of the grid, in vertices : 2 x 2237 x 2237 triangles
+#define GRID_SIZE 2238
+
+// Small files are read this many times, and the fastest one counts
+#define SMALL_FILE_RUNS 5
+#define SMALL_FILE_SIZE (16 << 20)
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static long getFileSize(const char * path){
+	FILE * file = fopen(path, "rb");
+	if ( !file )
+		return -1;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+// A wavy grid with UVs and normals, one of each per vertex, as exporters write them
+static bool writeGrid(const char * path){
+	FILE * file = fopen(path, "wb");
+	if ( !file )
+		return false;
+	fprintf(file, "# objload_bench grid\n");
+	for ( int y=0; y<GRID_SIZE; y++ )
+		for ( int x=0; x<GRID_SIZE; x++ )
+			fprintf(file, "v %.6f %.6f %.6f\n", x * 0.01f, 0.05f * sinf(x * 0.1f) * cosf(y * 0.1f), y * 0.01f);
+	for ( int y=0; y<GRID_SIZE; y++ )
+		for ( int x=0; x<GRID_SIZE; x++ )
+			fprintf(file, "vt %.6f %.6f\n", x / (float)(GRID_SIZE - 1), y / (float)(GRID_SIZE - 1));
+	for ( int y=0; y<GRID_SIZE; y++ ){
+		for ( int x=0; x<GRID_SIZE; x++ ){
+			glm::vec3 normal = glm::normalize(glm::vec3(-0.5f * cosf(x * 0.1f) * cosf(y * 0.1f), 10.0f, 0.5f * sinf(x * 0.1f) * sinf(y * 0.1f)));
+			fprintf(file, "vn %.6f %.6f %.6f\n", normal.x, normal.y, normal.z);
+		}
+	}
+	for ( int y=0; y+1<GRID_SIZE; y++ ){
+		for ( int x=0; x+1<GRID_SIZE; x++ ){
+			int a = y * GRID_SIZE + x + 1;
+			int b = a + 1;
+			int c = a + GRID_SIZE;
+			int d = c + 1;
+			fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b);
+			fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, c, c, c, d, d, d);
+		}
+	}
+	return fclose(file) == 0;
+}
+
+struct Model {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+};
+
+template <typename T>
+static bool sameBytes(const std::vector<T> & a, const std::vector<T> & b){
+	return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], a.size() * sizeof(T)) == 0);
+}
+
+// Fastest of runs loads, in ms, or a negative time when the file can't be read.
+// threadCount : for loadOBJ, 0 to let it decide.
+static double timeLoad(const char * path, bool slow, unsigned int threadCount, int runs, Model & out_model){
+	double best = -1.0;
+	for ( int run=0; run<runs; run++ ){
+		out_model = Model();
+		double startTime = getTime();
+		bool loaded = slow ?
+			loadOBJ_slow(path, out_model.vertices, out_model.uvs, out_model.normals) :
+			loadOBJ(path, out_model.vertices, out_model.uvs, out_model.normals, threadCount);
+		double time = getTime() - startTime;
+		if ( !loaded )
+			return -1.0;
+		if ( best < 0.0 || time < best )
+			best = time;
+	}
+	return best;
+}
+
+int main( int argc, char * argv[] )
+{
+	std::vector<std::string> paths;
+	unsigned int maxThreadCount = getHardwareThreadCount();
+	for ( int i=1; i<argc; i++ ){
+		if ( strcmp(argv[i], "-threads") == 0 && i + 1 < argc ) maxThreadCount = (unsigned int)atoi(argv[++i]);
+		else paths.push_back(argv[i]);
+	}
+	if ( maxThreadCount == 0 ){
+		printf("Usage : objload_bench [-threads N] [file.obj ...]\n");
+		return 1;
+	}
+	const char * gridPath = "objload_bench_grid.obj";
+	if ( paths.empty() ){
+		paths.push_back("tutorial08_basic_shading/suzanne.obj");
+		paths.push_back("tutorial15_lightmaps/room.obj");
+		printf("Writing %s...\n", gridPath);
+		if ( !writeGrid(gridPath) ){
+			printf("Could not write %s\n", gridPath);
+			return 1;
+		}
+		paths.push_back(gridPath);
+	}
+
+	struct Result {
+		std::string path;
+		double megabytes;
+		size_t triangles;
+		double slowTime, fastTime;
+		bool same;
+		std::vector<double> threadTimes;    // For 1 to maxThreadCount threads
+		bool sameOnThreads;
+	};
+	std::vector<Result> results;
+	for ( size_t i=0; i<paths.size(); i++ ){
+		const char * path = paths[i].c_str();
+		long size = getFileSize(path);
+		if ( size < 0 ){
+			printf("Could not open %s\n", path);
+			continue;
+		}
+		int runs = size < SMALL_FILE_SIZE ? SMALL_FILE_RUNS : 1;
+
+		// Both models are kept to compare them : close to 2 GB for the grid
+		Result result;
+		result.path = path;
+		result.megabytes = size / (1024.0 * 1024.0);
+		Model slow, fast;
+		result.slowTime = timeLoad(path, true, 0, runs, slow);
+		result.fastTime = timeLoad(path, false, 0, runs, fast);
+		result.triangles = fast.vertices.size() / 3;
+		result.same = sameBytes(slow.vertices, fast.vertices) && sameBytes(slow.uvs, fast.uvs) && sameBytes(slow.normals, fast.normals);
+		if ( result.slowTime < 0.0 || result.fastTime < 0.0 ){
+			printf("Could not read %s\n", path);
+			continue;
+		}
+
+		// Every thread count must give the serial result, byte for byte. The fscanf one
+		// isn't needed anymore.
+		slow = Model();
+		result.sameOnThreads = true;
+		for ( unsigned int threadCount=1; threadCount<=maxThreadCount; threadCount++ ){
+			Model threaded;
+			result.threadTimes.push_back(timeLoad(path, false, threadCount, runs, threaded));
+			result.sameOnThreads = result.sameOnThreads && sameBytes(threaded.vertices, fast.vertices) &&
+				sameBytes(threaded.uvs, fast.uvs) && sameBytes(threaded.normals, fast.normals);
+		}
+		results.push_back(result);
+	}
+	if ( paths.back() == gridPath )
+		remove(gridPath);
+
+	printf("\n%-40s %9s %10s %20s %20s %8s %s\n", "file", "MB", "triangles", "fscanf", "loadOBJ", "speedup", "same output");
+	for ( size_t i=0; i<results.size(); i++ ){
+		const Result & result = results[i];
+		printf("%-40s %9.2f %10zu %9.1f ms %5.1f MB/s %9.1f ms %5.1f MB/s %7.1fx %s\n",
+			result.path.c_str(), result.megabytes, result.triangles,
+			result.slowTime, result.megabytes / result.slowTime * 1000.0,
+			result.fastTime, result.megabytes / result.fastTime * 1000.0,
+			result.slowTime / result.fastTime, result.same ? "yes" : "NO");
+	}
+
+	printf("\nloadOBJ on 1 to %u threads, %u job threads\n", maxThreadCount, getJobThreadCount());
+	for ( size_t i=0; i<results.size(); i++ ){
+		const Result & result = results[i];
+		printf("%s : same output on every thread count : %s\n", result.path.c_str(), result.sameOnThreads ? "yes" : "NO");
+		for ( size_t t=0; t<result.threadTimes.size(); t++ ){
+			double time = result.threadTimes[t];
+			printf("  %2zu threads %9.1f ms %7.1f MB/s, %5.2fx\n", t + 1, time, result.megabytes / time * 1000.0, result.threadTimes[0] / time);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,211 @@
+// Streams a few hundred textures while running frames shaped like the playground's, and
+// reports how much longer than usual the worst frames took :
+//
+//   texturestream_bench [count] [size]
+//
+// Writes count BMP files of size x size texels (300 and 1024 by default) to the current
+// directory, and removes them when done.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Include GLFW
+#include <GLFW/glfw3.h>
+
+#include <common/jobsystem.hpp>
+#include <common/parallel.hpp>
+#include <playground/TextureStreamer.hpp>
+
+// Frames first run without streaming, to know how long a frame takes on its own
+#define BASELINE_FRAMES 60
+
+// Elements each stand-in for transforms and culling goes through
+#define FRAME_WORK_SIZE (1 << 20)
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 24 bit, bottom row first, a different gradient for each file
+static bool writeBMP(const char * path, unsigned int size, unsigned int seed){
+	unsigned int stride = getTextureRowStride(size, 3);
+	unsigned int imageSize = stride * size;
+	unsigned char header[54] = { 'B', 'M' };
+	unsigned int fields[] = { 54 + imageSize, 0, 54, 40, size, size };
+	memcpy(&header[2], fields, sizeof(fields));
+	header[26] = 1;     // Planes
+	header[28] = 24;    // Bits per pixel
+	memcpy(&header[34], &imageSize, 4);
+
+	std::vector<unsigned char> pixels(imageSize);
+	for ( unsigned int y=0; y<size; y++ ){
+		for ( unsigned int x=0; x<size; x++ ){
+			unsigned char * texel = &pixels[y * stride + x * 3];
+			texel[0] = (unsigned char)(x + seed);
+			texel[1] = (unsigned char)(y * 3 + seed * 7);
+			texel[2] = (unsigned char)((x ^ y) + seed * 13);
+		}
+	}
+
+	FILE * file = fopen(path, "wb");
+	if ( !file )
+		return false;
+	bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header) && fwrite(&pixels[0], 1, imageSize, file) == imageSize;
+	return (fclose(file) == 0) && written;
+}
+
+static void doFrameWork(std::vector<float> & values){
+	parallelFor(values.size(), 1 << 14, [&](size_t begin, size_t end){
+		for ( size_t i=begin; i<end; i++ )
+			values[i] = sqrtf(values[i] * values[i] + 1.0f) * 0.5f;
+	});
+}
+
+struct FrameTime {
+	double frame;
+	double graph;   // Running the frame graph and waiting for it
+};
+
+// A frame graph like the playground's : transforms, then culling, which the render
+// thread waits for, then the streamer's uploads
+static FrameTime runFrame(TextureStreamer * streamer, std::vector<float> & transforms, std::vector<float> & bounds){
+	double startTime = getTime();
+
+	FrameGraph frameGraph;
+	int transformTask = addFrameTask(frameGraph, [&](){ doFrameWork(transforms); });
+	int cullTask = addFrameTask(frameGraph, [&](){ doFrameWork(bounds); }, &transformTask, 1);
+	runFrameGraph(frameGraph);
+	waitForFrameTask(frameGraph, cullTask);
+	finishFrameGraph(frameGraph);
+	double graphTime = getTime();
+
+	streamer->update();
+	glFinish();
+	FrameTime time = { getTime() - startTime, graphTime - startTime };
+	return time;
+}
+
+struct FrameTimes {
+	double average;
+	double percentile99;
+	double worst;
+};
+
+static FrameTimes getFrameTimes(const std::vector<FrameTime> & frameTimes, bool graph){
+	std::vector<double> times;
+	for ( size_t i=0; i<frameTimes.size(); i++ )
+		times.push_back(graph ? frameTimes[i].graph : frameTimes[i].frame);
+	std::sort(times.begin(), times.end());
+	FrameTimes result = { 0.0, 0.0, 0.0 };
+	for ( size_t i=0; i<times.size(); i++ )
+		result.average += times[i] / times.size();
+	result.percentile99 = times[std::min(times.size() - 1, times.size() * 99 / 100)];
+	result.worst = times.back();
+	return result;
+}
+
+int main( int argc, char * argv[] )
+{
+	int textureCount = argc > 1 ? atoi(argv[1]) : 300;
+	unsigned int textureSize = argc > 2 ? (unsigned int)atoi(argv[2]) : 1024;
+	if ( textureCount <= 0 || textureSize == 0 ){
+		printf("Usage : texturestream_bench [count] [size]\n");
+		return 1;
+	}
+
+	if( !glfwInit() )
+	{
+		fprintf( stderr, "Failed to initialize GLFW\n" );
+		return -1;
+	}
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	GLFWwindow * window = NULL;
+	const int contextVersions[][2] = { { 4, 5 }, { 3, 3 } };
+	for ( int i=0; i<2 && window == NULL; i++ ){
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, contextVersions[i][0]);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, contextVersions[i][1]);
+		window = glfwCreateWindow(64, 64, "texturestream_bench", NULL, NULL);
+	}
+	if( window == NULL ){
+		fprintf( stderr, "Failed to open GLFW window.\n" );
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK) {
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		return -1;
+	}
+
+	printf("Writing %d textures of %ux%u...\n", textureCount, textureSize, textureSize);
+	std::vector<std::string> paths;
+	for ( int i=0; i<textureCount; i++ ){
+		char path[64];
+		snprintf(path, sizeof(path), "texturestream_bench_%03d.bmp", i);
+		if ( !writeBMP(path, textureSize, (unsigned int)i) ){
+			printf("Could not write %s\n", path);
+			return 1;
+		}
+		paths.push_back(path);
+	}
+
+	std::vector<float> transforms(FRAME_WORK_SIZE, 1.0f);
+	std::vector<float> bounds(FRAME_WORK_SIZE, 1.0f);
+	TextureStreamer * streamer = new TextureStreamer();
+
+	std::vector<FrameTime> baselineTimes;
+	for ( int i=0; i<BASELINE_FRAMES; i++ )
+		baselineTimes.push_back(runFrame(streamer, transforms, bounds));
+
+	// Everything at once, as when a level starts
+	double startTime = getTime();
+	std::vector<int> requests;
+	for ( size_t i=0; i<paths.size(); i++ )
+		requests.push_back(streamer->request(paths[i].c_str()));
+	std::vector<FrameTime> streamingTimes;
+	while ( streamer->getStatistics().pendingCount > 0 ){
+		streamingTimes.push_back(runFrame(streamer, transforms, bounds));
+		// Leave the job threads the rest of a 60 Hz frame, as vsync would
+		double frameTime = streamingTimes.back().frame;
+		if ( frameTime < 16.0 )
+			std::this_thread::sleep_for(std::chrono::microseconds((long long)((16.0 - frameTime) * 1000.0)));
+	}
+	double streamingTime = getTime() - startTime;
+
+	printf("%d textures of %ux%u, %s, %u job threads, %zu frames, %.0f ms in all\n", textureCount, textureSize, textureSize,
+		streamer->isStagingMapped() ? "persistently mapped staging ring" : "no staging ring", getJobThreadCount(),
+		streamingTimes.size(), streamingTime);
+	const char * names[] = { "frame", "frame graph" };
+	for ( int graph=0; graph<2; graph++ ){
+		FrameTimes baseline = getFrameTimes(baselineTimes, graph != 0);
+		FrameTimes streaming = getFrameTimes(streamingTimes, graph != 0);
+		printf("  %-11s : average %6.2f ms, 99th percentile %6.2f ms, worst %6.2f ms alone ; %6.2f, %6.2f, %6.2f ms while streaming : worst hitch %.2f ms\n",
+			names[graph], baseline.average, baseline.percentile99, baseline.worst,
+			streaming.average, streaming.percentile99, streaming.worst, streaming.worst - baseline.average);
+	}
+	printf("  longest update %.2f ms\n", streamer->getStatistics().maxUploadTime);
+
+	for ( size_t i=0; i<requests.size(); i++ )
+		streamer->release(requests[i]);
+	delete streamer;
+	for ( size_t i=0; i<paths.size(); i++ )
+		remove(paths[i].c_str());
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return 0;
+}
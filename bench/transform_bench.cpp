@@ -0,0 +1,151 @@
+// Times TransformHierarchy::update on hierarchies of 100k nodes of three shapes, with 1% and
+// then all of the nodes moving each frame, on one thread and on all of them :
+//
+//   transform_bench [count]
+//
+// Checks the world matrices against recomputing every node from its parent, which is also
+// timed, as what updating everything each frame would cost.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <common/jobsystem.hpp>
+#include <playground/TransformHierarchy.hpp>
+
+// Nodes in a group of the first shape, and in a chain of the third
+#define GROUP_SIZE 100
+#define CHAIN_COUNT 10
+
+#define FRAME_COUNT 20
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+enum Shape {
+	SHAPE_GROUPS,       // Roots of GROUP_SIZE nodes, each the child of one of the previous ones
+	SHAPE_TREE,         // One root, each node the child of any previous one
+	SHAPE_CHAINS,       // CHAIN_COUNT roots, each starting chains of GROUP_SIZE nodes, a chain
+	                    // hanging from the first node of the previous one
+	SHAPE_COUNT
+};
+
+static const char * SHAPE_NAMES[SHAPE_COUNT] = { "groups of 100", "one random tree", "10 deep chains" };
+
+static glm::mat4 getLocalMatrix(const TransformHierarchy & hierarchy, TransformHierarchy::Node node){
+	glm::mat4 matrix = glm::mat4_cast(hierarchy.getLocalRotation(node));
+	glm::vec3 scale = hierarchy.getLocalScale(node);
+	matrix[0] *= scale.x;
+	matrix[1] *= scale.y;
+	matrix[2] *= scale.z;
+	matrix[3] = glm::vec4(hierarchy.getLocalPosition(node), 1.0f);
+	return matrix;
+}
+
+// Every node from its parent, in the order they were created : parents come first. Returns
+// the time taken and the largest difference with the hierarchy's matrices.
+static double recomputeAll(const TransformHierarchy & hierarchy, const std::vector<TransformHierarchy::Node> & nodes,
+	const std::vector<int> & parents, std::vector<glm::mat4> & worldMatrices, float & out_error){
+	double startTime = getTime();
+	for ( size_t i=0; i<nodes.size(); i++ ){
+		glm::mat4 local = getLocalMatrix(hierarchy, nodes[i]);
+		worldMatrices[i] = parents[i] < 0 ? local : worldMatrices[parents[i]] * local;
+	}
+	double time = getTime() - startTime;
+	out_error = 0.0f;
+	for ( size_t i=0; i<nodes.size(); i++ ){
+		const glm::mat4 & matrix = hierarchy.getWorldMatrix(nodes[i]);
+		for ( int column=0; column<4; column++ )
+			for ( int row=0; row<4; row++ )
+				out_error = std::max(out_error, fabsf(matrix[column][row] - worldMatrices[i][column][row]));
+	}
+	return time;
+}
+
+int main( int argc, char * argv[] )
+{
+	int count = argc > 1 ? atoi(argv[1]) : 100000;
+	if ( count < GROUP_SIZE * CHAIN_COUNT ){
+		printf("Usage : transform_bench [count], count at least %d\n", GROUP_SIZE * CHAIN_COUNT);
+		return 1;
+	}
+	startJobSystem();
+	unsigned int threadCount = getJobThreadCount();
+	printf("%d nodes, %u job threads\n", count, threadCount);
+
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+	for ( int shape=0; shape<SHAPE_COUNT; shape++ ){
+		TransformHierarchy hierarchy;
+		std::vector<TransformHierarchy::Node> nodes;
+		std::vector<int> parents;
+		int chainLength = count / CHAIN_COUNT;
+		for ( int i=0; i<count; i++ ){
+			int parent = -1;
+			if ( shape == SHAPE_GROUPS && i % GROUP_SIZE != 0 )
+				parent = i - 1 - (int)(random() % (i % GROUP_SIZE));
+			else if ( shape == SHAPE_TREE && i != 0 )
+				parent = (int)(random() % i);
+			else if ( shape == SHAPE_CHAINS && i % chainLength != 0 )
+				parent = i % GROUP_SIZE != 0 ? i - 1 : i - GROUP_SIZE;
+			TransformHierarchy::Node node = hierarchy.createNode(parent < 0 ? TransformHierarchy::NONE : nodes[parent]);
+			hierarchy.setLocalPosition(node, glm::vec3(uniform(random), uniform(random), uniform(random)));
+			hierarchy.setLocalRotation(node, glm::normalize(glm::quat(uniform(random), uniform(random), uniform(random), uniform(random))));
+			hierarchy.setLocalScale(node, glm::vec3(0.9f + 0.1f * uniform(random)));
+			nodes.push_back(node);
+			parents.push_back(parent);
+		}
+
+		double startTime = getTime();
+		hierarchy.update();
+		double firstTime = getTime() - startTime;
+		std::vector<glm::mat4> worldMatrices(count);
+		float error;
+		double allTime = recomputeAll(hierarchy, nodes, parents, worldMatrices, error);
+		printf("%s : first update, sorting the nodes, %.2f ms ; recomputing every node %.3f ms, largest difference %g\n",
+			SHAPE_NAMES[shape], firstTime, allTime, error);
+
+		const int percents[2] = { 1, 100 };
+		for ( int p=0; p<2; p++ ){
+			for ( unsigned int threads=1; threads<=threadCount; threads+=std::max(1u, threadCount - 1) ){
+				double totalTime = 0.0, worstTime = 0.0;
+				for ( int frame=0; frame<FRAME_COUNT; frame++ ){
+					glm::vec3 offset(0.001f);
+					if ( percents[p] == 100 ){
+						for ( int i=0; i<count; i++ )
+							hierarchy.setLocalPosition(nodes[i], hierarchy.getLocalPosition(nodes[i]) + offset);
+					}
+					else {
+						for ( int i=0; i<count/100; i++ ){
+							TransformHierarchy::Node node = nodes[random() % count];
+							hierarchy.setLocalPosition(node, hierarchy.getLocalPosition(node) + offset);
+						}
+					}
+					startTime = getTime();
+					hierarchy.update(threads);
+					double time = getTime() - startTime;
+					totalTime += time;
+					worstTime = std::max(worstTime, time);
+				}
+				const TransformHierarchy::Statistics & statistics = hierarchy.getStatistics();
+				recomputeAll(hierarchy, nodes, parents, worldMatrices, error);
+				printf("  %3d%% moving, on %2u threads : %7.3f ms a frame on average, %7.3f ms at worst, %zu nodes updated in %zu ranges, largest difference %g\n",
+					percents[p], threads, totalTime / FRAME_COUNT, worstTime, statistics.updatedCount, statistics.subtreeCount, error);
+			}
+		}
+	}
+
+	stopJobSystem();
+	return 0;
+}
@@ -0,0 +1,182 @@
+// Times indexVBO against the std::map welding it replaced, on a triangle list of more than a
+// million unique vertices :
+//
+//   weld_bench [size | file.obj]
+//
+// size : the side of the generated grid, in vertices, 1024 by default. Each quad is written
+// as 6 corners, as loadOBJ gives them.
+//
+// Then checks indexVBO_TBN against the linear search it replaced, on the cylinder of the
+// normal mapping tutorial. Run from the repository root.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include <common/objloader.hpp>
+#include <common/vboindexer.hpp>
+#include <common/tangentspace.hpp>
+
+// Each welding is done this many times, and the fastest one counts
+#define WELD_RUNS 3
+
+#define TBN_MESH "tutorial13_normal_mapping/cylinder.obj"
+
+static double getTime(){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// indexVBO as it was : a std::map of the vertices, ordered by memcmp
+struct PackedVertex{
+	glm::vec3 position;
+	glm::vec2 uv;
+	glm::vec3 normal;
+	bool operator<(const PackedVertex that) const{
+		return memcmp((void*)this, (void*)&that, sizeof(PackedVertex))>0;
+	};
+};
+
+static void indexVBO_map(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	std::map<PackedVertex,unsigned int> VertexToOutIndex;
+	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+		PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
+		std::map<PackedVertex,unsigned int>::iterator it = VertexToOutIndex.find(packed);
+		if ( it != VertexToOutIndex.end() ){
+			out_indices.push_back( it->second );
+		}else{
+			out_vertices.push_back( in_vertices[i]);
+			out_uvs     .push_back( in_uvs[i]);
+			out_normals .push_back( in_normals[i]);
+			unsigned int newindex = (unsigned int)out_vertices.size() - 1;
+			out_indices .push_back( newindex );
+			VertexToOutIndex[ packed ] = newindex;
+		}
+	}
+}
+
+// A wavy grid of size x size vertices, 2 triangles per quad, unindexed
+static void makeGrid(int size, std::vector<glm::vec3> & out_vertices, std::vector<glm::vec2> & out_uvs, std::vector<glm::vec3> & out_normals){
+	const int corners[6][2] = { {0, 0}, {0, 1}, {1, 0}, {1, 0}, {0, 1}, {1, 1} };
+	for ( int y=0; y+1<size; y++ ){
+		for ( int x=0; x+1<size; x++ ){
+			for ( int c=0; c<6; c++ ){
+				int cx = x + corners[c][0];
+				int cy = y + corners[c][1];
+				out_vertices.push_back(glm::vec3(cx * 0.01f, 0.05f * sinf(cx * 0.1f) * cosf(cy * 0.1f), cy * 0.01f));
+				out_uvs.push_back(glm::vec2(cx / (float)(size - 1), cy / (float)(size - 1)));
+				out_normals.push_back(glm::normalize(glm::vec3(-0.5f * cosf(cx * 0.1f) * cosf(cy * 0.1f), 10.0f, 0.5f * sinf(cx * 0.1f) * sinf(cy * 0.1f))));
+			}
+		}
+	}
+}
+
+struct Welded {
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+};
+
+struct WeldedTBN {
+	std::vector<unsigned short> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec3> tangents;
+	std::vector<glm::vec3> bitangents;
+};
+
+template <typename Function>
+static double fastest(Function function){
+	double best = -1.0;
+	for ( int run=0; run<WELD_RUNS; run++ ){
+		double startTime = getTime();
+		function();
+		double time = getTime() - startTime;
+		if ( best < 0.0 || time < best )
+			best = time;
+	}
+	return best;
+}
+
+int main( int argc, char * argv[] )
+{
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	const char * source = argc > 1 ? argv[1] : "1024";
+	int size = atoi(source);
+	if ( size >= 2 ){
+		makeGrid(size, vertices, uvs, normals);
+	}else if ( !loadOBJ(source, vertices, uvs, normals) ){
+		printf("Usage : weld_bench [size | file.obj]\n");
+		return 1;
+	}
+
+	Welded hashed, mapped;
+	double hashTime = fastest([&](){
+		hashed = Welded();
+		indexVBO(vertices, uvs, normals, hashed.indices, hashed.vertices, hashed.uvs, hashed.normals);
+	});
+	double mapTime = fastest([&](){
+		mapped = Welded();
+		indexVBO_map(vertices, uvs, normals, mapped.indices, mapped.vertices, mapped.uvs, mapped.normals);
+	});
+	bool same = hashed.indices == mapped.indices && hashed.vertices == mapped.vertices &&
+		hashed.uvs == mapped.uvs && hashed.normals == mapped.normals;
+
+	// 16 bit indices can't address that many vertices : indexVBO must say so
+	std::vector<unsigned short> shortIndices;
+	Welded unused;
+	bool shortRefused = hashed.vertices.size() <= 65536 ||
+		!indexVBO(vertices, uvs, normals, shortIndices, unused.vertices, unused.uvs, unused.normals);
+
+	printf("%zu corners welded into %zu vertices\n", vertices.size(), hashed.vertices.size());
+	printf("  indexVBO  %9.1f ms, %6.1f M corners/s\n", hashTime, vertices.size() / hashTime / 1000.0);
+	printf("  std::map  %9.1f ms, %6.1f M corners/s\n", mapTime, vertices.size() / mapTime / 1000.0);
+	printf("  %.1fx faster, same output : %s, 16 bit indices refused : %s\n", mapTime / hashTime, same ? "yes" : "NO", shortRefused ? "yes" : "NO");
+
+	// As tutorial 13 welds its mesh
+	std::vector<glm::vec3> tbnVertices, tbnNormals, tangents, bitangents;
+	std::vector<glm::vec2> tbnUvs;
+	if ( !loadOBJ(TBN_MESH, tbnVertices, tbnUvs, tbnNormals) ){
+		printf("Could not load %s\n", TBN_MESH);
+		return 1;
+	}
+	computeTangentBasis(tbnVertices, tbnUvs, tbnNormals, tangents, bitangents);
+	WeldedTBN grid, linear;
+	double gridTime = fastest([&](){
+		grid = WeldedTBN();
+		indexVBO_TBN(tbnVertices, tbnUvs, tbnNormals, tangents, bitangents,
+			grid.indices, grid.vertices, grid.uvs, grid.normals, grid.tangents, grid.bitangents);
+	});
+	double linearTime = fastest([&](){
+		linear = WeldedTBN();
+		indexVBO_TBN_slow(tbnVertices, tbnUvs, tbnNormals, tangents, bitangents,
+			linear.indices, linear.vertices, linear.uvs, linear.normals, linear.tangents, linear.bitangents);
+	});
+	bool sameTBN = grid.indices == linear.indices && grid.vertices == linear.vertices && grid.uvs == linear.uvs &&
+		grid.normals == linear.normals && grid.tangents == linear.tangents && grid.bitangents == linear.bitangents;
+	printf("%s : %zu corners welded into %zu vertices\n", TBN_MESH, tbnVertices.size(), grid.vertices.size());
+	printf("  indexVBO_TBN %9.3f ms, linear search %9.3f ms, speedup %.2fx, same output : %s\n",
+		gridTime, linearTime, linearTime / gridTime, sameTBN ? "yes" : "NO");
+	return same && shortRefused && sameTBN ? 0 : 1;
+}
@@ -0,0 +1,692 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "texture.hpp"
+#include "parallel.hpp"
+#include "blockcompression.hpp"
+
+// Rows of blocks per parallelFor range
+#define BLOCK_ROW_GRAIN 4
+
+// Least squares passes after the principal axis fit
+#define BLOCK_REFINE_COUNT 2
+
+#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
+#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
+#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+#define FOURCC_DX10 0x30315844 // Equivalent to "DX10" in ASCII
+
+#define DXGI_FORMAT_BC7_UNORM      98
+#define DXGI_FORMAT_BC7_UNORM_SRGB 99
+
+// Interpolation weights of BC7 4 bit indices, out of 64
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+const char * getBlockFormatName(BlockFormat format){
+	switch ( format ){
+		case BLOCK_FORMAT_BC1: return "BC1";
+		case BLOCK_FORMAT_BC3: return "BC3";
+		case BLOCK_FORMAT_BC7: return "BC7";
+		default:               return "unknown";
+	}
+}
+
+// The level of an 8 bit RGB(A) texture, read as RGBA
+struct SourceLevel {
+	const unsigned char * pixels;
+	unsigned int width;
+	unsigned int height;
+	unsigned int stride;
+	int channels;
+	bool bgr;
+};
+
+static bool getSourceLevel(const TextureData & data, unsigned int level, SourceLevel & out_level){
+	if ( data.type != GL_UNSIGNED_BYTE || level >= getTextureLevelCount(data) )
+		return false;
+	if ( data.format == GL_RGB || data.format == GL_BGR )
+		out_level.channels = 3;
+	else if ( data.format == GL_RGBA || data.format == GL_BGRA )
+		out_level.channels = 4;
+	else
+		return false;
+	out_level.bgr = data.format == GL_BGR || data.format == GL_BGRA;
+	out_level.width  = data.width  >> level ? data.width  >> level : 1;
+	out_level.height = data.height >> level ? data.height >> level : 1;
+	out_level.stride = getTextureRowStride(out_level.width, out_level.channels);
+	out_level.pixels = &data.pixels[data.levelOffsets[level]];
+	return true;
+}
+
+static void getSourceTexel(const SourceLevel & level, unsigned int x, unsigned int y, unsigned char out_rgba[4]){
+	const unsigned char * texel = level.pixels + y * level.stride + x * level.channels;
+	out_rgba[0] = texel[level.bgr ? 2 : 0];
+	out_rgba[1] = texel[1];
+	out_rgba[2] = texel[level.bgr ? 0 : 2];
+	out_rgba[3] = level.channels == 4 ? texel[3] : 255;
+}
+
+// Texels past the edge repeat the last row or column
+static void fetchBlock(const SourceLevel & level, unsigned int blockX, unsigned int blockY, unsigned char out_texels[16][4]){
+	for ( unsigned int y=0; y<4; y++ ){
+		unsigned int sourceY = blockY * 4 + y < level.height ? blockY * 4 + y : level.height - 1;
+		for ( unsigned int x=0; x<4; x++ ){
+			unsigned int sourceX = blockX * 4 + x < level.width ? blockX * 4 + x : level.width - 1;
+			getSourceTexel(level, sourceX, sourceY, out_texels[y*4 + x]);
+		}
+	}
+}
+
+static inline float clampFloat(float value, float low, float high){
+	return value < low ? low : value > high ? high : value;
+}
+
+static inline int clampInt(int value, int low, int high){
+	return value < low ? low : value > high ? high : value;
+}
+
+// Mean, and direction of largest variance by power iteration. The axis is 0 for a flat block.
+static void getPrincipalAxis(const unsigned char texels[16][4], int channels, float out_mean[4], float out_axis[4]){
+	for ( int c=0; c<4; c++ ){
+		float sum = 0.0f;
+		for ( int i=0; i<16; i++ )
+			sum += texels[i][c];
+		out_mean[c] = c < channels ? sum / 16.0f : 0.0f;
+		out_axis[c] = 0.0f;
+	}
+
+	float covariance[4][4] = {};
+	for ( int i=0; i<16; i++ ){
+		float d[4];
+		for ( int c=0; c<channels; c++ )
+			d[c] = texels[i][c] - out_mean[c];
+		for ( int a=0; a<channels; a++ )
+			for ( int b=0; b<channels; b++ )
+				covariance[a][b] += d[a] * d[b];
+	}
+
+	// Starting from the row of the widest channel converges in a few steps
+	int widest = 0;
+	for ( int c=1; c<channels; c++ )
+		if ( covariance[c][c] > covariance[widest][widest] ) widest = c;
+	if ( covariance[widest][widest] < 1e-3f )
+		return;
+	float axis[4] = { covariance[widest][0], covariance[widest][1], covariance[widest][2], covariance[widest][3] };
+	for ( int iteration=0; iteration<8; iteration++ ){
+		float next[4] = {};
+		float length = 0.0f;
+		for ( int a=0; a<channels; a++ ){
+			for ( int b=0; b<channels; b++ )
+				next[a] += covariance[a][b] * axis[b];
+			length += next[a] * next[a];
+		}
+		if ( length < 1e-12f )
+			return;
+		length = 1.0f / sqrtf(length);
+		for ( int c=0; c<4; c++ )
+			axis[c] = next[c] * length;
+	}
+	for ( int c=0; c<4; c++ )
+		out_axis[c] = axis[c];
+}
+
+// The ends of the texels along the axis
+static void getAxisEndpoints(const unsigned char texels[16][4], int channels, const float mean[4], const float axis[4], float out_low[4], float out_high[4]){
+	float low = 0.0f, high = 0.0f;
+	for ( int i=0; i<16; i++ ){
+		float t = 0.0f;
+		for ( int c=0; c<channels; c++ )
+			t += (texels[i][c] - mean[c]) * axis[c];
+		low  = t < low  ? t : low;
+		high = t > high ? t : high;
+	}
+	for ( int c=0; c<4; c++ ){
+		out_low[c]  = mean[c] + axis[c] * low;
+		out_high[c] = mean[c] + axis[c] * high;
+	}
+}
+
+// Endpoints minimizing the squared error of the texels, given how much of the first
+// endpoint each texel takes. Returns false when the system is singular.
+static bool fitEndpoints(const unsigned char texels[16][4], int channels, const float weights[16], float out_first[4], float out_second[4]){
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[4] = {}, bx[4] = {};
+	for ( int i=0; i<16; i++ ){
+		float a = weights[i];
+		float b = 1.0f - a;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for ( int c=0; c<channels; c++ ){
+			ax[c] += a * texels[i][c];
+			bx[c] += b * texels[i][c];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if ( fabsf(determinant) < 1e-6f )
+		return false;
+	float inverse = 1.0f / determinant;
+	for ( int c=0; c<channels; c++ ){
+		out_first[c]  = (ax[c] * bb - bx[c] * ab) * inverse;
+		out_second[c] = (bx[c] * aa - ax[c] * ab) * inverse;
+	}
+	return true;
+}
+
+
+// BC1 colors
+
+static unsigned short packColor565(const float color[4]){
+	int r = (int)(clampFloat(color[0], 0.0f, 255.0f) * (31.0f / 255.0f) + 0.5f);
+	int g = (int)(clampFloat(color[1], 0.0f, 255.0f) * (63.0f / 255.0f) + 0.5f);
+	int b = (int)(clampFloat(color[2], 0.0f, 255.0f) * (31.0f / 255.0f) + 0.5f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void unpackColor565(unsigned short color, int out_rgb[3]){
+	int r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+	out_rgb[0] = (r << 3) | (r >> 2);
+	out_rgb[1] = (g << 2) | (g >> 4);
+	out_rgb[2] = (b << 3) | (b >> 2);
+}
+
+// fourColors : always for BC3, when color0 > color1 for BC1. The fourth color is black
+// otherwise, and transparent.
+static void getColorPalette(unsigned short color0, unsigned short color1, bool fourColors, int out_palette[4][3]){
+	unpackColor565(color0, out_palette[0]);
+	unpackColor565(color1, out_palette[1]);
+	for ( int c=0; c<3; c++ ){
+		if ( fourColors ){
+			out_palette[2][c] = (2 * out_palette[0][c] + out_palette[1][c]) / 3;
+			out_palette[3][c] = (out_palette[0][c] + 2 * out_palette[1][c]) / 3;
+		}
+		else {
+			out_palette[2][c] = (out_palette[0][c] + out_palette[1][c]) / 2;
+			out_palette[3][c] = 0;
+		}
+	}
+}
+
+// Closest palette entries, returns the squared error
+static int selectColorIndices(const unsigned char texels[16][4], const int palette[4][3], unsigned char out_indices[16]){
+	int error = 0;
+	for ( int i=0; i<16; i++ ){
+		int best = 0, bestError = 0x7fffffff;
+		for ( int p=0; p<4; p++ ){
+			int dr = texels[i][0] - palette[p][0];
+			int dg = texels[i][1] - palette[p][1];
+			int db = texels[i][2] - palette[p][2];
+			int e = dr * dr + dg * dg + db * db;
+			if ( e < bestError ){ bestError = e; best = p; }
+		}
+		out_indices[i] = (unsigned char)best;
+		error += bestError;
+	}
+	return error;
+}
+
+// 4 color mode, which BC3 always uses
+static void encodeColorBlock(const unsigned char texels[16][4], unsigned char out_block[8]){
+	// Share of color0 in each palette entry
+	static const float COLOR_WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+	float mean[4], axis[4], low[4], high[4];
+	getPrincipalAxis(texels, 3, mean, axis);
+	getAxisEndpoints(texels, 3, mean, axis, low, high);
+
+	unsigned short bestColor0 = 0, bestColor1 = 0;
+	unsigned char bestIndices[16] = {};
+	int bestError = 0x7fffffff;
+	for ( int pass=0; pass<=BLOCK_REFINE_COUNT; pass++ ){
+		unsigned short color0 = packColor565(high);
+		unsigned short color1 = packColor565(low);
+		if ( color0 < color1 ){
+			unsigned short swap = color0; color0 = color1; color1 = swap;
+		}
+		int palette[4][3];
+		getColorPalette(color0, color1, true, palette);
+		unsigned char indices[16];
+		int error = selectColorIndices(texels, palette, indices);
+		if ( error < bestError ){
+			bestError = error;
+			bestColor0 = color0;
+			bestColor1 = color1;
+			memcpy(bestIndices, indices, 16);
+		}
+		if ( error == 0 || pass == BLOCK_REFINE_COUNT )
+			break;
+
+		float weights[16];
+		for ( int i=0; i<16; i++ )
+			weights[i] = COLOR_WEIGHTS[indices[i]];
+		if ( !fitEndpoints(texels, 3, weights, high, low) )
+			break;
+	}
+
+	// Equal colors read as 3 color mode in BC1 : index 0 is the color either way
+	if ( bestColor0 == bestColor1 )
+		memset(bestIndices, 0, 16);
+
+	out_block[0] = (unsigned char)(bestColor0 & 0xff);
+	out_block[1] = (unsigned char)(bestColor0 >> 8);
+	out_block[2] = (unsigned char)(bestColor1 & 0xff);
+	out_block[3] = (unsigned char)(bestColor1 >> 8);
+	for ( int row=0; row<4; row++ ){
+		out_block[4 + row] = (unsigned char)(
+			bestIndices[row*4 + 0] |
+			(bestIndices[row*4 + 1] << 2) |
+			(bestIndices[row*4 + 2] << 4) |
+			(bestIndices[row*4 + 3] << 6));
+	}
+}
+
+static void decodeColorBlock(const unsigned char block[8], bool alwaysFourColors, unsigned char out_texels[16][4]){
+	unsigned short color0 = (unsigned short)(block[0] | (block[1] << 8));
+	unsigned short color1 = (unsigned short)(block[2] | (block[3] << 8));
+	bool fourColors = alwaysFourColors || color0 > color1;
+	int palette[4][3];
+	getColorPalette(color0, color1, fourColors, palette);
+	for ( int i=0; i<16; i++ ){
+		int index = (block[4 + i/4] >> ((i % 4) * 2)) & 3;
+		for ( int c=0; c<3; c++ )
+			out_texels[i][c] = (unsigned char)palette[index][c];
+		out_texels[i][3] = !fourColors && index == 3 ? 0 : 255;
+	}
+}
+
+
+// BC3 alpha : 8 values between the extremes
+
+static void getAlphaPalette(int alpha0, int alpha1, int out_palette[8]){
+	out_palette[0] = alpha0;
+	out_palette[1] = alpha1;
+	if ( alpha0 > alpha1 ){
+		for ( int i=2; i<8; i++ )
+			out_palette[i] = ((8 - i) * alpha0 + (i - 1) * alpha1) / 7;
+	}
+	else {
+		for ( int i=2; i<6; i++ )
+			out_palette[i] = ((6 - i) * alpha0 + (i - 1) * alpha1) / 5;
+		out_palette[6] = 0;
+		out_palette[7] = 255;
+	}
+}
+
+static void encodeAlphaBlock(const unsigned char texels[16][4], unsigned char out_block[8]){
+	int alpha0 = 0, alpha1 = 255;
+	for ( int i=0; i<16; i++ ){
+		alpha0 = texels[i][3] > alpha0 ? texels[i][3] : alpha0;
+		alpha1 = texels[i][3] < alpha1 ? texels[i][3] : alpha1;
+	}
+	int palette[8];
+	getAlphaPalette(alpha0, alpha1, palette);
+
+	unsigned long long bits = 0;
+	if ( alpha0 != alpha1 ){
+		for ( int i=0; i<16; i++ ){
+			int best = 0, bestError = 256;
+			for ( int p=0; p<8; p++ ){
+				int e = abs(texels[i][3] - palette[p]);
+				if ( e < bestError ){ bestError = e; best = p; }
+			}
+			bits |= (unsigned long long)best << (3 * i);
+		}
+	}
+	out_block[0] = (unsigned char)alpha0;
+	out_block[1] = (unsigned char)alpha1;
+	for ( int i=0; i<6; i++ )
+		out_block[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+static void decodeAlphaBlock(const unsigned char block[8], unsigned char out_texels[16][4]){
+	int palette[8];
+	getAlphaPalette(block[0], block[1], palette);
+	unsigned long long bits = 0;
+	for ( int i=0; i<6; i++ )
+		bits |= (unsigned long long)block[2 + i] << (8 * i);
+	for ( int i=0; i<16; i++ )
+		out_texels[i][3] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+}
+
+
+// BC7 mode 6 : RGBA endpoints of 7 bits plus a shared lowest bit each, 4 bit indices
+
+struct BlockBits {
+	unsigned char * bytes;
+	unsigned int position;
+};
+
+static void writeBits(BlockBits & bits, unsigned int value, unsigned int count){
+	for ( unsigned int i=0; i<count; i++, bits.position++ ){
+		if ( (value >> i) & 1 )
+			bits.bytes[bits.position >> 3] |= (unsigned char)(1 << (bits.position & 7));
+	}
+}
+
+static unsigned int readBits(const unsigned char * bytes, unsigned int & position, unsigned int count){
+	unsigned int value = 0;
+	for ( unsigned int i=0; i<count; i++, position++ )
+		value |= ((bytes[position >> 3] >> (position & 7)) & 1u) << i;
+	return value;
+}
+
+static inline int interpolateBC7(int endpoint0, int endpoint1, int index){
+	return ((64 - BC7_WEIGHTS[index]) * endpoint0 + BC7_WEIGHTS[index] * endpoint1 + 32) >> 6;
+}
+
+// Indices for 8 bit endpoints, returns the squared error
+static int selectBC7Indices(const unsigned char texels[16][4], const int endpoint0[4], const int endpoint1[4], unsigned char out_indices[16]){
+	int palette[16][4];
+	for ( int p=0; p<16; p++ )
+		for ( int c=0; c<4; c++ )
+			palette[p][c] = interpolateBC7(endpoint0[c], endpoint1[c], p);
+
+	// Projection on the endpoint line gives the index within one
+	float direction[4];
+	float lengthSquared = 0.0f;
+	for ( int c=0; c<4; c++ ){
+		direction[c] = (float)(endpoint1[c] - endpoint0[c]);
+		lengthSquared += direction[c] * direction[c];
+	}
+	float scale = lengthSquared > 0.0f ? 15.0f / lengthSquared : 0.0f;
+
+	int error = 0;
+	for ( int i=0; i<16; i++ ){
+		float t = 0.0f;
+		for ( int c=0; c<4; c++ )
+			t += (texels[i][c] - endpoint0[c]) * direction[c];
+		int guess = clampInt((int)(t * scale + 0.5f), 0, 15);
+		int best = guess, bestError = 0x7fffffff;
+		for ( int p=guess > 0 ? guess - 1 : 0; p<=guess + 1 && p<16; p++ ){
+			int e = 0;
+			for ( int c=0; c<4; c++ ){
+				int d = texels[i][c] - palette[p][c];
+				e += d * d;
+			}
+			if ( e < bestError ){ bestError = e; best = p; }
+		}
+		out_indices[i] = (unsigned char)best;
+		error += bestError;
+	}
+	return error;
+}
+
+static void encodeBC7Block(const unsigned char texels[16][4], unsigned char out_block[16]){
+	float mean[4], axis[4], first[4], second[4];
+	getPrincipalAxis(texels, 4, mean, axis);
+	getAxisEndpoints(texels, 4, mean, axis, first, second);
+
+	int bestQuantized[2][4] = {};
+	int bestPBits[2] = {};
+	unsigned char bestIndices[16] = {};
+	int bestError = 0x7fffffff;
+	for ( int pass=0; pass<=BLOCK_REFINE_COUNT; pass++ ){
+		unsigned char indices[16];
+		bool improved = false;
+		// The lowest bits of the endpoints : each choice shifts the values they reach
+		for ( int pBits=0; pBits<4; pBits++ ){
+			int pBit0 = pBits & 1, pBit1 = pBits >> 1;
+			int quantized[2][4], endpoint0[4], endpoint1[4];
+			for ( int c=0; c<4; c++ ){
+				quantized[0][c] = clampInt((int)floorf((first[c]  - pBit0) * 0.5f + 0.5f), 0, 127);
+				quantized[1][c] = clampInt((int)floorf((second[c] - pBit1) * 0.5f + 0.5f), 0, 127);
+				endpoint0[c] = (quantized[0][c] << 1) | pBit0;
+				endpoint1[c] = (quantized[1][c] << 1) | pBit1;
+			}
+			int error = selectBC7Indices(texels, endpoint0, endpoint1, indices);
+			if ( error < bestError ){
+				bestError = error;
+				memcpy(bestQuantized, quantized, sizeof(quantized));
+				bestPBits[0] = pBit0;
+				bestPBits[1] = pBit1;
+				memcpy(bestIndices, indices, 16);
+				improved = true;
+			}
+		}
+		if ( bestError == 0 || !improved || pass == BLOCK_REFINE_COUNT )
+			break;
+
+		float weights[16];
+		for ( int i=0; i<16; i++ )
+			weights[i] = 1.0f - BC7_WEIGHTS[bestIndices[i]] / 64.0f;
+		if ( !fitEndpoints(texels, 4, weights, first, second) )
+			break;
+	}
+
+	// The highest bit of the first index is implied 0 : swap the endpoints otherwise
+	if ( bestIndices[0] & 8 ){
+		for ( int c=0; c<4; c++ ){
+			int swap = bestQuantized[0][c]; bestQuantized[0][c] = bestQuantized[1][c]; bestQuantized[1][c] = swap;
+		}
+		int swap = bestPBits[0]; bestPBits[0] = bestPBits[1]; bestPBits[1] = swap;
+		for ( int i=0; i<16; i++ )
+			bestIndices[i] = (unsigned char)(15 - bestIndices[i]);
+	}
+
+	memset(out_block, 0, 16);
+	BlockBits bits = { out_block, 0 };
+	writeBits(bits, 1 << 6, 7);
+	for ( int c=0; c<4; c++ ){
+		writeBits(bits, bestQuantized[0][c], 7);
+		writeBits(bits, bestQuantized[1][c], 7);
+	}
+	writeBits(bits, bestPBits[0], 1);
+	writeBits(bits, bestPBits[1], 1);
+	writeBits(bits, bestIndices[0], 3);
+	for ( int i=1; i<16; i++ )
+		writeBits(bits, bestIndices[i], 4);
+}
+
+static void decodeBC7Block(const unsigned char block[16], unsigned char out_texels[16][4]){
+	if ( (block[0] & 0x7f) != (1 << 6) ){
+		memset(out_texels, 0, 16 * 4);
+		return;
+	}
+	unsigned int position = 7;
+	int endpoints[2][4];
+	for ( int c=0; c<4; c++ ){
+		endpoints[0][c] = readBits(block, position, 7) << 1;
+		endpoints[1][c] = readBits(block, position, 7) << 1;
+	}
+	int pBit0 = readBits(block, position, 1);
+	int pBit1 = readBits(block, position, 1);
+	for ( int c=0; c<4; c++ ){
+		endpoints[0][c] |= pBit0;
+		endpoints[1][c] |= pBit1;
+	}
+	for ( int i=0; i<16; i++ ){
+		int index = readBits(block, position, i == 0 ? 3 : 4);
+		for ( int c=0; c<4; c++ )
+			out_texels[i][c] = (unsigned char)interpolateBC7(endpoints[0][c], endpoints[1][c], index);
+	}
+}
+
+
+static bool getBlockFormat(GLenum internalFormat, BlockFormat & out_format){
+	switch ( internalFormat ){
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+			out_format = BLOCK_FORMAT_BC1;
+			return true;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+			out_format = BLOCK_FORMAT_BC3;
+			return true;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+			out_format = BLOCK_FORMAT_BC7;
+			return true;
+		default:
+			return false;
+	}
+}
+
+static unsigned int getBlockBytes(BlockFormat format){
+	return format == BLOCK_FORMAT_BC1 ? 8 : 16;
+}
+
+bool compressTexture(const TextureData & data, BlockFormat format, TextureData & out_data, unsigned int threadCount){
+	SourceLevel level;
+	if ( !getSourceLevel(data, 0, level) )
+		return false;
+
+	static const GLenum INTERNAL_FORMATS[3] = {
+		GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+		GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+		GL_COMPRESSED_RGBA_BPTC_UNORM
+	};
+	unsigned int blockBytes = getBlockBytes(format);
+	unsigned int levelCount = getTextureLevelCount(data);
+	out_data.width = data.width;
+	out_data.height = data.height;
+	out_data.internalFormat = INTERNAL_FORMATS[format];
+	out_data.format = 0;
+	out_data.type = 0;
+	out_data.fileOffset = 0;
+	out_data.generateMipmaps = false;
+	out_data.levelOffsets.resize(1, 0);
+	for ( unsigned int l=0; l<levelCount; l++ ){
+		getSourceLevel(data, l, level);
+		out_data.levelOffsets.push_back(out_data.levelOffsets.back() + ((level.width + 3) / 4) * ((level.height + 3) / 4) * blockBytes);
+	}
+	out_data.pixels.resize(out_data.levelOffsets.back());
+
+	for ( unsigned int l=0; l<levelCount; l++ ){
+		getSourceLevel(data, l, level);
+		unsigned int blocksX = (level.width + 3) / 4;
+		unsigned int blocksY = (level.height + 3) / 4;
+		unsigned char * blocks = &out_data.pixels[out_data.levelOffsets[l]];
+		parallelFor(blocksY, BLOCK_ROW_GRAIN, [&](size_t begin, size_t end){
+			unsigned char texels[16][4];
+			for ( size_t y=begin; y<end; y++ ){
+				for ( unsigned int x=0; x<blocksX; x++ ){
+					unsigned char * block = blocks + (y * blocksX + x) * blockBytes;
+					fetchBlock(level, x, (unsigned int)y, texels);
+					switch ( format ){
+						case BLOCK_FORMAT_BC1:
+							encodeColorBlock(texels, block);
+							break;
+						case BLOCK_FORMAT_BC3:
+							encodeAlphaBlock(texels, block);
+							encodeColorBlock(texels, block + 8);
+							break;
+						case BLOCK_FORMAT_BC7:
+							encodeBC7Block(texels, block);
+							break;
+					}
+				}
+			}
+		}, threadCount);
+	}
+	return true;
+}
+
+bool decompressTextureLevel(const TextureData & data, unsigned int level, std::vector<unsigned char> & out_rgba){
+	BlockFormat format;
+	if ( !getBlockFormat(data.internalFormat, format) || level >= getTextureLevelCount(data) )
+		return false;
+	unsigned int width  = data.width  >> level ? data.width  >> level : 1;
+	unsigned int height = data.height >> level ? data.height >> level : 1;
+	unsigned int blocksX = (width + 3) / 4;
+	unsigned int blocksY = (height + 3) / 4;
+	unsigned int blockBytes = getBlockBytes(format);
+	out_rgba.resize(width * height * 4);
+
+	const unsigned char * blocks = &data.pixels[data.levelOffsets[level]];
+	for ( unsigned int by=0; by<blocksY; by++ ){
+		for ( unsigned int bx=0; bx<blocksX; bx++ ){
+			const unsigned char * block = blocks + (by * blocksX + bx) * blockBytes;
+			unsigned char texels[16][4];
+			switch ( format ){
+				case BLOCK_FORMAT_BC1:
+					decodeColorBlock(block, false, texels);
+					break;
+				case BLOCK_FORMAT_BC3:
+					decodeColorBlock(block + 8, true, texels);
+					decodeAlphaBlock(block, texels);
+					break;
+				case BLOCK_FORMAT_BC7:
+					decodeBC7Block(block, texels);
+					break;
+			}
+			for ( unsigned int y=0; y<4 && by*4 + y < height; y++ )
+				for ( unsigned int x=0; x<4 && bx*4 + x < width; x++ )
+					memcpy(&out_rgba[((by*4 + y) * width + bx*4 + x) * 4], texels[y*4 + x], 4);
+		}
+	}
+	return true;
+}
+
+double computeCompressionPSNR(const TextureData & source, const TextureData & compressed, unsigned int level){
+	SourceLevel sourceLevel;
+	BlockFormat format;
+	std::vector<unsigned char> decoded;
+	if ( !getSourceLevel(source, level, sourceLevel) || !getBlockFormat(compressed.internalFormat, format) || !decompressTextureLevel(compressed, level, decoded) )
+		return 0.0;
+
+	int channels = sourceLevel.channels == 4 && format != BLOCK_FORMAT_BC1 ? 4 : 3;
+	double squaredError = 0.0;
+	for ( unsigned int y=0; y<sourceLevel.height; y++ ){
+		for ( unsigned int x=0; x<sourceLevel.width; x++ ){
+			unsigned char texel[4];
+			getSourceTexel(sourceLevel, x, y, texel);
+			const unsigned char * result = &decoded[(y * sourceLevel.width + x) * 4];
+			for ( int c=0; c<channels; c++ ){
+				double d = (double)texel[c] - result[c];
+				squaredError += d * d;
+			}
+		}
+	}
+	double meanSquaredError = squaredError / ((double)sourceLevel.width * sourceLevel.height * channels);
+	return meanSquaredError > 0.0 ? 10.0 * log10(255.0 * 255.0 / meanSquaredError) : INFINITY;
+}
+
+bool writeDDS(const char * imagepath, const TextureData & data){
+	unsigned int fourCC, dxgiFormat = 0;
+	switch ( data.internalFormat ){
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:     fourCC = FOURCC_DXT1; break;
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:     fourCC = FOURCC_DXT3; break;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:     fourCC = FOURCC_DXT5; break;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:        fourCC = FOURCC_DX10; dxgiFormat = DXGI_FORMAT_BC7_UNORM; break;
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:  fourCC = FOURCC_DX10; dxgiFormat = DXGI_FORMAT_BC7_UNORM_SRGB; break;
+		default:
+			printf("%s : only DXT1, DXT3, DXT5 and BC7 can be written\n", imagepath);
+			return false;
+	}
+
+	FILE * fp = fopen(imagepath, "wb");
+	if ( fp == NULL ){
+		printf("%s could not be opened for writing\n", imagepath);
+		return false;
+	}
+
+	unsigned int levelCount = getTextureLevelCount(data);
+	unsigned int header[31] = {};
+	header[0]  = 124;                                       // Size
+	header[1]  = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // Caps, height, width, pixel format, mipmap count, linear size
+	header[2]  = data.height;
+	header[3]  = data.width;
+	header[4]  = data.levelOffsets[1] - data.levelOffsets[0];
+	header[6]  = levelCount;
+	header[18] = 32;                                        // Pixel format : size
+	header[19] = 0x4;                                       // FourCC
+	header[20] = fourCC;
+	header[26] = 0x1000 | (levelCount > 1 ? 0x8 | 0x400000 : 0); // Texture, complex, mipmap
+
+	bool written = fwrite("DDS ", 1, 4, fp) == 4 && fwrite(header, sizeof(header), 1, fp) == 1;
+	if ( fourCC == FOURCC_DX10 ){
+		// DXGI format, 2D texture, no flags, one element
+		unsigned int header10[5] = { dxgiFormat, 3, 0, 1, 0 };
+		written = written && fwrite(header10, sizeof(header10), 1, fp) == 1;
+	}
+	written = written && fwrite(&data.pixels[0], 1, data.pixels.size(), fp) == data.pixels.size();
+	written = fclose(fp) == 0 && written;
+	if ( !written )
+		printf("%s could not be written\n", imagepath);
+	return written;
+}
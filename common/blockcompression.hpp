@@ -0,0 +1,36 @@
+#ifndef BLOCKCOMPRESSION_HPP
+#define BLOCKCOMPRESSION_HPP
+
+#include <vector>
+
+// Block compression of 8 bit RGB(A) textures into the formats loadDDS reads, a level at a
+// time on the job threads. Blocks of 4x4 texels are fitted on their principal axis, then
+// refined by least squares.
+
+struct TextureData;
+
+enum BlockFormat {
+	BLOCK_FORMAT_BC1 = 0,       // DXT1 : RGB, 8 bytes per block
+	BLOCK_FORMAT_BC3 = 1,       // DXT5 : RGB as BC1, plus interpolated alpha, 16 bytes
+	BLOCK_FORMAT_BC7 = 2        // BPTC, mode 6 only : RGBA endpoints of 7 bits, 16 bytes
+};
+
+const char * getBlockFormatName(BlockFormat format);
+
+// Compresses every level of an 8 bit RGB, BGR, RGBA or BGRA texture : see buildMipmaps for
+// the chain. Rows are kept in the same order. out_data is ready for createTexture and
+// writeDDS. Returns false for other formats.
+bool compressTexture(const TextureData & data, BlockFormat format, TextureData & out_data, unsigned int threadCount = 0);
+
+// Decodes a level of what compressTexture wrote into RGBA, 4 bytes per texel without row
+// padding. BC7 blocks of other modes than 6 come out black.
+bool decompressTextureLevel(const TextureData & data, unsigned int level, std::vector<unsigned char> & out_rgba);
+
+// Peak signal to noise ratio of a compressed level against its source, in dB, over RGB and
+// over alpha too when both have one. Infinite when they are the same.
+double computeCompressionPSNR(const TextureData & source, const TextureData & compressed, unsigned int level);
+
+// Writes a .dds file, with a DX10 header for BC7. Prints what went wrong and returns false.
+bool writeDDS(const char * imagepath, const TextureData & data);
+
+#endif
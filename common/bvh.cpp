@@ -0,0 +1,442 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+
+#define BVH_BINS 16
+
+static float surfaceArea(const glm::vec3 & boxMin, const glm::vec3 & boxMax){
+	glm::vec3 d = glm::max(boxMax - boxMin, glm::vec3(0.0f));
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static void refitNode(Bvh & bvh, int node){
+	BvhNode & n = bvh.nodes[node];
+	const BvhNode & left = bvh.nodes[n.children[0]];
+	const BvhNode & right = bvh.nodes[n.children[1]];
+	n.boxMin = glm::min(left.boxMin, right.boxMin);
+	n.boxMax = glm::max(left.boxMax, right.boxMax);
+}
+
+// ==== Build ==================================================================
+
+struct BuildContext {
+	Bvh * bvh;
+	const std::vector<glm::vec3> * boxMins;
+	const std::vector<glm::vec3> * boxMaxs;
+	std::vector<glm::vec3> centroids;
+	std::vector<int> objects;           // Partitioned in place, node by node
+};
+
+struct Bin {
+	glm::vec3 boxMin;
+	glm::vec3 boxMax;
+	int count;
+};
+
+static int buildNode(BuildContext & context, int begin, int end, int parent){
+	Bvh & bvh = *context.bvh;
+	int node = (int)bvh.nodes.size();
+	bvh.nodes.push_back(BvhNode());
+	bvh.nodes[node].parent = parent;
+	bvh.nodes[node].object = BVH_NONE;
+
+	if ( end - begin == 1 ){
+		int object = context.objects[begin];
+		glm::vec3 margin(bvh.margin);
+		bvh.nodes[node].boxMin = (*context.boxMins)[object] - margin;
+		bvh.nodes[node].boxMax = (*context.boxMaxs)[object] + margin;
+		bvh.nodes[node].object = object;
+		bvh.nodes[node].children[0] = BVH_NONE;
+		bvh.nodes[node].children[1] = BVH_NONE;
+		bvh.objectLeaves[object] = node;
+		return node;
+	}
+
+	// Split along the longest axis of the centroids' box
+	glm::vec3 centroidMin = context.centroids[context.objects[begin]];
+	glm::vec3 centroidMax = centroidMin;
+	for ( int i=begin+1; i<end; i++ ){
+		centroidMin = glm::min(centroidMin, context.centroids[context.objects[i]]);
+		centroidMax = glm::max(centroidMax, context.centroids[context.objects[i]]);
+	}
+	glm::vec3 size = centroidMax - centroidMin;
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+	int middle = begin;
+	if ( size[axis] > 0.0f ){
+		// Binned SAH : the cost of a split is the number of objects on each side times the
+		// surface area of their box
+		Bin bins[BVH_BINS];
+		for ( int b=0; b<BVH_BINS; b++ ){
+			bins[b].boxMin = glm::vec3(INFINITY);
+			bins[b].boxMax = glm::vec3(-INFINITY);
+			bins[b].count = 0;
+		}
+		float binScale = BVH_BINS / size[axis] * 0.9999f;
+		for ( int i=begin; i<end; i++ ){
+			int object = context.objects[i];
+			int b = (int)((context.centroids[object][axis] - centroidMin[axis]) * binScale);
+			bins[b].boxMin = glm::min(bins[b].boxMin, (*context.boxMins)[object]);
+			bins[b].boxMax = glm::max(bins[b].boxMax, (*context.boxMaxs)[object]);
+			bins[b].count++;
+		}
+
+		// Right to left, the cost of the right side of each split
+		float rightCosts[BVH_BINS];
+		glm::vec3 boxMin(INFINITY);
+		glm::vec3 boxMax(-INFINITY);
+		int count = 0;
+		for ( int b=BVH_BINS-1; b>0; b-- ){
+			boxMin = glm::min(boxMin, bins[b].boxMin);
+			boxMax = glm::max(boxMax, bins[b].boxMax);
+			count += bins[b].count;
+			rightCosts[b] = count > 0 ? count * surfaceArea(boxMin, boxMax) : 0.0f;
+		}
+		// Left to right, add the left side and keep the cheapest
+		int bestSplit = 1;
+		float bestCost = INFINITY;
+		boxMin = glm::vec3(INFINITY);
+		boxMax = glm::vec3(-INFINITY);
+		count = 0;
+		for ( int b=0; b<BVH_BINS-1; b++ ){
+			boxMin = glm::min(boxMin, bins[b].boxMin);
+			boxMax = glm::max(boxMax, bins[b].boxMax);
+			count += bins[b].count;
+			float cost = (count > 0 ? count * surfaceArea(boxMin, boxMax) : 0.0f) + rightCosts[b+1];
+			if ( cost < bestCost ){
+				bestCost = cost;
+				bestSplit = b + 1;
+			}
+		}
+
+		int * first = &context.objects[0] + begin;
+		int * last = &context.objects[0] + end;
+		const std::vector<glm::vec3> & centroids = context.centroids;
+		int * split = first;
+		for ( int * it=first; it!=last; ++it ){
+			int b = (int)((centroids[*it][axis] - centroidMin[axis]) * binScale);
+			if ( b < bestSplit )
+				std::swap(*it, *split++);
+		}
+		middle = (int)(split - &context.objects[0]);
+	}
+	// All the centroids in one place, or all on one side : halve
+	if ( middle == begin || middle == end )
+		middle = (begin + end) / 2;
+
+	int left = buildNode(context, begin, middle, node);
+	int right = buildNode(context, middle, end, node);
+	bvh.nodes[node].children[0] = left;
+	bvh.nodes[node].children[1] = right;
+	refitNode(bvh, node);
+	return node;
+}
+
+void buildBvh(
+	Bvh & out_bvh,
+	const std::vector<glm::vec3> & boxMins,
+	const std::vector<glm::vec3> & boxMaxs,
+	float margin
+){
+	size_t count = boxMins.size();
+	out_bvh.nodes.clear();
+	out_bvh.nodes.reserve(count * 2);
+	out_bvh.objectLeaves.assign(count, BVH_NONE);
+	out_bvh.root = BVH_NONE;
+	out_bvh.margin = margin;
+	if ( count == 0 )
+		return;
+
+	BuildContext context;
+	context.bvh = &out_bvh;
+	context.boxMins = &boxMins;
+	context.boxMaxs = &boxMaxs;
+	context.centroids.resize(count);
+	context.objects.resize(count);
+	for ( size_t i=0; i<count; i++ ){
+		context.centroids[i] = (boxMins[i] + boxMaxs[i]) * 0.5f;
+		context.objects[i] = (int)i;
+	}
+	out_bvh.root = buildNode(context, 0, (int)count, BVH_NONE);
+}
+
+// ==== Updates ================================================================
+
+// Swaps a child of node with a grandchild on the other side when that shrinks the child
+// that gets the grandchild's place, the only box that changes
+static void rotateNode(Bvh & bvh, int node){
+	int bestChild = BVH_NONE;       // Child of node going down
+	int bestGrandchild = BVH_NONE;  // Grandchild of node going up
+	float bestGain = 0.0f;
+	for ( int side=0; side<2; side++ ){
+		int child = bvh.nodes[node].children[side];
+		int other = bvh.nodes[node].children[1 - side];
+		const BvhNode & o = bvh.nodes[other];
+		if ( o.object != BVH_NONE )
+			continue;
+		float area = surfaceArea(o.boxMin, o.boxMax);
+		const BvhNode & c = bvh.nodes[child];
+		for ( int k=0; k<2; k++ ){
+			// child takes the place of o.children[k], next to o.children[1 - k]
+			const BvhNode & kept = bvh.nodes[o.children[1 - k]];
+			float gain = area - surfaceArea(glm::min(c.boxMin, kept.boxMin), glm::max(c.boxMax, kept.boxMax));
+			if ( gain > bestGain ){
+				bestGain = gain;
+				bestChild = child;
+				bestGrandchild = o.children[k];
+			}
+		}
+	}
+	if ( bestChild == BVH_NONE )
+		return;
+
+	int other = bvh.nodes[bestGrandchild].parent;
+	BvhNode & n = bvh.nodes[node];
+	n.children[n.children[0] == bestChild ? 0 : 1] = bestGrandchild;
+	BvhNode & o = bvh.nodes[other];
+	o.children[o.children[0] == bestGrandchild ? 0 : 1] = bestChild;
+	bvh.nodes[bestGrandchild].parent = node;
+	bvh.nodes[bestChild].parent = other;
+	refitNode(bvh, other);
+}
+
+bool updateBvhObject(Bvh & bvh, int object, const glm::vec3 & boxMin, const glm::vec3 & boxMax){
+	int leaf = bvh.objectLeaves[object];
+	BvhNode & l = bvh.nodes[leaf];
+	if ( bvh.margin > 0.0f ){
+		if ( glm::all(glm::greaterThanEqual(boxMin, l.boxMin)) && glm::all(glm::lessThanEqual(boxMax, l.boxMax)) )
+			return false;
+	}
+	else if ( boxMin == l.boxMin && boxMax == l.boxMax ){
+		return false;
+	}
+
+	glm::vec3 margin(bvh.margin);
+	l.boxMin = boxMin - margin;
+	l.boxMax = boxMax + margin;
+	for ( int node=l.parent; node!=BVH_NONE; node=bvh.nodes[node].parent ){
+		refitNode(bvh, node);
+		rotateNode(bvh, node);
+	}
+	return true;
+}
+
+void refitBvh(Bvh & bvh, const std::vector<glm::vec3> & boxMins, const std::vector<glm::vec3> & boxMaxs){
+	if ( bvh.root == BVH_NONE )
+		return;
+	glm::vec3 margin(bvh.margin);
+	for ( size_t i=0; i<bvh.objectLeaves.size(); i++ ){
+		BvhNode & leaf = bvh.nodes[bvh.objectLeaves[i]];
+		leaf.boxMin = boxMins[i] - margin;
+		leaf.boxMax = boxMaxs[i] + margin;
+	}
+
+	// Children before parents. Rotations break the build order, so walk the tree.
+	std::vector<int> stack;
+	std::vector<int> inner;
+	stack.push_back(bvh.root);
+	while ( !stack.empty() ){
+		int node = stack.back();
+		stack.pop_back();
+		const BvhNode & n = bvh.nodes[node];
+		if ( n.object != BVH_NONE )
+			continue;
+		inner.push_back(node);
+		stack.push_back(n.children[0]);
+		stack.push_back(n.children[1]);
+	}
+	for ( size_t i=inner.size(); i>0; i-- )
+		refitNode(bvh, inner[i - 1]);
+}
+
+float getBvhCost(const Bvh & bvh){
+	if ( bvh.root == BVH_NONE )
+		return 0.0f;
+	float area = 0.0f;
+	for ( size_t i=0; i<bvh.nodes.size(); i++ ){
+		const BvhNode & n = bvh.nodes[i];
+		if ( n.object == BVH_NONE )
+			area += surfaceArea(n.boxMin, n.boxMax);
+	}
+	const BvhNode & root = bvh.nodes[bvh.root];
+	return area / surfaceArea(root.boxMin, root.boxMax);
+}
+
+// ==== Queries ================================================================
+
+static size_t appendSubtree(const Bvh & bvh, int node, std::vector<int> & stack, std::vector<int> & out_objects){
+	size_t count = 0;
+	size_t bottom = stack.size();
+	stack.push_back(node);
+	while ( stack.size() > bottom ){
+		const BvhNode & n = bvh.nodes[stack.back()];
+		stack.pop_back();
+		if ( n.object != BVH_NONE ){
+			out_objects.push_back(n.object);
+			count++;
+		}
+		else {
+			stack.push_back(n.children[0]);
+			stack.push_back(n.children[1]);
+		}
+	}
+	return count;
+}
+
+size_t queryBvhFrustum(const Bvh & bvh, const Frustum & frustum, std::vector<int> & out_objects){
+	if ( bvh.root == BVH_NONE )
+		return 0;
+
+	// Each node comes with the planes its parent wasn't entirely inside of
+	size_t count = 0;
+	std::vector<int> stack;
+	std::vector<int> masks;
+	std::vector<int> subtree;
+	stack.push_back(bvh.root);
+	masks.push_back(0x3F);
+	while ( !stack.empty() ){
+		int node = stack.back();
+		int mask = masks.back();
+		stack.pop_back();
+		masks.pop_back();
+
+		const BvhNode & n = bvh.nodes[node];
+		glm::vec3 center = (n.boxMin + n.boxMax) * 0.5f;
+		glm::vec3 extent = (n.boxMax - n.boxMin) * 0.5f;
+		bool outside = false;
+		for ( int p=0; p<6; p++ ){
+			if ( !(mask & (1 << p)) )
+				continue;
+			const glm::vec4 & plane = frustum.planes[p];
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+			if ( distance + radius < 0.0f ){
+				outside = true;
+				break;
+			}
+			if ( distance - radius >= 0.0f )
+				mask &= ~(1 << p);
+		}
+		if ( outside )
+			continue;
+
+		if ( mask == 0 ){
+			count += appendSubtree(bvh, node, subtree, out_objects);
+		}
+		else if ( n.object != BVH_NONE ){
+			out_objects.push_back(n.object);
+			count++;
+		}
+		else {
+			stack.push_back(n.children[0]);
+			masks.push_back(mask);
+			stack.push_back(n.children[1]);
+			masks.push_back(mask);
+		}
+	}
+	return count;
+}
+
+size_t queryBvhBox(const Bvh & bvh, const glm::vec3 & boxMin, const glm::vec3 & boxMax, std::vector<int> & out_objects){
+	if ( bvh.root == BVH_NONE )
+		return 0;
+
+	size_t count = 0;
+	std::vector<int> stack;
+	stack.push_back(bvh.root);
+	while ( !stack.empty() ){
+		const BvhNode & n = bvh.nodes[stack.back()];
+		stack.pop_back();
+		if ( glm::any(glm::lessThan(n.boxMax, boxMin)) || glm::any(glm::greaterThan(n.boxMin, boxMax)) )
+			continue;
+		if ( n.object != BVH_NONE ){
+			out_objects.push_back(n.object);
+			count++;
+		}
+		else {
+			stack.push_back(n.children[0]);
+			stack.push_back(n.children[1]);
+		}
+	}
+	return count;
+}
+
+// Slab test. Returns the distance at which the ray enters the box, or INFINITY if it misses it.
+static float intersectRayBox(
+	const glm::vec3 & origin,
+	const glm::vec3 & inverseDirection,
+	const glm::vec3 & boxMin,
+	const glm::vec3 & boxMax
+){
+	glm::vec3 t0 = (boxMin - origin) * inverseDirection;
+	glm::vec3 t1 = (boxMax - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+	float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+	float exit = glm::min(glm::min(tFar.x, tFar.y), tFar.z);
+	return enter <= exit ? enter : INFINITY;
+}
+
+int raycastBvh(
+	const Bvh & bvh,
+	const glm::vec3 & origin,
+	const glm::vec3 & direction,
+	float maxDistance,
+	float & out_distance,
+	BvhRayTest test,
+	void * context
+){
+	if ( bvh.root == BVH_NONE )
+		return BVH_NONE;
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+	int nearest = BVH_NONE;
+	float nearestDistance = maxDistance;
+
+	struct Entry {
+		int node;
+		float distance;
+	};
+	std::vector<Entry> stack;
+	const BvhNode & root = bvh.nodes[bvh.root];
+	Entry first = { bvh.root, intersectRayBox(origin, inverseDirection, root.boxMin, root.boxMax) };
+	stack.push_back(first);
+	while ( !stack.empty() ){
+		Entry entry = stack.back();
+		stack.pop_back();
+		if ( entry.distance >= nearestDistance )
+			continue;
+
+		const BvhNode & n = bvh.nodes[entry.node];
+		if ( n.object != BVH_NONE ){
+			if ( test == NULL ){
+				nearest = n.object;
+				nearestDistance = entry.distance;
+			}
+			else if ( test(context, n.object, origin, direction, nearestDistance) ){
+				nearest = n.object;
+			}
+			continue;
+		}
+
+		// The nearer child is popped first
+		const BvhNode & left = bvh.nodes[n.children[0]];
+		const BvhNode & right = bvh.nodes[n.children[1]];
+		Entry a = { n.children[0], intersectRayBox(origin, inverseDirection, left.boxMin, left.boxMax) };
+		Entry b = { n.children[1], intersectRayBox(origin, inverseDirection, right.boxMin, right.boxMax) };
+		if ( a.distance < b.distance )
+			std::swap(a, b);
+		if ( a.distance < nearestDistance )
+			stack.push_back(a);
+		if ( b.distance < nearestDistance )
+			stack.push_back(b);
+	}
+
+	if ( nearest != BVH_NONE )
+		out_distance = nearestDistance;
+	return nearest;
+}
@@ -0,0 +1,75 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include "frustum.hpp"
+
+// Bounding volume hierarchy over axis aligned boxes, one object per leaf. Built top-down
+// with a binned surface area heuristic, then kept up to date as objects move by refitting
+// the ancestors of what moved and rotating the nodes along the way (Kopta et al. 2012), so
+// that the tree stays good without being rebuilt.
+// Objects are referred to by their index in the boxes given to buildBvh.
+
+#define BVH_NONE (-1)
+
+struct BvhNode {
+	glm::vec3 boxMin;
+	int parent;         // BVH_NONE for the root
+	glm::vec3 boxMax;
+	int object;         // For leaves, BVH_NONE for inner nodes
+	int children[2];    // For inner nodes
+};
+
+struct Bvh {
+	std::vector<BvhNode> nodes;
+	std::vector<int> objectLeaves; // Leaf of each object
+	int root;
+	float margin;       // Leaf boxes are this much larger than their object's box
+};
+
+// margin : objects moving less than this don't touch the tree, see updateBvhObject
+void buildBvh(
+	Bvh & out_bvh,
+	const std::vector<glm::vec3> & boxMins,
+	const std::vector<glm::vec3> & boxMaxs,
+	float margin = 0.0f
+);
+
+// Gives an object a new box. Only if it left its leaf box : then the leaf gets the new box,
+// its ancestors are refitted and rotated. Returns whether the tree changed.
+bool updateBvhObject(Bvh & bvh, int object, const glm::vec3 & boxMin, const glm::vec3 & boxMax);
+
+// Gives every object a new box, without rotations, for when most of them moved. The tree
+// keeps its shape : after large motions getBvhCost tells when to build it again.
+void refitBvh(Bvh & bvh, const std::vector<glm::vec3> & boxMins, const std::vector<glm::vec3> & boxMaxs);
+
+// Sum of the surface areas of the inner nodes over that of the root : the expected number
+// of inner nodes a random ray visits. Lower is better.
+float getBvhCost(const Bvh & bvh);
+
+// Appends the objects whose leaf box intersects the frustum to out_objects, or might (see
+// cullBoxes). Whole subtrees inside the frustum are taken without testing their leaves.
+// Returns the number of objects appended.
+size_t queryBvhFrustum(const Bvh & bvh, const Frustum & frustum, std::vector<int> & out_objects);
+
+// Appends the objects whose leaf box overlaps the box to out_objects.
+// Returns the number of objects appended.
+size_t queryBvhBox(const Bvh & bvh, const glm::vec3 & boxMin, const glm::vec3 & boxMax, std::vector<int> & out_objects);
+
+// Exact test against an object whose leaf box the ray hits. Returns true on a hit closer than
+// inout_distance, which it then sets.
+typedef bool (*BvhRayTest)(void * context, int object, const glm::vec3 & origin, const glm::vec3 & direction, float & inout_distance);
+
+// Nearest object along the ray, within maxDistance. Leaves are visited from the closest,
+// and skipped once a hit is closer than their box. With a null test, hits are on the leaf
+// boxes. Returns the object, or BVH_NONE.
+int raycastBvh(
+	const Bvh & bvh,
+	const glm::vec3 & origin,
+	const glm::vec3 & direction,
+	float maxDistance,
+	float & out_distance,
+	BvhRayTest test = NULL,
+	void * context = NULL
+);
+
+#endif
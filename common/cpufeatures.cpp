@@ -0,0 +1,71 @@
+#include "cpufeatures.hpp"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#define CPUFEATURES_X86
+	#include <intrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define CPUFEATURES_X86
+	#include <cpuid.h>
+#endif
+
+#ifdef CPUFEATURES_X86
+
+static void cpuid(int leaf, unsigned int out_info[4]){
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, leaf, 0);
+	for ( int i=0; i<4; i++ )
+		out_info[i] = (unsigned int)info[i];
+#else
+	__cpuid_count(leaf, 0, out_info[0], out_info[1], out_info[2], out_info[3]);
+#endif
+}
+
+// The registers the OS saves on a context switch. Only valid when cpuid reports OSXSAVE.
+static unsigned long long xgetbv(){
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static CpuFeatures detectCpuFeatures(){
+	CpuFeatures features = { false, false, false, false };
+	unsigned int info[4];
+	cpuid(0, info);
+	unsigned int maxLeaf = info[0];
+	if ( maxLeaf < 1 )
+		return features;
+
+	cpuid(1, info);
+	features.sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	// XMM and YMM state
+	bool ymmSaved = osxsave && (xgetbv() & 6) == 6;
+	features.avx = avx && ymmSaved;
+	features.fma = fma && features.avx;
+	if ( maxLeaf >= 7 ){
+		cpuid(7, info);
+		features.avx2 = (info[1] & (1 << 5)) != 0 && features.avx;
+	}
+	return features;
+}
+
+#else
+
+static CpuFeatures detectCpuFeatures(){
+	CpuFeatures features = { false, false, false, false };
+	return features;
+}
+
+#endif
+
+const CpuFeatures & getCpuFeatures(){
+	static CpuFeatures features = detectCpuFeatures();
+	return features;
+}
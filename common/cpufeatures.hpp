@@ -0,0 +1,17 @@
+#ifndef CPUFEATURES_HPP
+#define CPUFEATURES_HPP
+
+// The instruction sets of the processor the program runs on, beyond the ones the compiler
+// targets, for the functions that pick an SSE or AVX path at run time. Read once with
+// cpuid; AVX and what needs it count only when the OS saves the YMM registers too.
+// All false on other processors than x86.
+struct CpuFeatures {
+	bool sse2;
+	bool avx;
+	bool avx2;
+	bool fma;
+};
+
+const CpuFeatures & getCpuFeatures();
+
+#endif
@@ -0,0 +1,226 @@
+#include <vector>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "culling.hpp"
+#include "cpufeatures.hpp"
+
+// SSE is part of x86-64, AVX is checked at run time. Functions using wider instructions
+// than the compiler targets are marked for GCC and Clang, MSVC takes them anyway.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#define CULLING_X86
+	#define CULLING_TARGET(isa)
+	#include <immintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define CULLING_X86
+	#define CULLING_TARGET(isa) __attribute__((target(isa)))
+	#include <immintrin.h>
+#endif
+
+void resizeBoxArrays(BoxArrays & boxes, size_t count){
+	boxes.centerX.resize(count);
+	boxes.centerY.resize(count);
+	boxes.centerZ.resize(count);
+	boxes.extentX.resize(count);
+	boxes.extentY.resize(count);
+	boxes.extentZ.resize(count);
+}
+
+void setBox(BoxArrays & boxes, size_t index, const glm::vec3 & center, const glm::vec3 & extent){
+	boxes.centerX[index] = center.x;
+	boxes.centerY[index] = center.y;
+	boxes.centerZ[index] = center.z;
+	boxes.extentX[index] = extent.x;
+	boxes.extentY[index] = extent.y;
+	boxes.extentZ[index] = extent.z;
+}
+
+void transformBox(
+	const glm::mat4 & m,
+	const glm::vec3 & boxMin,
+	const glm::vec3 & boxMax,
+	glm::vec3 & out_center,
+	glm::vec3 & out_extent
+){
+	glm::vec3 center = (boxMin + boxMax) * 0.5f;
+	glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+	out_center = glm::vec3(m * glm::vec4(center, 1.0f));
+	// Each new half extent is the sum of the old ones, projected on the new axis
+	out_extent =
+		glm::abs(glm::vec3(m[0])) * extent.x +
+		glm::abs(glm::vec3(m[1])) * extent.y +
+		glm::abs(glm::vec3(m[2])) * extent.z;
+}
+
+CullingPath getCullingPath(){
+#ifdef CULLING_X86
+	return getCpuFeatures().avx ? CULLING_PATH_AVX : CULLING_PATH_SSE;
+#else
+	return CULLING_PATH_SCALAR;
+#endif
+}
+
+const char * getCullingPathName(CullingPath path){
+	switch ( path ){
+		case CULLING_PATH_AVX: return "AVX";
+		case CULLING_PATH_SSE: return "SSE";
+		default:               return "scalar";
+	}
+}
+
+// A box is outside when it is entirely behind one of the planes : the distance of its
+// center is below minus its extent projected on the plane normal.
+static size_t cullBoxesScalar(
+	const Frustum & frustum,
+	const BoxArrays & boxes,
+	size_t first,
+	size_t end,
+	unsigned char * out_visible
+){
+	size_t visibleCount = 0;
+	for ( size_t i=first; i<end; i++ ){
+		bool visible = true;
+		for ( int p=0; p<6; p++ ){
+			const glm::vec4 & plane = frustum.planes[p];
+			float distance = plane.x * boxes.centerX[i] + plane.y * boxes.centerY[i] + plane.z * boxes.centerZ[i] + plane.w;
+			float radius = fabsf(plane.x) * boxes.extentX[i] + fabsf(plane.y) * boxes.extentY[i] + fabsf(plane.z) * boxes.extentZ[i];
+			if ( distance + radius < 0.0f ){
+				visible = false;
+				break;
+			}
+		}
+		out_visible[i] = visible ? 1 : 0;
+		visibleCount += visible ? 1 : 0;
+	}
+	return visibleCount;
+}
+
+#ifdef CULLING_X86
+
+// Number of visible boxes in a 4 or 8 bit mask
+static const unsigned char BIT_COUNTS[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+CULLING_TARGET("sse2")
+static size_t cullBoxesSse(
+	const Frustum & frustum,
+	const BoxArrays & boxes,
+	size_t count,
+	unsigned char * out_visible
+){
+	__m128 planes[6][7];
+	for ( int p=0; p<6; p++ ){
+		const glm::vec4 & plane = frustum.planes[p];
+		planes[p][0] = _mm_set1_ps(plane.x);
+		planes[p][1] = _mm_set1_ps(plane.y);
+		planes[p][2] = _mm_set1_ps(plane.z);
+		planes[p][3] = _mm_set1_ps(plane.w);
+		planes[p][4] = _mm_set1_ps(fabsf(plane.x));
+		planes[p][5] = _mm_set1_ps(fabsf(plane.y));
+		planes[p][6] = _mm_set1_ps(fabsf(plane.z));
+	}
+
+	size_t visibleCount = 0;
+	size_t simdCount = count & ~size_t(3);
+	const __m128 zero = _mm_setzero_ps();
+	for ( size_t i=0; i<simdCount; i+=4 ){
+		__m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+		__m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+		__m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+		__m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+		__m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+
+		__m128 outside = _mm_setzero_ps();
+		for ( int p=0; p<6; p++ ){
+			const __m128 * plane = planes[p];
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(plane[0], cx), _mm_mul_ps(plane[1], cy)),
+				_mm_add_ps(_mm_mul_ps(plane[2], cz), plane[3])
+			);
+			__m128 radius = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(plane[4], ex), _mm_mul_ps(plane[5], ey)),
+				_mm_mul_ps(plane[6], ez)
+			);
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		int visible = ~_mm_movemask_ps(outside) & 0xF;
+		out_visible[i]     = (unsigned char)(visible & 1);
+		out_visible[i + 1] = (unsigned char)((visible >> 1) & 1);
+		out_visible[i + 2] = (unsigned char)((visible >> 2) & 1);
+		out_visible[i + 3] = (unsigned char)((visible >> 3) & 1);
+		visibleCount += BIT_COUNTS[visible];
+	}
+	return visibleCount + cullBoxesScalar(frustum, boxes, simdCount, count, out_visible);
+}
+
+CULLING_TARGET("avx")
+static size_t cullBoxesAvx(
+	const Frustum & frustum,
+	const BoxArrays & boxes,
+	size_t count,
+	unsigned char * out_visible
+){
+	__m256 planes[6][7];
+	for ( int p=0; p<6; p++ ){
+		const glm::vec4 & plane = frustum.planes[p];
+		planes[p][0] = _mm256_set1_ps(plane.x);
+		planes[p][1] = _mm256_set1_ps(plane.y);
+		planes[p][2] = _mm256_set1_ps(plane.z);
+		planes[p][3] = _mm256_set1_ps(plane.w);
+		planes[p][4] = _mm256_set1_ps(fabsf(plane.x));
+		planes[p][5] = _mm256_set1_ps(fabsf(plane.y));
+		planes[p][6] = _mm256_set1_ps(fabsf(plane.z));
+	}
+
+	size_t visibleCount = 0;
+	size_t simdCount = count & ~size_t(7);
+	const __m256 zero = _mm256_setzero_ps();
+	for ( size_t i=0; i<simdCount; i+=8 ){
+		__m256 cx = _mm256_loadu_ps(&boxes.centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&boxes.centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&boxes.extentX[i]);
+		__m256 ey = _mm256_loadu_ps(&boxes.extentY[i]);
+		__m256 ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+
+		__m256 outside = _mm256_setzero_ps();
+		for ( int p=0; p<6; p++ ){
+			const __m256 * plane = planes[p];
+			__m256 distance = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(plane[0], cx), _mm256_mul_ps(plane[1], cy)),
+				_mm256_add_ps(_mm256_mul_ps(plane[2], cz), plane[3])
+			);
+			__m256 radius = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(plane[4], ex), _mm256_mul_ps(plane[5], ey)),
+				_mm256_mul_ps(plane[6], ez)
+			);
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+		}
+
+		int visible = ~_mm256_movemask_ps(outside) & 0xFF;
+		for ( int k=0; k<8; k++ )
+			out_visible[i + k] = (unsigned char)((visible >> k) & 1);
+		visibleCount += BIT_COUNTS[visible & 0xF] + BIT_COUNTS[visible >> 4];
+	}
+	return visibleCount + cullBoxesScalar(frustum, boxes, simdCount, count, out_visible);
+}
+
+#endif
+
+size_t cullBoxes(
+	const Frustum & frustum,
+	const BoxArrays & boxes,
+	unsigned char * out_visible,
+	CullingPath path
+){
+	size_t count = boxes.centerX.size();
+#ifdef CULLING_X86
+	if ( path == CULLING_PATH_AVX && getCullingPath() == CULLING_PATH_AVX )
+		return cullBoxesAvx(frustum, boxes, count, out_visible);
+	if ( path != CULLING_PATH_SCALAR )
+		return cullBoxesSse(frustum, boxes, count, out_visible);
+#endif
+	return cullBoxesScalar(frustum, boxes, 0, count, out_visible);
+}
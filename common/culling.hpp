@@ -0,0 +1,47 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+#include "frustum.hpp"
+
+// Axis aligned boxes as centers and half extents, one array per component, so that the
+// frustum test loads 4 or 8 boxes at once.
+struct BoxArrays {
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+};
+
+void resizeBoxArrays(BoxArrays & boxes, size_t count);
+
+void setBox(BoxArrays & boxes, size_t index, const glm::vec3 & center, const glm::vec3 & extent);
+
+// The axis aligned box around a box transformed by m (Arvo)
+void transformBox(
+	const glm::mat4 & m,
+	const glm::vec3 & boxMin,
+	const glm::vec3 & boxMax,
+	glm::vec3 & out_center,
+	glm::vec3 & out_extent
+);
+
+enum CullingPath {
+	CULLING_PATH_SCALAR = 0,
+	CULLING_PATH_SSE = 1,    // 4 boxes at a time
+	CULLING_PATH_AVX = 2     // 8 boxes at a time
+};
+
+// The widest path this CPU runs, checked once
+CullingPath getCullingPath();
+
+const char * getCullingPathName(CullingPath path);
+
+// Sets out_visible[i] to 1 for the boxes that intersect the frustum, and to 0 for the
+// others. Conservative : a box just outside a corner of the frustum counts as visible.
+// out_visible holds one byte per box. Returns the number of visible boxes.
+size_t cullBoxes(
+	const Frustum & frustum,
+	const BoxArrays & boxes,
+	unsigned char * out_visible,
+	CullingPath path = getCullingPath()
+);
+
+#endif
@@ -0,0 +1,203 @@
+#include <vector>
+#include <string>
+#include <set>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include "filewatcher.hpp"
+
+struct WatchedFile {
+	std::string path;
+	std::string directory;
+	std::string name;
+	int watch;               // inotify watch of the directory, -1 when polling
+	long long modifiedTime;  // Polling only
+};
+
+struct FileWatcher {
+	std::vector<WatchedFile> files;
+	std::thread thread;
+	std::atomic<bool> stopping;
+
+	// changed is set whenever changedPaths isn't empty, so that the main thread
+	// only takes the lock when there is something to take
+	std::atomic<bool> changed;
+	std::mutex mutex;
+	std::set<std::string> changedPaths;
+
+	int inotifyFile;         // -1 when polling
+	int stopPipe[2];         // Wakes the inotify thread up to stop it
+};
+
+static void markChanged(FileWatcher * watcher, const std::string & path){
+	std::lock_guard<std::mutex> lock(watcher->mutex);
+	watcher->changedPaths.insert(path);
+	watcher->changed.store(true, std::memory_order_release);
+}
+
+static long long getModifiedTime(const std::string & path){
+	struct stat st;
+	if ( stat(path.c_str(), &st) != 0 )
+		return -1;
+	return (long long)st.st_mtime;
+}
+
+// Fallback : compares the modification times a few times per second
+static void pollFiles(FileWatcher * watcher){
+	while ( !watcher->stopping.load() ){
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		for ( size_t i=0; i<watcher->files.size(); i++ ){
+			WatchedFile & file = watcher->files[i];
+			long long modifiedTime = getModifiedTime(file.path);
+			if ( modifiedTime != file.modifiedTime ){
+				file.modifiedTime = modifiedTime;
+				if ( modifiedTime != -1 )
+					markChanged(watcher, file.path);
+			}
+		}
+	}
+}
+
+#ifdef __linux__
+
+static void readInotifyEvents(FileWatcher * watcher){
+	// Events are variable length, but always aligned like inotify_event
+	struct inotify_event aligned[256];
+	char * buffer = (char *)aligned;
+
+	struct pollfd files[2];
+	files[0].fd = watcher->inotifyFile;
+	files[0].events = POLLIN;
+	files[1].fd = watcher->stopPipe[0];
+	files[1].events = POLLIN;
+
+	for (;;){
+		files[0].revents = 0;
+		files[1].revents = 0;
+		if ( poll(files, 2, -1) < 0 ){
+			if ( errno == EINTR )
+				continue;
+			return;
+		}
+		if ( files[1].revents != 0 || watcher->stopping.load() )
+			return;
+
+		ssize_t length = read(watcher->inotifyFile, buffer, sizeof(aligned));
+		if ( length <= 0 )
+			continue;
+
+		for ( char * p = buffer; p < buffer + length; ){
+			const struct inotify_event * event = (const struct inotify_event *)p;
+			p += sizeof(struct inotify_event) + event->len;
+			if ( event->len == 0 )
+				continue;
+			for ( size_t i=0; i<watcher->files.size(); i++ ){
+				const WatchedFile & file = watcher->files[i];
+				if ( file.watch == event->wd && file.name == event->name )
+					markChanged(watcher, file.path);
+			}
+		}
+	}
+}
+
+// Returns false if inotify isn't available, to fall back to polling
+static bool startInotify(FileWatcher * watcher){
+	watcher->inotifyFile = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if ( watcher->inotifyFile < 0 )
+		return false;
+	if ( pipe(watcher->stopPipe) != 0 ){
+		close(watcher->inotifyFile);
+		watcher->inotifyFile = -1;
+		return false;
+	}
+
+	// Written and closed, or renamed over the old file
+	for ( size_t i=0; i<watcher->files.size(); i++ ){
+		WatchedFile & file = watcher->files[i];
+		file.watch = inotify_add_watch(watcher->inotifyFile, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if ( file.watch < 0 )
+			printf("Can't watch %s for changes\n", file.path.c_str());
+	}
+
+	watcher->thread = std::thread(readInotifyEvents, watcher);
+	return true;
+}
+
+static void stopInotify(FileWatcher * watcher){
+	char wake = 0;
+	if ( write(watcher->stopPipe[1], &wake, 1) != 1 )
+		printf("Could not wake the file watcher up\n");
+	watcher->thread.join();
+	close(watcher->stopPipe[0]);
+	close(watcher->stopPipe[1]);
+	close(watcher->inotifyFile);
+}
+
+#endif
+
+FileWatcher * createFileWatcher(const std::vector<std::string> & paths){
+	FileWatcher * watcher = new FileWatcher();
+	watcher->stopping.store(false);
+	watcher->changed.store(false);
+	watcher->inotifyFile = -1;
+	watcher->stopPipe[0] = -1;
+	watcher->stopPipe[1] = -1;
+
+	for ( size_t i=0; i<paths.size(); i++ ){
+		WatchedFile file;
+		file.path = paths[i];
+		size_t separator = file.path.find_last_of("/\\");
+		file.directory = separator == std::string::npos ? std::string(".") : file.path.substr(0, separator + 1);
+		file.name = separator == std::string::npos ? file.path : file.path.substr(separator + 1);
+		file.watch = -1;
+		file.modifiedTime = getModifiedTime(file.path);
+		watcher->files.push_back(file);
+	}
+
+#ifdef __linux__
+	if ( startInotify(watcher) )
+		return watcher;
+#endif
+	watcher->thread = std::thread(pollFiles, watcher);
+	return watcher;
+}
+
+bool takeChangedFiles(FileWatcher * watcher, std::vector<std::string> & out_paths){
+	if ( !watcher->changed.load(std::memory_order_acquire) )
+		return false;
+
+	std::lock_guard<std::mutex> lock(watcher->mutex);
+	out_paths.insert(out_paths.end(), watcher->changedPaths.begin(), watcher->changedPaths.end());
+	watcher->changedPaths.clear();
+	watcher->changed.store(false, std::memory_order_relaxed);
+	return !out_paths.empty();
+}
+
+void destroyFileWatcher(FileWatcher * watcher){
+	if ( !watcher )
+		return;
+	watcher->stopping.store(true);
+#ifdef __linux__
+	if ( watcher->inotifyFile >= 0 ){
+		stopInotify(watcher);
+		delete watcher;
+		return;
+	}
+#endif
+	watcher->thread.join();
+	delete watcher;
+}
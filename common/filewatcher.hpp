@@ -0,0 +1,21 @@
+#ifndef FILEWATCHER_HPP
+#define FILEWATCHER_HPP
+
+// Watches a set of files from a background thread : inotify on Linux, polling the
+// modification times elsewhere. Directories are watched rather than the files, so that
+// editors that save by renaming a new file over the old one are seen too.
+// Checking for changes costs one atomic load until something is actually written.
+
+struct FileWatcher;
+
+// Files that don't exist yet are reported once they are created
+FileWatcher * createFileWatcher(const std::vector<std::string> & paths);
+
+// Moves the paths written since the last call to out_paths. Returns false, without
+// touching out_paths or taking any lock, if nothing changed.
+bool takeChangedFiles(FileWatcher * watcher, std::vector<std::string> & out_paths);
+
+// Stops the thread. Safe to call with NULL.
+void destroyFileWatcher(FileWatcher * watcher);
+
+#endif
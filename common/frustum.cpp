@@ -0,0 +1,34 @@
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+void extractFrustum(const glm::mat4 & viewProjection, Frustum & out_frustum){
+	// glm is column major : row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+	const glm::mat4 & m = viewProjection;
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	out_frustum.planes[0] = row3 + row0;
+	out_frustum.planes[1] = row3 - row0;
+	out_frustum.planes[2] = row3 + row1;
+	out_frustum.planes[3] = row3 - row1;
+	out_frustum.planes[4] = row3 + row2;
+	out_frustum.planes[5] = row3 - row2;
+
+	for ( int i=0; i<6; i++ ){
+		float length = glm::length(glm::vec3(out_frustum.planes[i]));
+		if ( length > 0.0f )
+			out_frustum.planes[i] /= length;
+	}
+}
+
+bool isSphereInFrustum(const Frustum & frustum, const glm::vec3 & center, float radius){
+	for ( int i=0; i<6; i++ ){
+		const glm::vec4 & plane = frustum.planes[i];
+		if ( glm::dot(glm::vec3(plane), center) + plane.w < -radius )
+			return false;
+	}
+	return true;
+}
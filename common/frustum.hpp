@@ -0,0 +1,17 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+// The 6 planes of a view frustum, pointing inwards : a point p is inside
+// if dot(plane.xyz, p) + plane.w >= 0 for all of them.
+// Extracted from a model-view-projection matrix, the planes are in model space.
+struct Frustum {
+	glm::vec4 planes[6]; // Left, right, bottom, top, near, far
+};
+
+// Gribb & Hartmann. The planes are normalized, so that distances are in world units.
+void extractFrustum(const glm::mat4 & viewProjection, Frustum & out_frustum);
+
+// Conservative : may say true for spheres that are just outside a corner
+bool isSphereInFrustum(const Frustum & frustum, const glm::vec3 & center, float radius);
+
+#endif
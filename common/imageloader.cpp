@@ -0,0 +1,993 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "mappedfile.hpp"
+#include "texture.hpp"
+#include "imageloader.hpp"
+#include "cpufeatures.hpp"
+
+// SSE2 is part of x86-64, and checked at run time for 32 bit x86. Functions using it are
+// marked for GCC and Clang on 32 bit x86, MSVC takes them anyway.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#define IMAGE_X86
+	#define IMAGE_TARGET(isa)
+	#include <emmintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define IMAGE_X86
+	#define IMAGE_TARGET(isa) __attribute__((target(isa)))
+	#include <emmintrin.h>
+#endif
+
+// Scratch buffers kept for the next images, at most. They keep their size : most images
+// of a program are the same size, and only the first allocates. Larger buffers than
+// IMAGE_SCRATCH_MAX_SIZE are freed rather than kept.
+#define IMAGE_SCRATCH_POOL_SIZE 8
+#define IMAGE_SCRATCH_MAX_SIZE (64 << 20)
+
+// Larger images would not fit the offsets of TextureData, levels included
+#define IMAGE_MAX_TEXELS (1u << 28)
+
+static std::mutex scratchMutex;
+static std::vector< std::vector<unsigned char>* > scratchPool;
+
+static std::vector<unsigned char> * acquireScratch(size_t size){
+	std::vector<unsigned char> * buffer = NULL;
+	{
+		std::lock_guard<std::mutex> lock(scratchMutex);
+		if ( !scratchPool.empty() ){
+			buffer = scratchPool.back();
+			scratchPool.pop_back();
+		}
+	}
+	if ( buffer == NULL )
+		buffer = new std::vector<unsigned char>();
+	// Never shrunk, so that growing again doesn't clear what's already there
+	if ( buffer->size() < size )
+		buffer->resize(size);
+	return buffer;
+}
+
+static void releaseScratch(std::vector<unsigned char> * buffer){
+	if ( buffer == NULL )
+		return;
+	{
+		std::lock_guard<std::mutex> lock(scratchMutex);
+		if ( scratchPool.size() < IMAGE_SCRATCH_POOL_SIZE && buffer->size() <= IMAGE_SCRATCH_MAX_SIZE ){
+			scratchPool.push_back(buffer);
+			return;
+		}
+	}
+	delete buffer;
+}
+
+// Headers are read byte by byte : fields aren't aligned, and BMP and TGA are little endian
+static unsigned int readU16(const unsigned char * p){
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned int readU32(const unsigned char * p){
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned int readU32BigEndian(const unsigned char * p){
+	return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static int getChannelCount(GLenum format){
+	return format == GL_RGB || format == GL_BGR ? 3 : 4;
+}
+
+unsigned int getImageRowStride(const Image & image){
+	return getTextureRowStride(image.width, getChannelCount(image.format));
+}
+
+static bool checkImageSize(unsigned int width, unsigned int height){
+	return width > 0 && height > 0 && width <= 65536 && height <= 65536 && (uint64_t)width * height <= IMAGE_MAX_TEXELS;
+}
+
+// The scratch buffer the decoders write level 0 into
+static unsigned char * allocatePixels(Image & image){
+	image.buffer = acquireScratch((size_t)getImageRowStride(image) * image.height);
+	image.pixels = &(*image.buffer)[0];
+	return &(*image.buffer)[0];
+}
+
+
+
+// BMP : uncompressed only, which is most of them
+
+#define BMP_RGB       0
+#define BMP_BITFIELDS 3
+
+static bool readBMPImage(const unsigned char * data, size_t size, Image & out_image){
+	if ( size < 54 ){
+		printf("Not a correct BMP file\n");
+		return false;
+	}
+	unsigned int dataPos     = readU32(data + 0x0A);
+	unsigned int headerSize  = readU32(data + 0x0E);
+	int width                = (int)readU32(data + 0x12);
+	int height               = (int)readU32(data + 0x16);
+	unsigned int bitCount    = readU16(data + 0x1C);
+	unsigned int compression = readU32(data + 0x1E);
+	unsigned int colorCount  = readU32(data + 0x2E);
+
+	// Rows go down the image when the height is negative
+	bool topDown = height < 0;
+	if ( topDown )
+		height = -height;
+	if ( headerSize < 40 || headerSize > size - 14 || width <= 0 || !checkImageSize(width, height) ){
+		printf("Not a correct BMP file\n");
+		return false;
+	}
+
+	bool alpha = false;
+	if ( compression == BMP_BITFIELDS && bitCount == 32 ){
+		// Masks follow a 40 byte header, and are part of the larger ones
+		if ( 14 + 40 + 12 > size || readU32(data + 0x36) != 0x00FF0000 || readU32(data + 0x3A) != 0x0000FF00 || readU32(data + 0x3E) != 0x000000FF ){
+			printf("Only BGRA bit fields are supported in BMP files\n");
+			return false;
+		}
+		alpha = headerSize >= 56 && readU32(data + 0x42) == 0xFF000000;
+	}
+	else if ( compression != BMP_RGB ){
+		printf("Compressed BMP files aren't supported\n");
+		return false;
+	}
+	if ( bitCount != 8 && bitCount != 24 && bitCount != 32 ){
+		printf("%u bit BMP files aren't supported, only 8, 24 and 32\n", bitCount);
+		return false;
+	}
+
+	// The palette of 8 bit files, BGRX colors after the header
+	if ( colorCount == 0 || colorCount > 256 )
+		colorCount = 256;
+	const unsigned char * palette = data + 14 + headerSize;
+	if ( bitCount == 8 && (size_t)(palette - data) + colorCount * 4 > size ){
+		printf("Not a correct BMP file\n");
+		return false;
+	}
+
+	// Some BMP files are misformatted, guess missing information
+	if ( dataPos == 0 )
+		dataPos = 14 + headerSize + (bitCount == 8 ? colorCount * 4 : 0) + (compression == BMP_BITFIELDS && headerSize == 40 ? 12 : 0);
+	unsigned int srcStride = ((width * bitCount + 31) / 32) * 4;
+	if ( dataPos > size || (size - dataPos) / srcStride < (size_t)height ){
+		printf("Not a correct BMP file\n");
+		return false;
+	}
+
+	out_image.width = width;
+	out_image.height = height;
+	out_image.internalFormat = alpha ? GL_RGBA : GL_RGB;
+	out_image.format = bitCount == 32 ? GL_BGRA : GL_BGR;
+	const unsigned char * src = data + dataPos;
+
+	// BMP rows are padded to 4 bytes as well : in place, unless upside down
+	if ( bitCount != 8 && !topDown ){
+		out_image.pixels = src;
+		out_image.mapped = true;
+		return true;
+	}
+
+	unsigned char * pixels = allocatePixels(out_image);
+	unsigned int stride = getImageRowStride(out_image);
+	for ( int y=0; y<height; y++ ){
+		const unsigned char * srcRow = src + (size_t)(topDown ? height - 1 - y : y) * srcStride;
+		unsigned char * row = pixels + (size_t)y * stride;
+		if ( bitCount != 8 ){
+			memcpy(row, srcRow, width * (bitCount / 8));
+			continue;
+		}
+		for ( int x=0; x<width; x++ ){
+			unsigned int index = srcRow[x];
+			const unsigned char * color = palette + (index < colorCount ? index : 0) * 4;
+			row[x*3 + 0] = color[0];
+			row[x*3 + 1] = color[1];
+			row[x*3 + 2] = color[2];
+		}
+	}
+	return true;
+}
+
+
+
+// TGA : true color, grey and color mapped, raw or run length encoded
+
+#define TGA_COLOR_MAPPED 1
+#define TGA_TRUE_COLOR   2
+#define TGA_GREY         3
+#define TGA_RLE          8
+
+static bool readTGAImage(const unsigned char * data, size_t size, Image & out_image){
+	if ( size < 18 ){
+		printf("Not a correct TGA file\n");
+		return false;
+	}
+	unsigned int idLength       = data[0];
+	unsigned int colorMapType   = data[1];
+	unsigned int imageType      = data[2];
+	unsigned int colorMapFirst  = readU16(data + 3);
+	unsigned int colorMapLength = readU16(data + 5);
+	unsigned int colorMapBits   = data[7];
+	unsigned int width          = readU16(data + 12);
+	unsigned int height         = readU16(data + 14);
+	unsigned int bitCount       = data[16];
+	unsigned int descriptor     = data[17];
+
+	bool rle = (imageType & TGA_RLE) != 0;
+	unsigned int kind = imageType & ~TGA_RLE;
+	bool supported =
+		(kind == TGA_TRUE_COLOR && (bitCount == 24 || bitCount == 32)) ||
+		(kind == TGA_GREY && bitCount == 8) ||
+		(kind == TGA_COLOR_MAPPED && bitCount == 8 && colorMapType == 1 && (colorMapBits == 24 || colorMapBits == 32));
+	if ( !supported || (descriptor & 0x10) != 0 ){
+		printf("Only 24 and 32 bit, grey and 8 bit color mapped TGA files are supported\n");
+		return false;
+	}
+	if ( !checkImageSize(width, height) ){
+		printf("Not a correct TGA file\n");
+		return false;
+	}
+
+	const unsigned char * palette = data + 18 + idLength;
+	size_t paletteSize = colorMapType == 1 ? (size_t)colorMapLength * ((colorMapBits + 7) / 8) : 0;
+	const unsigned char * src = palette + paletteSize;
+	const unsigned char * end = data + size;
+	if ( src > end ){
+		printf("Not a correct TGA file\n");
+		return false;
+	}
+
+	unsigned int srcBytes = bitCount / 8;
+	unsigned int channels = kind == TGA_TRUE_COLOR ? srcBytes : kind == TGA_COLOR_MAPPED ? colorMapBits / 8 : 3;
+	bool topOrigin = (descriptor & 0x20) != 0;
+	out_image.width = width;
+	out_image.height = height;
+	out_image.internalFormat = channels == 4 && (descriptor & 0x0F) != 0 ? GL_RGBA : GL_RGB;
+	out_image.format = channels == 4 ? GL_BGRA : GL_BGR;
+	// A packet of 1 + srcBytes bytes gives 128 texels at most
+	size_t available = (size_t)(end - src) / (rle ? 1 + srcBytes : srcBytes) * (rle ? 128 : 1);
+	if ( available / width < height ){
+		printf("Not a correct TGA file\n");
+		return false;
+	}
+
+	// Rows aren't padded : in place when they are a multiple of 4 bytes anyway
+	if ( kind == TGA_TRUE_COLOR && !rle && !topOrigin && (width * srcBytes) % 4 == 0 ){
+		out_image.pixels = src;
+		out_image.mapped = true;
+		return true;
+	}
+
+	unsigned char * pixels = allocatePixels(out_image);
+	unsigned int stride = getImageRowStride(out_image);
+	const unsigned char black[4] = { 0, 0, 0, 0 };
+	unsigned int packetLeft = 0;
+	bool packetRepeats = false;
+	const unsigned char * pixel = src;
+	for ( unsigned int y=0; y<height; y++ ){
+		unsigned char * row = pixels + (size_t)(topOrigin ? height - 1 - y : y) * stride;
+		for ( unsigned int x=0; x<width; x++ ){
+			// Packets run on from a row to the next
+			if ( rle ){
+				if ( packetLeft == 0 ){
+					if ( src >= end ){
+						printf("Not a correct TGA file\n");
+						return false;
+					}
+					packetLeft = (*src & 0x7F) + 1;
+					packetRepeats = (*src & 0x80) != 0;
+					src++;
+					if ( packetRepeats ){
+						pixel = src;
+						src += srcBytes;
+					}
+				}
+				if ( !packetRepeats ){
+					pixel = src;
+					src += srcBytes;
+				}
+				packetLeft--;
+				if ( src > end ){
+					printf("Not a correct TGA file\n");
+					return false;
+				}
+			}
+			else {
+				pixel = src;
+				src += srcBytes;
+			}
+
+			unsigned char * texel = row + x * channels;
+			if ( kind == TGA_GREY ){
+				texel[0] = texel[1] = texel[2] = pixel[0];
+				continue;
+			}
+			const unsigned char * color = pixel;
+			if ( kind == TGA_COLOR_MAPPED ){
+				unsigned int index = pixel[0] - colorMapFirst;
+				color = pixel[0] >= colorMapFirst && index < colorMapLength ? palette + index * channels : black;
+			}
+			texel[0] = color[0];
+			texel[1] = color[1];
+			texel[2] = color[2];
+			if ( channels == 4 )
+				texel[3] = color[3];
+		}
+	}
+	return true;
+}
+
+
+
+// PNG : every color type, not interlaced. Chunk CRCs and the zlib checksum aren't checked.
+
+static const unsigned char PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+#define PNG_GREY       0
+#define PNG_RGB        2
+#define PNG_PALETTE    3
+#define PNG_GREY_ALPHA 4
+#define PNG_RGBA       6
+
+// Bits read from the IDAT chunks as one stream, least significant first
+struct BitReader {
+	const std::pair<const unsigned char*, size_t> * chunks;
+	size_t chunkCount;
+	size_t chunk;
+	const unsigned char * next;
+	const unsigned char * end;
+	uint64_t bits;
+	unsigned int count;
+	unsigned int overrun;               // Zero bytes given past the end
+};
+
+static void refillBits(BitReader & reader){
+	// 8 bytes at once while the chunk has them : little endian only, as the rest
+	if ( reader.end - reader.next >= 8 ){
+		uint64_t word;
+		memcpy(&word, reader.next, 8);
+		reader.bits |= word << reader.count;
+		reader.next += (63 - reader.count) >> 3;
+		reader.count |= 56;
+		return;
+	}
+	while ( reader.count <= 56 ){
+		while ( reader.next == reader.end && reader.chunk + 1 < reader.chunkCount ){
+			reader.chunk++;
+			reader.next = reader.chunks[reader.chunk].first;
+			reader.end = reader.next + reader.chunks[reader.chunk].second;
+		}
+		uint64_t byte = 0;
+		if ( reader.next != reader.end )
+			byte = *reader.next++;
+		else
+			reader.overrun++;
+		reader.bits |= byte << reader.count;
+		reader.count += 8;
+	}
+}
+
+static unsigned int getBits(BitReader & reader, unsigned int count){
+	if ( reader.count < count )
+		refillBits(reader);
+	unsigned int value = (unsigned int)(reader.bits & ((1u << count) - 1));
+	reader.bits >>= count;
+	reader.count -= count;
+	return value;
+}
+
+// Codes up to HUFFMAN_FAST_BITS long are decoded with a single lookup, the others by
+// comparing against the last code of each length.
+#define HUFFMAN_FAST_BITS 10
+#define HUFFMAN_FAST_MASK ((1 << HUFFMAN_FAST_BITS) - 1)
+
+struct Huffman {
+	unsigned short fast[1 << HUFFMAN_FAST_BITS];  // symbol << 4 | length, 0 for longer codes
+	unsigned int firstCode[16];
+	unsigned int firstSymbol[16];
+	unsigned int maxCode[17];                       // Past the last code of each length, left aligned on 16 bits
+	unsigned short symbols[288];                    // In code order
+	unsigned int symbolCount;
+};
+
+static unsigned int reverseBits(unsigned int value, unsigned int count){
+	unsigned int reversed = 0;
+	for ( unsigned int i=0; i<count; i++ ){
+		reversed = (reversed << 1) | (value & 1);
+		value >>= 1;
+	}
+	return reversed;
+}
+
+static bool buildHuffman(Huffman & huffman, const unsigned char * lengths, unsigned int count){
+	unsigned int sizes[16] = { 0 };
+	for ( unsigned int i=0; i<count; i++ )
+		sizes[lengths[i]]++;
+	sizes[0] = 0;
+
+	unsigned int nextCode[16];
+	unsigned int code = 0;
+	unsigned int symbol = 0;
+	for ( unsigned int length=1; length<16; length++ ){
+		nextCode[length] = code;
+		huffman.firstCode[length] = code;
+		huffman.firstSymbol[length] = symbol;
+		code += sizes[length];
+		if ( code > (1u << length) )
+			return false;
+		huffman.maxCode[length] = code << (16 - length);
+		code <<= 1;
+		symbol += sizes[length];
+	}
+	huffman.maxCode[16] = 0x10000;
+	huffman.symbolCount = symbol;
+
+	memset(huffman.fast, 0, sizeof(huffman.fast));
+	for ( unsigned int i=0; i<count; i++ ){
+		unsigned int length = lengths[i];
+		if ( length == 0 )
+			continue;
+		unsigned int index = huffman.firstSymbol[length] + nextCode[length] - huffman.firstCode[length];
+		huffman.symbols[index] = (unsigned short)i;
+		if ( length <= HUFFMAN_FAST_BITS ){
+			for ( unsigned int j=reverseBits(nextCode[length], length); j<(1u << HUFFMAN_FAST_BITS); j+=1u << length )
+				huffman.fast[j] = (unsigned short)((i << 4) | length);
+		}
+		nextCode[length]++;
+	}
+	return true;
+}
+
+// -1 for codes that aren't in the table
+static int decodeSymbol(BitReader & reader, const Huffman & huffman){
+	if ( reader.count < 16 )
+		refillBits(reader);
+	unsigned int entry = huffman.fast[reader.bits & HUFFMAN_FAST_MASK];
+	unsigned int length;
+	int symbol;
+	if ( entry != 0 ){
+		length = entry & 15;
+		symbol = entry >> 4;
+	}
+	else {
+		unsigned int code = reverseBits((unsigned int)(reader.bits & 0xFFFF), 16);
+		for ( length=HUFFMAN_FAST_BITS+1; length<16; length++ ){
+			if ( code < huffman.maxCode[length] )
+				break;
+		}
+		if ( length == 16 )
+			return -1;
+		unsigned int index = (code >> (16 - length)) - huffman.firstCode[length] + huffman.firstSymbol[length];
+		if ( index >= huffman.symbolCount )
+			return -1;
+		symbol = huffman.symbols[index];
+	}
+	reader.bits >>= length;
+	reader.count -= length;
+	return symbol;
+}
+
+static const unsigned short LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static bool readDynamicHuffman(BitReader & reader, Huffman & literals, Huffman & distances){
+	unsigned int literalCount  = getBits(reader, 5) + 257;
+	unsigned int distanceCount = getBits(reader, 5) + 1;
+	unsigned int lengthCount   = getBits(reader, 4) + 4;
+	// 5 bits can count past the codes that exist : such a stream is corrupt
+	if ( literalCount > 286 || distanceCount > 30 )
+		return false;
+	unsigned char codeLengths[19] = { 0 };
+	for ( unsigned int i=0; i<lengthCount; i++ )
+		codeLengths[CODE_LENGTH_ORDER[i]] = (unsigned char)getBits(reader, 3);
+	Huffman codeLengthHuffman;
+	if ( !buildHuffman(codeLengthHuffman, codeLengths, 19) )
+		return false;
+
+	// Literal and distance lengths are one sequence : repeats may cross from one to the other
+	unsigned char lengths[286 + 30];
+	unsigned int count = 0;
+	while ( count < literalCount + distanceCount ){
+		int symbol = decodeSymbol(reader, codeLengthHuffman);
+		unsigned int repeat;
+		unsigned char length = 0;
+		if ( symbol < 0 )
+			return false;
+		if ( symbol < 16 ){
+			lengths[count++] = (unsigned char)symbol;
+			continue;
+		}
+		if ( symbol == 16 ){
+			if ( count == 0 )
+				return false;
+			length = lengths[count - 1];
+			repeat = getBits(reader, 2) + 3;
+		}
+		else if ( symbol == 17 )
+			repeat = getBits(reader, 3) + 3;
+		else
+			repeat = getBits(reader, 7) + 11;
+		if ( count + repeat > literalCount + distanceCount )
+			return false;
+		memset(lengths + count, length, repeat);
+		count += repeat;
+	}
+	return buildHuffman(literals, lengths, literalCount) && buildHuffman(distances, lengths + literalCount, distanceCount);
+}
+
+static void buildFixedHuffman(Huffman & literals, Huffman & distances){
+	unsigned char lengths[288];
+	memset(lengths, 8, 144);
+	memset(lengths + 144, 9, 112);
+	memset(lengths + 256, 7, 24);
+	memset(lengths + 280, 8, 8);
+	buildHuffman(literals, lengths, 288);
+	memset(lengths, 5, 30);
+	buildHuffman(distances, lengths, 30);
+}
+
+static bool inflateStored(BitReader & reader, unsigned char * & out, unsigned char * outEnd){
+	getBits(reader, reader.count & 7);
+	unsigned int length = getBits(reader, 16);
+	unsigned int inverse = getBits(reader, 16);
+	if ( (length ^ 0xFFFF) != inverse || length > (size_t)(outEnd - out) )
+		return false;
+	// What the bit buffer holds first, then straight from the chunks
+	while ( length > 0 && reader.count >= 8 ){
+		*out++ = (unsigned char)getBits(reader, 8);
+		length--;
+	}
+	// Refills leave the bytes after next above count : they are skipped now
+	if ( reader.count == 0 )
+		reader.bits = 0;
+	while ( length > 0 ){
+		while ( reader.next == reader.end ){
+			if ( reader.chunk + 1 >= reader.chunkCount )
+				return false;
+			reader.chunk++;
+			reader.next = reader.chunks[reader.chunk].first;
+			reader.end = reader.next + reader.chunks[reader.chunk].second;
+		}
+		size_t count = (size_t)(reader.end - reader.next) < length ? (size_t)(reader.end - reader.next) : length;
+		memcpy(out, reader.next, count);
+		out += count;
+		reader.next += count;
+		length -= (unsigned int)count;
+	}
+	return true;
+}
+
+static bool inflateHuffman(BitReader & reader, const Huffman & literals, const Huffman & distances, unsigned char * outBegin, unsigned char * & out, unsigned char * outEnd){
+	for ( ;; ){
+		int symbol = decodeSymbol(reader, literals);
+		if ( symbol < 0 || reader.overrun > 8 )
+			return false;
+		if ( symbol < 256 ){
+			if ( out == outEnd )
+				return false;
+			*out++ = (unsigned char)symbol;
+			continue;
+		}
+		if ( symbol == 256 )
+			return true;
+
+		symbol -= 257;
+		if ( symbol >= 29 )
+			return false;
+		unsigned int length = LENGTH_BASE[symbol] + getBits(reader, LENGTH_EXTRA[symbol]);
+		int distanceSymbol = decodeSymbol(reader, distances);
+		if ( distanceSymbol < 0 || distanceSymbol >= 30 )
+			return false;
+		unsigned int distance = DISTANCE_BASE[distanceSymbol] + getBits(reader, DISTANCE_EXTRA[distanceSymbol]);
+		if ( distance > (size_t)(out - outBegin) || length > (size_t)(outEnd - out) )
+			return false;
+
+		const unsigned char * from = out - distance;
+		if ( distance >= length )
+			memcpy(out, from, length);
+		else if ( distance == 1 )
+			memset(out, *from, length);
+		else {
+			// Overlapping : the copy repeats what it just wrote
+			for ( unsigned int i=0; i<length; i++ )
+				out[i] = from[i];
+		}
+		out += length;
+	}
+}
+
+// Inflates a zlib stream into exactly outSize bytes
+static bool inflateZlib(const std::vector< std::pair<const unsigned char*, size_t> > & chunks, unsigned char * outBegin, size_t outSize){
+	BitReader reader;
+	reader.chunks = &chunks[0];
+	reader.chunkCount = chunks.size();
+	reader.chunk = 0;
+	reader.next = chunks[0].first;
+	reader.end = chunks[0].first + chunks[0].second;
+	reader.bits = 0;
+	reader.count = 0;
+	reader.overrun = 0;
+
+	unsigned int method = getBits(reader, 8);
+	unsigned int flags = getBits(reader, 8);
+	if ( (method & 15) != 8 || ((method << 8) | flags) % 31 != 0 || (flags & 0x20) != 0 )
+		return false;
+
+	unsigned char * out = outBegin;
+	unsigned char * outEnd = outBegin + outSize;
+	Huffman literals, distances;
+	bool last = false;
+	while ( !last ){
+		last = getBits(reader, 1) != 0;
+		unsigned int type = getBits(reader, 2);
+		bool inflated;
+		if ( type == 0 )
+			inflated = inflateStored(reader, out, outEnd);
+		else if ( type == 1 ){
+			buildFixedHuffman(literals, distances);
+			inflated = inflateHuffman(reader, literals, distances, outBegin, out, outEnd);
+		}
+		else if ( type == 2 )
+			inflated = readDynamicHuffman(reader, literals, distances) && inflateHuffman(reader, literals, distances, outBegin, out, outEnd);
+		else
+			inflated = false;
+		if ( !inflated )
+			return false;
+	}
+	return out == outEnd;
+}
+
+static unsigned char paethPredictor(int a, int b, int c){
+	int p = a + b - c;
+	int pa = p > a ? p - a : a - p;
+	int pb = p > b ? p - b : b - p;
+	int pc = p > c ? p - c : c - p;
+	if ( pa <= pb && pa <= pc )
+		return (unsigned char)a;
+	return (unsigned char)(pb <= pc ? b : c);
+}
+
+// out may be in : each byte is read before it is written. previous is the row above, unfiltered.
+static void unfilterRowScalar(unsigned int filter, const unsigned char * in, const unsigned char * previous, unsigned char * out, size_t rowSize, unsigned int texelSize){
+	size_t first = texelSize < rowSize ? texelSize : rowSize;
+	switch ( filter ){
+	case 0:
+		if ( out != in )
+			memcpy(out, in, rowSize);
+		break;
+	case 1:
+		if ( out != in )
+			memcpy(out, in, first);
+		for ( size_t i=first; i<rowSize; i++ )
+			out[i] = (unsigned char)(in[i] + out[i - texelSize]);
+		break;
+	case 2:
+		for ( size_t i=0; i<rowSize; i++ )
+			out[i] = (unsigned char)(in[i] + previous[i]);
+		break;
+	case 3:
+		for ( size_t i=0; i<first; i++ )
+			out[i] = (unsigned char)(in[i] + (previous[i] >> 1));
+		for ( size_t i=first; i<rowSize; i++ )
+			out[i] = (unsigned char)(in[i] + ((out[i - texelSize] + previous[i]) >> 1));
+		break;
+	case 4:
+		for ( size_t i=0; i<first; i++ )
+			out[i] = (unsigned char)(in[i] + previous[i]);
+		for ( size_t i=first; i<rowSize; i++ )
+			out[i] = (unsigned char)(in[i] + paethPredictor(out[i - texelSize], previous[i], previous[i - texelSize]));
+		break;
+	}
+}
+
+#ifdef IMAGE_X86
+
+// A texel of 3 or 4 bytes in the low lanes, without reading or writing past it. 3 byte texels
+// are read as 4 when there is a byte after them : the extra one is ignored.
+template <unsigned int TEXEL_SIZE>
+IMAGE_TARGET("sse2")
+static inline __m128i loadTexel(const unsigned char * p, bool lastTexel){
+	int value = 0;
+	if ( TEXEL_SIZE == 3 && lastTexel )
+		memcpy(&value, p, 3);
+	else
+		memcpy(&value, p, 4);
+	return _mm_cvtsi32_si128(value);
+}
+
+template <unsigned int TEXEL_SIZE>
+IMAGE_TARGET("sse2")
+static inline void storeTexel(unsigned char * p, __m128i texel){
+	int value = _mm_cvtsi128_si32(texel);
+	memcpy(p, &value, TEXEL_SIZE);
+}
+
+// Paeth is the slowest filter a byte at a time, and the one encoders pick most : a texel at
+// a time, its bytes side by side in 16 bits lanes, as libpng does. The others are as fast
+// as memory a byte at a time.
+template <unsigned int TEXEL_SIZE>
+IMAGE_TARGET("sse2")
+static void unpaethRowSse2(const unsigned char * in, const unsigned char * previous, unsigned char * out, size_t rowSize){
+	__m128i zero = _mm_setzero_si128();
+	__m128i a = zero;
+	__m128i c = zero;
+	for ( size_t i=0; i<rowSize; i+=TEXEL_SIZE ){
+		bool last = i + TEXEL_SIZE >= rowSize;
+		__m128i b = _mm_unpacklo_epi8(loadTexel<TEXEL_SIZE>(previous + i, last), zero);
+		__m128i a16 = _mm_unpacklo_epi8(a, zero);
+		// p - a = b - c, p - b = a - c, p - c = a + b - 2c
+		__m128i pa = _mm_sub_epi16(b, c);
+		__m128i pb = _mm_sub_epi16(a16, c);
+		__m128i pc = _mm_add_epi16(pa, pb);
+		pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+		pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+		pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+		// Ties go to a, then b
+		__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		__m128i isA = _mm_cmpeq_epi16(smallest, pa);
+		__m128i isB = _mm_andnot_si128(isA, _mm_cmpeq_epi16(smallest, pb));
+		__m128i isC = _mm_andnot_si128(_mm_or_si128(isA, isB), _mm_set1_epi16(-1));
+		__m128i predictor = _mm_or_si128(_mm_or_si128(_mm_and_si128(isA, a16), _mm_and_si128(isB, b)), _mm_and_si128(isC, c));
+		a = _mm_add_epi8(loadTexel<TEXEL_SIZE>(in + i, last), _mm_packus_epi16(predictor, predictor));
+		c = b;
+		storeTexel<TEXEL_SIZE>(out + i, a);
+	}
+}
+
+#endif
+
+static bool unfilterRow(unsigned int filter, const unsigned char * in, const unsigned char * previous, unsigned char * out, size_t rowSize, unsigned int texelSize){
+	if ( filter > 4 )
+		return false;
+#ifdef IMAGE_X86
+	if ( filter == 4 && texelSize == 3 && getCpuFeatures().sse2 ){
+		unpaethRowSse2<3>(in, previous, out, rowSize);
+		return true;
+	}
+	if ( filter == 4 && texelSize == 4 && getCpuFeatures().sse2 ){
+		unpaethRowSse2<4>(in, previous, out, rowSize);
+		return true;
+	}
+#endif
+	unfilterRowScalar(filter, in, previous, out, rowSize, texelSize);
+	return true;
+}
+
+// Sample index of a row of bitDepth bits samples, 16 bits ones cut to their high byte
+static unsigned int getSample(const unsigned char * row, size_t index, unsigned int bitDepth){
+	if ( bitDepth == 8 )
+		return row[index];
+	if ( bitDepth == 16 )
+		return row[index * 2];
+	size_t bit = index * bitDepth;
+	return (row[bit >> 3] >> (8 - bitDepth - (bit & 7))) & ((1u << bitDepth) - 1);
+}
+
+static bool readPNGImage(const unsigned char * data, size_t size, Image & out_image){
+	unsigned int width = 0, height = 0, bitDepth = 0, colorType = 0, interlace = 0;
+	const unsigned char * palette = NULL;
+	unsigned int paletteCount = 0;
+	const unsigned char * transparency = NULL;
+	unsigned int transparencyCount = 0;
+	std::vector< std::pair<const unsigned char*, size_t> > chunks;
+	size_t compressedSize = 0;
+
+	size_t position = 8;
+	bool ended = false;
+	while ( !ended ){
+		if ( size - position < 12 ){
+			printf("Not a correct PNG file\n");
+			return false;
+		}
+		unsigned int length = readU32BigEndian(data + position);
+		const unsigned char * type = data + position + 4;
+		const unsigned char * content = data + position + 8;
+		if ( length > size - position - 12 ){
+			printf("Not a correct PNG file\n");
+			return false;
+		}
+		if ( memcmp(type, "IHDR", 4) == 0 && length >= 13 ){
+			width     = readU32BigEndian(content);
+			height    = readU32BigEndian(content + 4);
+			bitDepth  = content[8];
+			colorType = content[9];
+			interlace = content[12];
+		}
+		else if ( memcmp(type, "PLTE", 4) == 0 ){
+			palette = content;
+			paletteCount = length / 3;
+		}
+		else if ( memcmp(type, "tRNS", 4) == 0 ){
+			transparency = content;
+			transparencyCount = length;
+		}
+		else if ( memcmp(type, "IDAT", 4) == 0 && length > 0 ){
+			chunks.push_back(std::make_pair(content, (size_t)length));
+			compressedSize += length;
+		}
+		else if ( memcmp(type, "IEND", 4) == 0 )
+			ended = true;
+		position += 12 + length;
+	}
+
+	unsigned int sampleCount;
+	switch ( colorType ){
+	case PNG_GREY:       sampleCount = 1; break;
+	case PNG_RGB:        sampleCount = 3; break;
+	case PNG_PALETTE:    sampleCount = 1; break;
+	case PNG_GREY_ALPHA: sampleCount = 2; break;
+	case PNG_RGBA:       sampleCount = 4; break;
+	default:             sampleCount = 0; break;
+	}
+	bool depthValid =
+		bitDepth == 8 ||
+		(bitDepth == 16 && colorType != PNG_PALETTE) ||
+		((bitDepth == 1 || bitDepth == 2 || bitDepth == 4) && (colorType == PNG_GREY || colorType == PNG_PALETTE));
+	if ( sampleCount == 0 || !depthValid || !checkImageSize(width, height) || chunks.empty() || (colorType == PNG_PALETTE && palette == NULL) ){
+		printf("Not a correct PNG file\n");
+		return false;
+	}
+	if ( interlace != 0 ){
+		printf("Interlaced PNG files aren't supported\n");
+		return false;
+	}
+
+	bool alpha = colorType == PNG_GREY_ALPHA || colorType == PNG_RGBA || (colorType == PNG_PALETTE && transparency != NULL);
+	out_image.width = width;
+	out_image.height = height;
+	out_image.internalFormat = alpha ? GL_RGBA : GL_RGB;
+	out_image.format = alpha ? GL_RGBA : GL_RGB;
+	unsigned int channels = alpha ? 4 : 3;
+
+	// Each row is a filter byte then the samples
+	size_t rowSize = ((size_t)width * sampleCount * bitDepth + 7) / 8;
+	unsigned int texelSize = sampleCount * bitDepth >= 8 ? sampleCount * bitDepth / 8 : 1;
+	// Deflate doesn't do better than 1032 to 1 : larger sizes are a broken header
+	if ( (rowSize + 1) * height / 1032 > compressedSize + 1 ){
+		printf("Not a correct PNG file\n");
+		return false;
+	}
+	std::vector<unsigned char> * inflated = acquireScratch((rowSize + 1) * height);
+	unsigned char * filtered = &(*inflated)[0];
+	if ( !inflateZlib(chunks, filtered, (rowSize + 1) * height) ){
+		releaseScratch(inflated);
+		printf("Not a correct PNG file\n");
+		return false;
+	}
+
+	// PNG rows go down the image
+	unsigned char * pixels = allocatePixels(out_image);
+	unsigned int stride = getImageRowStride(out_image);
+	std::vector<unsigned char> zeros(rowSize, 0);
+	bool direct = bitDepth == 8 && (colorType == PNG_RGB || colorType == PNG_RGBA);
+	const unsigned char * previous = &zeros[0];
+	for ( unsigned int y=0; y<height; y++ ){
+		unsigned char * in = filtered + y * (rowSize + 1);
+		unsigned char * row = pixels + (size_t)(height - 1 - y) * stride;
+
+		// 8 bit RGB(A) rows are the texels : unfiltered straight into place
+		unsigned char * out = direct ? row : in + 1;
+		if ( !unfilterRow(in[0], in + 1, previous, out, rowSize, texelSize) ){
+			releaseScratch(inflated);
+			printf("Not a correct PNG file\n");
+			return false;
+		}
+		previous = out;
+		if ( direct )
+			continue;
+
+		for ( unsigned int x=0; x<width; x++ ){
+			unsigned char * texel = row + x * channels;
+			if ( colorType == PNG_PALETTE ){
+				unsigned int index = getSample(out, x, bitDepth);
+				if ( index < paletteCount )
+					memcpy(texel, palette + index * 3, 3);
+				else
+					memset(texel, 0, 3);
+				if ( alpha )
+					texel[3] = index < transparencyCount ? transparency[index] : 255;
+			}
+			else if ( colorType == PNG_GREY || colorType == PNG_GREY_ALPHA ){
+				unsigned int grey = getSample(out, x * sampleCount, bitDepth);
+				if ( bitDepth < 8 )
+					grey = grey * 255 / ((1u << bitDepth) - 1);
+				texel[0] = texel[1] = texel[2] = (unsigned char)grey;
+				if ( alpha )
+					texel[3] = (unsigned char)getSample(out, x * 2 + 1, bitDepth);
+			}
+			else {
+				for ( unsigned int c=0; c<channels; c++ )
+					texel[c] = (unsigned char)getSample(out, x * channels + c, bitDepth);
+			}
+		}
+	}
+	releaseScratch(inflated);
+	return true;
+}
+
+
+
+static bool hasExtension(const char * path, const char * extension){
+	size_t length = strlen(path);
+	size_t extensionLength = strlen(extension);
+	if ( length < extensionLength )
+		return false;
+	for ( size_t i=0; i<extensionLength; i++ ){
+		char c = path[length - extensionLength + i];
+		if ( c >= 'A' && c <= 'Z' )
+			c = c - 'A' + 'a';
+		if ( c != extension[i] )
+			return false;
+	}
+	return true;
+}
+
+bool openImage(const char * imagepath, Image & out_image){
+
+	printf("Reading image %s\n", imagepath);
+
+	out_image.width = 0;
+	out_image.height = 0;
+	out_image.pixels = NULL;
+	out_image.mapped = false;
+	out_image.buffer = NULL;
+	if ( !mapFile(imagepath, out_image.file) ){
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+		return false;
+	}
+
+	// TGA files have no signature
+	const unsigned char * data = (const unsigned char *)out_image.file.data;
+	size_t size = out_image.file.size;
+	bool read;
+	if ( size >= 2 && data[0] == 'B' && data[1] == 'M' )
+		read = readBMPImage(data, size, out_image);
+	else if ( size >= 8 && memcmp(data, PNG_SIGNATURE, 8) == 0 )
+		read = readPNGImage(data, size, out_image);
+	else if ( hasExtension(imagepath, ".tga") )
+		read = readTGAImage(data, size, out_image);
+	else {
+		printf("%s is not a BMP, TGA or PNG file\n", imagepath);
+		read = false;
+	}
+
+	if ( !read )
+		closeImage(out_image);
+	// Decoded : the file isn't needed anymore
+	else if ( !out_image.mapped )
+		unmapFile(out_image.file);
+	return read;
+}
+
+void closeImage(Image & image){
+	unmapFile(image.file);
+	releaseScratch(image.buffer);
+	image.buffer = NULL;
+	image.pixels = NULL;
+	image.mapped = false;
+}
+
+void getImageTextureData(const Image & image, TextureData & out_data){
+	out_data.width = image.width;
+	out_data.height = image.height;
+	out_data.internalFormat = image.internalFormat;
+	out_data.format = image.format;
+	out_data.type = GL_UNSIGNED_BYTE;
+	out_data.levelOffsets.clear();
+	out_data.levelOffsets.push_back(0);
+	out_data.levelOffsets.push_back(getImageRowStride(image) * image.height);
+	out_data.pixels.clear();
+	out_data.fileOffset = image.mapped ? (unsigned int)(image.pixels - (const unsigned char *)image.file.data) : 0;
+	out_data.generateMipmaps = true;
+}
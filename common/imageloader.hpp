@@ -0,0 +1,41 @@
+#ifndef IMAGELOADER_HPP
+#define IMAGELOADER_HPP
+
+#include <vector>
+
+#include "mappedfile.hpp"
+
+// BMP (8, 24 and 32 bits, uncompressed), TGA (true color, grey and color mapped, RLE or
+// not) and PNG (8 and 16 bits, not interlaced) files, read through a mapping of the file.
+// Images stored the way OpenGL reads them are used in place; the others are decoded into a
+// scratch buffer taken from a pool, so that loading many images allocates once.
+
+struct TextureData;
+
+struct Image {
+	unsigned int width;
+	unsigned int height;
+	GLenum internalFormat;              // GL_RGB or GL_RGBA
+	GLenum format;                      // GL_BGR, GL_BGRA, GL_RGB or GL_RGBA, of GL_UNSIGNED_BYTE
+	const unsigned char * pixels;       // Bottom row first, rows padded to 4 bytes, as TextureData
+	bool mapped;                        // pixels are in the file itself
+
+	// Where pixels are, don't touch
+	MappedFile file;
+	std::vector<unsigned char> * buffer;
+};
+
+// Prints what went wrong and returns false. The image stays valid until closeImage.
+bool openImage(const char * imagepath, Image & out_image);
+
+// Unmaps the file and gives the scratch buffer back to the pool. Safe to call twice.
+void closeImage(Image & image);
+
+// Size of a row of pixels, padding included
+unsigned int getImageRowStride(const Image & image);
+
+// Everything but the pixels of level 0, which stay in image : for buildMipmaps and
+// createTexture with level0 = image.pixels.
+void getImageTextureData(const Image & image, TextureData & out_data);
+
+#endif
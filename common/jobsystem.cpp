@@ -0,0 +1,280 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "jobsystem.hpp"
+
+// Jobs a queue holds. Past that, runJob runs them right away.
+#define JOB_QUEUE_CAPACITY 4096
+
+struct Job {
+	JobFunction function;
+	void * data;
+	JobCounter * counter;
+	bool background;        // Started by runBackgroundJob, or by a background job : workers only
+};
+
+// Ring of jobs : the owner takes from the tail, thieves from the head.
+// Short critical sections, hence a spin lock.
+struct JobQueue {
+	std::atomic_flag lock;
+	unsigned int head;
+	unsigned int tail;
+	Job jobs[JOB_QUEUE_CAPACITY];
+};
+
+static std::vector<JobQueue*> queues;       // 0 : the thread that started the system, and any other
+static JobQueue * backgroundQueue;          // runBackgroundJob's, for the workers only
+static std::vector<std::thread> workers;
+static std::mutex startMutex;
+static std::atomic<bool> started(false);
+static std::atomic<bool> running(false);
+
+// Sleeping workers wake up when jobs are queued
+static std::atomic<int> queuedJobs(0);
+static std::atomic<int> sleepingWorkers(0);
+static std::mutex sleepMutex;
+static std::condition_variable wakeCondition;
+
+static thread_local unsigned int threadQueue = 0;
+static thread_local bool inBackgroundJob = false;
+
+static void lockQueue(JobQueue & queue){
+	while ( queue.lock.test_and_set(std::memory_order_acquire) )
+		std::this_thread::yield();
+}
+
+static void unlockQueue(JobQueue & queue){
+	queue.lock.clear(std::memory_order_release);
+}
+
+static bool pushJob(JobQueue & queue, const Job & job){
+	lockQueue(queue);
+	if ( queue.tail - queue.head == JOB_QUEUE_CAPACITY ){
+		unlockQueue(queue);
+		return false;
+	}
+	queue.jobs[queue.tail % JOB_QUEUE_CAPACITY] = job;
+	queue.tail++;
+	unlockQueue(queue);
+	return true;
+}
+
+// newest : the owner's end, or else the thieves' one.
+// background : whether a background job may be taken. If not, one at that end stops the pop.
+static bool popJob(JobQueue & queue, bool newest, bool background, Job & out_job){
+	lockQueue(queue);
+	unsigned int end = newest ? queue.tail - 1 : queue.head;
+	if ( queue.head == queue.tail || (!background && queue.jobs[end % JOB_QUEUE_CAPACITY].background) ){
+		unlockQueue(queue);
+		return false;
+	}
+	if ( newest ) out_job = queue.jobs[--queue.tail % JOB_QUEUE_CAPACITY];
+	else          out_job = queue.jobs[queue.head++ % JOB_QUEUE_CAPACITY];
+	unlockQueue(queue);
+	return true;
+}
+
+// The jobs a background job starts are background jobs too
+static void executeJob(const Job & job){
+	bool wasInBackgroundJob = inBackgroundJob;
+	inBackgroundJob = job.background;
+	job.function(job.data);
+	inBackgroundJob = wasInBackgroundJob;
+	job.counter->count.fetch_sub(1, std::memory_order_release);
+}
+
+// Runs a job of the thread's own queue, or else one stolen from another, or else the
+// oldest background job. Background jobs only run on workers. Returns false when there
+// was none.
+static bool runQueuedJob(unsigned int self){
+	Job job;
+	bool background = self != 0;
+	bool found = popJob(*queues[self], true, background, job);
+	for ( size_t i=1; !found && i<queues.size(); i++ )
+		found = popJob(*queues[(self + i) % queues.size()], false, background, job);
+	if ( !found && background )
+		found = popJob(*backgroundQueue, false, true, job);
+	if ( !found )
+		return false;
+	queuedJobs--;
+	executeJob(job);
+	return true;
+}
+
+static void runWorker(unsigned int self){
+	threadQueue = self;
+	while ( running.load() ){
+		// Jobs often come in bursts : look again for a while before sleeping
+		bool found = false;
+		for ( int attempt=0; attempt<64 && !found; attempt++ ){
+			found = runQueuedJob(self);
+			if ( !found ) std::this_thread::yield();
+		}
+		if ( found )
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingWorkers++;
+		while ( running.load() && queuedJobs.load() <= 0 )
+			wakeCondition.wait(lock);
+		sleepingWorkers--;
+	}
+}
+
+static JobQueue * createQueue(){
+	JobQueue * queue = new JobQueue;
+	queue->lock.clear();
+	queue->head = 0;
+	queue->tail = 0;
+	return queue;
+}
+
+static void ensureStarted(){
+	if ( !started.load(std::memory_order_acquire) )
+		startJobSystem();
+}
+
+void startJobSystem(unsigned int workerCount){
+	std::lock_guard<std::mutex> lock(startMutex);
+	if ( started.load() )
+		return;
+
+	// At least one worker, or jobs nobody waits for would never run
+	if ( workerCount == 0 ){
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 2 ? hardwareThreads - 1 : 1;
+	}
+	for ( unsigned int i=0; i<=workerCount; i++ )
+		queues.push_back(createQueue());
+	backgroundQueue = createQueue();
+	threadQueue = 0;
+	running = true;
+	for ( unsigned int i=1; i<=workerCount; i++ )
+		workers.push_back(std::thread(runWorker, i));
+	started.store(true, std::memory_order_release);
+}
+
+void stopJobSystem(){
+	std::lock_guard<std::mutex> lock(startMutex);
+	if ( !started.load() )
+		return;
+
+	while ( queuedJobs.load() > 0 ){
+		if ( !runQueuedJob(threadQueue) )
+			std::this_thread::yield();
+	}
+	{
+		std::lock_guard<std::mutex> sleepLock(sleepMutex);
+		running = false;
+		wakeCondition.notify_all();
+	}
+	for ( size_t i=0; i<workers.size(); i++ )
+		workers[i].join();
+	workers.clear();
+	for ( size_t i=0; i<queues.size(); i++ )
+		delete queues[i];
+	queues.clear();
+	delete backgroundQueue;
+	backgroundQueue = NULL;
+	started = false;
+}
+
+// Workers would still be running jobs while statics go away
+static struct JobSystemShutdown {
+	~JobSystemShutdown(){ stopJobSystem(); }
+} jobSystemShutdown;
+
+unsigned int getJobThreadCount(){
+	ensureStarted();
+	return (unsigned int)queues.size();
+}
+
+static void queueJob(JobQueue & queue, JobFunction function, void * data, JobCounter & counter, bool background){
+	counter.count.fetch_add(1, std::memory_order_relaxed);
+	Job job = { function, data, &counter, background };
+	if ( !pushJob(queue, job) ){
+		executeJob(job);
+		return;
+	}
+
+	// Seen by a worker about to sleep, or the worker is seen sleeping
+	queuedJobs++;
+	if ( sleepingWorkers.load() > 0 ){
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeCondition.notify_one();
+	}
+}
+
+void runJob(JobFunction function, void * data, JobCounter & counter){
+	ensureStarted();
+	queueJob(*queues[threadQueue], function, data, counter, inBackgroundJob);
+}
+
+// Not in the thread's queue : the render thread would have to wait for the workers to take
+// them before it could pop the frame jobs it queues next
+void runBackgroundJob(JobFunction function, void * data, JobCounter & counter){
+	ensureStarted();
+	queueJob(*backgroundQueue, function, data, counter, true);
+}
+
+void waitForJobs(JobCounter & counter){
+	while ( counter.count.load(std::memory_order_acquire) > 0 ){
+		if ( !runQueuedJob(threadQueue) )
+			std::this_thread::yield();
+	}
+}
+
+
+static void runFrameTask(void * data){
+	FrameTask & task = *(FrameTask*)data;
+	task.function();
+	task.done.store(true, std::memory_order_release);
+
+	// Still counted : the graph can't be seen finished before the dependents start
+	for ( size_t i=0; i<task.dependents.size(); i++ ){
+		FrameTask & dependent = task.graph->tasks[task.dependents[i]];
+		if ( dependent.dependenciesLeft.fetch_sub(1) == 1 )
+			runJob(runFrameTask, &dependent, task.graph->counter);
+	}
+}
+
+int addFrameTask(FrameGraph & graph, const std::function<void()> & function, const int * dependencies, size_t dependencyCount){
+	int index = (int)graph.tasks.size();
+	graph.tasks.emplace_back();
+	FrameTask & task = graph.tasks.back();
+	task.function = function;
+	task.dependencyCount = (int)dependencyCount;
+	task.dependenciesLeft = 0;
+	task.done = false;
+	task.graph = &graph;
+	for ( size_t i=0; i<dependencyCount; i++ )
+		graph.tasks[dependencies[i]].dependents.push_back(index);
+	return index;
+}
+
+void runFrameGraph(FrameGraph & graph){
+	// Every count is set before any task can finish
+	for ( size_t i=0; i<graph.tasks.size(); i++ ){
+		graph.tasks[i].dependenciesLeft = graph.tasks[i].dependencyCount;
+		graph.tasks[i].done = false;
+	}
+	for ( size_t i=0; i<graph.tasks.size(); i++ ){
+		if ( graph.tasks[i].dependencyCount == 0 )
+			runJob(runFrameTask, &graph.tasks[i], graph.counter);
+	}
+}
+
+void waitForFrameTask(FrameGraph & graph, int task){
+	while ( !graph.tasks[task].done.load(std::memory_order_acquire) ){
+		if ( !runQueuedJob(threadQueue) )
+			std::this_thread::yield();
+	}
+}
+
+void finishFrameGraph(FrameGraph & graph){
+	waitForJobs(graph.counter);
+	graph.tasks.clear();
+}
@@ -0,0 +1,81 @@
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+#include <stddef.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Work-stealing job scheduler. Every thread has its own queue of jobs : it runs the newest
+// of them first, and when it has none left, steals the oldest job of another thread.
+// Threads waiting for jobs run queued ones meanwhile, so jobs may start jobs and wait for
+// them without tying up a thread.
+//
+// Background jobs, and the jobs they start, only run on the workers : a render thread
+// waiting for its frame never picks up a texture to decode.
+
+typedef void (*JobFunction)(void * data);
+
+// Jobs of a group that haven't returned yet. A job counts until it returns, so the jobs it
+// starts in its own group are waited for along with it.
+struct JobCounter {
+	std::atomic<int> count;
+	JobCounter() : count(0) {}
+};
+
+// workerCount : threads besides the calling one, 0 for one per other hardware thread, at
+// least one.
+// Done with the default on first use otherwise.
+void startJobSystem(unsigned int workerCount = 0);
+
+// Runs the jobs left, then joins the workers
+void stopJobSystem();
+
+// Threads running jobs, the calling one included
+unsigned int getJobThreadCount();
+
+// Queues function(data) on the calling thread's queue. Runs it right away if the queue is full.
+void runJob(JobFunction function, void * data, JobCounter & counter);
+
+// Same, for long jobs nobody is about to wait for, such as reading files : only the workers
+// run it. The oldest ones are run first.
+void runBackgroundJob(JobFunction function, void * data, JobCounter & counter);
+
+// Runs queued jobs until the counter reaches 0. Only the workers run background jobs : from
+// other threads, waiting for them just yields.
+void waitForJobs(JobCounter & counter);
+
+
+// Tasks of a frame and the tasks they need first. The graph starts every task as soon as
+// what it needs is done, and the render thread waits for the tasks whose results it needs
+// only, when it needs them.
+struct FrameGraph;
+
+struct FrameTask {
+	std::function<void()> function;
+	std::vector<int> dependents;
+	int dependencyCount;
+	std::atomic<int> dependenciesLeft;
+	std::atomic<bool> done;
+	FrameGraph * graph;
+};
+
+struct FrameGraph {
+	std::deque<FrameTask> tasks;    // Stay in place as tasks are added
+	JobCounter counter;
+};
+
+// Adds a task running after the given ones. Returns its index, for dependencies and waits.
+int addFrameTask(FrameGraph & graph, const std::function<void()> & function, const int * dependencies = NULL, size_t dependencyCount = 0);
+
+// Starts the tasks. Add no task until the graph is waited for.
+void runFrameGraph(FrameGraph & graph);
+
+// Runs queued jobs until the task is done
+void waitForFrameTask(FrameGraph & graph, int task);
+
+// Waits for every task, then removes them for the next frame
+void finishFrameGraph(FrameGraph & graph);
+
+#endif
@@ -0,0 +1,133 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.hpp"
+
+#ifdef _WIN32
+
+bool mapFile(const char * path, MappedFile & out_file){
+	out_file.data = NULL;
+	out_file.size = 0;
+	out_file.mapping = NULL;
+	out_file.file = NULL;
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if ( file == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if ( !GetFileSizeEx(file, &size) ){
+		CloseHandle(file);
+		return false;
+	}
+	out_file.file = file;
+	out_file.size = (size_t)size.QuadPart;
+
+	// CreateFileMapping refuses empty files, there is nothing to map anyway
+	if ( out_file.size == 0 )
+		return true;
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if ( mapping == NULL ){
+		unmapFile(out_file);
+		return false;
+	}
+	out_file.mapping = mapping;
+
+	out_file.data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if ( out_file.data == NULL ){
+		unmapFile(out_file);
+		return false;
+	}
+	return true;
+}
+
+void unmapFile(MappedFile & file){
+	if ( file.data )    UnmapViewOfFile(file.data);
+	if ( file.mapping ) CloseHandle((HANDLE)file.mapping);
+	if ( file.file )    CloseHandle((HANDLE)file.file);
+	file.data = NULL;
+	file.size = 0;
+	file.mapping = NULL;
+	file.file = NULL;
+}
+
+#else
+
+bool mapFile(const char * path, MappedFile & out_file){
+	out_file.data = NULL;
+	out_file.size = 0;
+	out_file.mapping = NULL;
+	out_file.file = NULL;
+
+	int fd = open(path, O_RDONLY);
+	if ( fd < 0 )
+		return false;
+
+	struct stat st;
+	if ( fstat(fd, &st) != 0 ){
+		close(fd);
+		return false;
+	}
+	out_file.size = (size_t)st.st_size;
+
+	// mmap refuses empty files, there is nothing to map anyway
+	if ( out_file.size == 0 ){
+		close(fd);
+		return true;
+	}
+
+	void * data = mmap(NULL, out_file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file
+	close(fd);
+	if ( data == MAP_FAILED ){
+		out_file.size = 0;
+		return false;
+	}
+	// We read everything front to back, once
+	madvise(data, out_file.size, MADV_SEQUENTIAL);
+
+	out_file.data = (const char *)data;
+	return true;
+}
+
+void unmapFile(MappedFile & file){
+	if ( file.data )
+		munmap((void *)file.data, file.size);
+	file.data = NULL;
+	file.size = 0;
+}
+
+#endif
+
+bool writeFileAtomically(const char * path, FileWriter write, void * data){
+	std::string temporaryPath = std::string(path) + ".tmp";
+	FILE * file = fopen(temporaryPath.c_str(), "wb");
+	if ( !file )
+		return false;
+	bool written = write(file, data);
+	written = (fclose(file) == 0) && written;
+	if ( !written ){
+		remove(temporaryPath.c_str());
+		return false;
+	}
+
+	// rename replaces the old file in one step on POSIX; Windows refuses while it exists
+	if ( rename(temporaryPath.c_str(), path) == 0 )
+		return true;
+	remove(path);
+	if ( rename(temporaryPath.c_str(), path) == 0 )
+		return true;
+	remove(temporaryPath.c_str());
+	return false;
+}
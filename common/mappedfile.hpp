@@ -0,0 +1,32 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <stddef.h>
+#include <stdio.h>
+
+// A read-only view of a whole file, mapped into memory.
+// data is NULL for empty files; size is always valid once mapped.
+struct MappedFile {
+	const char * data;
+	size_t size;
+
+	// Platform handles, don't touch
+	void * mapping;
+	void * file;
+};
+
+// Maps the file at path for reading. Returns false if it can't be opened.
+bool mapFile(const char * path, MappedFile & out_file);
+
+// Releases a mapping obtained with mapFile. Safe to call twice.
+void unmapFile(MappedFile & file);
+
+// Writes the contents of a file, returning false if any write fails
+typedef bool (*FileWriter)(FILE * file, void * data);
+
+// Has write(file, data) write path + ".tmp", then swaps it in for path, so that a crash
+// never leaves a half-written file. Returns false, and removes the temporary file, if
+// anything fails.
+bool writeFileAtomically(const char * path, FileWriter write, void * data);
+
+#endif
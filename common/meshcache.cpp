@@ -0,0 +1,209 @@
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glm/glm.hpp>
+
+#include "meshcache.hpp"
+
+static const char MESHCACHE_MAGIC[4] = { 'O', 'G', 'L', 'M' };
+
+static std::string getCachePath(const char * sourcePath){
+	return std::string(sourcePath) + ".meshcache";
+}
+
+// FNV-1a
+static unsigned long long hashString(const char * s){
+	unsigned long long hash = 14695981039346656037ULL;
+	for ( ; *s; s++ ){
+		hash ^= (unsigned char)*s;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool getSourceInfo(const char * sourcePath, unsigned long long & out_size, long long & out_modifiedTime){
+	struct stat st;
+	if ( stat(sourcePath, &st) != 0 )
+		return false;
+	out_size = (unsigned long long)st.st_size;
+	out_modifiedTime = (long long)st.st_mtime;
+	return true;
+}
+
+static unsigned long long alignTo16(unsigned long long offset){
+	return (offset + 15) & ~15ULL;
+}
+
+// Checks that a blob is aligned and entirely inside the file
+static bool isBlobValid(const MeshCache & cache, unsigned long long offset, unsigned long long size){
+	return (offset & 15) == 0 && offset <= cache.file.size && size <= cache.file.size - offset;
+}
+
+// Checks that every index addresses one of the vertices
+template <typename Index>
+static bool areIndicesValid(const void * indices, unsigned int indexCount, unsigned int vertexCount){
+	const Index * values = (const Index *)indices;
+	Index largest = 0;
+	for ( unsigned int i=0; i<indexCount; i++ )
+		largest = values[i] > largest ? values[i] : largest;
+	return indexCount == 0 || largest < vertexCount;
+}
+
+bool openMeshCache(const char * sourcePath, MeshCache & out_cache){
+	memset(&out_cache, 0, sizeof(out_cache));
+
+	unsigned long long sourceSize;
+	long long sourceModifiedTime;
+	if ( !getSourceInfo(sourcePath, sourceSize, sourceModifiedTime) )
+		return false;
+
+	std::string cachePath = getCachePath(sourcePath);
+	if ( !mapFile(cachePath.c_str(), out_cache.file) )
+		return false;
+
+	const MeshCacheHeader * header = (const MeshCacheHeader *)out_cache.file.data;
+	if (
+		out_cache.file.size < sizeof(MeshCacheHeader) ||
+		memcmp(header->magic, MESHCACHE_MAGIC, 4) != 0 ||
+		header->version != MESHCACHE_VERSION ||
+		header->sourcePathHash != hashString(sourcePath) ||
+		header->sourceSize != sourceSize ||
+		header->sourceModifiedTime != sourceModifiedTime ||
+		(header->indexSize != 2 && header->indexSize != 4) ||
+		header->lodCount == 0 || header->lodCount > MESHCACHE_MAX_LODS ||
+		(
+			!(header->vertexFormat == VERTEX_FORMAT_FLOAT     && header->vertexStride == sizeof(FloatVertex)) &&
+			!(header->vertexFormat == VERTEX_FORMAT_QUANTIZED && header->vertexStride == sizeof(QuantizedVertex))
+		) ||
+		!isBlobValid(out_cache, header->verticesOffset, (unsigned long long)header->vertexCount * header->vertexStride) ||
+		!isBlobValid(out_cache, header->indicesOffset,  (unsigned long long)header->indexCount * header->indexSize) ||
+		!isBlobValid(out_cache, header->meshletsOffset, (unsigned long long)header->meshletCount * sizeof(Meshlet))
+	){
+		closeMeshCache(out_cache);
+		return false;
+	}
+	for ( unsigned int i=0; i<header->lodCount; i++ ){
+		const MeshLod & lod = header->lods[i];
+		if ( lod.indexOffset > header->indexCount || lod.indexCount > header->indexCount - lod.indexOffset ){
+			closeMeshCache(out_cache);
+			return false;
+		}
+	}
+
+	// The draws read whatever these point to : a cache from another build, or damaged, must
+	// not send them out of the buffers
+	const Meshlet * meshlets = (const Meshlet *)(out_cache.file.data + header->meshletsOffset);
+	for ( unsigned int i=0; i<header->meshletCount; i++ ){
+		unsigned long long meshletEnd = meshlets[i].indexOffset + (unsigned long long)meshlets[i].triangleCount * 3;
+		if ( meshletEnd > header->indexCount ){
+			closeMeshCache(out_cache);
+			return false;
+		}
+	}
+	const void * indices = out_cache.file.data + header->indicesOffset;
+	bool indicesValid = header->indexSize == 2 ?
+		areIndicesValid<unsigned short>(indices, header->indexCount, header->vertexCount) :
+		areIndicesValid<unsigned int>(indices, header->indexCount, header->vertexCount);
+	if ( !indicesValid ){
+		closeMeshCache(out_cache);
+		return false;
+	}
+
+	out_cache.header   = header;
+	out_cache.vertices = out_cache.file.data + header->verticesOffset;
+	out_cache.indices  = indices;
+	out_cache.meshlets = meshlets;
+	return true;
+}
+
+void closeMeshCache(MeshCache & cache){
+	unmapFile(cache.file);
+	cache.header = NULL;
+	cache.vertices = NULL;
+	cache.indices = NULL;
+	cache.meshlets = NULL;
+}
+
+// Writes size bytes at offset, padding with zeros from the current position
+static bool writeBlob(FILE * file, unsigned long long & position, unsigned long long offset, const void * data, size_t size){
+	static const char zeros[16] = {0};
+	if ( offset - position > 0 && fwrite(zeros, 1, (size_t)(offset - position), file) != offset - position )
+		return false;
+	if ( size > 0 && fwrite(data, 1, size, file) != size )
+		return false;
+	position = offset + size;
+	return true;
+}
+
+struct MeshCacheContents {
+	const MeshCacheHeader * header;
+	const PackedVertices * vertices;
+	const void * indices;
+	const std::vector<Meshlet> * meshlets;
+};
+
+static bool writeMeshCacheContents(FILE * file, void * data){
+	const MeshCacheContents & contents = *(const MeshCacheContents *)data;
+	const MeshCacheHeader & header = *contents.header;
+	const std::vector<unsigned char> & vertexData = contents.vertices->data;
+	const std::vector<Meshlet> & meshlets = *contents.meshlets;
+	unsigned long long position = 0;
+	return
+		writeBlob(file, position, 0,                     &header,                                 sizeof(header)) &&
+		writeBlob(file, position, header.verticesOffset, vertexData.empty() ? NULL : &vertexData[0], vertexData.size()) &&
+		writeBlob(file, position, header.indicesOffset,  contents.indices,                        (size_t)header.indexCount * header.indexSize) &&
+		writeBlob(file, position, header.meshletsOffset, meshlets.empty() ? NULL : &meshlets[0],  meshlets.size() * sizeof(Meshlet));
+}
+
+bool writeMeshCache(
+	const char * sourcePath,
+	const PackedVertices & vertices,
+	const void * indices,
+	unsigned int indexCount,
+	unsigned int indexSize,
+	const MeshLod * lods,
+	unsigned int lodCount,
+	const std::vector<Meshlet> & meshlets
+){
+	if ( lodCount == 0 || lodCount > MESHCACHE_MAX_LODS )
+		return false;
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESHCACHE_MAGIC, 4);
+	header.version = MESHCACHE_VERSION;
+	header.sourcePathHash = hashString(sourcePath);
+	if ( !getSourceInfo(sourcePath, header.sourceSize, header.sourceModifiedTime) )
+		return false;
+
+	header.vertexFormat = vertices.format;
+	header.vertexStride = vertices.stride;
+	header.vertexCount  = vertices.count;
+	header.indexCount   = indexCount;
+	header.indexSize    = indexSize;
+	for ( int i=0; i<3; i++ ){
+		header.positionOffset[i] = vertices.positionOffset[i];
+		header.positionScale[i]  = vertices.positionScale[i];
+		header.boundsMin[i]      = vertices.boundsMin[i];
+		header.boundsMax[i]      = vertices.boundsMax[i];
+	}
+	header.lodCount = lodCount;
+	memcpy(header.lods, lods, lodCount * sizeof(MeshLod));
+	header.meshletCount = (unsigned int)meshlets.size();
+
+	header.verticesOffset = alignTo16(sizeof(MeshCacheHeader));
+	header.indicesOffset  = alignTo16(header.verticesOffset + vertices.data.size());
+	header.meshletsOffset = alignTo16(header.indicesOffset + (unsigned long long)indexCount * indexSize);
+
+	std::string cachePath = getCachePath(sourcePath);
+	MeshCacheContents contents = { &header, &vertices, indices, &meshlets };
+	if ( !writeFileAtomically(cachePath.c_str(), writeMeshCacheContents, &contents) ){
+		printf("Could not write the mesh cache %s\n", cachePath.c_str());
+		return false;
+	}
+	return true;
+}
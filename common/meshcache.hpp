@@ -0,0 +1,78 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include "mappedfile.hpp"
+#include "vertexpacking.hpp"
+#include "meshlet.hpp"
+
+// Binary, already indexed and packed version of a mesh, stored next to its source
+// file as <source>.meshcache. Every blob is 16-byte aligned, so the file can be
+// mapped and handed to glBufferData as is.
+// The cache is only used if the source file still has the same path, size and
+// modification time as when the cache was written.
+
+#define MESHCACHE_VERSION 6
+#define MESHCACHE_MAX_LODS 8
+
+// A detail level : a range of the index buffer, using the same vertices as the others
+struct MeshLod {
+	unsigned int indexOffset;
+	unsigned int indexCount;
+	float error;                // Geometric error against level 0, in model units
+	unsigned int reserved;
+};
+
+struct MeshCacheHeader {
+	char magic[4];              // "OGLM"
+	unsigned int version;       // MESHCACHE_VERSION
+	unsigned long long sourcePathHash;
+	unsigned long long sourceSize;
+	long long sourceModifiedTime;
+
+	unsigned int vertexFormat;  // VertexFormat
+	unsigned int vertexStride;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int indexSize;     // In bytes : 2 or 4
+	unsigned int lodCount;
+	float positionOffset[3];    // See PackedVertices
+	float positionScale[3];
+	float boundsMin[3];
+	float boundsMax[3];
+	MeshLod lods[MESHCACHE_MAX_LODS];
+	unsigned int meshletCount;  // Of level 0
+	unsigned int reserved;
+
+	// From the beginning of the file
+	unsigned long long verticesOffset; // vertexCount vertices of vertexStride bytes
+	unsigned long long indicesOffset;  // indexCount indices of indexSize bytes
+	unsigned long long meshletsOffset; // meshletCount Meshlet
+};
+
+struct MeshCache {
+	MappedFile file;
+	const MeshCacheHeader * header;
+
+	const void * vertices;
+	const void * indices;
+	const Meshlet * meshlets;
+};
+
+// Maps the cache of sourcePath. Returns false if there is none, or if it is stale.
+bool openMeshCache(const char * sourcePath, MeshCache & out_cache);
+
+void closeMeshCache(MeshCache & cache);
+
+// (Re)writes the cache of sourcePath. The lods index ranges are in indices.
+bool writeMeshCache(
+	const char * sourcePath,
+	const PackedVertices & vertices,
+	const void * indices,
+	unsigned int indexCount,
+	unsigned int indexSize,
+	const MeshLod * lods,
+	unsigned int lodCount,
+	const std::vector<Meshlet> & meshlets
+);
+
+#endif
@@ -0,0 +1,240 @@
+#include <vector>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+#include "meshoptimizer.hpp"
+#include "meshlet.hpp"
+
+static const unsigned int NONE = ~0u;
+
+static void computeMeshletBounds(
+	Meshlet & meshlet,
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions
+){
+	const unsigned int * triangles = &indices[meshlet.indexOffset];
+	unsigned int indexCount = meshlet.triangleCount * 3;
+
+	// Sphere around the bounding box
+	glm::vec3 minimum = positions[triangles[0]];
+	glm::vec3 maximum = minimum;
+	for ( unsigned int i=1; i<indexCount; i++ ){
+		minimum = glm::min(minimum, positions[triangles[i]]);
+		maximum = glm::max(maximum, positions[triangles[i]]);
+	}
+	meshlet.center = (minimum + maximum) * 0.5f;
+	float radiusSquared = 0.0f;
+	for ( unsigned int i=0; i<indexCount; i++ ){
+		glm::vec3 d = positions[triangles[i]] - meshlet.center;
+		radiusSquared = glm::max(radiusSquared, glm::dot(d, d));
+	}
+	meshlet.radius = sqrtf(radiusSquared);
+
+	// Normal cone : around the average normal, wide enough for all the normals
+	std::vector<glm::vec3> normals;
+	normals.reserve(meshlet.triangleCount);
+	glm::vec3 axis(0.0f);
+	for ( unsigned int i=0; i<indexCount; i+=3 ){
+		const glm::vec3 & p0 = positions[triangles[i]];
+		glm::vec3 n = glm::cross(positions[triangles[i+1]] - p0, positions[triangles[i+2]] - p0);
+		float length = glm::length(n);
+		if ( length == 0.0f )
+			continue;
+		normals.push_back(n / length);
+		axis += normals.back();
+	}
+
+	meshlet.coneAxis = glm::vec3(0.0f);
+	meshlet.coneCutoff = 1.0f;
+	meshlet.reserved = 0.0f;
+	float axisLength = glm::length(axis);
+	if ( normals.empty() || axisLength == 0.0f )
+		return;
+	axis /= axisLength;
+
+	float minimumDot = 1.0f;
+	for ( size_t i=0; i<normals.size(); i++ )
+		minimumDot = glm::min(minimumDot, glm::dot(normals[i], axis));
+
+	// A cone wider than a hemisphere never has only back faces
+	if ( minimumDot <= 0.0f )
+		return;
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = sqrtf(1.0f - minimumDot * minimumDot);
+}
+
+void buildMeshlets(
+	std::vector<Meshlet> & out_meshlets,
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	unsigned int maxVertices,
+	unsigned int maxTriangles
+){
+	out_meshlets.clear();
+	size_t vertexCount = positions.size();
+	size_t triangleCount = indices.size() / 3;
+	if ( triangleCount == 0 )
+		return;
+
+	// Triangles around each vertex
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	for ( size_t i=0; i<triangleCount*3; i++ )
+		adjacencyOffsets[indices[i] + 1]++;
+	for ( size_t v=0; v<vertexCount; v++ )
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	{
+		std::vector<unsigned int> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for ( size_t i=0; i<triangleCount*3; i++ )
+			adjacency[ cursors[indices[i]]++ ] = (unsigned int)(i / 3);
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<bool> inMeshlet(vertexCount, false);
+	std::vector<unsigned int> meshletVertices;
+	meshletVertices.reserve(maxVertices);
+
+	std::vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+
+	Meshlet meshlet = { 0, 0, 0, 1.0f, glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), 0.0f };
+	size_t inputCursor = 0;
+	unsigned int last = NONE; // Last triangle added
+
+	for ( size_t emittedCount=0; emittedCount<triangleCount; emittedCount++ ){
+		// The triangle that adds the fewest vertices : around the last one first, then
+		// around the whole meshlet, then the next one in input order.
+		unsigned int best = NONE;
+		unsigned int bestNewVertices = 4;
+		for ( int pass=0; pass<2 && best == NONE && last != NONE; pass++ ){
+			size_t sourceCount = pass == 0 ? 3 : meshletVertices.size();
+			for ( size_t s=0; s<sourceCount; s++ ){
+				unsigned int v = pass == 0 ? indices[last * 3 + s] : meshletVertices[s];
+				for ( unsigned int a=adjacencyOffsets[v]; a<adjacencyOffsets[v + 1]; a++ ){
+					unsigned int t = adjacency[a];
+					if ( emitted[t] )
+						continue;
+					unsigned int newVertices =
+						(inMeshlet[indices[t*3+0]] ? 0 : 1) +
+						(inMeshlet[indices[t*3+1]] ? 0 : 1) +
+						(inMeshlet[indices[t*3+2]] ? 0 : 1);
+					if ( newVertices < bestNewVertices || (newVertices == bestNewVertices && t < best) ){
+						best = t;
+						bestNewVertices = newVertices;
+					}
+				}
+			}
+		}
+		if ( best == NONE ){
+			while ( emitted[inputCursor] )
+				inputCursor++;
+			best = (unsigned int)inputCursor;
+			bestNewVertices =
+				(inMeshlet[indices[best*3+0]] ? 0 : 1) +
+				(inMeshlet[indices[best*3+1]] ? 0 : 1) +
+				(inMeshlet[indices[best*3+2]] ? 0 : 1);
+		}
+
+		// Full : start a new meshlet with this triangle
+		if ( meshlet.vertexCount + bestNewVertices > maxVertices || meshlet.triangleCount + 1 > maxTriangles ){
+			computeMeshletBounds(meshlet, result, positions);
+			out_meshlets.push_back(meshlet);
+
+			for ( size_t i=0; i<meshletVertices.size(); i++ )
+				inMeshlet[meshletVertices[i]] = false;
+			meshletVertices.clear();
+			meshlet.indexOffset = (unsigned int)result.size();
+			meshlet.triangleCount = 0;
+			meshlet.vertexCount = 0;
+		}
+
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = indices[best*3 + k];
+			result.push_back(v);
+			if ( !inMeshlet[v] ){
+				inMeshlet[v] = true;
+				meshletVertices.push_back(v);
+				meshlet.vertexCount++;
+			}
+		}
+		meshlet.triangleCount++;
+		emitted[best] = true;
+		last = best;
+	}
+
+	computeMeshletBounds(meshlet, result, positions);
+	out_meshlets.push_back(meshlet);
+
+	indices.swap(result);
+}
+
+void optimizeMeshletOverdraw(
+	std::vector<Meshlet> & meshlets,
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions
+){
+	if ( meshlets.empty() )
+		return;
+
+	// buildMeshlets leaves them contiguous, in order
+	std::vector<unsigned int> begins;
+	begins.reserve(meshlets.size() + 1);
+	for ( size_t i=0; i<meshlets.size(); i++ )
+		begins.push_back(meshlets[i].indexOffset / 3);
+	begins.push_back((unsigned int)(indices.size() / 3));
+
+	std::vector<unsigned int> order;
+	sortClustersForOverdraw(indices, positions, begins, order);
+
+	std::vector<Meshlet> sortedMeshlets;
+	std::vector<unsigned int> result;
+	sortedMeshlets.reserve(meshlets.size());
+	result.reserve(indices.size());
+	for ( size_t i=0; i<order.size(); i++ ){
+		Meshlet meshlet = meshlets[order[i]];
+		unsigned int indexCount = meshlet.triangleCount * 3;
+		result.insert(result.end(), indices.begin() + meshlet.indexOffset, indices.begin() + meshlet.indexOffset + indexCount);
+		meshlet.indexOffset = (unsigned int)(result.size() - indexCount);
+		sortedMeshlets.push_back(meshlet);
+	}
+	meshlets.swap(sortedMeshlets);
+	indices.swap(result);
+}
+
+size_t cullMeshlets(
+	const std::vector<Meshlet> & meshlets,
+	const Frustum & frustum,
+	const glm::vec3 & cameraPosition,
+	unsigned int indexSize,
+	DrawRanges & out_ranges,
+	bool cullBackFaces
+){
+	size_t visibleCount = 0;
+	unsigned int rangeEnd = NONE; // End of the last range, in indices
+
+	for ( size_t i=0; i<meshlets.size(); i++ ){
+		const Meshlet & meshlet = meshlets[i];
+		if ( !isSphereInFrustum(frustum, meshlet.center, meshlet.radius) )
+			continue;
+
+		// Every direction from the camera to the sphere is within the back facing cone
+		if ( cullBackFaces && meshlet.coneCutoff < 1.0f ){
+			glm::vec3 toCenter = meshlet.center - cameraPosition;
+			if ( glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius )
+				continue;
+		}
+
+		visibleCount++;
+		unsigned int indexCount = meshlet.triangleCount * 3;
+		if ( meshlet.indexOffset == rangeEnd ){
+			out_ranges.counts.back() += (int)indexCount;
+		} else {
+			out_ranges.counts.push_back((int)indexCount);
+			out_ranges.offsets.push_back((const void *)((size_t)meshlet.indexOffset * indexSize));
+		}
+		rangeEnd = meshlet.indexOffset + indexCount;
+	}
+	return visibleCount;
+}
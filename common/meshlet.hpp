@@ -0,0 +1,64 @@
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#include "frustum.hpp"
+
+// Small clusters of triangles, each with bounds to cull it on its own.
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct Meshlet {
+	unsigned int indexOffset;   // First index of the meshlet's triangles in the index buffer
+	unsigned int triangleCount;
+	unsigned int vertexCount;   // Unique vertices
+	float coneCutoff;           // sin of the cone half angle, 1 if the cone can't cull anything
+
+	glm::vec3 center;           // Bounding sphere
+	float radius;
+	glm::vec3 coneAxis;         // All the triangle normals are within the cone
+	float reserved;
+};
+
+// Splits the triangles into meshlets of at most maxVertices vertices and maxTriangles
+// triangles, growing each one through shared edges, and reorders indices so that the
+// triangles of each meshlet are contiguous. Follows the input order when it can, so
+// run it after optimizeVertexCache.
+void buildMeshlets(
+	std::vector<Meshlet> & out_meshlets,
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	unsigned int maxVertices = MESHLET_MAX_VERTICES,
+	unsigned int maxTriangles = MESHLET_MAX_TRIANGLES
+);
+
+// Draws the meshlets that face outwards first, so that early-z rejects more of the others,
+// by moving whole meshlets in indices : run it on the output of buildMeshlets instead of
+// optimizeOverdraw, which would split them up.
+void optimizeMeshletOverdraw(
+	std::vector<Meshlet> & meshlets,
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions
+);
+
+// Ranges of the index buffer, for glMultiDrawElements
+struct DrawRanges {
+	std::vector<int> counts;           // In indices
+	std::vector<const void *> offsets; // In bytes
+};
+
+// Skips the meshlets that are outside the frustum or that only have back faces, and
+// appends the index ranges of the others to out_ranges, merging consecutive meshlets.
+// frustum and cameraPosition are in model space. Returns the number of visible meshlets.
+// Facing away is kept by any model matrix but a mirroring one (negative determinant), which
+// swaps front and back faces : pass cullBackFaces = false for those.
+size_t cullMeshlets(
+	const std::vector<Meshlet> & meshlets,
+	const Frustum & frustum,
+	const glm::vec3 & cameraPosition,
+	unsigned int indexSize,
+	DrawRanges & out_ranges,
+	bool cullBackFaces = true
+);
+
+#endif
@@ -0,0 +1,399 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include <glm/glm.hpp>
+
+#include "meshoptimizer.hpp"
+
+// Vertex -> triangles adjacency, as flat arrays
+struct TriangleAdjacency {
+	std::vector<unsigned int> counts;  // Live (not yet emitted) triangles of each vertex
+	std::vector<unsigned int> offsets; // Where the triangles of each vertex start in data
+	std::vector<unsigned int> data;
+};
+
+static void buildTriangleAdjacency(TriangleAdjacency & adjacency, const std::vector<unsigned int> & indices, size_t vertexCount){
+	adjacency.counts.assign(vertexCount, 0);
+	adjacency.offsets.assign(vertexCount, 0);
+	adjacency.data.resize(indices.size());
+
+	for ( size_t i=0; i<indices.size(); i++ )
+		adjacency.counts[indices[i]]++;
+
+	unsigned int offset = 0;
+	for ( size_t v=0; v<vertexCount; v++ ){
+		adjacency.offsets[v] = offset;
+		offset += adjacency.counts[v];
+	}
+
+	// Fill, using offsets as write cursors, then rewind them
+	for ( size_t i=0; i<indices.size(); i++ )
+		adjacency.data[ adjacency.offsets[indices[i]]++ ] = (unsigned int)(i / 3);
+	for ( size_t v=0; v<vertexCount; v++ )
+		adjacency.offsets[v] -= adjacency.counts[v];
+}
+
+
+// Tom Forsyth's scoring, with his constants
+static const int FORSYTH_CACHE_SIZE = 32;
+static const int FORSYTH_MAX_VALENCE = 32;
+
+struct ForsythScoreTable {
+	float cache[FORSYTH_CACHE_SIZE];
+	float valence[FORSYTH_MAX_VALENCE + 1];
+
+	ForsythScoreTable(){
+		const float cacheDecayPower = 1.5f;
+		const float lastTriangleScore = 0.75f;
+		const float valenceBoostScale = 2.0f;
+		const float valenceBoostPower = 0.5f;
+
+		for ( int i=0; i<FORSYTH_CACHE_SIZE; i++ ){
+			// The 3 vertices of the last triangle get a fixed score, so that the next
+			// triangle doesn't just reuse the freshest edge and make long strips
+			if ( i < 3 ) cache[i] = lastTriangleScore;
+			else         cache[i] = powf(1.0f - (i - 3) / (float)(FORSYTH_CACHE_SIZE - 3), cacheDecayPower);
+		}
+		valence[0] = 0.0f;
+		for ( int i=1; i<=FORSYTH_MAX_VALENCE; i++ )
+			// Boost vertices with few triangles left, to finish them off instead of leaving lone triangles
+			valence[i] = valenceBoostScale * powf((float)i, -valenceBoostPower);
+	}
+
+	float score(int cachePosition, unsigned int liveTriangles) const {
+		if ( liveTriangles == 0 )
+			return -1.0f; // Nothing left to draw with this vertex
+		float result = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+		return result + valence[ liveTriangles < (unsigned int)FORSYTH_MAX_VALENCE ? liveTriangles : FORSYTH_MAX_VALENCE ];
+	}
+};
+
+void optimizeVertexCache(
+	std::vector<unsigned int> & indices,
+	size_t vertexCount
+){
+	static const ForsythScoreTable table;
+
+	size_t triangleCount = indices.size() / 3;
+	if ( triangleCount == 0 )
+		return;
+
+	TriangleAdjacency adjacency;
+	buildTriangleAdjacency(adjacency, indices, vertexCount);
+
+	std::vector<float> vertexScores(vertexCount);
+	for ( size_t v=0; v<vertexCount; v++ )
+		vertexScores[v] = table.score(-1, adjacency.counts[v]);
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for ( size_t t=0; t<triangleCount; t++ )
+		triangleScores[t] = vertexScores[indices[t*3+0]] + vertexScores[indices[t*3+1]] + vertexScores[indices[t*3+2]];
+
+	// Room for the cache, plus the 3 vertices that get pushed in front
+	unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+	unsigned int cacheNew[FORSYTH_CACHE_SIZE + 3];
+	unsigned int cacheCount = 0;
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+
+	unsigned int current = 0;     // Triangle to emit next
+	unsigned int inputCursor = 1; // Where to look for a fresh start when the cache has nothing to offer
+
+	while ( current != ~0u ){
+		const unsigned int a = indices[current*3+0], b = indices[current*3+1], c = indices[current*3+2];
+		result.push_back(a);
+		result.push_back(b);
+		result.push_back(c);
+		emitted[current] = true;
+
+		// The triangle's vertices go in front, the rest of the cache follows
+		unsigned int cacheNewCount = 0;
+		cacheNew[cacheNewCount++] = a;
+		cacheNew[cacheNewCount++] = b;
+		cacheNew[cacheNewCount++] = c;
+		for ( unsigned int i=0; i<cacheCount; i++ ){
+			unsigned int v = cache[i];
+			if ( v != a && v != b && v != c )
+				cacheNew[cacheNewCount++] = v;
+		}
+		memcpy(cache, cacheNew, sizeof(cache));
+		cacheCount = cacheNewCount > (unsigned int)FORSYTH_CACHE_SIZE ? FORSYTH_CACHE_SIZE : cacheNewCount;
+
+		// The triangle is done : remove it from the adjacency of its vertices
+		const unsigned int corners[3] = { a, b, c };
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = corners[k];
+			unsigned int * triangles = &adjacency.data[adjacency.offsets[v]];
+			unsigned int & count = adjacency.counts[v];
+			for ( unsigned int i=0; i<count; i++ ){
+				if ( triangles[i] == current ){
+					triangles[i] = triangles[count - 1];
+					count--;
+					break;
+				}
+			}
+		}
+
+		// Update the scores of everything that moved in the cache, including
+		// the vertices that just fell out of it, and find the best next triangle
+		unsigned int best = ~0u;
+		float bestScore = 0.0f;
+		for ( unsigned int i=0; i<cacheNewCount; i++ ){
+			unsigned int v = cacheNew[i];
+			int position = i < cacheCount ? (int)i : -1;
+			float score = table.score(position, adjacency.counts[v]);
+			float delta = score - vertexScores[v];
+			vertexScores[v] = score;
+
+			const unsigned int * triangles = &adjacency.data[adjacency.offsets[v]];
+			for ( unsigned int j=0; j<adjacency.counts[v]; j++ ){
+				unsigned int t = triangles[j];
+				triangleScores[t] += delta;
+				if ( triangleScores[t] > bestScore ){
+					best = t;
+					bestScore = triangleScores[t];
+				}
+			}
+		}
+
+		// Nothing around : continue with the next triangle in input order
+		if ( best == ~0u ){
+			while ( inputCursor < triangleCount && emitted[inputCursor] )
+				inputCursor++;
+			if ( inputCursor < triangleCount )
+				best = inputCursor;
+		}
+		current = best;
+	}
+
+	indices.swap(result);
+}
+
+
+// FIFO post-transform cache simulation. A vertex is in the cache if it was
+// inserted less than cacheSize misses ago, so starting from a cold cache only
+// needs to move the clock forward, and the timestamps can be reused across runs.
+struct FifoCacheSimulator {
+	std::vector<unsigned int> timestamps;
+	unsigned int cacheSize;
+	unsigned int time;
+
+	FifoCacheSimulator(size_t vertexCount, unsigned int cacheSize_)
+		: timestamps(vertexCount, 0), cacheSize(cacheSize_), time(cacheSize_ + 1) {}
+
+	void flush(){
+		time += cacheSize + 1;
+	}
+
+	// Returns the number of misses, and the misses of each triangle in misses (if not NULL)
+	unsigned int run(const unsigned int * indices, size_t indexCount, unsigned char * misses){
+		unsigned int start = time;
+		for ( size_t i=0; i<indexCount; i++ ){
+			unsigned int v = indices[i];
+			bool hit = time - timestamps[v] <= cacheSize;
+			if ( !hit )
+				timestamps[v] = time++;
+			if ( misses ){
+				if ( i % 3 == 0 ) misses[i / 3] = 0;
+				misses[i / 3] += hit ? 0 : 1;
+			}
+		}
+		return time - start;
+	}
+};
+
+VertexCacheStatistics analyzeVertexCache(
+	const std::vector<unsigned int> & indices,
+	size_t vertexCount,
+	unsigned int cacheSize
+){
+	VertexCacheStatistics result = { 0, 0.0f, 0.0f };
+	if ( indices.empty() )
+		return result;
+
+	FifoCacheSimulator cache(vertexCount, cacheSize);
+	result.vertexTransforms = cache.run(&indices[0], indices.size(), NULL);
+
+	// ATVR is relative to the vertices that are actually used
+	std::vector<bool> used(vertexCount, false);
+	size_t usedCount = 0;
+	for ( size_t i=0; i<indices.size(); i++ ){
+		if ( !used[indices[i]] ){
+			used[indices[i]] = true;
+			usedCount++;
+		}
+	}
+
+	result.acmr = result.vertexTransforms / (float)(indices.size() / 3);
+	result.atvr = result.vertexTransforms / (float)usedCount;
+	return result;
+}
+
+
+struct TriangleCluster {
+	unsigned int begin; // First triangle
+	unsigned int end;
+	float sortKey;
+};
+
+static bool isClusterDrawnBefore(const TriangleCluster & a, const TriangleCluster & b){
+	return a.sortKey > b.sortKey;
+}
+
+// Clusters that are far out and face outwards hide the rest : they get the largest keys
+static void computeClusterSortKeys(
+	std::vector<TriangleCluster> & clusters,
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions
+){
+	// Area weighted centroid of the mesh, and of each cluster with its average normal
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	std::vector<glm::vec3> clusterCentroids(clusters.size());
+	std::vector<glm::vec3> clusterNormals(clusters.size());
+	for ( size_t c=0; c<clusters.size(); c++ ){
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for ( unsigned int t=clusters[c].begin; t<clusters[c].end; t++ ){
+			const glm::vec3 & p0 = positions[indices[t*3+0]];
+			const glm::vec3 & p1 = positions[indices[t*3+1]];
+			const glm::vec3 & p2 = positions[indices[t*3+2]];
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0); // Length is twice the area
+			float a = glm::length(n);
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+		meshCentroid += centroid;
+		meshArea += area;
+		clusterCentroids[c] = area > 0.0f ? centroid / area : positions[indices[clusters[c].begin * 3]];
+		float normalLength = glm::length(normal);
+		clusterNormals[c] = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f);
+	}
+	if ( meshArea > 0.0f )
+		meshCentroid /= meshArea;
+
+	for ( size_t c=0; c<clusters.size(); c++ )
+		clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+}
+
+void optimizeOverdraw(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	float threshold
+){
+	// Same cache size as the optimizeVertexCache() output is tuned for
+	const unsigned int cacheSize = 16;
+
+	size_t triangleCount = indices.size() / 3;
+	if ( triangleCount == 0 )
+		return;
+
+	// Hard boundaries : triangles that miss on all 3 vertices start a new strip of locality.
+	// Drawing these clusters in any order doesn't change the cache efficiency much.
+	FifoCacheSimulator cache(positions.size(), cacheSize);
+	std::vector<unsigned char> misses(triangleCount);
+	cache.run(&indices[0], indices.size(), &misses[0]);
+
+	std::vector<unsigned int> hardBoundaries;
+	for ( size_t t=0; t<triangleCount; t++ )
+		if ( t == 0 || misses[t] == 3 )
+			hardBoundaries.push_back((unsigned int)t);
+	hardBoundaries.push_back((unsigned int)triangleCount);
+
+	// Soft boundaries : split the hard clusters further wherever the cache efficiency
+	// of the part so far is within threshold of the efficiency of the whole cluster.
+	std::vector<TriangleCluster> clusters;
+	for ( size_t h=0; h+1<hardBoundaries.size(); h++ ){
+		unsigned int begin = hardBoundaries[h];
+		unsigned int end = hardBoundaries[h + 1];
+
+		// The cluster's own efficiency, with a cold cache
+		cache.flush();
+		unsigned int transforms = cache.run(&indices[begin * 3], (end - begin) * 3, NULL);
+		float clusterThreshold = threshold * transforms / (float)(end - begin);
+
+		// Each part starts with a cold cache, as it may end up anywhere in the final order
+		cache.flush();
+		unsigned int start = begin;
+		unsigned int runningMisses = 0;
+		for ( unsigned int t=begin; t<end; t++ ){
+			runningMisses += cache.run(&indices[t * 3], 3, NULL);
+			if ( t + 1 < end && runningMisses / (float)(t - start + 1) <= clusterThreshold ){
+				TriangleCluster cluster = { start, t + 1, 0.0f };
+				clusters.push_back(cluster);
+				start = t + 1;
+				runningMisses = 0;
+				cache.flush();
+			}
+		}
+		TriangleCluster cluster = { start, end, 0.0f };
+		clusters.push_back(cluster);
+	}
+
+	computeClusterSortKeys(clusters, indices, positions);
+	std::stable_sort(clusters.begin(), clusters.end(), isClusterDrawnBefore);
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for ( size_t c=0; c<clusters.size(); c++ )
+		result.insert(result.end(), indices.begin() + clusters[c].begin * 3, indices.begin() + clusters[c].end * 3);
+	indices.swap(result);
+}
+
+void sortClustersForOverdraw(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	const std::vector<unsigned int> & clusterBegins,
+	std::vector<unsigned int> & out_order
+){
+	std::vector<TriangleCluster> clusters;
+	for ( size_t c=0; c+1<clusterBegins.size(); c++ ){
+		TriangleCluster cluster = { clusterBegins[c], clusterBegins[c + 1], 0.0f };
+		clusters.push_back(cluster);
+	}
+	computeClusterSortKeys(clusters, indices, positions);
+
+	// The begins tell the clusters apart once sorted
+	std::stable_sort(clusters.begin(), clusters.end(), isClusterDrawnBefore);
+	out_order.resize(clusters.size());
+	for ( size_t c=0; c<clusters.size(); c++ )
+		out_order[c] = (unsigned int)(std::lower_bound(clusterBegins.begin(), clusterBegins.end() - 1, clusters[c].begin) - clusterBegins.begin());
+}
+
+
+void optimizeVertexFetch(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+){
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(vertices.size(), unused);
+
+	std::vector<glm::vec3> newVertices;
+	std::vector<glm::vec2> newUvs;
+	std::vector<glm::vec3> newNormals;
+	newVertices.reserve(vertices.size());
+	newUvs     .reserve(uvs.size());
+	newNormals .reserve(normals.size());
+
+	for ( size_t i=0; i<indices.size(); i++ ){
+		unsigned int & index = indices[i];
+		if ( remap[index] == unused ){
+			remap[index] = (unsigned int)newVertices.size();
+			newVertices.push_back(vertices[index]);
+			newUvs     .push_back(uvs[index]);
+			newNormals .push_back(normals[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(newVertices);
+	uvs     .swap(newUvs);
+	normals .swap(newNormals);
+}
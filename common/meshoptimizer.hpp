@@ -0,0 +1,56 @@
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+// Reordering passes for indexed triangle lists, as produced by indexVBO.
+// The usual order is :
+//   optimizeVertexCache -> optimizeOverdraw (optional) -> optimizeVertexFetch
+
+// Reorders triangles so that the GPU post-transform cache gets more hits
+// (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation").
+void optimizeVertexCache(
+	std::vector<unsigned int> & indices,
+	size_t vertexCount
+);
+
+// Splits the (cache optimized) triangles into clusters and draws the clusters
+// that face outwards first, so that early-z rejects more of the others.
+// threshold is how much worse the vertex cache may get : 1.05 allows 5% more transforms.
+void optimizeOverdraw(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	float threshold
+);
+
+// optimizeOverdraw's order for clusters made by another pass, such as meshlets : the ones
+// that face outwards first. clusterBegins holds the first triangle of each cluster, in
+// increasing order, then the triangle count. out_order gets the clusters to draw, in order.
+void sortClustersForOverdraw(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	const std::vector<unsigned int> & clusterBegins,
+	std::vector<unsigned int> & out_order
+);
+
+// Moves vertices in the order the triangles first use them, so that vertex fetch
+// reads memory linearly, and drops unused vertices. The indices are remapped.
+void optimizeVertexFetch(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
+struct VertexCacheStatistics {
+	unsigned int vertexTransforms; // Cache misses
+	float acmr; // Average transforms per triangle : 3 is the worst, 0.5 the best on a regular grid
+	float atvr; // Average transforms per vertex : 1 is the best
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries
+VertexCacheStatistics analyzeVertexCache(
+	const std::vector<unsigned int> & indices,
+	size_t vertexCount,
+	unsigned int cacheSize = 16
+);
+
+#endif
@@ -0,0 +1,458 @@
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "meshsimplify.hpp"
+
+enum VertexKind {
+	VERTEX_MANIFOLD, // Interior vertex : can collapse onto anything
+	VERTEX_BORDER,   // On a border of the mesh : only along the border
+	VERTEX_SEAM,     // On a UV or normal seam (2 vertices, same position) : only along the seam
+	VERTEX_LOCKED    // Corners, non manifold, or more than 2 vertices at the same position
+};
+
+static const unsigned int NONE = ~0u;
+
+// Corners of the triangles around each vertex, as flat arrays.
+// A corner c is the vertex indices[c] of the triangle c/3.
+struct CornerAdjacency {
+	std::vector<unsigned int> counts;
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> corners;
+};
+
+static unsigned int nextCorner(unsigned int c){ return c % 3 == 2 ? c - 2 : c + 1; }
+static unsigned int previousCorner(unsigned int c){ return c % 3 == 0 ? c + 2 : c - 1; }
+
+// remap can be NULL, or map indices to the vertex they are grouped with
+static void buildCornerAdjacency(
+	CornerAdjacency & adjacency,
+	const std::vector<unsigned int> & indices,
+	const unsigned int * remap,
+	size_t vertexCount
+){
+	adjacency.counts.assign(vertexCount, 0);
+	adjacency.offsets.assign(vertexCount, 0);
+	adjacency.corners.resize(indices.size());
+
+	for ( size_t i=0; i<indices.size(); i++ )
+		adjacency.counts[remap ? remap[indices[i]] : indices[i]]++;
+
+	unsigned int offset = 0;
+	for ( size_t v=0; v<vertexCount; v++ ){
+		adjacency.offsets[v] = offset;
+		offset += adjacency.counts[v];
+	}
+	for ( size_t i=0; i<indices.size(); i++ ){
+		unsigned int v = remap ? remap[indices[i]] : indices[i];
+		adjacency.corners[ adjacency.offsets[v]++ ] = (unsigned int)i;
+	}
+	for ( size_t v=0; v<vertexCount; v++ )
+		adjacency.offsets[v] -= adjacency.counts[v];
+}
+
+// Is there a triangle with the directed edge a -> b ?
+static bool hasEdge(
+	const CornerAdjacency & adjacency,
+	const std::vector<unsigned int> & indices,
+	const unsigned int * remap,
+	unsigned int a,
+	unsigned int b
+){
+	if ( adjacency.counts[a] == 0 )
+		return false;
+	const unsigned int * corners = &adjacency.corners[0] + adjacency.offsets[a];
+	for ( unsigned int i=0; i<adjacency.counts[a]; i++ ){
+		unsigned int target = indices[nextCorner(corners[i])];
+		if ( (remap ? remap[target] : target) == b )
+			return true;
+	}
+	return false;
+}
+
+
+// Is the open edge v -> loop[v] also open once the seams are closed ?
+static bool isPositionEdgeOpen(
+	const CornerAdjacency & positionAdjacency,
+	const std::vector<unsigned int> & indices,
+	const std::vector<unsigned int> & remap,
+	const std::vector<unsigned int> & loop,
+	unsigned int v
+){
+	return !hasEdge(positionAdjacency, indices, &remap[0], remap[loop[v]], remap[v]);
+}
+
+
+// Vertices with the same position : remap[v] is the first of them, wedge[v] the next one (cyclic)
+static void buildPositionGroups(
+	const std::vector<glm::vec3> & positions,
+	std::vector<unsigned int> & remap,
+	std::vector<unsigned int> & wedge
+){
+	size_t vertexCount = positions.size();
+	std::vector<unsigned int> order(vertexCount);
+	for ( size_t v=0; v<vertexCount; v++ )
+		order[v] = (unsigned int)v;
+
+	struct PositionLess {
+		const glm::vec3 * p;
+		bool operator()(unsigned int a, unsigned int b) const {
+			if ( p[a].x != p[b].x ) return p[a].x < p[b].x;
+			if ( p[a].y != p[b].y ) return p[a].y < p[b].y;
+			if ( p[a].z != p[b].z ) return p[a].z < p[b].z;
+			return a < b;
+		}
+	};
+	PositionLess less = { vertexCount ? &positions[0] : NULL };
+	std::sort(order.begin(), order.end(), less);
+
+	remap.resize(vertexCount);
+	wedge.resize(vertexCount);
+	for ( size_t i=0; i<vertexCount; ){
+		size_t end = i + 1;
+		while ( end < vertexCount && positions[order[end]] == positions[order[i]] )
+			end++;
+		for ( size_t j=i; j<end; j++ ){
+			remap[order[j]] = order[i];
+			wedge[order[j]] = order[j + 1 < end ? j + 1 : i];
+		}
+		i = end;
+	}
+}
+
+
+// Symmetric 4x4 matrix, as in "Surface Simplification Using Quadric Error Metrics"
+struct Quadric {
+	double a00, a11, a22;
+	double a10, a20, a21;
+	double b0, b1, b2;
+	double c;
+};
+
+static void quadricAdd(Quadric & q, const Quadric & r){
+	q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+	q.a10 += r.a10; q.a20 += r.a20; q.a21 += r.a21;
+	q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+	q.c += r.c;
+}
+
+// Squared distance to the plane dot(n, p) + d = 0, times weight
+static Quadric quadricFromPlane(glm::dvec3 n, double d, double weight){
+	Quadric q;
+	q.a00 = weight * n.x * n.x;
+	q.a11 = weight * n.y * n.y;
+	q.a22 = weight * n.z * n.z;
+	q.a10 = weight * n.y * n.x;
+	q.a20 = weight * n.z * n.x;
+	q.a21 = weight * n.z * n.y;
+	q.b0 = weight * n.x * d;
+	q.b1 = weight * n.y * d;
+	q.b2 = weight * n.z * d;
+	q.c = weight * d * d;
+	return q;
+}
+
+static double quadricError(const Quadric & q, const glm::vec3 & v){
+	double x = v.x, y = v.y, z = v.z;
+	double rx = q.b0 + q.a00 * x + q.a10 * y + q.a20 * z;
+	double ry = q.b1 + q.a10 * x + q.a11 * y + q.a21 * z;
+	double rz = q.b2 + q.a20 * x + q.a21 * y + q.a22 * z;
+	double r = q.c + 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + (rx - q.b0) * x + (ry - q.b1) * y + (rz - q.b2) * z;
+	return r > 0.0 ? r : 0.0;
+}
+
+// Borders and seams also get planes through the edge, perpendicular to the triangle,
+// so that collapses along them are not free. Borders are weighted more, the
+// silhouette changes are the most visible.
+static const double BORDER_WEIGHT = 10.0;
+static const double SEAM_WEIGHT = 1.0;
+
+
+struct EdgeCollapse {
+	unsigned int from;
+	unsigned int to;
+	double error;
+};
+
+struct EdgeCollapseLess {
+	bool operator()(const EdgeCollapse & a, const EdgeCollapse & b) const {
+		return a.error < b.error;
+	}
+};
+
+static bool canCollapse(const std::vector<unsigned char> & kinds, unsigned int from, unsigned int to, bool isOpenEdge){
+	switch ( kinds[from] ){
+		case VERTEX_MANIFOLD: return true;
+		case VERTEX_BORDER:   return kinds[to] == VERTEX_BORDER && isOpenEdge;
+		case VERTEX_SEAM:     return kinds[to] == VERTEX_SEAM && isOpenEdge;
+		default:              return false;
+	}
+}
+
+// Would moving from onto the position of to turn a triangle around ?
+static bool hasTriangleFlips(
+	const CornerAdjacency & adjacency,
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	const std::vector<unsigned int> & remap,
+	const std::vector<unsigned int> & collapseRemap,
+	unsigned int from,
+	unsigned int to
+){
+	if ( adjacency.counts[from] == 0 )
+		return false;
+	const glm::vec3 & target = positions[to];
+	const unsigned int * corners = &adjacency.corners[0] + adjacency.offsets[from];
+	for ( unsigned int i=0; i<adjacency.counts[from]; i++ ){
+		unsigned int b = collapseRemap[ indices[nextCorner(corners[i])] ];
+		unsigned int c = collapseRemap[ indices[previousCorner(corners[i])] ];
+		// Triangles on the collapsed edge disappear
+		if ( remap[b] == remap[to] || remap[c] == remap[to] )
+			continue;
+
+		const glm::vec3 & pb = positions[b];
+		const glm::vec3 & pc = positions[c];
+		glm::vec3 before = glm::cross(pb - positions[from], pc - positions[from]);
+		glm::vec3 after = glm::cross(pb - target, pc - target);
+		if ( glm::dot(before, after) <= 0.0f )
+			return true;
+	}
+	return false;
+}
+
+float simplifyMesh(
+	std::vector<unsigned int> & out_indices,
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	size_t targetIndexCount,
+	float targetError
+){
+	size_t vertexCount = positions.size();
+
+	// Degenerate triangles would only confuse the topology
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for ( size_t i=0; i+2<indices.size(); i+=3 ){
+		unsigned int a = indices[i], b = indices[i+1], c = indices[i+2];
+		if ( a != b && b != c && c != a ){
+			result.push_back(a);
+			result.push_back(b);
+			result.push_back(c);
+		}
+	}
+
+	std::vector<unsigned int> remap, wedge;
+	buildPositionGroups(positions, remap, wedge);
+
+	CornerAdjacency adjacency, positionAdjacency;
+	buildCornerAdjacency(adjacency, result, NULL, vertexCount);
+	buildCornerAdjacency(positionAdjacency, result, &remap[0], vertexCount);
+
+	// Open edges : loop[v] is where the only open edge leaving v goes,
+	// loopback[v] where the only open edge arriving to v comes from
+	std::vector<unsigned int> loop(vertexCount, NONE), loopback(vertexCount, NONE);
+	std::vector<unsigned char> openOut(vertexCount, 0), openIn(vertexCount, 0);
+	for ( size_t v=0; v<vertexCount; v++ ){
+		for ( unsigned int i=0; i<adjacency.counts[v]; i++ ){
+			unsigned int corner = adjacency.corners[adjacency.offsets[v] + i];
+			unsigned int next = result[nextCorner(corner)];
+			unsigned int previous = result[previousCorner(corner)];
+			if ( !hasEdge(adjacency, result, NULL, next, (unsigned int)v) ){
+				loop[v] = next;
+				openOut[v]++;
+			}
+			if ( !hasEdge(adjacency, result, NULL, (unsigned int)v, previous) ){
+				loopback[v] = previous;
+				openIn[v]++;
+			}
+		}
+	}
+
+	std::vector<unsigned char> kinds(vertexCount, VERTEX_LOCKED);
+	for ( size_t v=0; v<vertexCount; v++ ){
+		if ( remap[v] != v )
+			continue;
+
+		unsigned int w = wedge[v];
+		if ( w == v ){
+			if ( openOut[v] == 0 && openIn[v] == 0 )
+				kinds[v] = VERTEX_MANIFOLD;
+			else if ( openOut[v] == 1 && openIn[v] == 1 && isPositionEdgeOpen(positionAdjacency, result, remap, loop, v) )
+				kinds[v] = VERTEX_BORDER;
+		}
+		else if ( wedge[w] == v ){
+			// The two sides of a seam go in opposite directions
+			if (
+				openOut[v] == 1 && openIn[v] == 1 && openOut[w] == 1 && openIn[w] == 1 &&
+				remap[loop[v]] == remap[loopback[w]] && remap[loopback[v]] == remap[loop[w]] &&
+				!isPositionEdgeOpen(positionAdjacency, result, remap, loop, v) && !isPositionEdgeOpen(positionAdjacency, result, remap, loop, w)
+			)
+				kinds[v] = kinds[w] = VERTEX_SEAM;
+		}
+	}
+
+	// Error quadrics, one per position
+	Quadric zero = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+	std::vector<Quadric> quadrics(vertexCount, zero);
+	for ( size_t i=0; i<result.size(); i+=3 ){
+		const glm::vec3 & p0 = positions[result[i]];
+		const glm::vec3 & p1 = positions[result[i+1]];
+		const glm::vec3 & p2 = positions[result[i+2]];
+		glm::dvec3 n = glm::cross(glm::dvec3(p1 - p0), glm::dvec3(p2 - p0));
+		double area = glm::length(n);
+		if ( area == 0.0 )
+			continue;
+		n /= area;
+		Quadric q = quadricFromPlane(n, -glm::dot(n, glm::dvec3(p0)), area * 0.5);
+
+		for ( int k=0; k<3; k++ ){
+			unsigned int a = result[i+k];
+			quadricAdd(quadrics[remap[a]], q);
+
+			unsigned int b = result[i + (k+1)%3];
+			if ( hasEdge(adjacency, result, NULL, b, a) )
+				continue;
+			bool isBorder = !hasEdge(positionAdjacency, result, &remap[0], remap[b], remap[a]);
+
+			glm::dvec3 edge = glm::dvec3(positions[b] - positions[a]);
+			glm::dvec3 perpendicular = glm::cross(edge, n);
+			double perpendicularLength = glm::length(perpendicular);
+			if ( perpendicularLength == 0.0 )
+				continue;
+			perpendicular /= perpendicularLength;
+			double weight = (isBorder ? BORDER_WEIGHT : SEAM_WEIGHT) * glm::length(edge);
+			Quadric edgeQuadric = quadricFromPlane(perpendicular, -glm::dot(perpendicular, glm::dvec3(positions[a])), weight);
+			quadricAdd(quadrics[remap[a]], edgeQuadric);
+			quadricAdd(quadrics[remap[b]], edgeQuadric);
+		}
+	}
+
+	std::vector<EdgeCollapse> collapses;
+	std::vector<unsigned int> collapseRemap(vertexCount);
+	std::vector<unsigned char> collapseLocked(vertexCount);
+	double errorLimit = (double)targetError * targetError;
+	double resultError = 0.0;
+
+	// Each pass collapses a batch of the cheapest edges, at most one per vertex
+	while ( result.size() > targetIndexCount ){
+		if ( collapses.capacity() == 0 )
+			collapses.reserve(result.size());
+		collapses.clear();
+		buildCornerAdjacency(adjacency, result, NULL, vertexCount);
+
+		for ( size_t i=0; i<result.size(); i++ ){
+			unsigned int a = result[i];
+			unsigned int b = result[nextCorner((unsigned int)i)];
+			if ( remap[a] == remap[b] )
+				continue;
+			bool isOpenEdge = !hasEdge(adjacency, result, NULL, b, a);
+			// Interior edges are seen from both triangles
+			if ( !isOpenEdge && a > b )
+				continue;
+
+			EdgeCollapse collapse = { NONE, NONE, DBL_MAX };
+			if ( canCollapse(kinds, a, b, isOpenEdge) ){
+				collapse.from = a;
+				collapse.to = b;
+				collapse.error = quadricError(quadrics[remap[a]], positions[b]);
+			}
+			if ( canCollapse(kinds, b, a, isOpenEdge) ){
+				double error = quadricError(quadrics[remap[b]], positions[a]);
+				if ( error < collapse.error ){
+					collapse.from = b;
+					collapse.to = a;
+					collapse.error = error;
+				}
+			}
+			if ( collapse.from != NONE )
+				collapses.push_back(collapse);
+		}
+		if ( collapses.empty() )
+			break;
+		std::sort(collapses.begin(), collapses.end(), EdgeCollapseLess());
+
+		// A manifold collapse removes 2 triangles. Don't go much further than the
+		// goal's error in one pass : the next pass will have better quadrics.
+		size_t triangleGoal = (result.size() - targetIndexCount) / 3;
+		size_t edgeGoal = triangleGoal / 2 > 0 ? triangleGoal / 2 : 1;
+		double passErrorLimit = edgeGoal < collapses.size() ? 1.5 * collapses[edgeGoal].error : DBL_MAX;
+
+		for ( size_t v=0; v<vertexCount; v++ )
+			collapseRemap[v] = (unsigned int)v;
+		std::fill(collapseLocked.begin(), collapseLocked.end(), 0);
+
+		size_t trianglesRemoved = 0;
+		for ( size_t i=0; i<collapses.size(); i++ ){
+			const EdgeCollapse & collapse = collapses[i];
+			if ( trianglesRemoved >= triangleGoal || collapse.error > errorLimit )
+				break;
+			if ( collapse.error > passErrorLimit && trianglesRemoved > triangleGoal / 10 )
+				break;
+
+			unsigned int from = collapse.from, to = collapse.to;
+			if ( collapseLocked[remap[from]] || collapseLocked[remap[to]] )
+				continue;
+
+			// The other side of a seam moves along with it
+			unsigned int seamFrom = NONE, seamTo = NONE;
+			if ( kinds[from] == VERTEX_SEAM ){
+				seamFrom = wedge[from];
+				seamTo = loop[from] == to ? loopback[seamFrom] : loop[seamFrom];
+				if ( seamTo == NONE || remap[seamTo] != remap[to] )
+					continue;
+			}
+
+			if ( hasTriangleFlips(adjacency, result, positions, remap, collapseRemap, from, to) )
+				continue;
+			if ( seamFrom != NONE && hasTriangleFlips(adjacency, result, positions, remap, collapseRemap, seamFrom, seamTo) )
+				continue;
+
+			collapseRemap[from] = to;
+			if ( seamFrom != NONE )
+				collapseRemap[seamFrom] = seamTo;
+			quadricAdd(quadrics[remap[to]], quadrics[remap[from]]);
+			collapseLocked[remap[from]] = 1;
+			collapseLocked[remap[to]] = 1;
+
+			trianglesRemoved += kinds[from] == VERTEX_BORDER ? 1 : 2;
+			resultError = std::max(resultError, collapse.error);
+		}
+		if ( trianglesRemoved == 0 )
+			break;
+
+		// Follow the collapses in the open edge loops
+		for ( size_t v=0; v<vertexCount; v++ ){
+			if ( loop[v] != NONE ){
+				unsigned int l = loop[v];
+				unsigned int r = collapseRemap[l];
+				// v == r : the edge was collapsed in the direction opposite to the loop
+				loop[v] = v == r ? loop[l] : r;
+			}
+			if ( loopback[v] != NONE ){
+				unsigned int l = loopback[v];
+				unsigned int r = collapseRemap[l];
+				loopback[v] = v == r ? loopback[l] : r;
+			}
+		}
+
+		// Apply, and drop the triangles that collapsed
+		size_t writeIndex = 0;
+		for ( size_t i=0; i<result.size(); i+=3 ){
+			unsigned int a = collapseRemap[result[i]];
+			unsigned int b = collapseRemap[result[i+1]];
+			unsigned int c = collapseRemap[result[i+2]];
+			if ( remap[a] != remap[b] && remap[b] != remap[c] && remap[c] != remap[a] ){
+				result[writeIndex++] = a;
+				result[writeIndex++] = b;
+				result[writeIndex++] = c;
+			}
+		}
+		result.resize(writeIndex);
+	}
+
+	out_indices.swap(result);
+	return (float)sqrt(resultError);
+}
@@ -0,0 +1,19 @@
+#ifndef MESHSIMPLIFY_HPP
+#define MESHSIMPLIFY_HPP
+
+// Quadric error metric simplification of an indexed triangle list (Garland & Heckbert),
+// collapsing edges onto one of their endpoints so that no vertex is created.
+// Vertices that indexVBO split because of a UV or normal discontinuity only collapse
+// along that seam, and mesh borders only collapse along the border.
+//
+// Writes at most targetIndexCount indices to out_indices, or more if that would need
+// an error above targetError (in model units). Returns the error of the result.
+float simplifyMesh(
+	std::vector<unsigned int> & out_indices,
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	size_t targetIndexCount,
+	float targetError
+);
+
+#endif
@@ -0,0 +1,481 @@
+#include <math.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "texture.hpp"
+#include "parallel.hpp"
+#include "mipmap.hpp"
+#include "cpufeatures.hpp"
+
+// SSE is part of x86-64, AVX2 and FMA are checked at run time. Functions using wider
+// instructions than the compiler targets are marked for GCC and Clang, MSVC takes them anyway.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#define MIPMAP_X86
+	#define MIPMAP_TARGET(isa)
+	#include <immintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define MIPMAP_X86
+	#define MIPMAP_TARGET(isa) __attribute__((target(isa)))
+	#include <immintrin.h>
+#endif
+
+// Rows of a level per parallelFor range
+#define MIPMAP_ROW_GRAIN 16
+
+// Entries of the linear to sRGB table : a step is 0.05 of an 8 bit step at worst, near black
+#define LINEAR_TO_SRGB_SIZE 65536
+
+// Bins of the alpha histogram, for alpha coverage
+#define ALPHA_BIN_COUNT 4096
+
+MipmapPath getMipmapPath(){
+#ifdef MIPMAP_X86
+	const CpuFeatures & features = getCpuFeatures();
+	return features.avx2 && features.fma ? MIPMAP_PATH_AVX2 : MIPMAP_PATH_SSE;
+#else
+	return MIPMAP_PATH_SCALAR;
+#endif
+}
+
+const char * getMipmapPathName(MipmapPath path){
+	switch ( path ){
+		case MIPMAP_PATH_AVX2: return "AVX2";
+		case MIPMAP_PATH_SSE:  return "SSE";
+		default:               return "scalar";
+	}
+}
+
+// 8 bit values to floats, and back
+struct MipmapTables {
+	float srgbToLinear[256];
+	float unormToFloat[256];
+	unsigned char linearToSrgb[LINEAR_TO_SRGB_SIZE];
+
+	MipmapTables(){
+		for ( int i=0; i<256; i++ ){
+			float value = i / 255.0f;
+			srgbToLinear[i] = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+			unormToFloat[i] = value;
+		}
+		for ( int i=0; i<LINEAR_TO_SRGB_SIZE; i++ ){
+			float value = i / float(LINEAR_TO_SRGB_SIZE - 1);
+			float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+			linearToSrgb[i] = (unsigned char)(srgb * 255.0f + 0.5f);
+		}
+	}
+};
+
+static const MipmapTables & getMipmapTables(){
+	static MipmapTables tables;
+	return tables;
+}
+
+// Texel i of a level is the weighted sum of texels 2i + offset + k of the level above
+struct MipmapKernel {
+	int offset;
+	int tapCount;
+	float weights[8];
+};
+
+static double besselI0(double x){
+	double sum = 1.0, term = 1.0;
+	for ( int k=1; k<32; k++ ){
+		term *= (x * 0.5 / k) * (x * 0.5 / k);
+		sum += term;
+	}
+	return sum;
+}
+
+static void getMipmapKernel(MipmapFilter filter, MipmapKernel & out_kernel){
+	if ( filter == MIPMAP_FILTER_BOX ){
+		out_kernel.offset = 0;
+		out_kernel.tapCount = 2;
+		out_kernel.weights[0] = 0.5f;
+		out_kernel.weights[1] = 0.5f;
+		return;
+	}
+
+	// Sinc cut at the new Nyquist frequency, windowed over 4 texels of the level above on
+	// each side (alpha = 4, as NVTT does)
+	const double alpha = 4.0;
+	const double pi = 3.14159265358979323846;
+	out_kernel.offset = -3;
+	out_kernel.tapCount = 8;
+	double sum = 0.0;
+	double weights[8];
+	for ( int k=0; k<8; k++ ){
+		double distance = k - 3.5;      // From the center of the new texel, in texels above
+		double x = pi * distance * 0.5;
+		double t = distance / 4.0;
+		weights[k] = sin(x) / x * besselI0(alpha * sqrt(1.0 - t * t)) / besselI0(alpha);
+		sum += weights[k];
+	}
+	for ( int k=0; k<8; k++ )
+		out_kernel.weights[k] = (float)(weights[k] / sum);
+}
+
+static inline int wrapIndex(int i, int size){
+	i %= size;
+	return i < 0 ? i + size : i;
+}
+
+static inline float clamp01(float value){
+	return value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+}
+
+
+// Level 0 to floats, 4 per texel : the colors as linear light if srgb, then alpha, 1 for
+// RGB. Channels stay in the order of the file, alpha is last either way.
+static void decodeRowScalar(const unsigned char * src, unsigned int width, int channels, const float * colorTable, float * dst){
+	const float * alphaTable = getMipmapTables().unormToFloat;
+	for ( unsigned int x=0; x<width; x++ ){
+		dst[x*4 + 0] = colorTable[src[x*channels + 0]];
+		dst[x*4 + 1] = colorTable[src[x*channels + 1]];
+		dst[x*4 + 2] = colorTable[src[x*channels + 2]];
+		dst[x*4 + 3] = channels == 4 ? alphaTable[src[x*4 + 3]] : 1.0f;
+	}
+}
+
+// dst[i] = sum of weights[k] * rows[k][i]
+static void accumulateRowsScalar(const float * const * rows, const float * weights, int tapCount, size_t count, float * dst){
+	for ( size_t i=0; i<count; i++ ){
+		float sum = 0.0f;
+		for ( int k=0; k<tapCount; k++ )
+			sum += weights[k] * rows[k][i];
+		dst[i] = sum;
+	}
+}
+
+// Texel x of dst = sum of weights[k] * the texel of src at offsets[x*tapCount + k]
+static void filterRowScalar(const float * src, const int * offsets, const float * weights, int tapCount, unsigned int width, float * dst){
+	for ( unsigned int x=0; x<width; x++ ){
+		const int * texelOffsets = offsets + x * tapCount;
+		for ( int c=0; c<4; c++ ){
+			float sum = 0.0f;
+			for ( int k=0; k<tapCount; k++ )
+				sum += weights[k] * src[texelOffsets[k] + c];
+			dst[x*4 + c] = sum;
+		}
+	}
+}
+
+// Floats back to bytes, alpha scaled first
+static void encodeRowScalar(const float * src, unsigned int width, int channels, bool srgb, float alphaScale, unsigned char * dst){
+	const unsigned char * srgbTable = getMipmapTables().linearToSrgb;
+	for ( unsigned int x=0; x<width; x++ ){
+		for ( int c=0; c<3; c++ ){
+			float value = clamp01(src[x*4 + c]);
+			dst[x*channels + c] = srgb
+				? srgbTable[(int)(value * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)]
+				: (unsigned char)(value * 255.0f + 0.5f);
+		}
+		if ( channels == 4 )
+			dst[x*4 + 3] = (unsigned char)(clamp01(src[x*4 + 3] * alphaScale) * 255.0f + 0.5f);
+	}
+}
+
+#ifdef MIPMAP_X86
+
+MIPMAP_TARGET("sse2")
+static void accumulateRowsSse(const float * const * rows, const float * weights, int tapCount, size_t count, float * dst){
+	// count is a multiple of 4 : whole texels
+	for ( size_t i=0; i<count; i+=4 ){
+		__m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(rows[0] + i));
+		for ( int k=1; k<tapCount; k++ )
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+		_mm_storeu_ps(dst + i, sum);
+	}
+}
+
+MIPMAP_TARGET("sse2")
+static void filterRowSse(const float * src, const int * offsets, const float * weights, int tapCount, unsigned int width, float * dst){
+	__m128 w[8];
+	for ( int k=0; k<tapCount; k++ )
+		w[k] = _mm_set1_ps(weights[k]);
+	for ( unsigned int x=0; x<width; x++ ){
+		const int * texelOffsets = offsets + x * tapCount;
+		__m128 sum = _mm_mul_ps(w[0], _mm_loadu_ps(src + texelOffsets[0]));
+		for ( int k=1; k<tapCount; k++ )
+			sum = _mm_add_ps(sum, _mm_mul_ps(w[k], _mm_loadu_ps(src + texelOffsets[k])));
+		_mm_storeu_ps(dst + x*4, sum);
+	}
+}
+
+// Clamps and scales with SSE into 32 bit values, then narrows or looks sRGB up one by one
+MIPMAP_TARGET("sse2")
+static void encodeRowSse(const float * src, unsigned int width, int channels, bool srgb, float alphaScale, unsigned char * dst, int * scratch){
+	const unsigned char * srgbTable = getMipmapTables().linearToSrgb;
+	float colorScale = srgb ? float(LINEAR_TO_SRGB_SIZE - 1) : 255.0f;
+	const __m128 prescale = _mm_setr_ps(1.0f, 1.0f, 1.0f, alphaScale);
+	const __m128 scale = _mm_setr_ps(colorScale, colorScale, colorScale, 255.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	for ( unsigned int x=0; x<width; x++ ){
+		__m128 value = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + x*4), prescale), zero), one);
+		// Rounds to nearest
+		_mm_storeu_si128((__m128i*)(scratch + x*4), _mm_cvtps_epi32(_mm_mul_ps(value, scale)));
+	}
+	for ( unsigned int x=0; x<width; x++ ){
+		for ( int c=0; c<3; c++ )
+			dst[x*channels + c] = srgb ? srgbTable[scratch[x*4 + c]] : (unsigned char)scratch[x*4 + c];
+		if ( channels == 4 )
+			dst[x*4 + 3] = (unsigned char)scratch[x*4 + 3];
+	}
+}
+
+// RGBA only : gathers 2 texels from the tables at a time
+MIPMAP_TARGET("avx2,fma")
+static void decodeRowAvx2(const unsigned char * src, unsigned int width, const float * colorTable, float * dst){
+	const float * alphaTable = getMipmapTables().unormToFloat;
+	unsigned int pairCount = width / 2;
+	for ( unsigned int i=0; i<pairCount; i++ ){
+		__m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i*8)));
+		__m256 colors = _mm256_i32gather_ps(colorTable, indices, 4);
+		__m256 alphas = _mm256_i32gather_ps(alphaTable, indices, 4);
+		_mm256_storeu_ps(dst + i*8, _mm256_blend_ps(colors, alphas, 0x88));
+	}
+	if ( width & 1 )
+		decodeRowScalar(src + pairCount*8, 1, 4, colorTable, dst + pairCount*8);
+}
+
+MIPMAP_TARGET("avx2,fma")
+static void accumulateRowsAvx2(const float * const * rows, const float * weights, int tapCount, size_t count, float * dst){
+	size_t wideCount = count & ~size_t(7);
+	for ( size_t i=0; i<wideCount; i+=8 ){
+		__m256 sum = _mm256_mul_ps(_mm256_set1_ps(weights[0]), _mm256_loadu_ps(rows[0] + i));
+		for ( int k=1; k<tapCount; k++ )
+			sum = _mm256_fmadd_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i), sum);
+		_mm256_storeu_ps(dst + i, sum);
+	}
+	// An odd texel
+	if ( wideCount < count ){
+		__m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(rows[0] + wideCount));
+		for ( int k=1; k<tapCount; k++ )
+			sum = _mm_fmadd_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + wideCount), sum);
+		_mm_storeu_ps(dst + wideCount, sum);
+	}
+}
+
+MIPMAP_TARGET("avx2,fma")
+static void filterRowAvx2(const float * src, const int * offsets, const float * weights, int tapCount, unsigned int width, float * dst){
+	__m256 w[8];
+	for ( int k=0; k<tapCount; k++ )
+		w[k] = _mm256_set1_ps(weights[k]);
+	unsigned int x = 0;
+	for ( ; x+2<=width; x+=2 ){
+		const int * first = offsets + x * tapCount;
+		const int * second = first + tapCount;
+		__m256 sum = _mm256_setzero_ps();
+		for ( int k=0; k<tapCount; k++ ){
+			__m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + first[k])), _mm_loadu_ps(src + second[k]), 1);
+			sum = _mm256_fmadd_ps(w[k], texels, sum);
+		}
+		_mm256_storeu_ps(dst + x*4, sum);
+	}
+	if ( x < width ){
+		const int * texelOffsets = offsets + x * tapCount;
+		__m128 sum = _mm_setzero_ps();
+		for ( int k=0; k<tapCount; k++ )
+			sum = _mm_fmadd_ps(_mm256_castps256_ps128(w[k]), _mm_loadu_ps(src + texelOffsets[k]), sum);
+		_mm_storeu_ps(dst + x*4, sum);
+	}
+}
+
+#endif
+
+static void decodeRow(MipmapPath path, const unsigned char * src, unsigned int width, int channels, const float * colorTable, float * dst){
+#ifdef MIPMAP_X86
+	if ( path == MIPMAP_PATH_AVX2 && channels == 4 )
+		return decodeRowAvx2(src, width, colorTable, dst);
+#endif
+	decodeRowScalar(src, width, channels, colorTable, dst);
+}
+
+static void accumulateRows(MipmapPath path, const float * const * rows, const float * weights, int tapCount, size_t count, float * dst){
+#ifdef MIPMAP_X86
+	if ( path == MIPMAP_PATH_AVX2 )
+		return accumulateRowsAvx2(rows, weights, tapCount, count, dst);
+	if ( path == MIPMAP_PATH_SSE )
+		return accumulateRowsSse(rows, weights, tapCount, count, dst);
+#endif
+	accumulateRowsScalar(rows, weights, tapCount, count, dst);
+}
+
+static void filterRow(MipmapPath path, const float * src, const int * offsets, const float * weights, int tapCount, unsigned int width, float * dst){
+#ifdef MIPMAP_X86
+	if ( path == MIPMAP_PATH_AVX2 )
+		return filterRowAvx2(src, offsets, weights, tapCount, width, dst);
+	if ( path == MIPMAP_PATH_SSE )
+		return filterRowSse(src, offsets, weights, tapCount, width, dst);
+#endif
+	filterRowScalar(src, offsets, weights, tapCount, width, dst);
+}
+
+static void encodeRow(MipmapPath path, const float * src, unsigned int width, int channels, bool srgb, float alphaScale, unsigned char * dst, std::vector<int> & scratch){
+#ifdef MIPMAP_X86
+	if ( path != MIPMAP_PATH_SCALAR ){
+		scratch.resize(width * 4);
+		return encodeRowSse(src, width, channels, srgb, alphaScale, dst, &scratch[0]);
+	}
+#endif
+	encodeRowScalar(src, width, channels, srgb, alphaScale, dst);
+}
+
+
+// The alpha above which coverage of the texels are : the test threshold that keeps the
+// coverage of level 0 at this level
+static float getCoverageThreshold(const std::vector<float> & texels, size_t texelCount, float coverage, unsigned int threadCount){
+	std::atomic<unsigned int> bins[ALPHA_BIN_COUNT];
+	for ( int i=0; i<ALPHA_BIN_COUNT; i++ )
+		bins[i] = 0;
+	parallelFor(texelCount, 1 << 16, [&](size_t begin, size_t end){
+		std::vector<unsigned int> localBins(ALPHA_BIN_COUNT, 0);
+		for ( size_t i=begin; i<end; i++ ){
+			int bin = (int)(clamp01(texels[i*4 + 3]) * (ALPHA_BIN_COUNT - 1));
+			localBins[bin]++;
+		}
+		for ( int i=0; i<ALPHA_BIN_COUNT; i++ ){
+			if ( localBins[i] != 0 ) bins[i] += localBins[i];
+		}
+	}, threadCount);
+
+	size_t wanted = (size_t)(coverage * texelCount + 0.5);
+	size_t covered = 0;
+	for ( int i=ALPHA_BIN_COUNT-1; i>0; i-- ){
+		covered += bins[i];
+		if ( covered >= wanted )
+			return i / float(ALPHA_BIN_COUNT - 1);
+	}
+	return 0.0f;
+}
+
+// level0 : NULL when level 0 is in data.pixels
+static bool buildMipmapChain(TextureData & data, const unsigned char * level0, const MipmapOptions & options){
+	int channels;
+	if ( data.format == GL_RGB || data.format == GL_BGR )
+		channels = 3;
+	else if ( data.format == GL_RGBA || data.format == GL_BGRA )
+		channels = 4;
+	else
+		return false;
+	if ( data.type != GL_UNSIGNED_BYTE || data.levelOffsets.size() < 2 || data.width == 0 || data.height == 0 )
+		return false;
+
+	MipmapPath path = options.path <= getMipmapPath() ? options.path : getMipmapPath();
+	const MipmapTables & tables = getMipmapTables();
+	const float * colorTable = options.srgb ? tables.srgbToLinear : tables.unormToFloat;
+	MipmapKernel kernel;
+	getMipmapKernel(options.filter, kernel);
+
+	// Level 0 keeps its offsets, the BMP may pad it
+	unsigned int levelCount = 1;
+	while ( (data.width >> levelCount) > 0 || (data.height >> levelCount) > 0 )
+		levelCount++;
+	data.levelOffsets.resize(2);
+	for ( unsigned int level=1; level<levelCount; level++ ){
+		unsigned int width  = data.width  >> level ? data.width  >> level : 1;
+		unsigned int height = data.height >> level ? data.height >> level : 1;
+		data.levelOffsets.push_back(data.levelOffsets.back() + getTextureRowStride(width, channels) * height);
+	}
+	size_t base = level0 != NULL ? data.levelOffsets[1] : 0;
+	data.pixels.resize(data.levelOffsets.back() - base);
+	if ( level0 == NULL )
+		level0 = &data.pixels[0];
+
+	// Share of the texels of level 0 that pass the alpha test
+	bool keepCoverage = channels == 4 && options.alphaCoverage > 0.0f;
+	float coverage = 0.0f;
+	if ( keepCoverage ){
+		unsigned int stride = getTextureRowStride(data.width, 4);
+		size_t covered = 0;
+		for ( unsigned int y=0; y<data.height; y++ ){
+			const unsigned char * row = level0 + (size_t)y * stride;
+			for ( unsigned int x=0; x<data.width; x++ )
+				covered += row[x*4 + 3] > options.alphaCoverage * 255.0f ? 1 : 0;
+		}
+		coverage = covered / float(data.width * data.height);
+	}
+
+	std::vector<float> above, level;
+	std::vector<int> offsets;
+	for ( unsigned int levelIndex=1; levelIndex<levelCount; levelIndex++ ){
+		unsigned int srcWidth  = data.width  >> (levelIndex - 1) ? data.width  >> (levelIndex - 1) : 1;
+		unsigned int srcHeight = data.height >> (levelIndex - 1) ? data.height >> (levelIndex - 1) : 1;
+		unsigned int width  = data.width  >> levelIndex ? data.width  >> levelIndex : 1;
+		unsigned int height = data.height >> levelIndex ? data.height >> levelIndex : 1;
+
+		// Where the taps of each texel of a row are, in floats
+		offsets.resize(width * kernel.tapCount);
+		for ( unsigned int x=0; x<width; x++ ){
+			for ( int k=0; k<kernel.tapCount; k++ )
+				offsets[x * kernel.tapCount + k] = wrapIndex(2*x + kernel.offset + k, srcWidth) * 4;
+		}
+
+		level.resize((size_t)width * height * 4);
+		unsigned char * pixels = &data.pixels[data.levelOffsets[levelIndex] - base];
+		unsigned int stride = getTextureRowStride(width, channels);
+		parallelFor(height, MIPMAP_ROW_GRAIN, [&](size_t begin, size_t end){
+			// Rows above that the range reads, decoded first for level 1
+			static thread_local std::vector<float> decoded;
+			static thread_local std::vector<float> vertical;
+			static thread_local std::vector<int> scratch;
+			int firstRow = 2 * (int)begin + kernel.offset;
+			int rowCount = 2 * (int)(end - begin) + kernel.tapCount - 2;
+			std::vector<const float*> rows(rowCount);
+			size_t rowSize = (size_t)srcWidth * 4;
+			if ( levelIndex == 1 ){
+				decoded.resize(rowCount * rowSize);
+				unsigned int srcStride = getTextureRowStride(srcWidth, channels);
+				for ( int j=0; j<rowCount; j++ ){
+					const unsigned char * src = level0 + (size_t)wrapIndex(firstRow + j, srcHeight) * srcStride;
+					decodeRow(path, src, srcWidth, channels, colorTable, &decoded[j * rowSize]);
+					rows[j] = &decoded[j * rowSize];
+				}
+			}
+			else {
+				for ( int j=0; j<rowCount; j++ )
+					rows[j] = &above[wrapIndex(firstRow + j, srcHeight) * rowSize];
+			}
+
+			vertical.resize(rowSize);
+			for ( size_t y=begin; y<end; y++ ){
+				float * row = &level[y * width * 4];
+				accumulateRows(path, &rows[2 * (y - begin)], kernel.weights, kernel.tapCount, rowSize, &vertical[0]);
+				filterRow(path, &vertical[0], &offsets[0], kernel.weights, kernel.tapCount, width, row);
+				// While the row is in cache, unless alpha needs the whole level first
+				if ( !keepCoverage )
+					encodeRow(path, row, width, channels, options.srgb, 1.0f, pixels + y * stride, scratch);
+			}
+		}, options.threadCount);
+
+		// Alpha scaled so that as many texels pass the test as in level 0. Only the bytes are
+		// scaled : the next level is filtered from the actual alpha.
+		if ( keepCoverage ){
+			float alphaScale = 1.0f;
+			float threshold = getCoverageThreshold(level, (size_t)width * height, coverage, options.threadCount);
+			if ( threshold > 0.0f )
+				alphaScale = options.alphaCoverage / threshold;
+			parallelFor(height, MIPMAP_ROW_GRAIN * 4, [&](size_t begin, size_t end){
+				static thread_local std::vector<int> scratch;
+				for ( size_t y=begin; y<end; y++ )
+					encodeRow(path, &level[y * width * 4], width, channels, options.srgb, alphaScale, pixels + y * stride, scratch);
+			}, options.threadCount);
+		}
+
+		above.swap(level);
+	}
+
+	data.generateMipmaps = false;
+	return true;
+}
+
+bool buildMipmaps(TextureData & data, const MipmapOptions & options){
+	return buildMipmapChain(data, NULL, options);
+}
+
+bool buildMipmaps(TextureData & data, const unsigned char * level0, const MipmapOptions & options){
+	return buildMipmapChain(data, level0, options);
+}
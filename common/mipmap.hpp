@@ -0,0 +1,46 @@
+#ifndef MIPMAP_HPP
+#define MIPMAP_HPP
+
+// Mip chains built on the CPU, on the job threads, instead of glGenerateMipmap : a sync point
+// of the GL thread, slow on software drivers, and a box filter of the sRGB values at best.
+
+struct TextureData;
+
+enum MipmapFilter {
+	MIPMAP_FILTER_BOX = 0,      // Average of 2x2 texels
+	MIPMAP_FILTER_KAISER = 1    // Kaiser windowed sinc over 8x8 texels : sharper, may ring a little
+};
+
+enum MipmapPath {
+	MIPMAP_PATH_SCALAR = 0,
+	MIPMAP_PATH_SSE = 1,        // 1 texel at a time
+	MIPMAP_PATH_AVX2 = 2        // 2 texels at a time, with FMA
+};
+
+// The widest path this CPU runs, checked once
+MipmapPath getMipmapPath();
+
+const char * getMipmapPathName(MipmapPath path);
+
+struct MipmapOptions {
+	MipmapFilter filter;
+	bool srgb;                  // Colors are sRGB, and filtered as linear light. Not for normals and other data.
+	float alphaCoverage;        // Alpha test reference whose coverage each level keeps, 0 for none
+	unsigned int threadCount;   // See parallelFor
+	MipmapPath path;
+
+	MipmapOptions() : filter(MIPMAP_FILTER_KAISER), srgb(true), alphaCoverage(0.0f), threadCount(0), path(getMipmapPath()) {}
+};
+
+// Fills in every level below level 0 of an 8 bit RGB, BGR, RGBA or BGRA texture, such as
+// readImage leaves with generateMipmaps set, which it clears. Rows of every level are padded
+// to 4 bytes, as for level 0. Each level is filtered from the one above, kept as floats, and
+// edges wrap around, as textures repeat.
+// Returns false for other formats.
+bool buildMipmaps(TextureData & data, const MipmapOptions & options = MipmapOptions());
+
+// The same, with level 0 read from level0, such as an image still in its file mapping :
+// data.pixels gets the levels below only, level n at levelOffsets[n] - levelOffsets[1].
+bool buildMipmaps(TextureData & data, const unsigned char * level0, const MipmapOptions & options = MipmapOptions());
+
+#endif
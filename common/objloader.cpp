@@ -1,10 +1,13 @@
 #include <vector>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <cstring>
 
 #include <glm/glm.hpp>
 
+#include "mappedfile.hpp"
+#include "parallel.hpp"
 #include "objloader.hpp"
 
 // Very, VERY simple OBJ loader.
@@ -17,7 +20,8 @@
 // - More secure. Change another line and you can inject code.
 // - Loading from memory, stream, etc
 
-bool loadOBJ(
+// The original fscanf-based loader. Kept around as a reference for loadOBJ.
+bool loadOBJ_slow(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
 	std::vector<glm::vec2> & out_uvs,
@@ -111,6 +115,488 @@ bool loadOBJ(
 }
 
 
+// Fast path : the file is mapped and parsed in place.
+// No stdio, no locale, no temporary strings, and every vector
+// is sized once from a quick first pass over the line headers.
+//
+// Big files are split into chunks on line boundaries and the chunks are
+// parsed in parallel. Each chunk only knows its own records, so the merge
+// uses prefix sums of the per-chunk counts to place them in the global
+// lists. The serial path is the same code with a single chunk, which is
+// why both produce exactly the same output.
+
+struct OBJRecordCounts {
+	size_t vertices;
+	size_t uvs;
+	size_t normals;
+	size_t faces;
+};
+
+struct OBJChunk {
+	const char * begin;
+	const char * end;
+
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+
+	// 3 corners per face, each corner is vertex/uv/normal.
+	// Absolute OBJ indices are stored 0-based. Relative (negative) ones can only
+	// be resolved against this chunk's own records : they are stored as a signed
+	// offset from the chunk's first record, and listed in relativeCorners.
+	std::vector<unsigned int> corners;
+	std::vector<size_t> relativeCorners;
+
+	// Where parsing failed, NULL if it didn't
+	const char * error;
+
+	// Where this chunk's records go in the global lists
+	OBJRecordCounts base;
+};
+
+static inline bool isLineEnd(char c){
+	return c == '\n' || c == '\r';
+}
+
+static inline bool isBlank(char c){
+	return c == ' ' || c == '\t';
+}
+
+static inline const char * skipBlanks(const char * p, const char * end){
+	while ( p < end && isBlank(*p) ) p++;
+	return p;
+}
+
+// Returns the beginning of the next line (CR, LF and CRLF all work)
+static inline const char * skipLine(const char * p, const char * end){
+	while ( p < end && !isLineEnd(*p) ) p++;
+	if ( p < end && *p++ == '\r' && p < end && *p == '\n' ) p++;
+	return p;
+}
+
+// Exact powers of ten, as far as a double can represent them
+static const double POWERS_OF_TEN[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10
+};
+
+// Significant digits kept by normalizeFloat : a value halfway between two floats has at most
+// 113 of them, so the digits past 120 only tell which side of it the number is
+#define NORMALIZED_DIGITS 120
+
+// Rewrites the number parseFloat read from [p, end) as [-]digits e exponent, without a
+// decimal point, so that strtof reads it the same in every locale. Keeps the first
+// NORMALIZED_DIGITS significant digits, and a 1 after them if any of the others isn't 0 :
+// strtof rounds that to the same float as the whole number. buffer : at least
+// NORMALIZED_DIGITS + 16 chars.
+static void normalizeFloat(const char * p, const char * end, char * buffer){
+	char * out = buffer;
+	if ( *p == '-' || *p == '+' ){
+		if ( *p == '-' ) *out++ = '-';
+		p++;
+	}
+	int digits = 0;
+	long exponent = 0;
+	bool dropped = false;
+	bool fraction = false;
+	for ( ; p < end; p++ ){
+		if ( *p == '.' ){
+			fraction = true;
+			continue;
+		}
+		if ( (unsigned)(*p - '0') >= 10 )
+			break;
+		if ( digits == 0 && *p == '0' ){
+			if ( fraction ) exponent--;
+			continue;
+		}
+		if ( digits < NORMALIZED_DIGITS ){
+			*out++ = *p;
+			digits++;
+			if ( fraction ) exponent--;
+		}else{
+			dropped = dropped || *p != '0';
+			if ( !fraction ) exponent++;
+		}
+	}
+	if ( digits == 0 )
+		*out++ = '0';
+	if ( dropped ){
+		*out++ = '1';
+		exponent--;
+	}
+	if ( p < end && (*p == 'e' || *p == 'E') ){
+		p++;
+		bool negativeExponent = false;
+		if ( p < end && (*p == '-' || *p == '+') ){
+			negativeExponent = (*p == '-');
+			p++;
+		}
+		long value = 0;
+		while ( p < end && (unsigned)(*p - '0') < 10 ){
+			if ( value < 100000 ) value = value * 10 + (*p - '0');
+			p++;
+		}
+		exponent += negativeExponent ? -value : value;
+	}
+	sprintf(out, "e%ld", exponent);
+}
+
+// Parses a decimal float like "-1.5e-3". Returns NULL if there is no number at p.
+// The digits are accumulated in an integer and scaled once. When both the integer and the
+// power of ten are exact floats, as with the 6 or 7 digits modelers write out, the double
+// product or quotient rounds to the same float as strtof would; anything longer is handed
+// to strtof, see normalizeFloat.
+static const char * parseFloat(const char * p, const char * end, float & out){
+	p = skipBlanks(p, end);
+	const char * number = p;
+
+	bool negative = false;
+	if ( p < end && (*p == '-' || *p == '+') ){
+		negative = (*p == '-');
+		p++;
+	}
+
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	const char * start = p;
+
+	while ( p < end && (unsigned)(*p - '0') < 10 ){
+		if ( digits < 19 ){
+			mantissa = mantissa * 10 + (*p - '0');
+			if ( mantissa ) digits++;
+		}else{
+			exponent++; // Too many digits, only keep the magnitude
+		}
+		p++;
+	}
+	if ( p < end && *p == '.' ){
+		p++;
+		while ( p < end && (unsigned)(*p - '0') < 10 ){
+			if ( digits < 19 ){
+				mantissa = mantissa * 10 + (*p - '0');
+				if ( mantissa ) digits++;
+				exponent--;
+			}
+			p++;
+		}
+	}
+	if ( p == start || (p == start + 1 && *start == '.') )
+		return NULL;
+
+	if ( p < end && (*p == 'e' || *p == 'E') ){
+		const char * e = p + 1;
+		bool negativeExponent = false;
+		if ( e < end && (*e == '-' || *e == '+') ){
+			negativeExponent = (*e == '-');
+			e++;
+		}
+		if ( e < end && (unsigned)(*e - '0') < 10 ){
+			int value = 0;
+			while ( e < end && (unsigned)(*e - '0') < 10 ){
+				if ( value < 10000 ) value = value * 10 + (*e - '0');
+				e++;
+			}
+			exponent += negativeExponent ? -value : value;
+			p = e;
+		}
+	}
+
+	if ( mantissa == 0 ){
+		out = negative ? -0.0f : 0.0f;
+		return p;
+	}
+	if ( mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10 ){
+		double result = (double)mantissa;
+		if ( exponent >= 0 ) result *= POWERS_OF_TEN[exponent];
+		else                 result /= POWERS_OF_TEN[-exponent];
+		out = (float)(negative ? -result : result);
+		return p;
+	}
+
+	// The file isn't null terminated, and strtof would want the locale's decimal point
+	char buffer[NORMALIZED_DIGITS + 16];
+	normalizeFloat(number, p, buffer);
+	out = strtof(buffer, NULL);
+	return p;
+}
+
+// Parses an OBJ index. Negative indices are relative to the end of the list.
+static const char * parseIndex(const char * p, const char * end, long long & out){
+	bool negative = false;
+	if ( p < end && *p == '-' ){
+		negative = true;
+		p++;
+	}
+	if ( p == end || (unsigned)(*p - '0') >= 10 )
+		return NULL;
+
+	long long value = 0;
+	while ( p < end && (unsigned)(*p - '0') < 10 ){
+		if ( value < 0x100000000LL ) value = value * 10 + (*p - '0');
+		p++;
+	}
+	out = negative ? -value : value;
+	return p;
+}
+
+// Stores one OBJ index in chunk.corners, see OBJChunk. count is the number of
+// records of this kind the chunk has read so far.
+static bool storeIndex(long long index, size_t count, OBJChunk & chunk){
+	if ( index > 0 && index <= 0xFFFFFFFFLL ){
+		chunk.corners.push_back((unsigned int)(index - 1));
+		return true;
+	}
+	long long local = (long long)count + index;
+	if ( index < 0 && local >= -0x80000000LL ){
+		chunk.relativeCorners.push_back(chunk.corners.size());
+		chunk.corners.push_back((unsigned int)(int)local);
+		return true;
+	}
+	return false;
+}
+
+static OBJRecordCounts countOBJRecords(const char * p, const char * end){
+	OBJRecordCounts counts = {0, 0, 0, 0};
+	while ( p < end ){
+		p = skipBlanks(p, end);
+		if ( end - p >= 2 ){
+			if ( p[0] == 'v' ){
+				if      ( isBlank(p[1]) ) counts.vertices++;
+				else if ( p[1] == 't' )   counts.uvs++;
+				else if ( p[1] == 'n' )   counts.normals++;
+			}else if ( p[0] == 'f' && isBlank(p[1]) ){
+				counts.faces++;
+			}
+		}
+		p = skipLine(p, end);
+	}
+	return counts;
+}
+
+// Parses every record of the chunk. On error, chunk.error points to the faulty line.
+static void parseOBJChunk(OBJChunk & chunk){
+	const char * end = chunk.end;
+
+	// First pass : only look at the line headers, so that nothing gets reallocated later
+	OBJRecordCounts counts = countOBJRecords(chunk.begin, end);
+	chunk.vertices.reserve(counts.vertices);
+	chunk.uvs     .reserve(counts.uvs);
+	chunk.normals .reserve(counts.normals);
+	chunk.corners .reserve(counts.faces * 9);
+	chunk.error = NULL;
+
+	for ( const char * p = chunk.begin; p < end; p = skipLine(p, end) ){
+		const char * line = p;
+		p = skipBlanks(p, end);
+		if ( p == end || isLineEnd(*p) )
+			continue; // Blank line
+
+		// Read the first word of the line
+		const char * header = p;
+		while ( p < end && !isBlank(*p) && !isLineEnd(*p) ) p++;
+		size_t headerLength = p - header;
+
+		if ( headerLength == 1 && header[0] == 'v' ){
+			glm::vec3 vertex;
+			if ( !(p = parseFloat(p, end, vertex.x)) || !(p = parseFloat(p, end, vertex.y)) || !(p = parseFloat(p, end, vertex.z)) ){
+				chunk.error = line;
+				return;
+			}
+			chunk.vertices.push_back(vertex);
+		}else if ( headerLength == 2 && header[0] == 'v' && header[1] == 't' ){
+			glm::vec2 uv;
+			if ( !(p = parseFloat(p, end, uv.x)) || !(p = parseFloat(p, end, uv.y)) ){
+				chunk.error = line;
+				return;
+			}
+			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+			chunk.uvs.push_back(uv);
+		}else if ( headerLength == 2 && header[0] == 'v' && header[1] == 'n' ){
+			glm::vec3 normal;
+			if ( !(p = parseFloat(p, end, normal.x)) || !(p = parseFloat(p, end, normal.y)) || !(p = parseFloat(p, end, normal.z)) ){
+				chunk.error = line;
+				return;
+			}
+			chunk.normals.push_back(normal);
+		}else if ( headerLength == 1 && header[0] == 'f' ){
+			// Exactly like the slow loader : triangles, with v/vt/vn on every corner
+			for ( int corner=0; corner<3; corner++ ){
+				long long v, vt, vn;
+				p = skipBlanks(p, end);
+				if ( !(p = parseIndex(p, end, v)) || p == end || *p++ != '/' ||
+				     !(p = parseIndex(p, end, vt)) || p == end || *p++ != '/' ||
+				     !(p = parseIndex(p, end, vn)) ||
+				     !storeIndex(v,  chunk.vertices.size(), chunk) ||
+				     !storeIndex(vt, chunk.uvs.size(),      chunk) ||
+				     !storeIndex(vn, chunk.normals.size(),  chunk) ){
+					chunk.error = line;
+					return;
+				}
+			}
+		}
+		// Anything else is a comment, a material, a group... Skip the line.
+	}
+}
+
+// Copies src at dst[offset...], or just takes it if it is the only chunk
+template <typename T>
+static void mergeRecords(std::vector<T> & src, std::vector<T> & dst, size_t offset, bool onlyChunk){
+	if ( onlyChunk )
+		dst.swap(src);
+	else if ( !src.empty() )
+		memcpy(&dst[offset], &src[0], src.size() * sizeof(T));
+}
+
+// 1-based line number of p, for error messages
+static unsigned int lineNumber(const char * data, const char * p){
+	unsigned int line = 1;
+	for ( const char * q = data; q < p; ){
+		q = skipLine(q, p);
+		if ( isLineEnd(q[-1]) ) line++;
+	}
+	return line;
+}
+
+bool loadOBJFromMemory(
+	const char * data,
+	size_t size,
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount
+){
+	const char * end = data + size;
+
+	if ( threadCount == 0 )
+		threadCount = size < 4 * 1024 * 1024 ? 1 : getHardwareThreadCount();
+
+	// A few chunks per thread, so that a dense chunk doesn't keep the others waiting,
+	// but not so small that the merge would cost more than the parsing.
+	size_t chunkCount = 1;
+	if ( threadCount > 1 ){
+		chunkCount = (size_t)threadCount * 4;
+		size_t maxChunkCount = size / (256 * 1024) + 1;
+		if ( chunkCount > maxChunkCount ) chunkCount = maxChunkCount;
+	}
+
+	// Cut on line boundaries
+	std::vector<OBJChunk> chunks(chunkCount);
+	const char * begin = data;
+	for ( size_t i=0; i<chunkCount; i++ ){
+		const char * chunkEnd = end;
+		if ( i + 1 < chunkCount ){
+			chunkEnd = data + size / chunkCount * (i + 1);
+			if ( chunkEnd < begin ) chunkEnd = begin;
+			if ( chunkEnd > data && !isLineEnd(chunkEnd[-1]) ) chunkEnd = skipLine(chunkEnd, end);
+		}
+		chunks[i].begin = begin;
+		chunks[i].end = chunkEnd;
+		begin = chunkEnd;
+	}
+
+	parallelFor(chunkCount, 1, [&](size_t first, size_t last){
+		for ( size_t i=first; i<last; i++ )
+			parseOBJChunk(chunks[i]);
+	}, threadCount);
+
+	// Prefix sums : where each chunk goes in the global lists
+	OBJRecordCounts total = {0, 0, 0, 0};
+	for ( size_t i=0; i<chunkCount; i++ ){
+		OBJChunk & chunk = chunks[i];
+		if ( chunk.error ){
+			printf("File can't be read by our simple parser :-( Error on line %u. Try exporting with other options\n", lineNumber(data, chunk.error));
+			return false;
+		}
+		chunk.base = total;
+		total.vertices += chunk.vertices.size();
+		total.uvs      += chunk.uvs.size();
+		total.normals  += chunk.normals.size();
+		total.faces    += chunk.corners.size() / 9;
+	}
+
+	std::vector<glm::vec3> vertices(chunkCount > 1 ? total.vertices : 0);
+	std::vector<glm::vec2> uvs     (chunkCount > 1 ? total.uvs      : 0);
+	std::vector<glm::vec3> normals (chunkCount > 1 ? total.normals  : 0);
+
+	parallelFor(chunkCount, 1, [&](size_t first, size_t last){
+		for ( size_t i=first; i<last; i++ ){
+			OBJChunk & chunk = chunks[i];
+			mergeRecords(chunk.vertices, vertices, chunk.base.vertices, chunkCount == 1);
+			mergeRecords(chunk.uvs,      uvs,      chunk.base.uvs,      chunkCount == 1);
+			mergeRecords(chunk.normals,  normals,  chunk.base.normals,  chunkCount == 1);
+		}
+	}, threadCount);
+
+	// For each vertex of each triangle, put the attributes in the buffers
+	size_t first = out_vertices.size();
+	out_vertices.resize(first + total.faces * 3);
+	out_uvs     .resize(first + total.faces * 3);
+	out_normals .resize(first + total.faces * 3);
+
+	std::atomic<bool> outOfRange(false);
+	parallelFor(chunkCount, 1, [&](size_t firstChunk, size_t lastChunk){
+		for ( size_t i=firstChunk; i<lastChunk; i++ ){
+			OBJChunk & chunk = chunks[i];
+			if ( chunk.corners.empty() )
+				continue;
+
+			// Relative indices can now be made absolute
+			const size_t bases[3] = { chunk.base.vertices, chunk.base.uvs, chunk.base.normals };
+			for ( size_t r=0; r<chunk.relativeCorners.size(); r++ ){
+				size_t c = chunk.relativeCorners[r];
+				long long index = (long long)bases[c % 3] + (int)chunk.corners[c];
+				chunk.corners[c] = index < 0 ? 0xFFFFFFFFu : (unsigned int)index;
+			}
+
+			const unsigned int * corner = &chunk.corners[0];
+			size_t out = first + chunk.base.faces * 3;
+			size_t count = chunk.corners.size() / 3;
+			for ( size_t c=0; c<count; c++, corner+=3, out++ ){
+				if ( corner[0] >= total.vertices || corner[1] >= total.uvs || corner[2] >= total.normals ){
+					outOfRange = true;
+					return;
+				}
+				out_vertices[out] = vertices[ corner[0] ];
+				out_uvs     [out] = uvs     [ corner[1] ];
+				out_normals [out] = normals [ corner[2] ];
+			}
+		}
+	}, threadCount);
+
+	if ( outOfRange ){
+		printf("File can't be read by our simple parser :-( A face uses a vertex that doesn't exist.\n");
+		out_vertices.resize(first);
+		out_uvs     .resize(first);
+		out_normals .resize(first);
+		return false;
+	}
+	return true;
+}
+
+bool loadOBJ(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount
+){
+	printf("Loading OBJ file %s...\n", path);
+
+	MappedFile file;
+	if ( !mapFile(path, file) ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		getchar();
+		return false;
+	}
+
+	bool result = loadOBJFromMemory(file.data, file.size, out_vertices, out_uvs, out_normals, threadCount);
+
+	unmapFile(file);
+	return result;
+}
+
+
 #ifdef USE_ASSIMP // don't use this #define, it's only for me (it AssImp fails to compile on your machine, at least all the other tutorials still work)
 
 // Include AssImp
@@ -1,7 +1,29 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 
+// Maps the file and parses it in place. Same output as the old fscanf loader.
+// Big files are parsed on threadCount threads (0 : decide from the file size),
+// the result doesn't depend on the number of threads.
 bool loadOBJ(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount = 0
+);
+
+// Same as loadOBJ, for a file that is already in memory
+bool loadOBJFromMemory(
+	const char * data,
+	size_t size,
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount = 0
+);
+
+// The original fscanf loader, for comparison
+bool loadOBJ_slow(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
 	std::vector<glm::vec2> & out_uvs, 
@@ -18,4 +40,4 @@ bool loadAssImp(
 	std::vector<glm::vec3> & normals
 );
 
-#endif
\ No newline at end of file
+#endif
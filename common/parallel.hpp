@@ -0,0 +1,67 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "jobsystem.hpp"
+
+// Number of threads worth using for CPU bound work
+inline unsigned int getHardwareThreadCount(){
+	unsigned int count = std::thread::hardware_concurrency();
+	return count ? count : 1;
+}
+
+// A job of parallelFor : takes the next range until there is none left
+template <typename Body>
+struct ParallelForJob {
+	const Body * body;
+	size_t count;
+	size_t grainSize;
+	size_t rangeCount;
+	std::atomic<size_t> nextRange;
+
+	static void run(void * data){
+		ParallelForJob & job = *(ParallelForJob*)data;
+		for ( size_t range = job.nextRange++; range < job.rangeCount; range = job.nextRange++ ){
+			size_t begin = range * job.grainSize;
+			(*job.body)(begin, begin + job.grainSize < job.count ? begin + job.grainSize : job.count);
+		}
+	}
+};
+
+// Calls body(begin, end) on consecutive ranges covering [0, count), each at most
+// grainSize long, from up to threadCount jobs of the job system (0 : one per job thread).
+// Ranges are handed out in order, and the call returns once all of them are done. The
+// calling thread works too, and may itself be running a job.
+template <typename Body>
+void parallelFor(size_t count, size_t grainSize, const Body & body, unsigned int threadCount = 0){
+	if ( grainSize == 0 ) grainSize = 1;
+	size_t rangeCount = (count + grainSize - 1) / grainSize;
+
+	if ( threadCount == 0 ) threadCount = getJobThreadCount();
+	if ( threadCount > rangeCount ) threadCount = (unsigned int)rangeCount;
+
+	if ( threadCount <= 1 ){
+		for ( size_t begin=0; begin<count; begin+=grainSize )
+			body(begin, begin + grainSize < count ? begin + grainSize : count);
+		return;
+	}
+
+	ParallelForJob<Body> job;
+	job.body = &body;
+	job.count = count;
+	job.grainSize = grainSize;
+	job.rangeCount = rangeCount;
+	job.nextRange = 0;
+
+	JobCounter counter;
+	for ( unsigned int i=1; i<threadCount; i++ )
+		runJob(ParallelForJob<Body>::run, &job, counter);
+	ParallelForJob<Body>::run(&job);
+	waitForJobs(counter);
+}
+
+#endif
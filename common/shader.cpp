@@ -13,6 +13,7 @@ using namespace std;
 #include <GL/glew.h>
 
 #include "shader.hpp"
+#include "shadercache.hpp"
 
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
 
@@ -44,6 +45,14 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		FragmentShaderStream.close();
 	}
 
+	// Same sources and driver as last time : skip compiling and linking
+	GLuint CachedProgramID = loadCachedProgram(vertex_file_path, fragment_file_path, VertexShaderCode.c_str(), FragmentShaderCode.c_str());
+	if ( CachedProgramID != 0 ){
+		glDeleteShader(VertexShaderID);
+		glDeleteShader(FragmentShaderID);
+		return CachedProgramID;
+	}
+
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
@@ -87,6 +96,7 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	prepareProgramForCache(ProgramID);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -97,6 +107,8 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 		printf("%s\n", &ProgramErrorMessage[0]);
 	}
+	if ( Result == GL_TRUE )
+		saveCachedProgram(ProgramID, vertex_file_path, fragment_file_path, VertexShaderCode.c_str(), FragmentShaderCode.c_str());
 
 	
 	glDetachShader(ProgramID, VertexShaderID);
@@ -0,0 +1,162 @@
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "shadercache.hpp"
+#include "mappedfile.hpp"
+
+static const char PROGRAMCACHE_MAGIC[4] = { 'O', 'G', 'L', 'P' };
+static const unsigned int PROGRAMCACHE_VERSION = 1;
+
+struct ProgramCacheHeader {
+	char magic[4];              // "OGLP"
+	unsigned int version;       // PROGRAMCACHE_VERSION
+	unsigned long long key;     // See getProgramKey
+	unsigned int binaryFormat;  // As returned by glGetProgramBinary
+	unsigned int binarySize;    // In bytes, right after the header
+};
+
+// <vertex shader>.<fragment shader file name>.programcache
+static std::string getCachePath(const char * vertex_file_path, const char * fragment_file_path){
+	const char * fragmentName = fragment_file_path;
+	for ( const char * c = fragment_file_path; *c; c++ )
+		if ( *c == '/' || *c == '\\' )
+			fragmentName = c + 1;
+	return std::string(vertex_file_path) + "." + fragmentName + ".programcache";
+}
+
+// FNV-1a, including the terminating zero so that "ab"+"c" and "a"+"bc" differ
+static void hashString(unsigned long long & hash, const char * s){
+	if ( !s )
+		s = "";
+	do {
+		hash ^= (unsigned char)*s;
+		hash *= 1099511628211ULL;
+	} while ( *s++ );
+}
+
+// A binary is only valid for the exact same sources and driver
+static unsigned long long getProgramKey(const char * vertexSource, const char * fragmentSource){
+	unsigned long long hash = 14695981039346656037ULL;
+	hashString(hash, (const char *)glGetString(GL_VENDOR));
+	hashString(hash, (const char *)glGetString(GL_RENDERER));
+	hashString(hash, (const char *)glGetString(GL_VERSION));
+	hashString(hash, vertexSource);
+	hashString(hash, fragmentSource);
+	return hash;
+}
+
+bool isProgramCacheSupported(){
+	if ( !GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary )
+		return false;
+	GLint formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	return formatCount > 0;
+}
+
+GLuint loadCachedProgram(
+	const char * vertex_file_path,
+	const char * fragment_file_path,
+	const char * vertexSource,
+	const char * fragmentSource
+){
+	if ( !isProgramCacheSupported() )
+		return 0;
+
+	std::string cachePath = getCachePath(vertex_file_path, fragment_file_path);
+	FILE * file = fopen(cachePath.c_str(), "rb");
+	if ( !file )
+		return 0;
+
+	ProgramCacheHeader header;
+	std::vector<char> binary;
+	bool valid =
+		fread(&header, 1, sizeof(header), file) == sizeof(header) &&
+		memcmp(header.magic, PROGRAMCACHE_MAGIC, 4) == 0 &&
+		header.version == PROGRAMCACHE_VERSION &&
+		header.key == getProgramKey(vertexSource, fragmentSource) &&
+		header.binarySize > 0;
+	if ( valid ){
+		binary.resize(header.binarySize);
+		valid = fread(&binary[0], 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+	if ( !valid )
+		return 0;
+
+	GLuint ProgramID = glCreateProgram();
+	glProgramBinary(ProgramID, header.binaryFormat, &binary[0], header.binarySize);
+
+	// The driver may still refuse a binary it wrote itself, e.g. after a partial update
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if ( Result != GL_TRUE ){
+		printf("Cached program %s rejected by the driver, recompiling\n", cachePath.c_str());
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+	printf("Loaded cached program %s\n", cachePath.c_str());
+	return ProgramID;
+}
+
+void prepareProgramForCache(GLuint programID){
+	if ( isProgramCacheSupported() )
+		glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+struct ProgramCacheContents {
+	const ProgramCacheHeader * header;
+	const std::vector<char> * binary;
+};
+
+static bool writeProgramCache(FILE * file, void * data){
+	const ProgramCacheContents & contents = *(const ProgramCacheContents *)data;
+	size_t binarySize = contents.header->binarySize;
+	return
+		fwrite(contents.header, 1, sizeof(ProgramCacheHeader), file) == sizeof(ProgramCacheHeader) &&
+		fwrite(&(*contents.binary)[0], 1, binarySize, file) == binarySize;
+}
+
+bool saveCachedProgram(
+	GLuint programID,
+	const char * vertex_file_path,
+	const char * fragment_file_path,
+	const char * vertexSource,
+	const char * fragmentSource
+){
+	if ( !isProgramCacheSupported() )
+		return false;
+
+	GLint Result = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &Result);
+	GLint binarySize = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+	if ( Result != GL_TRUE || binarySize <= 0 )
+		return false;
+
+	std::vector<char> binary(binarySize);
+	GLenum binaryFormat = 0;
+	GLsizei writtenSize = 0;
+	glGetProgramBinary(programID, binarySize, &writtenSize, &binaryFormat, &binary[0]);
+	if ( writtenSize <= 0 )
+		return false;
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PROGRAMCACHE_MAGIC, 4);
+	header.version = PROGRAMCACHE_VERSION;
+	header.key = getProgramKey(vertexSource, fragmentSource);
+	header.binaryFormat = binaryFormat;
+	header.binarySize = (unsigned int)writtenSize;
+
+	std::string cachePath = getCachePath(vertex_file_path, fragment_file_path);
+	ProgramCacheContents contents = { &header, &binary };
+	if ( !writeFileAtomically(cachePath.c_str(), writeProgramCache, &contents) ){
+		printf("Could not write the program cache %s\n", cachePath.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,34 @@
+#ifndef SHADERCACHE_HPP
+#define SHADERCACHE_HPP
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary), so that
+// a program only has to be compiled the first time it's loaded with a given driver.
+// Entries live next to the vertex shader and are keyed by a hash of both sources and of
+// the GL vendor, renderer and version strings : editing a shader or updating the driver
+// just misses the cache.
+
+// Whether the context can save and load program binaries at all
+bool isProgramCacheSupported();
+
+// Returns a linked program made from the cached binary, or 0 if there is no entry for
+// these sources or if the driver rejects it. Then compile the program as usual.
+GLuint loadCachedProgram(
+	const char * vertex_file_path,
+	const char * fragment_file_path,
+	const char * vertexSource,
+	const char * fragmentSource
+);
+
+// Call before glLinkProgram on programs that will be saved with saveCachedProgram
+void prepareProgramForCache(GLuint programID);
+
+// Saves the binary of a successfully linked program. Returns false if nothing was written.
+bool saveCachedProgram(
+	GLuint programID,
+	const char * vertex_file_path,
+	const char * fragment_file_path,
+	const char * vertexSource,
+	const char * fragmentSource
+);
+
+#endif
@@ -6,63 +6,78 @@
 
 #include <GLFW/glfw3.h>
 
+#include "texture.hpp"
+#include "mipmap.hpp"
+#include "imageloader.hpp"
+
+
+bool readImage(const char * imagepath, TextureData & out_data){
+	Image image;
+	if ( !openImage(imagepath, image) )
+		return false;
+	getImageTextureData(image, out_data);
+
+	// Room for the levels buildMipmaps adds, so that they don't move level 0 again
+	unsigned int channels = image.format == GL_RGB || image.format == GL_BGR ? 3 : 4;
+	size_t chainSize = 0;
+	for ( unsigned int level=0; (image.width >> level) > 0 || (image.height >> level) > 0; level++ ){
+		unsigned int width  = image.width  >> level ? image.width  >> level : 1;
+		unsigned int height = image.height >> level ? image.height >> level : 1;
+		chainSize += (size_t)getTextureRowStride(width, channels) * height;
+	}
+	out_data.pixels.reserve(chainSize);
+	out_data.pixels.assign(image.pixels, image.pixels + out_data.levelOffsets[1]);
+	closeImage(image);
+	return true;
+}
 
-GLuint loadBMP_custom(const char * imagepath){
-
-	printf("Reading image %s\n", imagepath);
-
-	// Data read from the header of the BMP file
-	unsigned char header[54];
-	unsigned int dataPos;
-	unsigned int imageSize;
-	unsigned int width, height;
-	// Actual RGB data
-	unsigned char * data;
-
-	// Open the file
-	FILE* file = fopen(imagepath, "rb");
-	if (!file){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+GLuint loadImage(const char * imagepath, bool srgb){
+	// Wait for a key when the file can't be read, as the tutorials do, so that the console
+	// doesn't close
+	Image image;
+	if ( !openImage(imagepath, image) ){
 		getchar();
 		return 0;
 	}
 
-	// Read the header, i.e. the 54 first bytes
-
-	// If less than 54 bytes are read, problem
-	if ( fread(header, 1, 54, file)!=54 ){ 
-		printf("Not a correct BMP file\n");
-		fclose(file);
-		return 0;
-	}
-	// A BMP files always begins with "BM"
-	if ( header[0]!='B' || header[1]!='M' ){
-		printf("Not a correct BMP file\n");
-		fclose(file);
-		return 0;
-	}
-	// Make sure this is a 24bpp file
-	if ( *(int*)&(header[0x1E])!=0  ) {printf("Not a correct BMP file\n"); fclose(file); return 0;}
-	if ( *(int*)&(header[0x1C])!=24 ) {printf("Not a correct BMP file\n"); fclose(file); return 0;}
+	// Level 0 is uploaded from where the image is : the file itself when it can
+	TextureData data;
+	getImageTextureData(image, data);
+	MipmapOptions options;
+	options.srgb = srgb;
+	buildMipmaps(data, image.pixels, options);
+	GLuint textureID = createTexture(data, data.pixels.empty() ? NULL : &data.pixels[0], image.pixels);
+	closeImage(image);
+	return textureID;
+}
 
-	// Read the information about the image
-	dataPos    = *(int*)&(header[0x0A]);
-	imageSize  = *(int*)&(header[0x22]);
-	width      = *(int*)&(header[0x12]);
-	height     = *(int*)&(header[0x16]);
+GLuint loadBMP_custom(const char * imagepath, bool srgb){
+	return loadImage(imagepath, srgb);
+}
 
-	// Some BMP files are misformatted, guess missing information
-	if (imageSize==0)    imageSize=width*height*3; // 3 : one byte for each Red, Green and Blue component
-	if (dataPos==0)      dataPos=54; // The BMP header is done that way
+unsigned int getTextureLevelCount(const TextureData & data){
+	return (unsigned int)data.levelOffsets.size() - 1;
+}
 
-	// Create a buffer
-	data = new unsigned char [imageSize];
+unsigned int getTextureRowStride(unsigned int width, unsigned int channels){
+	return (width * channels + 3) & ~3u;
+}
 
-	// Read the actual data from the file into the buffer
-	fread(data,1,imageSize,file);
+void uploadTextureLevel(const TextureData & data, unsigned int level, const unsigned char * pixels){
+	// Deal with Non-Power-Of-Two textures
+	GLsizei width  = data.width  >> level ? data.width  >> level : 1;
+	GLsizei height = data.height >> level ? data.height >> level : 1;
+	GLsizei size = data.levelOffsets[level + 1] - data.levelOffsets[level];
+
+	// BMP rows are padded to 4 bytes, compressed blocks aren't
+	glPixelStorei(GL_UNPACK_ALIGNMENT, data.format == 0 ? 1 : 4);
+	if ( data.format == 0 )
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, data.internalFormat, width, height, 0, size, pixels);
+	else
+		glTexImage2D(GL_TEXTURE_2D, level, data.internalFormat, width, height, 0, data.format, data.type, pixels);
+}
 
-	// Everything is in memory now, the file can be closed.
-	fclose (file);
+GLuint createTexture(const TextureData & data, const unsigned char * pixels, const unsigned char * level0){
 
 	// Create one OpenGL texture
 	GLuint textureID;
@@ -71,23 +86,33 @@ GLuint loadBMP_custom(const char * imagepath){
 	// "Bind" the newly created texture : all future texture functions will modify this texture
 	glBindTexture(GL_TEXTURE_2D, textureID);
 
-	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
 
-	// OpenGL has now copied the data. Free our own version
-	delete [] data;
+	// Give the image to OpenGL
+	for ( unsigned int level=0; level<getTextureLevelCount(data); level++ ){
+		if ( level0 == NULL )
+			uploadTextureLevel(data, level, pixels + data.levelOffsets[level]);
+		else
+			uploadTextureLevel(data, level, level == 0 ? level0 : pixels + data.levelOffsets[level] - data.levelOffsets[1]);
+	}
 
-	// Poor filtering, or ...
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	if ( data.format != 0 ){
+		// Poor filtering, or ...
+		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
-	// ... nice trilinear filtering ...
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	// ... which requires mipmaps. Generate them automatically.
-	glGenerateMipmap(GL_TEXTURE_2D);
+		// ... nice trilinear filtering ...
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	}
+	if ( data.generateMipmaps ){
+		// ... which requires mipmaps. Generate them automatically, unless buildMipmaps did.
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}else{
+		// A file may stop before 1x1 : sample only the levels it has
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, getTextureLevelCount(data) - 1);
+	}
 
 	// Return the ID of the texture we just created
 	return textureID;
@@ -123,48 +148,48 @@ GLuint loadBMP_custom(const char * imagepath){
 #define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
 #define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
 #define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+#define FOURCC_DX10 0x30315844 // Equivalent to "DX10" in ASCII : the format follows the header
 
-GLuint loadDDS(const char * imagepath){
+// DXGI formats of the DX10 header
+#define DXGI_FORMAT_BC1_UNORM      71
+#define DXGI_FORMAT_BC1_UNORM_SRGB 72
+#define DXGI_FORMAT_BC3_UNORM      77
+#define DXGI_FORMAT_BC3_UNORM_SRGB 78
+#define DXGI_FORMAT_BC7_UNORM      98
+#define DXGI_FORMAT_BC7_UNORM_SRGB 99
+
+// Reads the header of a .dds file opened in fp, leaving fp at the pixels
+static bool readDDSHeaderFromFile(FILE * fp, TextureData & out_data){
 
 	unsigned char header[124];
 
-	FILE *fp; 
- 
-	/* try to open the file */ 
-	fp = fopen(imagepath, "rb"); 
-	if (fp == NULL){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); 
-		return 0;
-	}
-   
 	/* verify the type of file */ 
 	char filecode[4]; 
-	fread(filecode, 1, 4, fp); 
-	if (strncmp(filecode, "DDS ", 4) != 0) { 
-		fclose(fp); 
-		return 0; 
+	if (fread(filecode, 1, 4, fp) != 4 || strncmp(filecode, "DDS ", 4) != 0) { 
+		return false; 
 	}
 	
 	/* get the surface desc */ 
-	fread(&header, 124, 1, fp); 
+	if (fread(&header, 124, 1, fp) != 1) {
+		return false;
+	}
 
 	unsigned int height      = *(unsigned int*)&(header[8 ]);
 	unsigned int width	     = *(unsigned int*)&(header[12]);
-	unsigned int linearSize	 = *(unsigned int*)&(header[16]);
 	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
 	unsigned int fourCC      = *(unsigned int*)&(header[80]);
+	unsigned int fileOffset  = 4 + 124;
+
+	// Formats past DXT5, such as BC7, are given in an extended header
+	if (fourCC == FOURCC_DX10) {
+		unsigned char header10[20];
+		if (fread(header10, 20, 1, fp) != 1) {
+			return false;
+		}
+		fileOffset += 20;
+		fourCC = *(unsigned int*)&(header10[0]) | 0x80000000u;
+	}
 
- 
-	unsigned char * buffer;
-	unsigned int bufsize;
-	/* how big is it going to be including all mipmaps? */ 
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize; 
-	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char)); 
-	fread(buffer, 1, bufsize, fp); 
-	/* close the file pointer */ 
-	fclose(fp);
-
-	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
 	unsigned int format;
 	switch(fourCC) 
 	{ 
@@ -177,42 +202,117 @@ GLuint loadDDS(const char * imagepath){
 	case FOURCC_DXT5: 
 		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
 		break; 
+	case DXGI_FORMAT_BC1_UNORM | 0x80000000u:
+		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		break;
+	case DXGI_FORMAT_BC1_UNORM_SRGB | 0x80000000u:
+		format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+		break;
+	case DXGI_FORMAT_BC3_UNORM | 0x80000000u:
+		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		break;
+	case DXGI_FORMAT_BC3_UNORM_SRGB | 0x80000000u:
+		format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+		break;
+	case DXGI_FORMAT_BC7_UNORM | 0x80000000u:
+		format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+		break;
+	case DXGI_FORMAT_BC7_UNORM_SRGB | 0x80000000u:
+		format = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+		break;
 	default: 
-		free(buffer); 
-		return 0; 
+		return false; 
 	}
+	if (mipMapCount == 0) mipMapCount = 1;
 
-	// Create one OpenGL texture
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-
-	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
-	
-	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16; 
+	/* how big is it going to be including all mipmaps? */ 
+	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT) ? 8 : 16; 
+	out_data.levelOffsets.clear();
 	unsigned int offset = 0;
-
-	/* load the mipmaps */ 
-	for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) 
+	unsigned int levelWidth = width;
+	unsigned int levelHeight = height;
+	for (unsigned int level = 0; level < mipMapCount; ++level) 
 	{ 
-		unsigned int size = ((width+3)/4)*((height+3)/4)*blockSize; 
-		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,  
-			0, size, buffer + offset); 
-	 
-		offset += size; 
-		width  /= 2; 
-		height /= 2; 
+		out_data.levelOffsets.push_back(offset);
+		offset += ((levelWidth+3)/4)*((levelHeight+3)/4)*blockSize; 
+		levelWidth  = levelWidth  > 1 ? levelWidth  / 2 : 1;
+		levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+	}
+	out_data.levelOffsets.push_back(offset);
+
+	out_data.width = width;
+	out_data.height = height;
+	out_data.internalFormat = format;
+	out_data.format = 0;
+	out_data.type = 0;
+	out_data.fileOffset = fileOffset;
+	out_data.generateMipmaps = false;
+	return true;
+}
 
-		// Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-		if(width < 1) width = 1;
-		if(height < 1) height = 1;
+static bool readDDSFile(const char * imagepath, TextureData & out_data, bool pauseOnMissing){
 
-	} 
+	FILE *fp; 
+ 
+	/* try to open the file */ 
+	fp = fopen(imagepath, "rb"); 
+	if (fp == NULL){
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+		if (pauseOnMissing) getchar(); 
+		return false;
+	}
+	if (!readDDSHeaderFromFile(fp, out_data)) {
+		fclose(fp);
+		return false;
+	}
 
-	free(buffer); 
+	out_data.pixels.resize(out_data.levelOffsets.back());
+	size_t readSize = fread(&out_data.pixels[0], 1, out_data.pixels.size(), fp); 
+	/* close the file pointer */ 
+	fclose(fp);
+	return readSize == out_data.pixels.size();
+}
 
-	return textureID;
+bool readDDSHeader(const char * imagepath, TextureData & out_data){
+	FILE * fp = fopen(imagepath, "rb");
+	if (fp == NULL){
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+		return false;
+	}
+	bool read = readDDSHeaderFromFile(fp, out_data);
+	fclose(fp);
+	out_data.pixels.clear();
+	return read;
+}
 
+bool readTextureLevels(const char * imagepath, const TextureData & data, unsigned int firstLevel, unsigned int endLevel, std::vector<unsigned char> & out_pixels){
+	FILE * fp = fopen(imagepath, "rb");
+	if (fp == NULL){
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+		return false;
+	}
+	out_pixels.resize(data.levelOffsets[endLevel] - data.levelOffsets[firstLevel]);
+	size_t readSize = 0;
+	if (fseek(fp, data.fileOffset + data.levelOffsets[firstLevel], SEEK_SET) == 0 && !out_pixels.empty())
+		readSize = fread(&out_pixels[0], 1, out_pixels.size(), fp);
+	fclose(fp);
+	return readSize == out_pixels.size();
+}
 
-}
\ No newline at end of file
+bool readDDS(const char * imagepath, TextureData & out_data){
+	return readDDSFile(imagepath, out_data, false);
+}
+
+GLuint loadDDS(const char * imagepath){
+	TextureData data;
+	if ( !readDDSFile(imagepath, data, true) )
+		return 0;
+	return createTexture(data, &data.pixels[0]);
+}
+
+bool readTexture(const char * imagepath, TextureData & out_data){
+	size_t length = strlen(imagepath);
+	if ( length >= 4 && (strcmp(imagepath + length - 4, ".dds") == 0 || strcmp(imagepath + length - 4, ".DDS") == 0) )
+		return readDDS(imagepath, out_data);
+	return readImage(imagepath, out_data);
+}
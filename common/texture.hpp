@@ -1,8 +1,14 @@
 #ifndef LIB_TEXTURE_HPP
 #define LIB_TEXTURE_HPP
 
-// Load a .BMP file using our custom loader
-GLuint loadBMP_custom(const char * imagepath);
+#include <vector>
+
+// Load a .BMP, .TGA or .PNG file using our custom loader, see openImage. Mipmaps are built on
+// the CPU, see buildMipmaps. srgb : false for normal maps and other data that isn't colors.
+GLuint loadImage(const char * imagepath, bool srgb = true);
+
+// loadImage, by its old name
+GLuint loadBMP_custom(const char * imagepath, bool srgb = true);
 
 //// Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
 //// or do it yourself (just like loadBMP_custom and loadDDS)
@@ -12,5 +18,49 @@ GLuint loadBMP_custom(const char * imagepath);
 // Load a .DDS file using GLFW's own loader
 GLuint loadDDS(const char * imagepath);
 
+// A texture file read in memory, ready to be given to OpenGL : loadBMP_custom and loadDDS
+// are a read then a createTexture. Reading needs no OpenGL context, so it can be done on
+// any thread.
+struct TextureData {
+	unsigned int width;                 // Of level 0
+	unsigned int height;
+	GLenum internalFormat;
+	GLenum format;                      // 0 for compressed formats
+	GLenum type;
+	std::vector<unsigned int> levelOffsets; // Where each level starts in pixels, then the end
+	std::vector<unsigned char> pixels;
+	unsigned int fileOffset;            // Where pixels start in the file
+	bool generateMipmaps;               // Only level 0 is in pixels, see buildMipmaps
+};
+
+// Print what went wrong and return false. readImage : BMP, TGA or PNG, see openImage.
+bool readImage(const char * imagepath, TextureData & out_data);
+bool readDDS(const char * imagepath, TextureData & out_data);
+
+// readDDS for .dds files, readImage otherwise
+bool readTexture(const char * imagepath, TextureData & out_data);
+
+// Everything but the pixels, to read the levels one by one with readTextureLevels
+bool readDDSHeader(const char * imagepath, TextureData & out_data);
+
+// Reads levels [firstLevel, endLevel) of the file data was read from, one after the other.
+// Levels are stored from the largest, so the smallest ones are a single read at the end.
+bool readTextureLevels(const char * imagepath, const TextureData & data, unsigned int firstLevel, unsigned int endLevel, std::vector<unsigned char> & out_pixels);
+
+unsigned int getTextureLevelCount(const TextureData & data);
+
+// Bytes in a row of width texels of 8 bit channels. Rows are padded to 4 bytes, as in BMP
+// files and for the default GL_UNPACK_ALIGNMENT.
+unsigned int getTextureRowStride(unsigned int width, unsigned int channels);
+
+// Creates the texture from the levels of data, found at pixels : usually &data.pixels[0], or
+// the offset of a copy of data.pixels in the bound GL_PIXEL_UNPACK_BUFFER. level0 : where
+// level 0 is when pixels starts at level 1, see buildMipmaps.
+// Leaves the texture bound.
+GLuint createTexture(const TextureData & data, const unsigned char * pixels, const unsigned char * level0 = NULL);
+
+// Gives one level of data to the bound texture. pixels : that level only, as for createTexture.
+void uploadTextureLevel(const TextureData & data, unsigned int level, const unsigned char * pixels);
+
 
 #endif
\ No newline at end of file
@@ -1,9 +1,11 @@
 #include <vector>
-#include <map>
+#include <stdio.h>
+#include <math.h>
 
 #include <glm/glm.hpp>
 
 #include "vboindexer.hpp"
+#include "parallel.hpp"
 
 #include <string.h> // for memcmp
 
@@ -78,67 +80,126 @@ struct PackedVertex{
 	glm::vec3 position;
 	glm::vec2 uv;
 	glm::vec3 normal;
-	bool operator<(const PackedVertex that) const{
-		return memcmp((void*)this, (void*)&that, sizeof(PackedVertex))>0;
-	};
 };
 
-bool getSimilarVertexIndex_fast( 
-	PackedVertex & packed, 
-	std::map<PackedVertex,unsigned short> & VertexToOutIndex,
-	unsigned short & result
-){
-	std::map<PackedVertex,unsigned short>::iterator it = VertexToOutIndex.find(packed);
-	if ( it == VertexToOutIndex.end() ){
-		return false;
-	}else{
-		result = it->second;
-		return true;
+// Vertices are compared bit for bit, so they can be hashed bit for bit too
+static unsigned int hashPackedVertex(const PackedVertex & vertex){
+	unsigned int words[sizeof(PackedVertex) / 4];
+	memcpy(words, &vertex, sizeof(PackedVertex));
+
+	unsigned int hash = 2166136261u;
+	for ( unsigned int i=0; i<sizeof(PackedVertex) / 4; i++ ){
+		// murmur3 style mixing of each word
+		unsigned int k = words[i] * 0xcc9e2d51u;
+		k = (k << 15) | (k >> 17);
+		hash ^= k * 0x1b873593u;
+		hash = ((hash << 13) | (hash >> 19)) * 5 + 0xe6546b64u;
 	}
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	return hash;
 }
 
-void indexVBO(
+static const unsigned int EMPTY_SLOT = 0xFFFFFFFFu;
+
+// Open addressing hash table from a vertex to its index in out_XXXX.
+// Slots only store that index, the vertex itself is read back from the output arrays,
+// so there is a single flat allocation, sized once from the input.
+struct VertexHashTable {
+	std::vector<unsigned int> slots;
+	unsigned int mask;
+
+	VertexHashTable(size_t maxVertices){
+		size_t capacity = 16;
+		while ( capacity < maxVertices * 2 ) // At most half full
+			capacity *= 2;
+		slots.assign(capacity, EMPTY_SLOT);
+		mask = (unsigned int)(capacity - 1);
+	}
+
+	// Returns the slot holding this vertex, or the empty slot where it should go
+	unsigned int * find(
+		const PackedVertex & packed,
+		std::vector<glm::vec3> & out_vertices,
+		std::vector<glm::vec2> & out_uvs,
+		std::vector<glm::vec3> & out_normals
+	){
+		unsigned int slot = hashPackedVertex(packed) & mask;
+		for ( ;; slot = (slot + 1) & mask ){ // Linear probing
+			unsigned int index = slots[slot];
+			if (
+				index == EMPTY_SLOT || (
+					memcmp(&out_vertices[index], &packed.position, sizeof(glm::vec3)) == 0 &&
+					memcmp(&out_uvs     [index], &packed.uv,       sizeof(glm::vec2)) == 0 &&
+					memcmp(&out_normals [index], &packed.normal,   sizeof(glm::vec3)) == 0
+				)
+			){
+				return &slots[slot];
+			}
+		}
+	}
+};
+
+template <typename Index>
+bool indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<Index> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 ){
-	std::map<PackedVertex,unsigned short> VertexToOutIndex;
+	const size_t maxIndex = (size_t)(Index)~(Index)0;
+
+	VertexHashTable VertexToOutIndex(in_vertices.size());
+	out_indices.reserve(out_indices.size() + in_vertices.size());
 
 	// For each input vertex
 	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
 
 		PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
-		
 
 		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex_fast( packed, VertexToOutIndex, index);
+		unsigned int * slot = VertexToOutIndex.find(packed, out_vertices, out_uvs, out_normals);
 
-		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
+		if ( *slot != EMPTY_SLOT ){ // A similar vertex is already in the VBO, use it instead !
+			out_indices.push_back( (Index)*slot );
 		}else{ // If not, it needs to be added in the output data.
+			if ( out_vertices.size() > maxIndex ){
+				printf("Too many vertices for %u-bit indices, use a wider index type\n", (unsigned int)sizeof(Index) * 8);
+				return false;
+			}
 			out_vertices.push_back( in_vertices[i]);
 			out_uvs     .push_back( in_uvs[i]);
 			out_normals .push_back( in_normals[i]);
-			unsigned short newindex = (unsigned short)out_vertices.size() - 1;
-			out_indices .push_back( newindex );
-			VertexToOutIndex[ packed ] = newindex;
+			unsigned int newindex = (unsigned int)out_vertices.size() - 1;
+			out_indices .push_back( (Index)newindex );
+			*slot = newindex;
 		}
 	}
+	return true;
 }
 
+template bool indexVBO<unsigned short>(
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<unsigned short> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &
+);
+template bool indexVBO<unsigned int>(
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<unsigned int> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &
+);
 
 
 
 
 
 
-void indexVBO_TBN(
+// The original version, with a linear search over all the exported vertices.
+// Kept as a reference for indexVBO_TBN.
+void indexVBO_TBN_slow(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
@@ -175,3 +236,154 @@ void indexVBO_TBN(
 		}
 	}
 }
+
+// Spatial hash over the *input* positions, for the epsilon compare of indexVBO_TBN.
+// Two positions closer than the is_near() tolerance always land in the same or in
+// adjacent cells, so only the 27 cells around a vertex need to be searched.
+// Cells are a hair bigger than the tolerance so that rounding can't break this.
+struct VertexGrid {
+	// Cell coordinates of each input vertex
+	std::vector<glm::ivec3> cells;
+	// Input vertices sorted by bucket, in increasing order inside each bucket
+	std::vector<unsigned int> entries;
+	// Bucket b is entries[bucketStart[b], bucketStart[b+1])
+	std::vector<unsigned int> bucketStart;
+	unsigned int mask;
+};
+
+static const float GRID_CELLS_PER_UNIT = 1.0f / 0.0101f;
+
+static int gridCoordinate(float v){
+	float cell = floorf(v * GRID_CELLS_PER_UNIT);
+	// Far away vertices share the border cells, the compare still sorts them out
+	if ( cell < -1e9f ) return -1000000000;
+	if ( cell >  1e9f ) return  1000000000;
+	return (int)cell;
+}
+
+static unsigned int hashCell(const glm::ivec3 & cell){
+	return (unsigned int)cell.x * 73856093u ^ (unsigned int)cell.y * 19349663u ^ (unsigned int)cell.z * 83492791u;
+}
+
+static void buildVertexGrid(const std::vector<glm::vec3> & positions, VertexGrid & grid){
+	size_t count = positions.size();
+	size_t bucketCount = 16;
+	while ( bucketCount < count ) bucketCount *= 2;
+	grid.mask = (unsigned int)(bucketCount - 1);
+
+	// The float work is the expensive part and is independent for each vertex :
+	// spread it over all threads for big meshes.
+	std::vector<unsigned int> buckets(count);
+	grid.cells.resize(count);
+	parallelFor(count, 32768, [&](size_t begin, size_t end){
+		for ( size_t i=begin; i<end; i++ ){
+			glm::ivec3 cell(gridCoordinate(positions[i].x), gridCoordinate(positions[i].y), gridCoordinate(positions[i].z));
+			grid.cells[i] = cell;
+			buckets[i] = hashCell(cell) & grid.mask;
+		}
+	});
+
+	// Counting sort. Filling in input order keeps every bucket sorted.
+	grid.bucketStart.assign(bucketCount + 1, 0);
+	for ( size_t i=0; i<count; i++ )
+		grid.bucketStart[buckets[i] + 1]++;
+	for ( size_t b=0; b<bucketCount; b++ )
+		grid.bucketStart[b + 1] += grid.bucketStart[b];
+
+	std::vector<unsigned int> fill(grid.bucketStart.begin(), grid.bucketStart.end() - 1);
+	grid.entries.resize(count);
+	for ( size_t i=0; i<count; i++ )
+		grid.entries[ fill[buckets[i]]++ ] = (unsigned int)i;
+}
+
+template <typename Index>
+bool indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	std::vector<Index> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+){
+	const size_t maxIndex = (size_t)(Index)~(Index)0;
+
+	VertexGrid grid;
+	buildVertexGrid(in_vertices, grid);
+
+	// Index in out_XXXX of the input vertices that were exported, EMPTY_SLOT for the others.
+	// Vertices are exported in input order, so the first exported vertex that matches
+	// (the one the linear search would find) is simply the matching input with the lowest index.
+	std::vector<unsigned int> exportedAs(in_vertices.size(), EMPTY_SLOT);
+	out_indices.reserve(out_indices.size() + in_vertices.size());
+
+	// For each input vertex
+	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+
+		// Try to find a similar vertex in out_XXXX, among the exported vertices of the 27 neighbour cells
+		unsigned int match = EMPTY_SLOT;
+		const glm::ivec3 & cell = grid.cells[i];
+		for ( int dz=-1; dz<=1; dz++ )
+		for ( int dy=-1; dy<=1; dy++ )
+		for ( int dx=-1; dx<=1; dx++ ){
+			glm::ivec3 neighbour = cell + glm::ivec3(dx, dy, dz);
+			unsigned int bucket = hashCell(neighbour) & grid.mask;
+			for ( unsigned int e=grid.bucketStart[bucket]; e<grid.bucketStart[bucket + 1]; e++ ){
+				unsigned int j = grid.entries[e];
+				if ( j >= i || j >= match )
+					break; // Entries are sorted, nothing better in this bucket
+				if (
+					exportedAs[j] != EMPTY_SLOT &&
+					grid.cells[j] == neighbour &&
+					is_near( in_vertices[i].x , in_vertices[j].x ) &&
+					is_near( in_vertices[i].y , in_vertices[j].y ) &&
+					is_near( in_vertices[i].z , in_vertices[j].z ) &&
+					is_near( in_uvs[i].x      , in_uvs[j].x      ) &&
+					is_near( in_uvs[i].y      , in_uvs[j].y      ) &&
+					is_near( in_normals[i].x  , in_normals[j].x  ) &&
+					is_near( in_normals[i].y  , in_normals[j].y  ) &&
+					is_near( in_normals[i].z  , in_normals[j].z  )
+				){
+					match = j;
+					break;
+				}
+			}
+		}
+
+		if ( match != EMPTY_SLOT ){ // A similar vertex is already in the VBO, use it instead !
+			unsigned int index = exportedAs[match];
+			out_indices.push_back( (Index)index );
+
+			// Average the tangents and the bitangents
+			out_tangents[index] += in_tangents[i];
+			out_bitangents[index] += in_bitangents[i];
+		}else{ // If not, it needs to be added in the output data.
+			if ( out_vertices.size() > maxIndex ){
+				printf("Too many vertices for %u-bit indices, use a wider index type\n", (unsigned int)sizeof(Index) * 8);
+				return false;
+			}
+			out_vertices.push_back( in_vertices[i]);
+			out_uvs     .push_back( in_uvs[i]);
+			out_normals .push_back( in_normals[i]);
+			out_tangents .push_back( in_tangents[i]);
+			out_bitangents .push_back( in_bitangents[i]);
+			out_indices .push_back( (Index)(out_vertices.size() - 1) );
+			exportedAs[i] = (unsigned int)(out_vertices.size() - 1);
+		}
+	}
+	return true;
+}
+
+template bool indexVBO_TBN<unsigned short>(
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &,
+	std::vector<unsigned short> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &
+);
+template bool indexVBO_TBN<unsigned int>(
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &,
+	std::vector<unsigned int> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &
+);
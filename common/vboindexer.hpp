@@ -1,19 +1,42 @@
 #ifndef VBOINDEXER_HPP
 #define VBOINDEXER_HPP
 
-void indexVBO(
+// Merges identical vertices. Index can be unsigned short or unsigned int;
+// returns false if there are more unique vertices than Index can address.
+template <typename Index>
+bool indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<Index> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 );
 
 
-void indexVBO_TBN(
+// Merges vertices that are nearly the same, and sums the tangents and bitangents
+// of merged vertices. Index can be unsigned short or unsigned int; returns false
+// if there are more unique vertices than Index can address.
+template <typename Index>
+bool indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	std::vector<Index> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+);
+
+// Same result as indexVBO_TBN with a linear search, in O(n^2). For comparison only.
+void indexVBO_TBN_slow(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
@@ -0,0 +1,172 @@
+#include <vector>
+#include <math.h>
+#include <string.h>
+
+#include <glm/glm.hpp>
+
+#include "vertexpacking.hpp"
+
+glm::vec2 octEncode(glm::vec3 n){
+	// Project on the octahedron |x| + |y| + |z| = 1, then fold the lower half over the upper one
+	float length1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if ( length1 == 0.0f )
+		return glm::vec2(0.0f); // Degenerate normal : decodes to +Z
+	n /= length1;
+	glm::vec2 e(n.x, n.y);
+	if ( n.z < 0.0f ){
+		e.x = (1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		e.y = (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return e;
+}
+
+glm::vec3 octDecode(glm::vec2 e){
+	// Same as in vertex-shader.glsl
+	glm::vec3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+	float t = n.z < 0.0f ? -n.z : 0.0f;
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+unsigned short floatToHalf(float f){
+	unsigned int bits;
+	memcpy(&bits, &f, sizeof(bits));
+
+	unsigned int sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	unsigned int mantissa = bits & 0x7FFFFF;
+
+	if ( exponent >= 31 ){
+		// Overflow, infinity or NaN
+		bool isNaN = ((bits >> 23) & 0xFF) == 0xFF && mantissa != 0;
+		return (unsigned short)(sign | 0x7C00 | (isNaN ? 0x200 : 0));
+	}
+	if ( exponent <= 0 ){
+		// Denormal, or too small : zero
+		if ( exponent < -10 )
+			return (unsigned short)sign;
+		mantissa |= 0x800000;
+		unsigned int shift = (unsigned int)(14 - exponent);
+		unsigned int half = mantissa >> shift;
+		unsigned int rest = mantissa & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+		if ( rest > halfway || (rest == halfway && (half & 1)) )
+			half++;
+		return (unsigned short)(sign | half);
+	}
+
+	unsigned int half = sign | ((unsigned int)exponent << 10) | (mantissa >> 13);
+	unsigned int rest = mantissa & 0x1FFF;
+	// Round to nearest even. A carry into the exponent is still the right value.
+	if ( rest > 0x1000 || (rest == 0x1000 && (half & 1)) )
+		half++;
+	return (unsigned short)half;
+}
+
+float halfToFloat(unsigned short h){
+	unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+	unsigned int exponent = (h >> 10) & 0x1F;
+	unsigned int mantissa = h & 0x3FF;
+
+	unsigned int bits;
+	if ( exponent == 0x1F ){
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	} else if ( exponent != 0 ){
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	} else if ( mantissa != 0 ){
+		// Denormal : normalize it
+		exponent = 127 - 15 + 1;
+		while ( (mantissa & 0x400) == 0 ){
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	} else {
+		bits = sign;
+	}
+
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static unsigned short quantizeUnorm16(float v){
+	v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+	return (unsigned short)(v * 65535.0f + 0.5f);
+}
+
+static short quantizeSnorm16(float v){
+	v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+	return (short)floorf(v * 32767.0f + 0.5f);
+}
+
+void packVertices(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	VertexFormat format,
+	PackedVertices & out_packed
+){
+	size_t count = vertices.size();
+	out_packed.format = format;
+	out_packed.count = (unsigned int)count;
+
+	out_packed.boundsMin = out_packed.boundsMax = glm::vec3(0.0f);
+	if ( count ){
+		out_packed.boundsMin = out_packed.boundsMax = vertices[0];
+		for ( size_t i=1; i<count; i++ ){
+			out_packed.boundsMin = glm::min(out_packed.boundsMin, vertices[i]);
+			out_packed.boundsMax = glm::max(out_packed.boundsMax, vertices[i]);
+		}
+	}
+
+	if ( format == VERTEX_FORMAT_FLOAT ){
+		out_packed.stride = sizeof(FloatVertex);
+		out_packed.positionOffset = glm::vec3(0.0f);
+		out_packed.positionScale = glm::vec3(1.0f);
+		out_packed.data.resize(count * sizeof(FloatVertex));
+
+		FloatVertex * packed = (FloatVertex *)(count ? &out_packed.data[0] : NULL);
+		for ( size_t i=0; i<count; i++ ){
+			glm::vec2 normal = octEncode(normals[i]);
+			packed[i].position[0] = vertices[i].x;
+			packed[i].position[1] = vertices[i].y;
+			packed[i].position[2] = vertices[i].z;
+			packed[i].uv[0] = uvs[i].x;
+			packed[i].uv[1] = uvs[i].y;
+			packed[i].normal[0] = normal.x;
+			packed[i].normal[1] = normal.y;
+		}
+		return;
+	}
+
+	glm::vec3 minimum = out_packed.boundsMin;
+	glm::vec3 maximum = out_packed.boundsMax;
+	glm::vec3 extent = maximum - minimum;
+	// Flat axes have a zero extent : everything quantizes to 0 there
+	glm::vec3 inverseExtent(
+		extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+		extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+		extent.z > 0.0f ? 1.0f / extent.z : 0.0f
+	);
+
+	out_packed.stride = sizeof(QuantizedVertex);
+	out_packed.positionOffset = minimum;
+	out_packed.positionScale = extent;
+	out_packed.data.resize(count * sizeof(QuantizedVertex));
+
+	QuantizedVertex * packed = (QuantizedVertex *)(count ? &out_packed.data[0] : NULL);
+	for ( size_t i=0; i<count; i++ ){
+		glm::vec3 position = (vertices[i] - minimum) * inverseExtent;
+		glm::vec2 normal = octEncode(normals[i]);
+		packed[i].position[0] = quantizeUnorm16(position.x);
+		packed[i].position[1] = quantizeUnorm16(position.y);
+		packed[i].position[2] = quantizeUnorm16(position.z);
+		packed[i].position[3] = 0;
+		packed[i].uv[0] = floatToHalf(uvs[i].x);
+		packed[i].uv[1] = floatToHalf(uvs[i].y);
+		packed[i].normal[0] = quantizeSnorm16(normal.x);
+		packed[i].normal[1] = quantizeSnorm16(normal.y);
+	}
+}
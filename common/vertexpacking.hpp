@@ -0,0 +1,56 @@
+#ifndef VERTEXPACKING_HPP
+#define VERTEXPACKING_HPP
+
+// Interleaved vertex layouts, so that a mesh is a single buffer.
+// Normals are octahedral encoded in both layouts, so that one shader decodes both :
+//   position = positionOffset + position * positionScale
+//   normal   = octDecode(normal)
+
+enum VertexFormat {
+	// position : 3 floats, uv : 2 floats, normal : 2 floats. 28 bytes.
+	VERTEX_FORMAT_FLOAT = 0,
+	// position : 3 unorm16 relative to the bounding box (+ 1 padding), uv : 2 half floats,
+	// normal : 2 snorm16. 16 bytes.
+	VERTEX_FORMAT_QUANTIZED = 1
+};
+
+struct FloatVertex {
+	float position[3];
+	float uv[2];
+	float normal[2];
+};
+
+struct QuantizedVertex {
+	unsigned short position[4];
+	unsigned short uv[2];
+	short normal[2];
+};
+
+struct PackedVertices {
+	VertexFormat format;
+	unsigned int stride;      // sizeof(FloatVertex) or sizeof(QuantizedVertex)
+	unsigned int count;
+	glm::vec3 positionOffset; // Bounding box minimum, or 0 for VERTEX_FORMAT_FLOAT
+	glm::vec3 positionScale;  // Bounding box size, or 1 for VERTEX_FORMAT_FLOAT
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	std::vector<unsigned char> data;
+};
+
+void packVertices(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	VertexFormat format,
+	PackedVertices & out_packed
+);
+
+// Octahedral mapping of a unit vector to [-1, 1]^2
+glm::vec2 octEncode(glm::vec3 n);
+glm::vec3 octDecode(glm::vec2 e);
+
+// IEEE 754 half precision, rounded to nearest
+unsigned short floatToHalf(float f);
+float halfToFloat(unsigned short h);
+
+#endif
@@ -26,6 +26,8 @@ using namespace glm;
 #include <common/controls.hpp>
 #include <common/objloader.hpp>
 #include <common/vboindexer.hpp>
+#include <common/culling.hpp>
+#include <common/bvh.hpp>
 
 void ScreenPosToWorldRay(
 	int mouseX, int mouseY,             // Mouse position, in pixels, from bottom-left corner of the window
@@ -196,6 +198,24 @@ bool TestRayOBBIntersection(
 
 }
 
+// The exact test, for the objects whose bounding box the ray goes through
+struct PickingScene {
+	std::vector<glm::mat4> modelMatrices;
+	glm::vec3 aabb_min;
+	glm::vec3 aabb_max;
+};
+
+bool TestRayMonkey(void * context, int object, const glm::vec3 & origin, const glm::vec3 & direction, float & inout_distance){
+	const PickingScene & scene = *static_cast<const PickingScene *>(context);
+	float intersection_distance;
+	if ( TestRayOBBIntersection(origin, direction, scene.aabb_min, scene.aabb_max, scene.modelMatrices[object], intersection_distance)
+		&& intersection_distance < inout_distance ){
+		inout_distance = intersection_distance;
+		return true;
+	}
+	return false;
+}
+
 int main( void )
 {
 	// Initialise GLFW
@@ -318,6 +338,26 @@ int main( void )
 		orientations[i] = glm::quat(glm::vec3(rand()%360, rand()%360, rand()%360));
 	}
 
+	// A bounding volume hierarchy over the world space boxes around their OBBs,
+	// so that picking only tests the monkeys near the ray
+	PickingScene scene;
+	scene.aabb_min = glm::vec3(-1.0f, -1.0f, -1.0f);
+	scene.aabb_max = glm::vec3( 1.0f,  1.0f,  1.0f);
+	std::vector<glm::vec3> boxMins(100);
+	std::vector<glm::vec3> boxMaxs(100);
+	for(int i=0; i<100; i++){
+		glm::mat4 RotationMatrix = glm::toMat4(orientations[i]);
+		glm::mat4 TranslationMatrix = translate(mat4(), positions[i]);
+		scene.modelMatrices.push_back(TranslationMatrix * RotationMatrix);
+
+		glm::vec3 center, extent;
+		transformBox(scene.modelMatrices[i], scene.aabb_min, scene.aabb_max, center, extent);
+		boxMins[i] = center - extent;
+		boxMaxs[i] = center + extent;
+	}
+	Bvh bvh;
+	buildBvh(bvh, boxMins, boxMaxs);
+
 
 
 	// Get a handle for our "LightPosition" uniform
@@ -368,38 +408,17 @@ int main( void )
 
 			message = "background";
 
-			// Test each each Oriented Bounding Box (OBB).
-			// A physics engine can be much smarter than this, 
-			// because it already has some spatial partitionning structure, 
+			// Test the Oriented Bounding Boxes (OBB) whose world space box the ray goes
+			// through, nearest first, and keep the nearest hit.
+			// A physics engine does the same with its own spatial partitionning structure,
 			// like Binary Space Partitionning Tree (BSP-Tree),
 			// Bounding Volume Hierarchy (BVH) or other.
-			for(int i=0; i<100; i++){
-
-				float intersection_distance; // Output of TestRayOBBIntersection()
-				glm::vec3 aabb_min(-1.0f, -1.0f, -1.0f);
-				glm::vec3 aabb_max( 1.0f,  1.0f,  1.0f);
-
-				// The ModelMatrix transforms :
-				// - the mesh to its desired position and orientation
-				// - but also the AABB (defined with aabb_min and aabb_max) into an OBB
-				glm::mat4 RotationMatrix = glm::toMat4(orientations[i]);
-				glm::mat4 TranslationMatrix = translate(mat4(), positions[i]);
-				glm::mat4 ModelMatrix = TranslationMatrix * RotationMatrix;
-
-
-				if ( TestRayOBBIntersection(
-					ray_origin, 
-					ray_direction, 
-					aabb_min, 
-					aabb_max,
-					ModelMatrix,
-					intersection_distance)
-				){
-					std::ostringstream oss;
-					oss << "mesh " << i;
-					message = oss.str();
-					break;
-				}
+			float intersection_distance;
+			int picked = raycastBvh(bvh, ray_origin, ray_direction, 100000.0f, intersection_distance, TestRayMonkey, &scene);
+			if ( picked != BVH_NONE ){
+				std::ostringstream oss;
+				oss << "mesh " << picked;
+				message = oss.str();
 			}
 
 
@@ -87,8 +87,8 @@ public:
             (void*) nullptr
         );
         
-        glUniform1i(glGetUniformLocation(shader->getId(), "text"), 0);
-        glUniform3f(glGetUniformLocation(shader->getId(), "textColor"), color.x, color.y, color.z);
+        glUniform1i(shader->getUniformLocation("text"), 0);
+        glUniform3f(shader->getUniformLocation("textColor"), color.x, color.y, color.z);
         
         std::string::const_iterator it;
         float x = position.x;
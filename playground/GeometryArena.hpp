@@ -0,0 +1,207 @@
+#ifndef GEOMETRY_ARENA_HPP
+#define GEOMETRY_ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "common/vertexpacking.hpp"
+
+// As read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Attributes 0 to 2 of the bound vertex array, from the bound GL_ARRAY_BUFFER
+inline void setVertexAttributePointers(VertexFormat format, GLsizei stride) {
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    if (format == VERTEX_FORMAT_QUANTIZED) {
+        // Positions : unorm16 in the bounding box, UVs : half floats, normals : octahedral snorm16
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*) offsetof(QuantizedVertex, position));
+        glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*) offsetof(QuantizedVertex, uv));
+        glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, (void*) offsetof(QuantizedVertex, normal));
+    }
+    else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*) offsetof(FloatVertex, position));
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*) offsetof(FloatVertex, uv));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*) offsetof(FloatVertex, normal));
+    }
+}
+
+// One vertex array, one vertex buffer and one index buffer shared by many meshes of the
+// same vertex format and index size. Each mesh gets a range of both buffers and draws with
+// a base vertex, so that drawing different meshes needs no vertex array switch, and so that
+// they can all be drawn by a single glMultiDrawElementsIndirect.
+// Ranges are never given back : the arena is meant to hold meshes that live as long as it.
+class GeometryArena {
+public:
+    struct Range {
+        GLint baseVertex;       // Added to the mesh's indices
+        GLuint firstIndex;      // Of the mesh in the index buffer
+    };
+
+    // Attribute holding the index of the draw in a multi-draw, see enableDrawIds
+    static const GLuint DRAW_ID_LOCATION = 7;
+
+private:
+    VertexFormat _format;
+    GLsizei _vertexStride;
+    GLenum _indexType;
+    size_t _indexSize;
+
+    GLuint _vertexArrayId;
+    GLuint _vertexBuffer;
+    GLuint _indexBuffer;
+    GLuint _drawIdBuffer;
+
+    // In vertices and indices
+    size_t _vertexCapacity;
+    size_t _vertexCount;
+    size_t _indexCapacity;
+    size_t _indexCount;
+    size_t _drawIdCount;
+
+    // Copies the used part of buffer to a new one of newSize bytes, and returns it
+    static GLuint grow(GLuint buffer, GLsizeiptr usedSize, GLsizeiptr newSize) {
+        GLuint newBuffer;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+        if (usedSize > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedSize);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        return newBuffer;
+    }
+
+    void reserve(size_t vertexCount, size_t indexCount) {
+        glBindVertexArray(_vertexArrayId);
+        if (vertexCount > _vertexCapacity) {
+            _vertexCapacity = std::max(vertexCount, _vertexCapacity * 2);
+            _vertexBuffer = grow(_vertexBuffer, _vertexCount * _vertexStride, _vertexCapacity * _vertexStride);
+            // The attributes still point to the old buffer
+            glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+            setVertexAttributePointers(_format, _vertexStride);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        if (indexCount > _indexCapacity) {
+            _indexCapacity = std::max(indexCount, _indexCapacity * 2);
+            _indexBuffer = grow(_indexBuffer, _indexCount * _indexSize, _indexCapacity * _indexSize);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+        }
+        glBindVertexArray(0);
+    }
+
+public:
+
+    VertexFormat getFormat() const {
+        return _format;
+    }
+
+    GLenum getIndexType() const {
+        return _indexType;
+    }
+
+    size_t getIndexSize() const {
+        return _indexSize;
+    }
+
+    GLuint getVertexArrayId() const {
+        return _vertexArrayId;
+    }
+
+    bool canHold(VertexFormat format, size_t indexSize) const {
+        return format == _format && indexSize == _indexSize;
+    }
+
+    // Copies a mesh into the arena, growing it if needed. The mesh must pass canHold.
+    Range allocate(const void* vertices, size_t vertexCount, const void* indices, size_t indexCount) {
+        reserve(_vertexCount + vertexCount, _indexCount + indexCount);
+
+        Range range = {
+            static_cast<GLint>(_vertexCount),
+            static_cast<GLuint>(_indexCount)
+        };
+        glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, _vertexCount * _vertexStride, vertexCount * _vertexStride, vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        // Not through GL_ELEMENT_ARRAY_BUFFER, which belongs to whichever vertex array is bound
+        glBindBuffer(GL_COPY_WRITE_BUFFER, _indexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, _indexCount * _indexSize, indexCount * _indexSize, indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        _vertexCount += vertexCount;
+        _indexCount += indexCount;
+        return range;
+    }
+
+    // With the vertex array bound : feeds DRAW_ID_LOCATION with 0, 1, 2... one per instance,
+    // for at least drawCount draws. An indirect command whose baseInstance is i and whose
+    // instanceCount is 1 then reads i, which works where gl_DrawID doesn't.
+    void enableDrawIds(size_t drawCount) {
+        if (drawCount > _drawIdCount) {
+            _drawIdCount = std::max(drawCount, _drawIdCount * 2);
+            std::vector<GLuint> drawIds(_drawIdCount);
+            for (size_t i = 0; i < _drawIdCount; ++i) {
+                drawIds[i] = static_cast<GLuint>(i);
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, _drawIdBuffer);
+            glBufferData(GL_ARRAY_BUFFER, _drawIdCount * sizeof(GLuint), &drawIds[0], GL_STATIC_DRAW);
+            glVertexAttribIPointer(DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*) 0);
+            glVertexAttribDivisor(DRAW_ID_LOCATION, 1);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glEnableVertexAttribArray(DRAW_ID_LOCATION);
+    }
+
+    // Instanced draws may have more instances than there are draw ids
+    void disableDrawIds() {
+        glDisableVertexAttribArray(DRAW_ID_LOCATION);
+    }
+
+
+    // indexSize : 2 or 4 bytes. The capacities only save growing the buffers later.
+    GeometryArena(
+        VertexFormat format,
+        size_t indexSize,
+        size_t vertexCapacity = 65536,
+        size_t indexCapacity = 262144
+    ) {
+        _format = format;
+        _vertexStride = static_cast<GLsizei>(format == VERTEX_FORMAT_QUANTIZED ? sizeof(QuantizedVertex) : sizeof(FloatVertex));
+        _indexType = indexSize == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        _indexSize = indexSize;
+        _vertexCapacity = 0;
+        _vertexCount = 0;
+        _indexCapacity = 0;
+        _indexCount = 0;
+        _drawIdCount = 0;
+
+        glGenVertexArrays(1, &_vertexArrayId);
+        glGenBuffers(1, &_vertexBuffer);
+        glGenBuffers(1, &_indexBuffer);
+        glGenBuffers(1, &_drawIdBuffer);
+        reserve(vertexCapacity, indexCapacity);
+    }
+
+    ~GeometryArena() {
+        glDeleteBuffers(1, &_vertexBuffer);
+        glDeleteBuffers(1, &_indexBuffer);
+        glDeleteBuffers(1, &_drawIdBuffer);
+        glDeleteVertexArrays(1, &_vertexArrayId);
+    }
+};
+
+#endif//GEOMETRY_ARENA_HPP
@@ -0,0 +1,170 @@
+#ifndef INSTANCE_BATCHER_HPP
+#define INSTANCE_BATCHER_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "Model.hpp"
+#include "RenderQueue.hpp"
+#include "SceneUniforms.hpp"
+#include "UniformBuffer.hpp"
+
+// Groups the models that share a mesh, a level of detail, a texture and a shader, and draws
+// each group with one glDrawElementsInstanced. The model matrices of a frame go to a single
+// instance buffer ; what the instances share goes to one ObjectData block per batch.
+// A shader can only be batched once it has an instanced variant, see setInstancedShader.
+class InstanceBatcher {
+private:
+    typedef std::tuple<Mesh*, unsigned int, Texture*, Shader*> BatchKey;
+
+    struct Batch {
+        Mesh* mesh;
+        unsigned int lod;
+        Texture* texture;
+        Shader* shader;                     // The instanced variant
+        std::vector<glm::mat4> modelMatrices;
+        GLintptr instanceOffset;            // In the instance buffer, in bytes
+        GLintptr objectUniformsOffset;      // See UniformBuffer::push
+    };
+
+    // Batches live on from frame to frame, empty ones are skipped
+    std::map<BatchKey, size_t> _batchIndices;
+    std::vector<Batch> _batches;
+
+    std::map<const Shader*, Shader*> _instancedShaders;
+
+    GLuint _instanceBuffer;
+    GLsizeiptr _instanceBufferSize;
+    std::vector<glm::mat4> _instances;
+
+    size_t _batchCount;
+    size_t _instanceCount;
+
+public:
+
+    // Models drawn with shader will be drawn with instancedShader when batched. Both must
+    // read the same blocks, see instanced-vertex-shader.glsl.
+    void setInstancedShader(const Shader* shader, Shader* instancedShader) {
+        _instancedShaders[shader] = instancedShader;
+    }
+
+    bool canBatch(const Model* model, unsigned int lod) const {
+        return _instancedShaders.count(model->getShader()) != 0 && !model->usesMeshletCulling(lod);
+    }
+
+    // Forgets the instances of the previous frame
+    void clear() {
+        for (Batch& batch : _batches) {
+            batch.modelMatrices.clear();
+        }
+    }
+
+    // model must pass canBatch
+    void add(const Model* model, unsigned int lod) {
+        BatchKey key(model->getMesh(), lod, model->getTexture(), model->getShader());
+        std::map<BatchKey, size_t>::iterator it = _batchIndices.find(key);
+        if (it == _batchIndices.end()) {
+            Batch batch;
+            batch.mesh = model->getMesh();
+            batch.lod = lod;
+            batch.texture = model->getTexture();
+            batch.shader = _instancedShaders.find(model->getShader())->second;
+            batch.instanceOffset = 0;
+            batch.objectUniformsOffset = 0;
+            it = _batchIndices.insert(std::make_pair(key, _batches.size())).first;
+            _batches.push_back(batch);
+        }
+        _batches[it->second].modelMatrices.push_back(model->getModelMatrix());
+    }
+
+    // Writes the model matrices of every batch to the instance buffer, and pushes the
+    // ObjectData of each batch to uniforms, which the caller uploads
+    void upload(UniformBuffer& uniforms, const glm::mat4& viewProjection) {
+        _instances.clear();
+        _batchCount = 0;
+        for (Batch& batch : _batches) {
+            if (batch.modelMatrices.empty()) {
+                continue;
+            }
+            batch.instanceOffset = static_cast<GLintptr>(_instances.size() * sizeof(glm::mat4));
+            _instances.insert(_instances.end(), batch.modelMatrices.begin(), batch.modelMatrices.end());
+
+            ObjectUniforms objectUniforms;
+            objectUniforms.model = glm::mat4(1.0f);
+            objectUniforms.mvp = viewProjection;
+            objectUniforms.positionOffset = glm::vec4(batch.mesh->getPositionOffset(), 0.0f);
+            objectUniforms.positionScale = glm::vec4(batch.mesh->getPositionScale(), 0.0f);
+            batch.objectUniformsOffset = uniforms.push(&objectUniforms, sizeof(objectUniforms));
+            ++_batchCount;
+        }
+        _instanceCount = _instances.size();
+        if (_instances.empty()) {
+            return;
+        }
+
+        // Orphan the previous frame's data rather than wait for the GPU to be done with it
+        GLsizeiptr size = static_cast<GLsizeiptr>(_instances.size() * sizeof(glm::mat4));
+        glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+        if (size > _instanceBufferSize) {
+            _instanceBufferSize = size * 2;
+        }
+        glBufferData(GL_ARRAY_BUFFER, _instanceBufferSize, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, &_instances[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Adds every batch uploaded this frame to queue, which binds their shaders, textures
+    // and ObjectData
+    void enqueue(RenderQueue& queue, const glm::vec3& cameraPosition) const {
+        for (const Batch& batch : _batches) {
+            if (batch.modelMatrices.empty()) {
+                continue;
+            }
+
+            // Sorted by the closest instance
+            glm::vec4 center = glm::vec4(batch.mesh->getBoundsCenter(), 1.0f);
+            float depth = glm::length(glm::vec3(batch.modelMatrices[0] * center) - cameraPosition);
+            for (size_t i = 1; i < batch.modelMatrices.size(); ++i) {
+                depth = glm::min(depth, glm::length(glm::vec3(batch.modelMatrices[i] * center) - cameraPosition));
+            }
+
+            queue.addInstances(
+                batch.shader,
+                batch.texture,
+                batch.mesh,
+                batch.lod,
+                batch.objectUniformsOffset,
+                _instanceBuffer,
+                batch.instanceOffset,
+                static_cast<GLsizei>(batch.modelMatrices.size()),
+                depth
+            );
+        }
+    }
+
+    // Of the last upload
+    size_t getBatchCount() const {
+        return _batchCount;
+    }
+
+    size_t getInstanceCount() const {
+        return _instanceCount;
+    }
+
+
+    InstanceBatcher()
+        : _instanceBufferSize(0),
+          _batchCount(0),
+          _instanceCount(0) {
+        glGenBuffers(1, &_instanceBuffer);
+    }
+
+    ~InstanceBatcher() {
+        glDeleteBuffers(1, &_instanceBuffer);
+    }
+};
+
+#endif//INSTANCE_BATCHER_HPP
@@ -1,85 +1,317 @@
 #ifndef MESH_HPP
 #define MESH_HPP
 
+#include <cstddef>
+#include <cstdio>
 #include <vector>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
 #include "common/objloader.hpp"
+#include "common/meshcache.hpp"
 #include "common/vboindexer.hpp"
+#include "common/meshoptimizer.hpp"
+#include "common/meshsimplify.hpp"
+#include "common/meshlet.hpp"
+#include "common/vertexpacking.hpp"
+#include "GeometryArena.hpp"
 #include "LoadException.hpp"
 
 class Mesh {
 private:
     GLuint _vertexArrayId;
     GLuint _vertexBuffer;
-    GLuint _uvBuffer;
-    GLuint _normalBuffer;
     GLuint _indexBuffer;
     
-    std::vector<glm::vec3> _vertices;
-    std::vector<glm::vec2> _uvs;
-    std::vector<glm::vec3> _normals;
+    GLenum _indexType;
+    size_t _indexSize;
     
-    std::vector<unsigned short> _indices;
-
-public:
+    // When the buffers above belong to an arena, where the mesh starts in them.
+    // Otherwise nullptr, and both 0.
+    GeometryArena* _arena;
+    GLint _baseVertex;
+    GLuint _firstIndex;
     
-    void draw() {
-        glBindVertexArray(_vertexArrayId);
+    // Detail levels, from the full mesh to the coarsest, all in the index buffer
+    std::vector<MeshLod> _lods;
+    
+    glm::vec3 _boundsMin;
+    glm::vec3 _boundsMax;
+    glm::vec3 _boundsCenter;
+    float _boundsRadius;
+    
+    // Clusters of level 0, culled one by one
+    std::vector<Meshlet> _meshlets;
+    DrawRanges _visibleRanges;
+    std::vector<GLint> _visibleBaseVertices;
+    
+    // Decodes quantized positions, see PackedVertices
+    glm::vec3 _positionOffset;
+    glm::vec3 _positionScale;
+    
+    void upload(
+        VertexFormat format,
+        const void* vertices,
+        size_t vertexCount,
+        size_t vertexStride,
+        const void* indices,
+        size_t indexCount,
+        size_t indexSize
+    )
+    {
+        _indexType = indexSize == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        _indexSize = indexSize;
         
-        // 1st attribute buffer : vertices
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
-        glVertexAttribPointer(
-            0,
-            3,
-            GL_FLOAT,
-            GL_FALSE,
-            0,
-            (void*) nullptr
-        );
+        if (_arena != nullptr && _arena->canHold(format, indexSize)) {
+            GeometryArena::Range range = _arena->allocate(vertices, vertexCount, indices, indexCount);
+            _vertexArrayId = _arena->getVertexArrayId();
+            _vertexBuffer = 0;
+            _indexBuffer = 0;
+            _baseVertex = range.baseVertex;
+            _firstIndex = range.firstIndex;
+            return;
+        }
+        _arena = nullptr;
+        _baseVertex = 0;
+        _firstIndex = 0;
         
-        // 2nd attribute buffer : UVs
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, _uvBuffer);
-        glVertexAttribPointer(
-            1,
-            2,
-            GL_FLOAT,
-            GL_FALSE,
-            0,
-            (void*) nullptr
-        );
+        glGenVertexArrays(1, &_vertexArrayId);
+        glBindVertexArray(_vertexArrayId);
         
-        // 3rd attribute buffer : Normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, _normalBuffer);
-        glVertexAttribPointer(
-            2,
-            3,
-            GL_FLOAT,
-            GL_FALSE,
-            0,
-            (void*) nullptr
-        );
+        // One interleaved buffer for all the attributes
+        glGenBuffers(1, &_vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * vertexStride, vertices, GL_STATIC_DRAW);
         
+        // The element buffer binding is part of the VAO state
+        glGenBuffers(1, &_indexBuffer);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indices, GL_STATIC_DRAW);
         
-        glDrawElements(GL_TRIANGLES, _indices.size(), GL_UNSIGNED_SHORT, (void*) 0);
-        
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        setVertexAttributePointers(format, static_cast<GLsizei>(vertexStride));
         
         glBindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
     
+    void setBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+        _boundsMin = boundsMin;
+        _boundsMax = boundsMax;
+        _boundsCenter = (boundsMin + boundsMax) * 0.5f;
+        _boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+    }
+
+public:
+    
+    // Bounding box, in model space
+    const glm::vec3& getBoundsMin() const {
+        return _boundsMin;
+    }
+    
+    const glm::vec3& getBoundsMax() const {
+        return _boundsMax;
+    }
+    
+    const glm::vec3& getBoundsCenter() const {
+        return _boundsCenter;
+    }
+    
+    float getBoundsRadius() const {
+        return _boundsRadius;
+    }
+    
+    size_t getLodCount() const {
+        return _lods.size();
+    }
+    
+    size_t getMeshletCount() const {
+        return _meshlets.size();
+    }
+    
+    // Coarsest level whose error looks smaller than maxPixelError pixels from distance away.
+    // pixelsPerUnit is the size on screen of 1 unit at a distance of 1 : P[1][1] * screenHeight / 2
+    unsigned int selectLod(float distance, float pixelsPerUnit, float maxPixelError = 1.0f) const {
+        unsigned int lod = 0;
+        for (unsigned int i = 1; i < _lods.size(); ++i) {
+            if (_lods[i].error * pixelsPerUnit > maxPixelError * distance) {
+                break;
+            }
+            lod = i;
+        }
+        return lod;
+    }
+    
+    const glm::vec3& getPositionOffset() const {
+        return _positionOffset;
+    }
+    
+    const glm::vec3& getPositionScale() const {
+        return _positionScale;
+    }
+    
+    GLuint getVertexArrayId() const {
+        return _vertexArrayId;
+    }
+    
+    // nullptr if the mesh has buffers of its own
+    GeometryArena* getArena() const {
+        return _arena;
+    }
+    
+    // One instance of a level, for glMultiDrawElementsIndirect on the arena's vertex array
+    DrawElementsIndirectCommand getIndirectCommand(unsigned int lod, GLuint baseInstance) const {
+        const MeshLod& range = _lods[lod];
+        DrawElementsIndirectCommand command = {
+            range.indexCount,
+            1,
+            _firstIndex + range.indexOffset,
+            _baseVertex,
+            baseInstance
+        };
+        return command;
+    }
+    
+    // The submit functions draw with this mesh's vertex array already bound, so that
+    // consecutive draws of the same mesh can skip binding it, see RenderQueue.
+    // The draw functions bind it and unbind it around one draw.
+    
+    void submit(unsigned int lod = 0) {
+        const MeshLod& range = _lods[lod];
+        glDrawElementsBaseVertex(
+            GL_TRIANGLES,
+            static_cast<GLsizei>(range.indexCount),
+            _indexType,
+            (void*) ((_firstIndex + range.indexOffset) * _indexSize),
+            _baseVertex
+        );
+    }
+    
+    void draw(unsigned int lod = 0) {
+        glBindVertexArray(_vertexArrayId);
+        submit(lod);
+        glBindVertexArray(0);
+    }
+    
+    // Draws instanceCount copies of a level, each with its own model matrix, read as a mat4
+    // at locations 3 to 6 from instanceBuffer, starting instanceOffset bytes in, which are
+    // disabled again once drawn. Leaves instanceBuffer bound to GL_ARRAY_BUFFER.
+    void submitInstanced(unsigned int lod, GLuint instanceBuffer, GLintptr instanceOffset, GLsizei instanceCount) {
+        const MeshLod& range = _lods[lod];
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (GLuint column = 0; column < 4; ++column) {
+            GLuint location = 3 + column;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(
+                location,
+                4,
+                GL_FLOAT,
+                GL_FALSE,
+                sizeof(glm::mat4),
+                (void*) (instanceOffset + column * sizeof(glm::vec4))
+            );
+            glVertexAttribDivisor(location, 1);
+        }
+        glDrawElementsInstancedBaseVertex(
+            GL_TRIANGLES,
+            static_cast<GLsizei>(range.indexCount),
+            _indexType,
+            (void*) ((_firstIndex + range.indexOffset) * _indexSize),
+            instanceCount,
+            _baseVertex
+        );
+        // The vertex array may be a shared arena's : later draws on it mustn't read instances
+        for (GLuint location = 3; location < 7; ++location) {
+            glDisableVertexAttribArray(location);
+        }
+    }
+    
+    void drawInstanced(unsigned int lod, GLuint instanceBuffer, GLintptr instanceOffset, GLsizei instanceCount) {
+        glBindVertexArray(_vertexArrayId);
+        submitInstanced(lod, instanceBuffer, instanceOffset, instanceCount);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    
+    // Draws level 0 without the meshlets that are off screen or facing away.
+    // frustum and cameraPosition are in model space. Returns the number of meshlets drawn.
+    // cullBackFaces : see cullMeshlets
+    size_t submitMeshlets(const Frustum& frustum, const glm::vec3& cameraPosition, bool cullBackFaces = true) {
+        _visibleRanges.counts.clear();
+        _visibleRanges.offsets.clear();
+        size_t visibleCount = cullMeshlets(
+            _meshlets,
+            frustum,
+            cameraPosition,
+            static_cast<unsigned int>(_indexSize),
+            _visibleRanges,
+            cullBackFaces
+        );
+        if (visibleCount == 0) {
+            return 0;
+        }
+        
+        // The ranges are relative to the mesh
+        size_t drawCount = _visibleRanges.counts.size();
+        if (_firstIndex != 0) {
+            for (const void*& offset : _visibleRanges.offsets) {
+                offset = static_cast<const char*>(offset) + _firstIndex * _indexSize;
+            }
+        }
+        _visibleBaseVertices.assign(drawCount, _baseVertex);
+        
+        glMultiDrawElementsBaseVertex(
+            GL_TRIANGLES,
+            &_visibleRanges.counts[0],
+            _indexType,
+            &_visibleRanges.offsets[0],
+            static_cast<GLsizei>(drawCount),
+            &_visibleBaseVertices[0]
+        );
+        return visibleCount;
+    }
     
-    Mesh(const char* meshPath) {
+    size_t drawMeshlets(const Frustum& frustum, const glm::vec3& cameraPosition, bool cullBackFaces = true) {
+        glBindVertexArray(_vertexArrayId);
+        size_t visibleCount = submitMeshlets(frustum, cameraPosition, cullBackFaces);
+        glBindVertexArray(0);
+        return visibleCount;
+    }
+    
+    
+    // arena : where to put the mesh, if it fits its format and index size. Must outlive it.
+    Mesh(const char* meshPath, VertexFormat format = VERTEX_FORMAT_QUANTIZED, GeometryArena* arena = nullptr) {
+        _arena = arena;
+        
+        // Already baked : straight from the mapped file to the GPU
+        MeshCache cache;
+        if (openMeshCache(meshPath, cache)) {
+            if (cache.header->vertexFormat == static_cast<unsigned int>(format)) {
+                _positionOffset = glm::vec3(cache.header->positionOffset[0], cache.header->positionOffset[1], cache.header->positionOffset[2]);
+                _positionScale = glm::vec3(cache.header->positionScale[0], cache.header->positionScale[1], cache.header->positionScale[2]);
+                setBounds(
+                    glm::vec3(cache.header->boundsMin[0], cache.header->boundsMin[1], cache.header->boundsMin[2]),
+                    glm::vec3(cache.header->boundsMax[0], cache.header->boundsMax[1], cache.header->boundsMax[2])
+                );
+                _lods.assign(cache.header->lods, cache.header->lods + cache.header->lodCount);
+                _meshlets.assign(cache.meshlets, cache.meshlets + cache.header->meshletCount);
+                upload(
+                    format,
+                    cache.vertices,
+                    cache.header->vertexCount,
+                    cache.header->vertexStride,
+                    cache.indices,
+                    cache.header->indexCount,
+                    cache.header->indexSize
+                );
+                closeMeshCache(cache);
+                return;
+            }
+            // Baked in another format : bake again
+            closeMeshCache(cache);
+        }
+        
         std::vector<glm::vec3> vertices;
         std::vector<glm::vec2> uvs;
         std::vector<glm::vec3> normals;
@@ -89,36 +321,106 @@ public:
             throw LoadException("Failed to load OBJ model.");
         }
         
-        indexVBO(vertices, uvs, normals, _indices, _vertices, _uvs, _normals);
+        std::vector<glm::vec3> indexedVertices;
+        std::vector<glm::vec2> indexedUvs;
+        std::vector<glm::vec3> indexedNormals;
+        std::vector<unsigned int> indices;
+        indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUvs, indexedNormals);
+        if (indices.empty()) {
+            throw LoadException("OBJ model has no triangles.");
+        }
         
-        glGenVertexArrays(1, &_vertexArrayId);
-        glBindVertexArray(_vertexArrayId);
+        // Detail levels, each with about half the triangles of the previous one. All of them
+        // are simplified from the full mesh, and only use some of its vertices.
+        glm::vec3 boundsMin = indexedVertices[0];
+        glm::vec3 boundsMax = indexedVertices[0];
+        for (const glm::vec3& v : indexedVertices) {
+            boundsMin = glm::min(boundsMin, v);
+            boundsMax = glm::max(boundsMax, v);
+        }
+        const size_t maxLodCount = 4;
+        const float maxLodError = glm::length(boundsMax - boundsMin) * 0.05f;
         
-        glGenBuffers(1, &_vertexBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(glm::vec3), &_vertices[0], GL_STATIC_DRAW);
+        std::vector<std::vector<unsigned int> > levels(1, indices);
+        std::vector<float> levelErrors(1, 0.0f);
+        while (levels.size() < maxLodCount) {
+            std::vector<unsigned int> level;
+            float error = simplifyMesh(level, indices, indexedVertices, levels.back().size() / 6 * 3, maxLodError);
+            // Not simple enough to be worth a level
+            if (level.size() * 10 > levels.back().size() * 8) {
+                break;
+            }
+            levels.push_back(level);
+            levelErrors.push_back(error);
+        }
         
-        glGenBuffers(1, &_uvBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, _uvBuffer);
-        glBufferData(GL_ARRAY_BUFFER, _uvs.size() * sizeof(glm::vec2), &_uvs[0], GL_STATIC_DRAW);
+        // Reorder for the post-transform cache, early-z and vertex fetch, in that order.
+        // This is only paid when baking, the cache keeps the result.
+        for (std::vector<unsigned int>& level : levels) {
+            optimizeVertexCache(level, indexedVertices.size());
+        }
+        buildMeshlets(_meshlets, levels[0], indexedVertices);
+        optimizeMeshletOverdraw(_meshlets, levels[0], indexedVertices);
         
-        glGenBuffers(1, &_normalBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, _normalBuffer);
-        glBufferData(GL_ARRAY_BUFFER, _normals.size() * sizeof(glm::vec3), &_normals[0], GL_STATIC_DRAW);
+        // One index buffer for all the levels
+        indices.clear();
+        _lods.clear();
+        for (size_t i = 0; i < levels.size(); ++i) {
+            MeshLod lod = {
+                static_cast<unsigned int>(indices.size()),
+                static_cast<unsigned int>(levels[i].size()),
+                levelErrors[i],
+                0
+            };
+            _lods.push_back(lod);
+            indices.insert(indices.end(), levels[i].begin(), levels[i].end());
+        }
+        optimizeVertexFetch(indices, indexedVertices, indexedUvs, indexedNormals);
         
-        glGenBuffers(1, &_indexBuffer);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(unsigned short), &_indices[0], GL_STATIC_DRAW);
+        // 16-bit indices whenever they are enough, they are half the size
+        std::vector<unsigned short> shortIndices;
+        const void* indexData = &indices[0];
+        size_t indexSize = sizeof(unsigned int);
+        if (indexedVertices.size() <= 65536) {
+            shortIndices.assign(indices.begin(), indices.end());
+            indexData = &shortIndices[0];
+            indexSize = sizeof(unsigned short);
+        }
         
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        PackedVertices packed;
+        packVertices(indexedVertices, indexedUvs, indexedNormals, format, packed);
+        _positionOffset = packed.positionOffset;
+        _positionScale = packed.positionScale;
+        setBounds(packed.boundsMin, packed.boundsMax);
+        
+        // Next time, skip all of the above
+        writeMeshCache(
+            meshPath,
+            packed,
+            indexData,
+            static_cast<unsigned int>(indices.size()),
+            static_cast<unsigned int>(indexSize),
+            &_lods[0],
+            static_cast<unsigned int>(_lods.size()),
+            _meshlets
+        );
+        
+        upload(
+            format,
+            &packed.data[0],
+            packed.count,
+            packed.stride,
+            indexData,
+            indices.size(),
+            indexSize
+        );
     }
     
     ~Mesh() {
+        if (_arena != nullptr) {
+            return;
+        }
         glDeleteBuffers(1, &_vertexBuffer);
-        glDeleteBuffers(1, &_uvBuffer);
-        glDeleteBuffers(1, &_normalBuffer);
         glDeleteBuffers(1, &_indexBuffer);
         glDeleteVertexArrays(1, &_vertexArrayId);
     }
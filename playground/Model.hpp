@@ -1,42 +1,153 @@
 #ifndef MODEL_HPP
 #define MODEL_HPP
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
 #include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
 
+#include "common/culling.hpp"
 #include "Mesh.hpp"
 #include "Texture.hpp"
+#include "Shader.hpp"
+#include "TransformHierarchy.hpp"
 
 class Model {
 private:
     Mesh* _mesh;
     Texture* _texture;
+    Shader* _shader;
     
-    glm::mat4 _modelMatrix = glm::mat4(1.0f);
-    glm::vec3 _position = glm::vec3(0.0f, 0.0f, 0.0f);
+    TransformHierarchy* _transforms;
+    TransformHierarchy::Node _transformNode;
 
 public:
     
-    glm::mat4 getModelMatrix() const {
-        return _modelMatrix;
+    Mesh* getMesh() const {
+        return _mesh;
+    }
+    
+    Texture* getTexture() const {
+        return _texture;
+    }
+    
+    Shader* getShader() const {
+        return _shader;
+    }
+    
+    TransformHierarchy::Node getTransformNode() const {
+        return _transformNode;
     }
     
+    // As of the last TransformHierarchy::update
+    const glm::mat4& getModelMatrix() const {
+        return _transforms->getWorldMatrix(_transformNode);
+    }
+    
+    // Whether the model matrix changed in the last TransformHierarchy::update
+    bool hasMoved() const {
+        return _transforms->isUpdated(_transformNode);
+    }
+    
+    // Relative to the parent, if any
     void setPosition(glm::vec3 position) {
-        _position = position;
+        _transforms->setLocalPosition(_transformNode, position);
+    }
+    
+    void setRotation(glm::quat rotation) {
+        _transforms->setLocalRotation(_transformNode, rotation);
+    }
+    
+    void setScale(glm::vec3 scale) {
+        _transforms->setLocalScale(_transformNode, scale);
     }
     
-    void update() {
-        _modelMatrix[3] = glm::vec4(_position, 1.0f);
+    // World space bounding box, as a center and half extents, see BoxArrays
+    void getBounds(glm::vec3& center, glm::vec3& extent) const {
+        transformBox(getModelMatrix(), _mesh->getBoundsMin(), _mesh->getBoundsMax(), center, extent);
     }
     
-    void draw() {
+    // World units per model unit, along the most stretched axis of the model matrix, so that
+    // sizes scaled by it are never too small
+    float getScale() const {
+        const glm::mat4& m = getModelMatrix();
+        float x = glm::dot(glm::vec3(m[0]), glm::vec3(m[0]));
+        float y = glm::dot(glm::vec3(m[1]), glm::vec3(m[1]));
+        float z = glm::dot(glm::vec3(m[2]), glm::vec3(m[2]));
+        return std::sqrt(std::max(x, std::max(y, z)));
+    }
+    
+    // A negative scale along one axis turns the model inside out
+    bool isMirrored() const {
+        return glm::determinant(glm::mat3(getModelMatrix())) < 0.0f;
+    }
+    
+    // pixelsPerUnit : see Mesh::selectLod
+    unsigned int selectLod(const glm::vec3& cameraPosition, float pixelsPerUnit) const {
+        // The level of detail depends on how far the closest point of the mesh might be.
+        // The errors are in model units, like the radius.
+        float scale = getScale();
+        glm::vec3 center = glm::vec3(getModelMatrix() * glm::vec4(_mesh->getBoundsCenter(), 1.0f));
+        float distance = glm::length(center - cameraPosition) - _mesh->getBoundsRadius() * scale;
+        return distance > 0.0f ? _mesh->selectLod(distance, pixelsPerUnit * scale) : 0;
+    }
+    
+    // Diameter of the bounding sphere on screen, in pixels, see selectLod
+    float getScreenSize(const glm::vec3& cameraPosition, float pixelsPerUnit) const {
+        glm::vec3 center = glm::vec3(getModelMatrix() * glm::vec4(_mesh->getBoundsCenter(), 1.0f));
+        float distance = glm::length(center - cameraPosition);
+        float radius = _mesh->getBoundsRadius() * getScale();
+        // From inside, the mesh may cover the screen at any size
+        return distance > radius ? 2.0f * radius * pixelsPerUnit / distance : std::numeric_limits<float>::max();
+    }
+    
+    // Up close, the meshlets of the full mesh are culled one by one, which rules out instancing
+    bool usesMeshletCulling(unsigned int lod) const {
+        return lod == 0 && _mesh->getMeshletCount() > 1;
+    }
+    
+    // Binds the texture, not the shader
+    void draw(unsigned int lod, const glm::vec3& cameraPosition, const glm::mat4& viewProjection) {
         _texture->bind();
-        _mesh->draw();
+        
+        if (usesMeshletCulling(lod)) {
+            const glm::mat4& modelMatrix = getModelMatrix();
+            Frustum frustum;
+            extractFrustum(viewProjection * modelMatrix, frustum);
+            glm::vec3 cameraPosition_modelSpace = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(cameraPosition, 1.0f));
+            _mesh->drawMeshlets(frustum, cameraPosition_modelSpace, !isMirrored());
+        }
+        else {
+            _mesh->draw(lod);
+        }
     }
     
+    void draw(const glm::vec3& cameraPosition, float pixelsPerUnit, const glm::mat4& viewProjection) {
+        draw(selectLod(cameraPosition, pixelsPerUnit), cameraPosition, viewProjection);
+    }
     
-    Model(Mesh* mesh, Texture* texture) {
+    
+    // shader : what the model is drawn with, for batching. Binding it is up to the caller.
+    // transforms : where the node of the model goes, as a child of parent if any
+    Model(
+        Mesh* mesh,
+        Texture* texture,
+        Shader* shader,
+        TransformHierarchy* transforms,
+        TransformHierarchy::Node parent = TransformHierarchy::NONE
+    ) {
         _mesh = mesh;
         _texture = texture;
+        _shader = shader;
+        _transforms = transforms;
+        _transformNode = transforms->createNode(parent);
+    }
+    
+    ~Model() {
+        _transforms->destroyNode(_transformNode);
     }
 };
 
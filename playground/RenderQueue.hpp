@@ -0,0 +1,429 @@
+#ifndef RENDER_QUEUE_HPP
+#define RENDER_QUEUE_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "common/frustum.hpp"
+#include "GeometryArena.hpp"
+#include "Model.hpp"
+#include "SceneUniforms.hpp"
+#include "UniformBuffer.hpp"
+
+enum RenderPass {
+    RENDER_PASS_OPAQUE = 0,      // Front to back
+    RENDER_PASS_TRANSPARENT = 1  // Back to front, after the opaque pass
+};
+
+// Collects the draws of a frame as packets, sorts them by a 64-bit key so that the draws
+// sharing a shader, then a texture, then a mesh, end up next to each other, and submits
+// them without the binds that wouldn't change anything.
+//
+// Key, from the most significant bits :
+//   pass : 4 | shader : 12 | texture : 12 | mesh : 12 | depth : 24
+// Shader, texture and mesh are the low bits of their GL names. Two objects may then share
+// a key, which only costs a bind : submit compares the objects themselves.
+//
+// Models whose mesh lives in a GeometryArena, and whose shader has an indirect variant,
+// see setIndirectShader, are drawn by glMultiDrawElementsIndirect instead : every run of
+// them sharing a shader, a texture and an arena after sorting is one multi-draw.
+class RenderQueue {
+public:
+    struct Statistics {
+        size_t packetCount;
+        size_t drawCount;                   // Draw calls, a multi-draw counts once
+        size_t indirectPacketCount;         // Drawn by multi-draws
+        size_t programBinds;
+        size_t programBindsSkipped;
+        size_t textureBinds;
+        size_t textureBindsSkipped;
+        size_t vertexArrayBinds;
+        size_t vertexArrayBindsSkipped;
+    };
+
+private:
+    struct Packet {
+        Shader* shader;
+        Texture* texture;
+        Mesh* mesh;
+        unsigned int lod;
+        GLintptr objectUniformsOffset;  // ObjectData, see UniformBuffer::push
+
+        // Instanced when instanceCount > 0, see Mesh::submitInstanced
+        GLuint instanceBuffer;
+        GLintptr instanceOffset;
+        GLsizei instanceCount;
+
+        // Meshlets culled one by one when >= 0 : index in _meshletCulls
+        int meshletCull;
+
+        // Drawn by a multi-draw when >= 0 : index in _drawData
+        int drawData;
+    };
+
+    // What submit draws, in order : either one packet, or a multi-draw of commandCount
+    // commands starting at firstCommand, all of them sharing the packet's state
+    struct Submission {
+        unsigned int packet;
+        unsigned int firstCommand;
+        unsigned int commandCount;
+    };
+
+    struct MeshletCull {
+        Frustum frustum;                // Model space
+        glm::vec3 cameraPosition;       // Model space
+        bool cullBackFaces;             // See cullMeshlets
+    };
+
+    std::vector<Packet> _packets;
+    std::vector<unsigned long long> _keys;
+    std::vector<MeshletCull> _meshletCulls;
+    std::vector<ObjectUniforms> _drawData;
+
+    std::map<const Shader*, Shader*> _indirectShaders;
+    bool _indirectEnabled;
+
+    // Built by submit from the sorted packets. Each command reads the ObjectUniforms of
+    // the same index in _sortedDrawData, through its baseInstance.
+    std::vector<Submission> _submissions;
+    std::vector<DrawElementsIndirectCommand> _commands;
+    std::vector<ObjectUniforms> _sortedDrawData;
+    GLuint _indirectBuffer;
+    GLuint _drawDataBuffer;
+
+    // Packet indices in submission order, and radix sort scratch
+    std::vector<unsigned int> _order;
+    std::vector<unsigned int> _orderScratch;
+
+    Statistics _statistics;
+
+    static unsigned long long makeKey(RenderPass pass, const Packet& packet, float depth) {
+        // Positive floats sort like their bits : keep the top 24
+        if (!(depth > 0.0f)) {
+            depth = 0.0f;
+        }
+        unsigned int depthBits;
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+        depthBits >>= 8;
+        if (pass == RENDER_PASS_TRANSPARENT) {
+            depthBits = ~depthBits & 0xFFFFFF;
+        }
+
+        return
+            (static_cast<unsigned long long>(pass & 0xF) << 60) |
+            (static_cast<unsigned long long>(packet.shader->getId() & 0xFFF) << 48) |
+            (static_cast<unsigned long long>(packet.texture->getId() & 0xFFF) << 36) |
+            (static_cast<unsigned long long>(packet.mesh->getVertexArrayId() & 0xFFF) << 24) |
+            static_cast<unsigned long long>(depthBits);
+    }
+
+    void push(RenderPass pass, const Packet& packet, float depth) {
+        _keys.push_back(makeKey(pass, packet, depth));
+        _packets.push_back(packet);
+    }
+
+    // LSD radix sort of the packet indices by key, 8 bits at a time. The digits that are
+    // the same for every key, such as the pass bits most of the time, are skipped.
+    void sortByKey() {
+        size_t count = _keys.size();
+        _order.resize(count);
+        _orderScratch.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            _order[i] = static_cast<unsigned int>(i);
+        }
+
+        size_t histograms[8][256];
+        memset(histograms, 0, sizeof(histograms));
+        for (size_t i = 0; i < count; ++i) {
+            unsigned long long key = _keys[i];
+            for (int digit = 0; digit < 8; ++digit) {
+                ++histograms[digit][(key >> (digit * 8)) & 0xFF];
+            }
+        }
+
+        for (int digit = 0; digit < 8; ++digit) {
+            size_t* histogram = histograms[digit];
+            unsigned long long firstBucket = (_keys[0] >> (digit * 8)) & 0xFF;
+            if (histogram[firstBucket] == count) {
+                continue;
+            }
+
+            size_t offset = 0;
+            for (int bucket = 0; bucket < 256; ++bucket) {
+                size_t bucketSize = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += bucketSize;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                unsigned int packet = _order[i];
+                _orderScratch[histogram[(_keys[packet] >> (digit * 8)) & 0xFF]++] = packet;
+            }
+            _order.swap(_orderScratch);
+        }
+    }
+
+    // Merges the consecutive indirect packets that share a shader, a texture and an arena
+    // into multi-draws, and uploads their commands and draw data
+    void buildSubmissions() {
+        _submissions.clear();
+        _commands.clear();
+        _sortedDrawData.clear();
+        for (size_t i = 0; i < _order.size(); ++i) {
+            const Packet& packet = _packets[_order[i]];
+            if (packet.drawData < 0) {
+                Submission submission = { _order[i], 0, 0 };
+                _submissions.push_back(submission);
+                continue;
+            }
+
+            bool merged = false;
+            if (!_submissions.empty() && _submissions.back().commandCount > 0) {
+                const Packet& previous = _packets[_submissions.back().packet];
+                merged =
+                    previous.shader == packet.shader &&
+                    previous.texture == packet.texture &&
+                    previous.mesh->getArena() == packet.mesh->getArena();
+            }
+            if (merged) {
+                ++_submissions.back().commandCount;
+            }
+            else {
+                Submission submission = { _order[i], static_cast<unsigned int>(_commands.size()), 1 };
+                _submissions.push_back(submission);
+            }
+            GLuint drawId = static_cast<GLuint>(_sortedDrawData.size());
+            _commands.push_back(packet.mesh->getIndirectCommand(packet.lod, drawId));
+            _sortedDrawData.push_back(_drawData[packet.drawData]);
+        }
+        if (_commands.empty()) {
+            return;
+        }
+
+        // Orphaned every frame, like the instance buffer of InstanceBatcher
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, _commands.size() * sizeof(DrawElementsIndirectCommand), &_commands[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _drawDataBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _sortedDrawData.size() * sizeof(ObjectUniforms), &_sortedDrawData[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+public:
+
+    // Multi-draw indirect and shader storage buffers are core in 4.3
+    static bool isIndirectSupported() {
+        return GLEW_VERSION_4_3 != 0;
+    }
+
+    // Models drawn with shader will be drawn with indirectShader when their mesh is in an
+    // arena. indirectShader reads its ObjectData from DRAW_DATA_BINDING, indexed by the draw
+    // id attribute, see indirect-vertex-shader.glsl. Needs isIndirectSupported.
+    void setIndirectShader(const Shader* shader, Shader* indirectShader) {
+        _indirectShaders[shader] = indirectShader;
+    }
+
+    // On by default, once indirect shaders are set
+    void setIndirectEnabled(bool enabled) {
+        _indirectEnabled = enabled;
+    }
+
+    bool isIndirectEnabled() const {
+        return _indirectEnabled;
+    }
+
+    void clear() {
+        _packets.clear();
+        _keys.clear();
+        _meshletCulls.clear();
+        _drawData.clear();
+    }
+
+    // One model, with objectUniforms as its ObjectData : pushed to uniforms, which the caller
+    // uploads before submit, unless the model goes to a multi-draw
+    void addModel(
+        Model* model,
+        unsigned int lod,
+        const ObjectUniforms& objectUniforms,
+        UniformBuffer& uniforms,
+        const glm::vec3& cameraPosition,
+        const glm::mat4& viewProjection,
+        RenderPass pass = RENDER_PASS_OPAQUE
+    ) {
+        Packet packet;
+        packet.shader = model->getShader();
+        packet.texture = model->getTexture();
+        packet.mesh = model->getMesh();
+        packet.lod = lod;
+        packet.objectUniformsOffset = 0;
+        packet.instanceBuffer = 0;
+        packet.instanceOffset = 0;
+        packet.instanceCount = 0;
+        packet.meshletCull = -1;
+        packet.drawData = -1;
+
+        // Meshlet culling draws ranges of its own, which rules out the multi-draw
+        std::map<const Shader*, Shader*>::const_iterator indirectShader = _indirectShaders.find(packet.shader);
+        if (
+            _indirectEnabled &&
+            indirectShader != _indirectShaders.end() &&
+            packet.mesh->getArena() != nullptr &&
+            !model->usesMeshletCulling(lod)
+        ) {
+            packet.shader = indirectShader->second;
+            packet.drawData = static_cast<int>(_drawData.size());
+            _drawData.push_back(objectUniforms);
+        }
+        else {
+            packet.objectUniformsOffset = uniforms.push(&objectUniforms, sizeof(objectUniforms));
+        }
+
+        glm::mat4 modelMatrix = model->getModelMatrix();
+        if (model->usesMeshletCulling(lod)) {
+            MeshletCull cull;
+            extractFrustum(viewProjection * modelMatrix, cull.frustum);
+            cull.cameraPosition = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(cameraPosition, 1.0f));
+            cull.cullBackFaces = !model->isMirrored();
+            packet.meshletCull = static_cast<int>(_meshletCulls.size());
+            _meshletCulls.push_back(cull);
+        }
+
+        glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(packet.mesh->getBoundsCenter(), 1.0f));
+        push(pass, packet, glm::length(center - cameraPosition));
+    }
+
+    // instanceCount copies of a mesh, see Mesh::submitInstanced. depth : of the closest one.
+    void addInstances(
+        Shader* shader,
+        Texture* texture,
+        Mesh* mesh,
+        unsigned int lod,
+        GLintptr objectUniformsOffset,
+        GLuint instanceBuffer,
+        GLintptr instanceOffset,
+        GLsizei instanceCount,
+        float depth,
+        RenderPass pass = RENDER_PASS_OPAQUE
+    ) {
+        Packet packet;
+        packet.shader = shader;
+        packet.texture = texture;
+        packet.mesh = mesh;
+        packet.lod = lod;
+        packet.objectUniformsOffset = objectUniformsOffset;
+        packet.instanceBuffer = instanceBuffer;
+        packet.instanceOffset = instanceOffset;
+        packet.instanceCount = instanceCount;
+        packet.meshletCull = -1;
+        packet.drawData = -1;
+        push(pass, packet, depth);
+    }
+
+    // Sorts and draws everything added since clear(). FrameData must already be bound.
+    void submit(const UniformBuffer& uniforms) {
+        memset(&_statistics, 0, sizeof(_statistics));
+        _statistics.packetCount = _packets.size();
+        if (_packets.empty()) {
+            return;
+        }
+        sortByKey();
+        buildSubmissions();
+        if (!_commands.empty()) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, _drawDataBuffer);
+        }
+
+        // Whatever was bound before is unknown : the first packet binds everything.
+        // Meshes sharing an arena share a vertex array.
+        const Shader* currentShader = nullptr;
+        const Texture* currentTexture = nullptr;
+        GLuint currentVertexArray = 0;
+        for (const Submission& submission : _submissions) {
+            const Packet& packet = _packets[submission.packet];
+
+            if (packet.shader != currentShader) {
+                packet.shader->use();
+                currentShader = packet.shader;
+                ++_statistics.programBinds;
+            }
+            else {
+                ++_statistics.programBindsSkipped;
+            }
+
+            if (packet.texture != currentTexture) {
+                packet.texture->bind();
+                currentTexture = packet.texture;
+                ++_statistics.textureBinds;
+            }
+            else {
+                ++_statistics.textureBindsSkipped;
+            }
+
+            if (packet.mesh->getVertexArrayId() != currentVertexArray) {
+                currentVertexArray = packet.mesh->getVertexArrayId();
+                glBindVertexArray(currentVertexArray);
+                ++_statistics.vertexArrayBinds;
+            }
+            else {
+                ++_statistics.vertexArrayBindsSkipped;
+            }
+
+            if (submission.commandCount > 0) {
+                GeometryArena* arena = packet.mesh->getArena();
+                arena->enableDrawIds(_commands.size());
+                glMultiDrawElementsIndirect(
+                    GL_TRIANGLES,
+                    arena->getIndexType(),
+                    (void*) (submission.firstCommand * sizeof(DrawElementsIndirectCommand)),
+                    static_cast<GLsizei>(submission.commandCount),
+                    0
+                );
+                arena->disableDrawIds();
+                _statistics.indirectPacketCount += submission.commandCount;
+                ++_statistics.drawCount;
+                continue;
+            }
+
+            uniforms.bindRange(OBJECT_UNIFORMS_BINDING, packet.objectUniformsOffset, sizeof(ObjectUniforms));
+            if (packet.instanceCount > 0) {
+                packet.mesh->submitInstanced(packet.lod, packet.instanceBuffer, packet.instanceOffset, packet.instanceCount);
+            }
+            else if (packet.meshletCull >= 0) {
+                const MeshletCull& cull = _meshletCulls[packet.meshletCull];
+                packet.mesh->submitMeshlets(cull.frustum, cull.cameraPosition, cull.cullBackFaces);
+            }
+            else {
+                packet.mesh->submit(packet.lod);
+            }
+            ++_statistics.drawCount;
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (!_commands.empty()) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+
+    // Of the last submit
+    const Statistics& getStatistics() const {
+        return _statistics;
+    }
+
+
+    RenderQueue()
+        : _indirectEnabled(true) {
+        memset(&_statistics, 0, sizeof(_statistics));
+        glGenBuffers(1, &_indirectBuffer);
+        glGenBuffers(1, &_drawDataBuffer);
+    }
+
+    ~RenderQueue() {
+        glDeleteBuffers(1, &_indirectBuffer);
+        glDeleteBuffers(1, &_drawDataBuffer);
+    }
+};
+
+#endif//RENDER_QUEUE_HPP
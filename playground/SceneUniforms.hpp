@@ -0,0 +1,34 @@
+#ifndef SCENE_UNIFORMS_HPP
+#define SCENE_UNIFORMS_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// C++ side of the uniform blocks of vertex-shader.glsl and fragment-shader.glsl.
+// std140 : only mat4 and vec4 members, so that glm's layout matches without padding.
+
+// Binding points, see Shader::bindUniformBlock
+static const GLuint FRAME_UNIFORMS_BINDING = 0;
+static const GLuint OBJECT_UNIFORMS_BINDING = 1;
+
+// Shader storage binding of the ObjectUniforms array read by indirect-vertex-shader.glsl,
+// one per draw of a multi-draw. std430 lays it out as an array of ObjectUniforms.
+static const GLuint DRAW_DATA_BINDING = 0;
+
+// Block FrameData, written once per frame
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 lightPosition_worldSpace; // w unused
+    glm::vec4 lightColor;               // w unused
+};
+
+// Block ObjectData, written once per model per frame
+struct ObjectUniforms {
+    glm::mat4 model;
+    glm::mat4 mvp;
+    glm::vec4 positionOffset;           // See Mesh::getPositionOffset, w unused
+    glm::vec4 positionScale;            // w unused
+};
+
+#endif//SCENE_UNIFORMS_HPP
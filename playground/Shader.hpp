@@ -6,124 +6,442 @@
 #include <sstream>
 #include <fstream>
 #include <vector>
+#include <unordered_map>
+#include <future>
+#include <thread>
+#include <cstring>
+#include <functional>
+#include <utility>
 
+#include "common/shadercache.hpp"
+#include "common/jobsystem.hpp"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// A program built in the background : constructing a Shader doesn't touch GL, compileBatch
+// submits the compiles and links without waiting for them, and the first getId() or use()
+// waits for whatever is left. With KHR/ARB_parallel_shader_compile the driver builds the
+// programs of a batch on its own threads, otherwise glCompileShader may block as usual.
+// All the GL calls happen on the calling thread ; only the file reads go to a worker.
+// A reload reads its files in a background job, and submits then swaps the new program on
+// later calls to updateReload : without parallel compile support, the frame that submits
+// still waits for the driver to compile, unless the program cache has it.
 class Shader {
 private:
-    GLuint _shaderId;
-    
-    static GLuint loadShaders(const char * vertex_file_path,const char * fragment_file_path) {
-        // Create the shaders
-        GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-        GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-        
-        // Read the Vertex Shader code from the file
-        std::string VertexShaderCode;
-        std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-        if (VertexShaderStream.is_open()) {
-            std::stringstream sstr;
-            sstr << VertexShaderStream.rdbuf();
-            VertexShaderCode = sstr.str();
-            VertexShaderStream.close();
+    enum State {
+        CREATED,   // Sources not read yet
+        READING,   // Sources being read by a background job, see reload
+        SUBMITTED, // Compiling and linking, maybe in parallel
+        READY      // _shaderId is final, 0 on failure
+    };
+
+    std::string _vertexPath;
+    std::string _fragmentPath;
+
+    // Build state, mutable because the first use of a const Shader may finish it
+    mutable State _state;
+    mutable GLuint _shaderId;
+    mutable GLuint _vertexShaderId;
+    mutable GLuint _fragmentShaderId;
+    mutable bool _sourcesRead;
+    mutable std::string _vertexSource;
+    mutable std::string _fragmentSource;
+
+    // Reflected once the program is linked
+    mutable std::unordered_map<std::string, GLint> _uniformLocations;
+    mutable std::unordered_map<std::string, GLuint> _uniformBlockIndices;
+    mutable bool _linked;
+
+    std::function<void(const Shader&)> _onLinked;
+    // The next version of the program while it builds, see reload
+    Shader* _reloading;
+    // A file changed again while the next version was reading it
+    bool _reloadAgain;
+    mutable JobCounter _readCounter;
+
+    static bool readFile(const std::string & path, std::string & out_source) {
+        std::ifstream stream(path.c_str(), std::ios::in);
+        if (!stream.is_open()) {
+            return false;
         }
-        else {
+        std::stringstream sstr;
+        sstr << stream.rdbuf();
+        out_source = sstr.str();
+        return true;
+    }
+
+    static bool hasExtension(const char * name) {
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount; ++i) {
+            const char * extension = (const char *) glGetStringi(GL_EXTENSIONS, i);
+            if (extension && strcmp(extension, name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Checked once, on the first batch
+    static bool isParallelCompileSupported() {
+        static const bool supported = [] {
+            if (GLEW_ARB_parallel_shader_compile) {
+                // No limit on the driver's compiler threads. This GLEW doesn't load
+                // glMaxShaderCompilerThreadsKHR, so with KHR alone the driver picks.
+                glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+                return true;
+            }
+            return hasExtension("GL_KHR_parallel_shader_compile");
+        }();
+        return supported;
+    }
+
+    // Lists the active uniforms outside blocks, and the blocks
+    void reflect() const {
+        GLint uniformCount = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(_shaderId, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(_shaderId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+        std::vector<char> name(maxNameLength + 1);
+        for (GLint i = 0; i < uniformCount; ++i) {
+            GLsizei nameLength = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(_shaderId, i, maxNameLength + 1, &nameLength, &size, &type, &name[0]);
+            std::string uniformName(&name[0], nameLength);
+            GLint location = glGetUniformLocation(_shaderId, uniformName.c_str());
+            if (location < 0) {
+                continue; // In a block
+            }
+            _uniformLocations[uniformName] = location;
+            // Arrays are listed as "name[0]"
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0) {
+                _uniformLocations[uniformName.substr(0, uniformName.size() - 3)] = location;
+            }
+        }
+
+        GLint blockCount = 0;
+        GLint maxBlockNameLength = 0;
+        glGetProgramiv(_shaderId, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+        glGetProgramiv(_shaderId, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockNameLength);
+        name.resize(maxBlockNameLength + 1);
+        for (GLint i = 0; i < blockCount; ++i) {
+            GLsizei nameLength = 0;
+            glGetActiveUniformBlockName(_shaderId, i, maxBlockNameLength + 1, &nameLength, &name[0]);
+            _uniformBlockIndices[std::string(&name[0], nameLength)] = static_cast<GLuint>(i);
+        }
+    }
+
+    // Worker thread : no GL here
+    void readSources() const {
+        _sourcesRead =
+            readFile(_vertexPath, _vertexSource) &&
+            readFile(_fragmentPath, _fragmentSource);
+    }
+
+    static void readSourcesJob(void * data) {
+        static_cast<const Shader*>(data)->readSources();
+    }
+
+    void startReload() {
+        delete _reloading;
+        _reloadAgain = false;
+        _reloading = new Shader(_vertexPath.c_str(), _fragmentPath.c_str());
+        _reloading->_state = READING;
+        runBackgroundJob(readSourcesJob, _reloading, _reloading->_readCounter);
+    }
+
+    void submit() const {
+        if (!_sourcesRead) {
             printf(
-                "Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n",
-                vertex_file_path
+                "Impossible to open %s or %s. Are you in the right directory ? Don't forget to read the FAQ !\n",
+                _vertexPath.c_str(),
+                _fragmentPath.c_str()
             );
-            getchar();
-            return 0;
-        }
-        
-        // Read the Fragment Shader code from the file
-        std::string FragmentShaderCode;
-        std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-        if(FragmentShaderStream.is_open()){
-            std::stringstream sstr;
-            sstr << FragmentShaderStream.rdbuf();
-            FragmentShaderCode = sstr.str();
-            FragmentShaderStream.close();
-        }
-        
-        GLint Result = GL_FALSE;
-        int InfoLogLength;
-        
-        
-        // Compile Vertex Shader
-        printf("Compiling shader : %s\n", vertex_file_path);
-        char const * VertexSourcePointer = VertexShaderCode.c_str();
-        glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-        glCompileShader(VertexShaderID);
-        
-        // Check Vertex Shader
-        glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-        glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-        if ( InfoLogLength > 0 ){
-            std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-            glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-            printf("%s\n", &VertexShaderErrorMessage[0]);
-        }
-        
-        
-        
-        // Compile Fragment Shader
-        printf("Compiling shader : %s\n", fragment_file_path);
-        char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-        glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-        glCompileShader(FragmentShaderID);
-        
-        // Check Fragment Shader
-        glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-        glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+            _shaderId = 0;
+            setReady(false);
+            return;
+        }
+
+        // Same sources and driver as last time : skip compiling and linking
+        _shaderId = loadCachedProgram(
+            _vertexPath.c_str(), _fragmentPath.c_str(), _vertexSource.c_str(), _fragmentSource.c_str()
+        );
+        if (_shaderId != 0) {
+            _vertexSource.clear();
+            _fragmentSource.clear();
+            setReady(true);
+            return;
+        }
+
+        printf("Compiling program : %s, %s\n", _vertexPath.c_str(), _fragmentPath.c_str());
+        _vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+        char const * VertexSourcePointer = _vertexSource.c_str();
+        glShaderSource(_vertexShaderId, 1, &VertexSourcePointer , NULL);
+        glCompileShader(_vertexShaderId);
+
+        _fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+        char const * FragmentSourcePointer = _fragmentSource.c_str();
+        glShaderSource(_fragmentShaderId, 1, &FragmentSourcePointer , NULL);
+        glCompileShader(_fragmentShaderId);
+
+        // Don't query anything yet : that would wait for the compile
+        _shaderId = glCreateProgram();
+        glAttachShader(_shaderId, _vertexShaderId);
+        glAttachShader(_shaderId, _fragmentShaderId);
+        prepareProgramForCache(_shaderId);
+        glLinkProgram(_shaderId);
+        _state = SUBMITTED;
+    }
+
+    static void printShaderLog(GLuint shaderId, const std::string & path) {
+        int InfoLogLength = 0;
+        glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &InfoLogLength);
         if ( InfoLogLength > 0 ){
-            std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-            glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-            printf("%s\n", &FragmentShaderErrorMessage[0]);
-        }
-        
-        
-        
-        // Link the program
-        printf("Linking program\n");
-        GLuint ProgramID = glCreateProgram();
-        glAttachShader(ProgramID, VertexShaderID);
-        glAttachShader(ProgramID, FragmentShaderID);
-        glLinkProgram(ProgramID);
-        
-        // Check the program
-        glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-        glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+            std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+            glGetShaderInfoLog(shaderId, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+            printf("%s : %s\n", path.c_str(), &ShaderErrorMessage[0]);
+        }
+    }
+
+    // Blocks until the program is linked
+    void finish() const {
+        if (_state == CREATED) {
+            compileBatch(std::vector<Shader*>(1, const_cast<Shader*>(this)));
+        }
+        if (_state == READING) {
+            waitForJobs(_readCounter);
+            submit();
+        }
+        if (_state != SUBMITTED) {
+            return;
+        }
+
+        printShaderLog(_vertexShaderId, _vertexPath);
+        printShaderLog(_fragmentShaderId, _fragmentPath);
+
+        GLint Result = GL_FALSE;
+        int InfoLogLength = 0;
+        glGetProgramiv(_shaderId, GL_LINK_STATUS, &Result);
+        glGetProgramiv(_shaderId, GL_INFO_LOG_LENGTH, &InfoLogLength);
         if ( InfoLogLength > 0 ){
             std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-            glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+            glGetProgramInfoLog(_shaderId, InfoLogLength, NULL, &ProgramErrorMessage[0]);
             printf("%s\n", &ProgramErrorMessage[0]);
         }
-        
-        
-        glDetachShader(ProgramID, VertexShaderID);
-        glDetachShader(ProgramID, FragmentShaderID);
-        
-        glDeleteShader(VertexShaderID);
-        glDeleteShader(FragmentShaderID);
-        
-        return ProgramID;
-    }
-    
+        if (Result == GL_TRUE) {
+            saveCachedProgram(
+                _shaderId, _vertexPath.c_str(), _fragmentPath.c_str(), _vertexSource.c_str(), _fragmentSource.c_str()
+            );
+        }
+
+        glDetachShader(_shaderId, _vertexShaderId);
+        glDetachShader(_shaderId, _fragmentShaderId);
+        glDeleteShader(_vertexShaderId);
+        glDeleteShader(_fragmentShaderId);
+        _vertexShaderId = 0;
+        _fragmentShaderId = 0;
+        _vertexSource.clear();
+        _fragmentSource.clear();
+        setReady(Result == GL_TRUE);
+    }
+
+    void setReady(bool linked) const {
+        _state = READY;
+        _linked = linked;
+        if (linked) {
+            reflect();
+            if (_onLinked) {
+                _onLinked(*this);
+            }
+        }
+    }
+
 public:
-    
+
+    // Reads the sources of every shader of the batch that isn't started yet on a worker
+    // thread, and submits each program as soon as its sources are in, so that reading
+    // the next files overlaps with compiling the previous ones. Doesn't wait for the
+    // programs themselves.
+    static void compileBatch(const std::vector<Shader*> & shaders) {
+        std::vector<Shader*> pending;
+        for (size_t i = 0; i < shaders.size(); ++i) {
+            if (shaders[i]->_state == CREATED) {
+                pending.push_back(shaders[i]);
+            }
+        }
+        if (pending.empty()) {
+            return;
+        }
+        isParallelCompileSupported();
+
+        std::vector<std::promise<void>> sourcesRead(pending.size());
+        std::vector<std::future<void>> sourcesReady;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            sourcesReady.push_back(sourcesRead[i].get_future());
+        }
+        std::thread reader([&pending, &sourcesRead] {
+            for (size_t i = 0; i < pending.size(); ++i) {
+                pending[i]->readSources();
+                sourcesRead[i].set_value();
+            }
+        });
+        for (size_t i = 0; i < pending.size(); ++i) {
+            sourcesReady[i].wait();
+            pending[i]->submit();
+        }
+        reader.join();
+    }
+
+    // Whether getId() would return without waiting. Without parallel compile support,
+    // there's no way to ask, so this is true as soon as the program is submitted.
+    bool isReady() const {
+        if (_state != SUBMITTED) {
+            return _state == READY;
+        }
+        if (!isParallelCompileSupported()) {
+            return true;
+        }
+        GLint completed = GL_FALSE;
+        glGetProgramiv(_shaderId, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed == GL_TRUE;
+    }
+
     inline GLuint getId() const {
+        finish();
         return _shaderId;
     }
-    
+
     void use() const {
-        glUseProgram(_shaderId);
+        glUseProgram(getId());
     }
-    
-    
-    Shader(const char * vertex_file_path, const char * fragment_file_path) {
-        _shaderId = loadShaders(vertex_file_path, fragment_file_path);
+
+    // Called with the shader each time its program links : the first time, and after each
+    // successful reload. That's the place to set the uniforms that don't change and to bind
+    // the uniform blocks, as a new program starts over with the defaults.
+    void setOnLinked(const std::function<void(const Shader&)> & onLinked) {
+        _onLinked = onLinked;
+        if (_state == READY && _linked && _onLinked) {
+            _onLinked(*this);
+        }
+    }
+
+    const std::string & getVertexPath() const {
+        return _vertexPath;
+    }
+
+    const std::string & getFragmentPath() const {
+        return _fragmentPath;
     }
-    
+
+    // Starts reading the files again in a background job, and returns. The current
+    // program stays in use until updateReload swaps the new one in. Restarts the build
+    // if one is already going.
+    void reload() {
+        finish();
+        if (_reloading != nullptr && _reloading->_state == READING) {
+            // The job may have read the file already : updateReload starts over once it's done
+            _reloadAgain = true;
+            return;
+        }
+        startReload();
+    }
+
+    bool isReloading() const {
+        return _reloading != nullptr;
+    }
+
+    // Call between frames. Submits the new program once its files are read, and on a later
+    // call, once it's done, takes its handle and uniform tables and returns true, or keeps
+    // the current program if the new one didn't link. Doesn't wait for the files, nor for
+    // the driver while it's still compiling, if it can tell.
+    bool updateReload() {
+        if (_reloading == nullptr) {
+            return false;
+        }
+        if (_reloading->_state == READING) {
+            if (_reloading->_readCounter.count.load() != 0) {
+                return false;
+            }
+            if (_reloadAgain) {
+                startReload();
+            }
+            else {
+                _reloading->submit();
+            }
+            return false;
+        }
+        if (!_reloading->isReady()) {
+            return false;
+        }
+        _reloading->finish();
+        bool linked = _reloading->_linked;
+        if (linked) {
+            std::swap(_shaderId, _reloading->_shaderId);
+            std::swap(_uniformLocations, _reloading->_uniformLocations);
+            std::swap(_uniformBlockIndices, _reloading->_uniformBlockIndices);
+            // The first build may have failed : the program is usable from now on
+            _linked = true;
+            _state = READY;
+            printf("Reloaded program : %s, %s\n", _vertexPath.c_str(), _fragmentPath.c_str());
+            if (_onLinked) {
+                _onLinked(*this);
+            }
+        }
+        else {
+            printf("Keeping the previous program : %s, %s\n", _vertexPath.c_str(), _fragmentPath.c_str());
+        }
+        // Deletes the old program, or the one that failed
+        delete _reloading;
+        _reloading = nullptr;
+        return linked;
+    }
+
+    // Same as glGetUniformLocation, without asking the driver : -1 if the program has no
+    // such uniform, or if it's in a block
+    GLint getUniformLocation(const std::string & name) const {
+        finish();
+        std::unordered_map<std::string, GLint>::const_iterator it = _uniformLocations.find(name);
+        return it != _uniformLocations.end() ? it->second : -1;
+    }
+
+    // Reads the block from the buffer bound to this binding point. Returns false if the
+    // program doesn't use the block.
+    bool bindUniformBlock(const std::string & name, GLuint binding) const {
+        finish();
+        std::unordered_map<std::string, GLuint>::const_iterator it = _uniformBlockIndices.find(name);
+        if (it == _uniformBlockIndices.end()) {
+            return false;
+        }
+        glUniformBlockBinding(_shaderId, it->second, binding);
+        return true;
+    }
+
+
+    // Doesn't read or compile anything : see compileBatch, or the first getId()
+    Shader(const char * vertex_file_path, const char * fragment_file_path)
+        : _vertexPath(vertex_file_path),
+          _fragmentPath(fragment_file_path),
+          _state(CREATED),
+          _shaderId(0),
+          _vertexShaderId(0),
+          _fragmentShaderId(0),
+          _sourcesRead(false),
+          _linked(false),
+          _reloading(nullptr),
+          _reloadAgain(false) {
+    }
+
     ~Shader() {
+        delete _reloading;
+        // The files may still be being read into this one
+        waitForJobs(_readCounter);
+        if (_vertexShaderId != 0) {
+            glDeleteShader(_vertexShaderId);
+            glDeleteShader(_fragmentShaderId);
+        }
         glDeleteProgram(_shaderId);
     }
 };
@@ -0,0 +1,65 @@
+#ifndef SHADER_RELOADER_HPP
+#define SHADER_RELOADER_HPP
+
+#include <string>
+#include <vector>
+
+#include "common/filewatcher.hpp"
+#include "Shader.hpp"
+
+// Rebuilds shaders when their source files are saved, keeping the previous program while
+// the new one compiles, or for good if it doesn't link. See Shader::reload.
+class ShaderReloader {
+private:
+    FileWatcher* _watcher;
+    std::vector<Shader*> _shaders;
+    std::vector<std::string> _changedPaths;
+    bool _reloading;
+
+public:
+
+    // Once per frame, between frames. Costs one atomic load while no file changes and
+    // nothing is reloading.
+    void update() {
+        if (_watcher != nullptr && takeChangedFiles(_watcher, _changedPaths)) {
+            for (Shader* shader : _shaders) {
+                for (const std::string& path : _changedPaths) {
+                    if (path == shader->getVertexPath() || path == shader->getFragmentPath()) {
+                        shader->reload();
+                        _reloading = true;
+                        break;
+                    }
+                }
+            }
+            _changedPaths.clear();
+        }
+
+        if (!_reloading) {
+            return;
+        }
+        _reloading = false;
+        for (Shader* shader : _shaders) {
+            shader->updateReload();
+            _reloading = _reloading || shader->isReloading();
+        }
+    }
+
+
+    // The shaders must outlive the reloader
+    explicit ShaderReloader(const std::vector<Shader*>& shaders)
+        : _shaders(shaders),
+          _reloading(false) {
+        std::vector<std::string> paths;
+        for (Shader* shader : _shaders) {
+            paths.push_back(shader->getVertexPath());
+            paths.push_back(shader->getFragmentPath());
+        }
+        _watcher = createFileWatcher(paths);
+    }
+
+    ~ShaderReloader() {
+        destroyFileWatcher(_watcher);
+    }
+};
+
+#endif//SHADER_RELOADER_HPP
@@ -4,30 +4,59 @@
 #include <GL/glew.h>
 #include <common/texture.hpp>
 #include "LoadException.hpp"
+#include "TextureStreamer.hpp"
 
 class Texture {
 private:
-    GLuint _textureId;
+    GLuint _textureId = 0;
+    
+    // Streamed textures are the placeholder of the streamer until uploaded
+    TextureStreamer* _streamer = nullptr;
+    int _request;
 
 public:
     
+    GLuint getId() const {
+        return _streamer != nullptr ? _streamer->getTextureId(_request) : _textureId;
+    }
+    
     void bind() {
         // Bind our texture in Texture Unit 0
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, _textureId);
+        glBindTexture(GL_TEXTURE_2D, getId());
     }
     
     
     Texture(const char* filePath) {
-        _textureId = loadBMP_custom(filePath);
+        _textureId = loadImage(filePath);
         
         if (_textureId == 0) {
             throw LoadException("Failed to load texture");
         }
     }
     
+    // Returns right away, see TextureStreamer. The streamer must outlive the texture.
+    // progressive : DDS files only, see requestResolution
+    Texture(TextureStreamer* streamer, const char* filePath, bool progressive = false) {
+        _streamer = streamer;
+        _request = streamer->request(filePath, progressive);
+    }
+    
+    // Size the texture covers on screen this frame, in pixels. Only progressive textures
+    // make use of it, see TextureStreamer::requestResolution.
+    void requestResolution(float pixels) {
+        if (_streamer != nullptr) {
+            _streamer->requestResolution(_request, pixels);
+        }
+    }
+    
     ~Texture() {
-        glDeleteTextures(1, &_textureId);
+        if (_streamer != nullptr) {
+            _streamer->release(_request);
+        }
+        else {
+            glDeleteTextures(1, &_textureId);
+        }
     }
 };
 
@@ -0,0 +1,511 @@
+#ifndef TEXTURE_STREAMER_HPP
+#define TEXTURE_STREAMER_HPP
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/imageloader.hpp"
+#include "common/jobsystem.hpp"
+#include "common/mipmap.hpp"
+#include "common/texture.hpp"
+
+// Loads textures without stalling the frame. Files are read in background jobs, straight
+// into a staging pixel unpack buffer when it is persistently mapped (GL 4.4), and update
+// creates the textures from there on the GL thread, a few at a time : no more than a byte
+// budget per frame, in the order the reads finished. Until then, textures are a grey
+// placeholder.
+//
+// The staging buffer is a ring : reads take space at the head, and space comes back at
+// the tail once the GPU is done with the uploads of a frame, which a fence tells. Reads
+// that find no space, or run without the ring, are uploaded from their own memory.
+//
+// BMP, TGA and PNG files are opened with openImage : level 0 goes from the file mapping, or
+// the buffer it was decoded into, to the ring or the texture, and only the levels below are
+// built in memory.
+//
+// Progressive requests, for DDS files, first read the mip tail only : the levels no larger
+// than MIP_TAIL_SIZE, stored together at the end of the file. The texture shows them with
+// GL_TEXTURE_BASE_LEVEL, then gets larger levels one per read, down to the level that
+// requestResolution asks for. Textures only seen from afar stay small.
+class TextureStreamer {
+public:
+    struct Statistics {
+        size_t pendingCount;        // Reads not uploaded yet
+        size_t residentBytes;       // Uploaded from the files, for the textures alive
+        size_t uploadedCount;       // Last update
+        size_t uploadedBytes;       // Last update
+        float uploadTime;           // Last update, ms
+        float maxUploadTime;        // Longest update so far, ms
+    };
+
+private:
+    enum RequestState {
+        REQUEST_READING = 0,
+        REQUEST_READ = 1,
+        REQUEST_FAILED = 2
+    };
+
+    struct Request {
+        TextureStreamer* streamer;
+        int index;                      // In _requests
+        std::string path;
+        bool progressive;
+        TextureData data;               // Without pixels once uploaded, progressive keep the rest
+        Image image;                    // Level 0 of images, until it is in the ring or uploaded
+        bool hasImage;
+        unsigned int firstLevel;        // Levels of the read : [firstLevel, endLevel)
+        unsigned int endLevel;
+        GLintptr stagingOffset;         // -1 when uploaded from data.pixels
+        std::atomic<int> state;         // RequestState, set by the job
+        GLuint textureId;               // 0 until uploaded
+        size_t residentBytes;
+        unsigned int baseLevel;         // Largest level uploaded
+        unsigned int wantedLevel;       // Largest level asked for
+        float requestedResolution;      // Largest since the last update
+        bool busy;                      // Reading, or read and not uploaded
+        bool failed;
+        bool released;                  // By its owner, see release
+    };
+
+    static const GLsizeiptr STAGING_ALIGNMENT = 16;
+
+    // Largest level of the mip tail, in texels
+    static const unsigned int MIP_TAIL_SIZE = 64;
+
+    // Stay in place while the jobs use them
+    std::deque<Request> _requests;
+    std::vector<int> _freeRequests;
+    std::vector<int> _progressiveRequests;
+    JobCounter _jobs;
+
+    GLuint _placeholderId;
+    size_t _uploadBudget;
+
+    GLuint _stagingBufferId = 0;
+    GLsizeiptr _stagingSize;
+    unsigned char* _staging = nullptr;  // Persistently mapped, or null without a ring
+
+    // Guarded by _mutex : requests read, in the order they took staging space
+    std::mutex _mutex;
+    std::vector<int> _readRequests;
+    std::deque<std::pair<GLsizeiptr, GLsizeiptr> > _stagingRanges;   // Begin, end, oldest first
+
+    // GL thread only
+    std::deque<int> _uploadQueue;
+    size_t _unfencedRanges = 0;
+    std::deque<std::pair<GLsync, size_t> > _fences;                 // With the ranges they free
+
+    Statistics _statistics = {};
+
+    // Called with _mutex locked. Returns -1 when there is no room.
+    GLintptr allocateStaging(GLsizeiptr size) {
+        size = (size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+        GLsizeiptr begin;
+        if (_stagingRanges.empty()) {
+            begin = 0;
+            if (size > _stagingSize) {
+                return -1;
+            }
+        }
+        else {
+            GLsizeiptr tail = _stagingRanges.front().first;
+            GLsizeiptr head = _stagingRanges.back().second;
+            bool wrapped = _stagingRanges.back().first < tail;
+            if (!wrapped && head + size <= _stagingSize) {
+                begin = head;
+            }
+            else if (!wrapped && size <= tail) {
+                begin = 0;
+            }
+            else if (wrapped && head + size <= tail) {
+                begin = head;
+            }
+            else {
+                return -1;
+            }
+        }
+        _stagingRanges.push_back(std::make_pair(begin, begin + size));
+        return begin;
+    }
+
+    static void readRequest(void* data) {
+        Request& request = *static_cast<Request*>(data);
+        TextureStreamer& streamer = *request.streamer;
+        const char* path = request.path.c_str();
+        bool read;
+        if (!request.data.levelOffsets.empty()) {
+            read = readTextureLevels(path, request.data, request.firstLevel, request.endLevel, request.data.pixels);
+        }
+        else if (request.progressive) {
+            read = readDDSHeader(path, request.data);
+            if (read) {
+                unsigned int levelCount = getTextureLevelCount(request.data);
+                unsigned int first = 0;
+                while (first + 1 < levelCount && std::max(request.data.width >> first, request.data.height >> first) > MIP_TAIL_SIZE) {
+                    ++first;
+                }
+                request.firstLevel = first;
+                request.endLevel = levelCount;
+                read = readTextureLevels(path, request.data, first, levelCount, request.data.pixels);
+            }
+        }
+        else if (isDDSPath(request.path)) {
+            read = readDDS(path, request.data);
+            request.firstLevel = 0;
+            request.endLevel = read ? getTextureLevelCount(request.data) : 0;
+        }
+        else {
+            // Mipmaps are built here too, rather than by the driver on the GL thread
+            read = openImage(path, request.image);
+            if (read) {
+                request.hasImage = true;
+                getImageTextureData(request.image, request.data);
+                buildMipmaps(request.data, request.image.pixels);
+            }
+            request.firstLevel = 0;
+            request.endLevel = read ? getTextureLevelCount(request.data) : 0;
+        }
+
+        GLintptr offset = -1;
+        {
+            std::lock_guard<std::mutex> lock(streamer._mutex);
+            if (read && streamer._staging != nullptr) {
+                offset = streamer.allocateStaging(static_cast<GLsizeiptr>(request.data.levelOffsets[request.endLevel] - request.data.levelOffsets[request.firstLevel]));
+            }
+            request.stagingOffset = offset;
+            streamer._readRequests.push_back(request.index);
+        }
+
+        // The space is ours : the copy goes on outside the lock
+        if (offset >= 0) {
+            unsigned char* staging = streamer._staging + offset;
+            if (request.hasImage) {
+                memcpy(staging, request.image.pixels, request.data.levelOffsets[1]);
+                staging += request.data.levelOffsets[1];
+                closeImage(request.image);
+                request.hasImage = false;
+            }
+            if (!request.data.pixels.empty()) {
+                memcpy(staging, &request.data.pixels[0], request.data.pixels.size());
+            }
+            std::vector<unsigned char>().swap(request.data.pixels);
+        }
+        request.state.store(read ? REQUEST_READ : REQUEST_FAILED, std::memory_order_release);
+    }
+
+    void freeRequest(int index) {
+        Request& request = _requests[index];
+        if (request.textureId != 0) {
+            glDeleteTextures(1, &request.textureId);
+            request.textureId = 0;
+        }
+        _statistics.residentBytes -= request.residentBytes;
+        request.data = TextureData();
+        request.path.clear();
+        if (request.progressive) {
+            _progressiveRequests.erase(std::find(_progressiveRequests.begin(), _progressiveRequests.end(), index));
+        }
+        _freeRequests.push_back(index);
+    }
+
+    void startRead(Request& request) {
+        request.stagingOffset = -1;
+        request.state = REQUEST_READING;
+        request.busy = true;
+        ++_statistics.pendingCount;
+        runBackgroundJob(readRequest, &request, _jobs);
+    }
+
+    static bool isDDSPath(const std::string& path) {
+        return path.size() >= 4 && (path.compare(path.size() - 4, 4, ".dds") == 0 || path.compare(path.size() - 4, 4, ".DDS") == 0);
+    }
+
+    // Levels from the staging ring, or else from data.pixels, and level 0 of images from the image
+    void uploadLevels(Request& request) {
+        const unsigned char* pixels;
+        if (request.stagingOffset >= 0) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _stagingBufferId);
+            pixels = reinterpret_cast<const unsigned char*>(request.stagingOffset);
+        }
+        else {
+            pixels = request.data.pixels.empty() ? nullptr : &request.data.pixels[0];
+        }
+
+        if (!request.progressive) {
+            request.textureId = createTexture(request.data, pixels, request.hasImage ? request.image.pixels : nullptr);
+        }
+        else {
+            if (request.textureId == 0) {
+                glGenTextures(1, &request.textureId);
+                glBindTexture(GL_TEXTURE_2D, request.textureId);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, getTextureLevelCount(request.data) - 1);
+            }
+            else {
+                glBindTexture(GL_TEXTURE_2D, request.textureId);
+            }
+            const std::vector<unsigned int>& offsets = request.data.levelOffsets;
+            for (unsigned int level = request.firstLevel; level < request.endLevel; ++level) {
+                uploadTextureLevel(request.data, level, pixels + offsets[level] - offsets[request.firstLevel]);
+            }
+            // Sampling stays within the levels uploaded
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, request.firstLevel);
+        }
+        request.baseLevel = request.firstLevel;
+
+        if (request.stagingOffset >= 0) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    // The largest level whose size is at least resolution
+    static unsigned int getLevelForResolution(const TextureData& data, float resolution) {
+        unsigned int size = std::max(data.width, data.height);
+        unsigned int level = 0;
+        while (level + 1 < getTextureLevelCount(data) && static_cast<float>(size >> (level + 1)) >= resolution) {
+            ++level;
+        }
+        return level;
+    }
+
+    // Gives the staging ranges of the frames the GPU is done with back to the ring
+    void reclaimStaging() {
+        while (!_fences.empty()) {
+            GLenum status = glClientWaitSync(_fences.front().first, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                break;
+            }
+            glDeleteSync(_fences.front().first);
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (size_t i = 0; i < _fences.front().second; ++i) {
+                _stagingRanges.pop_front();
+            }
+            _fences.pop_front();
+        }
+    }
+
+public:
+
+    // uploadBudget : bytes update uploads at most, unless a single texture is larger.
+    // stagingSize : of the ring, in bytes.
+    TextureStreamer(size_t uploadBudget = 8 << 20, GLsizeiptr stagingSize = 32 << 20) {
+        _uploadBudget = uploadBudget;
+        _stagingSize = stagingSize;
+
+        const unsigned char grey[4] = {128, 128, 128, 255};
+        glGenTextures(1, &_placeholderId);
+        glBindTexture(GL_TEXTURE_2D, _placeholderId);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glGenBuffers(1, &_stagingBufferId);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _stagingBufferId);
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, _stagingSize, nullptr, flags);
+            _staging = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, _stagingSize, flags));
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    // Textures from requests that weren't released are deleted too
+    ~TextureStreamer() {
+        waitForJobs(_jobs);
+        for (size_t i = 0; i < _fences.size(); ++i) {
+            glDeleteSync(_fences[i].first);
+        }
+        for (size_t i = 0; i < _requests.size(); ++i) {
+            if (_requests[i].textureId != 0) {
+                glDeleteTextures(1, &_requests[i].textureId);
+            }
+            if (_requests[i].hasImage) {
+                closeImage(_requests[i].image);
+            }
+        }
+        if (_stagingBufferId != 0) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _stagingBufferId);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &_stagingBufferId);
+        }
+        glDeleteTextures(1, &_placeholderId);
+    }
+
+    bool isStagingMapped() const {
+        return _staging != nullptr;
+    }
+
+    GLuint getPlaceholderId() const {
+        return _placeholderId;
+    }
+
+    const Statistics& getStatistics() const {
+        return _statistics;
+    }
+
+    // Starts reading the file in a background job. Returns the request, for getTextureId and
+    // release.
+    // progressive : DDS files only, see requestResolution
+    int request(const char* path, bool progressive = false) {
+        int index;
+        if (_freeRequests.empty()) {
+            index = static_cast<int>(_requests.size());
+            _requests.emplace_back();
+        }
+        else {
+            index = _freeRequests.back();
+            _freeRequests.pop_back();
+        }
+        Request& request = _requests[index];
+        request.streamer = this;
+        request.index = index;
+        request.path = path;
+        request.progressive = progressive;
+        request.hasImage = false;
+        request.textureId = 0;
+        request.residentBytes = 0;
+        request.baseLevel = 0;
+        request.wantedLevel = static_cast<unsigned int>(-1);
+        request.requestedResolution = 0.0f;
+        request.failed = false;
+        request.released = false;
+        if (progressive) {
+            _progressiveRequests.push_back(index);
+        }
+        startRead(request);
+        return index;
+    }
+
+    // Size the texture covers on screen, in pixels, this frame. Progressive textures get the
+    // levels that size needs over the next frames. They keep them when it gets smaller.
+    void requestResolution(int request, float resolution) {
+        Request& r = _requests[request];
+        r.requestedResolution = std::max(r.requestedResolution, resolution);
+    }
+
+    // The texture once uploaded, the placeholder until then, or if the file can't be read
+    GLuint getTextureId(int request) const {
+        GLuint textureId = _requests[request].textureId;
+        return textureId != 0 ? textureId : _placeholderId;
+    }
+
+    bool isResident(int request) const {
+        return _requests[request].textureId != 0;
+    }
+
+    // The request won't be used any more : its texture is deleted, or won't be uploaded
+    void release(int request) {
+        _requests[request].released = true;
+        if (!_requests[request].busy) {
+            freeRequest(request);
+        }
+    }
+
+    // On the GL thread, once per frame : uploads what was read since, within the budget
+    void update() {
+        update(_uploadBudget);
+    }
+
+    void update(size_t budget) {
+        std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+        reclaimStaging();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _uploadQueue.insert(_uploadQueue.end(), _readRequests.begin(), _readRequests.end());
+            _readRequests.clear();
+        }
+
+        _statistics.uploadedCount = 0;
+        _statistics.uploadedBytes = 0;
+        while (!_uploadQueue.empty()) {
+            Request& request = _requests[_uploadQueue.front()];
+            int state = request.state.load(std::memory_order_acquire);
+            if (state == REQUEST_READING) {
+                // Still copying to the ring : the next ones wait too, ranges go back in order
+                break;
+            }
+            size_t size = state == REQUEST_READ ? request.data.levelOffsets[request.endLevel] - request.data.levelOffsets[request.firstLevel] : 0;
+            if (state == REQUEST_READ && !request.released && _statistics.uploadedBytes > 0 && _statistics.uploadedBytes + size > budget) {
+                break;
+            }
+
+            if (state == REQUEST_READ && !request.released) {
+                uploadLevels(request);
+                request.residentBytes += size;
+                _statistics.residentBytes += size;
+                _statistics.uploadedCount += 1;
+                _statistics.uploadedBytes += size;
+            }
+            if (state == REQUEST_FAILED) {
+                fprintf(stderr, "[TEXTURE LOAD ERROR]: Failed to load %s\n", request.path.c_str());
+                request.failed = true;
+            }
+            if (request.stagingOffset >= 0) {
+                ++_unfencedRanges;
+            }
+            if (request.progressive) {
+                std::vector<unsigned char>().swap(request.data.pixels);
+            }
+            else {
+                request.data = TextureData();
+            }
+            if (request.hasImage) {
+                closeImage(request.image);
+                request.hasImage = false;
+            }
+            request.busy = false;
+            --_statistics.pendingCount;
+            if (request.released) {
+                freeRequest(_uploadQueue.front());
+            }
+            _uploadQueue.pop_front();
+        }
+
+        // One more level for the progressive textures that need it
+        for (int index : _progressiveRequests) {
+            Request& request = _requests[index];
+            if (request.busy || request.failed || request.released || request.textureId == 0) {
+                continue;
+            }
+            if (request.requestedResolution > 0.0f) {
+                request.wantedLevel = std::min(request.wantedLevel, getLevelForResolution(request.data, request.requestedResolution));
+                request.requestedResolution = 0.0f;
+            }
+            if (request.wantedLevel < request.baseLevel) {
+                request.firstLevel = request.baseLevel - 1;
+                request.endLevel = request.baseLevel;
+                startRead(request);
+            }
+        }
+
+        if (_unfencedRanges > 0) {
+            _fences.push_back(std::make_pair(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), _unfencedRanges));
+            _unfencedRanges = 0;
+        }
+
+        std::chrono::duration<float, std::milli> uploadTime = std::chrono::steady_clock::now() - startTime;
+        _statistics.uploadTime = uploadTime.count();
+        if (_statistics.uploadTime > _statistics.maxUploadTime) {
+            _statistics.maxUploadTime = _statistics.uploadTime;
+        }
+    }
+
+    // Reads and uploads everything requested, and the levels asked for, for loading screens
+    void finish() {
+        while (_statistics.pendingCount > 0) {
+            waitForJobs(_jobs);
+            update(static_cast<size_t>(-1));
+        }
+    }
+};
+
+#endif//TEXTURE_STREAMER_HPP
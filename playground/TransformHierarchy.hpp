@@ -0,0 +1,402 @@
+#ifndef TRANSFORM_HIERARCHY_HPP
+#define TRANSFORM_HIERARCHY_HPP
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "common/parallel.hpp"
+
+// Local transforms (position, rotation, scale) with parents, and the world matrices they
+// make. Nodes are stored as one array per field, sorted so that every subtree is a
+// contiguous range starting with its root : a parent always comes before its children, and
+// a subtree is updated by one pass over its range.
+//
+// Changing a local transform only flags the node. update then recomputes the subtrees of
+// the flagged nodes and nothing else, splitting them across threads when there is enough
+// work : subtrees don't share nodes, so they don't need each other.
+//
+// Nodes are referred to by handles, which stay valid when the arrays are sorted again
+// after a change of parent. Destroyed nodes are only flagged, and removed by the same sort.
+class TransformHierarchy {
+public:
+    typedef int Node;
+    static const Node NONE = -1;
+
+    struct Statistics {
+        size_t nodeCount;
+        size_t updatedCount;        // Nodes whose world matrix the last update recomputed
+        size_t subtreeCount;        // Independent ranges the last update was split into
+    };
+
+private:
+    // Below this many nodes to recompute, threads cost more than they save
+    static const size_t PARALLEL_NODE_COUNT = 16384;
+
+    // By index, in subtree order
+    std::vector<int> _parents;                  // Index, -1 for roots
+    std::vector<int> _subtreeEnds;              // Index past the last node of the subtree
+    std::vector<glm::vec3> _positions;
+    std::vector<glm::quat> _rotations;
+    std::vector<glm::vec3> _scales;
+    std::vector<glm::mat4> _worldMatrices;
+    std::vector<unsigned int> _updateFrames;    // _frame when last recomputed
+    std::vector<unsigned char> _dirty;
+    std::vector<Node> _nodes;                   // Handle of each index, NONE once destroyed
+
+    // By handle
+    std::vector<int> _indices;                  // -1 for free handles
+    std::vector<Node> _freeNodes;
+
+    std::vector<Node> _dirtyNodes;              // May hold destroyed or reused handles
+    bool _orderDirty = false;
+    size_t _destroyedCount = 0;                 // Indices left to remove
+    unsigned int _frame = 0;
+
+    // Scratch for update
+    std::vector<int> _dirtyIndices;
+    std::vector<int> _ranges;                   // Begin, end pairs
+    std::vector<int> _splitRanges;              // Begin, end pairs
+    std::vector<int> _order;
+
+    Statistics _statistics = {};
+
+    void markDirty(int index) {
+        if (!_dirty[index]) {
+            _dirty[index] = 1;
+            _dirtyNodes.push_back(_nodes[index]);
+        }
+    }
+
+    glm::mat4 getLocalMatrix(int index) const {
+        glm::mat4 m = glm::mat4_cast(_rotations[index]);
+        m[0] *= _scales[index].x;
+        m[1] *= _scales[index].y;
+        m[2] *= _scales[index].z;
+        m[3] = glm::vec4(_positions[index], 1.0f);
+        return m;
+    }
+
+    // The parent of begin is up to date, and no other range contains nodes of this one
+    void updateRange(int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            int parent = _parents[i];
+            _worldMatrices[i] = parent < 0 ? getLocalMatrix(i) : _worldMatrices[parent] * getLocalMatrix(i);
+            _updateFrames[i] = _frame;
+        }
+    }
+
+    // Sorts the arrays in subtree order again, after parents changed, leaving the destroyed
+    // nodes out
+    void sortNodes() {
+        int count = static_cast<int>(_nodes.size());
+
+        // The children of destroyed nodes go to their closest ancestor left
+        if (_destroyedCount > 0) {
+            for (int i = 0; i < count; ++i) {
+                int parent = _parents[i];
+                if (_nodes[i] == NONE || parent < 0 || _nodes[parent] != NONE) {
+                    continue;
+                }
+                while (parent >= 0 && _nodes[parent] == NONE) {
+                    parent = _parents[parent];
+                }
+                _parents[i] = parent;
+                markDirty(i);
+            }
+        }
+
+        // Children of each node as a linked list, then depth first from the roots
+        std::vector<int> firstChildren(count, -1);
+        std::vector<int> nextSiblings(count, -1);
+        std::vector<int> roots;
+        for (int i = count - 1; i >= 0; --i) {
+            if (_nodes[i] == NONE) {
+                continue;
+            }
+            if (_parents[i] < 0) {
+                roots.push_back(i);
+            }
+            else {
+                nextSiblings[i] = firstChildren[_parents[i]];
+                firstChildren[_parents[i]] = i;
+            }
+        }
+        std::reverse(roots.begin(), roots.end());
+
+        _order.clear();
+        std::vector<int> stack;
+        for (int root : roots) {
+            stack.push_back(root);
+            while (!stack.empty()) {
+                int i = stack.back();
+                stack.pop_back();
+                _order.push_back(i);
+                // Pushed last to first, so that siblings keep their order
+                size_t firstPushed = stack.size();
+                for (int child = firstChildren[i]; child >= 0; child = nextSiblings[child]) {
+                    stack.push_back(child);
+                }
+                std::reverse(stack.begin() + firstPushed, stack.end());
+            }
+        }
+
+        std::vector<int> newIndices(count, -1);
+        count = static_cast<int>(_order.size());
+        for (int i = 0; i < count; ++i) {
+            newIndices[_order[i]] = i;
+        }
+        permute(_positions);
+        permute(_rotations);
+        permute(_scales);
+        permute(_worldMatrices);
+        permute(_updateFrames);
+        permute(_dirty);
+        permute(_nodes);
+        permute(_parents);
+        for (int i = 0; i < count; ++i) {
+            if (_parents[i] >= 0) {
+                _parents[i] = newIndices[_parents[i]];
+            }
+            _indices[_nodes[i]] = i;
+        }
+
+        // Children come after their parent : going backwards, a subtree ends where the last
+        // of its descendants does
+        _subtreeEnds.resize(count);
+        for (int i = 0; i < count; ++i) {
+            _subtreeEnds[i] = i + 1;
+        }
+        for (int i = count - 1; i >= 0; --i) {
+            if (_parents[i] >= 0) {
+                _subtreeEnds[_parents[i]] = std::max(_subtreeEnds[_parents[i]], _subtreeEnds[i]);
+            }
+        }
+
+        _orderDirty = false;
+        _destroyedCount = 0;
+    }
+
+    template <typename T>
+    void permute(std::vector<T>& values) const {
+        std::vector<T> sorted(_order.size());
+        for (size_t i = 0; i < _order.size(); ++i) {
+            sorted[i] = values[_order[i]];
+        }
+        values.swap(sorted);
+    }
+
+    // Splits the ranges of _ranges into the ranges of their children's subtrees until they
+    // are no larger than maxSize, into _splitRanges, updating the nodes split off on the way
+    void splitRanges(int maxSize) {
+        _splitRanges.clear();
+        std::vector<int>& pending = _ranges;
+        while (!pending.empty()) {
+            int end = pending.back();
+            pending.pop_back();
+            int begin = pending.back();
+            pending.pop_back();
+            if (end - begin <= maxSize) {
+                _splitRanges.push_back(begin);
+                _splitRanges.push_back(end);
+                continue;
+            }
+            updateRange(begin, begin + 1);
+            for (int child = begin + 1; child < end; child = _subtreeEnds[child]) {
+                pending.push_back(child);
+                pending.push_back(_subtreeEnds[child]);
+            }
+        }
+    }
+
+public:
+
+    // A root with the identity transform, or a child of parent
+    Node createNode(Node parent = NONE) {
+        Node node;
+        if (_freeNodes.empty()) {
+            node = static_cast<Node>(_indices.size());
+            _indices.push_back(-1);
+        }
+        else {
+            node = _freeNodes.back();
+            _freeNodes.pop_back();
+        }
+
+        int index = static_cast<int>(_nodes.size());
+        _indices[node] = index;
+        _nodes.push_back(node);
+        _parents.push_back(parent == NONE ? -1 : _indices[parent]);
+        _subtreeEnds.push_back(index + 1);
+        _positions.push_back(glm::vec3(0.0f));
+        _rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+        _scales.push_back(glm::vec3(1.0f));
+        _worldMatrices.push_back(glm::mat4(1.0f));
+        _updateFrames.push_back(_frame);
+        _dirty.push_back(0);
+        markDirty(index);
+
+        // Appending a root keeps the order, appending a child doesn't
+        if (parent != NONE) {
+            _orderDirty = true;
+        }
+        return node;
+    }
+
+    // The children of the node become children of its parent, keeping their local transform.
+    // The node is removed from the arrays by the next update, along with the others.
+    void destroyNode(Node node) {
+        int index = _indices[node];
+        _nodes[index] = NONE;
+        _indices[node] = -1;
+        _freeNodes.push_back(node);
+        ++_destroyedCount;
+        _orderDirty = true;
+    }
+
+    // parent : NONE to make the node a root. Must not be in the subtree of the node.
+    void setParent(Node node, Node parent) {
+        int index = _indices[node];
+        _parents[index] = parent == NONE ? -1 : _indices[parent];
+        markDirty(index);
+        _orderDirty = true;
+    }
+
+    Node getParent(Node node) const {
+        int parent = _parents[_indices[node]];
+        while (parent >= 0 && _nodes[parent] == NONE) {
+            parent = _parents[parent];
+        }
+        return parent < 0 ? NONE : _nodes[parent];
+    }
+
+    void setLocalPosition(Node node, const glm::vec3& position) {
+        int index = _indices[node];
+        _positions[index] = position;
+        markDirty(index);
+    }
+
+    void setLocalRotation(Node node, const glm::quat& rotation) {
+        int index = _indices[node];
+        _rotations[index] = rotation;
+        markDirty(index);
+    }
+
+    void setLocalScale(Node node, const glm::vec3& scale) {
+        int index = _indices[node];
+        _scales[index] = scale;
+        markDirty(index);
+    }
+
+    const glm::vec3& getLocalPosition(Node node) const {
+        return _positions[_indices[node]];
+    }
+
+    const glm::quat& getLocalRotation(Node node) const {
+        return _rotations[_indices[node]];
+    }
+
+    const glm::vec3& getLocalScale(Node node) const {
+        return _scales[_indices[node]];
+    }
+
+    // As of the last update. The reference is valid until the next change of parent.
+    const glm::mat4& getWorldMatrix(Node node) const {
+        return _worldMatrices[_indices[node]];
+    }
+
+    // Whether the last update recomputed the world matrix of the node
+    bool isUpdated(Node node) const {
+        return _updateFrames[_indices[node]] == _frame;
+    }
+
+    size_t getNodeCount() const {
+        return _nodes.size() - _destroyedCount;
+    }
+
+    const Statistics& getStatistics() const {
+        return _statistics;
+    }
+
+    // Recomputes the world matrices of the nodes changed since the last update, and of
+    // their descendants.
+    // threadCount : see parallelFor, 1 to stay on the calling thread
+    void update(unsigned int threadCount = 0) {
+        ++_frame;
+        if (_orderDirty) {
+            sortNodes();
+        }
+
+        // In index order, the subtree of a flagged node starts at the first flagged node it
+        // contains. With many of them flagged, going through the flags beats sorting them.
+        _ranges.clear();
+        size_t updatedCount = 0;
+        int coveredEnd = 0;
+        int count = static_cast<int>(_nodes.size());
+        if (_dirtyNodes.size() > _nodes.size() / 32) {
+            for (int index = 0; index < count; ++index) {
+                if (!_dirty[index] || index < coveredEnd) {
+                    continue;
+                }
+                coveredEnd = _subtreeEnds[index];
+                _ranges.push_back(index);
+                _ranges.push_back(coveredEnd);
+                updatedCount += coveredEnd - index;
+            }
+            std::fill(_dirty.begin(), _dirty.end(), 0);
+        }
+        else {
+            _dirtyIndices.clear();
+            for (Node node : _dirtyNodes) {
+                int index = _indices[node];
+                if (index < 0) {
+                    continue;
+                }
+                _dirtyIndices.push_back(index);
+                _dirty[index] = 0;
+            }
+            std::sort(_dirtyIndices.begin(), _dirtyIndices.end());
+            for (int index : _dirtyIndices) {
+                if (index < coveredEnd) {
+                    continue;
+                }
+                coveredEnd = _subtreeEnds[index];
+                _ranges.push_back(index);
+                _ranges.push_back(coveredEnd);
+                updatedCount += coveredEnd - index;
+            }
+        }
+        _dirtyNodes.clear();
+
+        _statistics.nodeCount = _nodes.size();
+        _statistics.updatedCount = updatedCount;
+
+        if (threadCount == 0) {
+            threadCount = getJobThreadCount();
+        }
+        if (updatedCount < PARALLEL_NODE_COUNT || threadCount <= 1) {
+            for (size_t i = 0; i < _ranges.size(); i += 2) {
+                updateRange(_ranges[i], _ranges[i + 1]);
+            }
+            _statistics.subtreeCount = _ranges.size() / 2;
+            return;
+        }
+
+        // A few ranges per thread, so that they even out. Large subtrees are split below
+        // their root, small ones are grouped by parallelFor.
+        int maxSize = std::max(1, static_cast<int>(updatedCount / (threadCount * 4)));
+        splitRanges(maxSize);
+
+        size_t rangeCount = _splitRanges.size() / 2;
+        size_t grainSize = std::max<size_t>(1, rangeCount / (threadCount * 4));
+        parallelFor(rangeCount, grainSize, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                updateRange(_splitRanges[2 * i], _splitRanges[2 * i + 1]);
+            }
+        }, threadCount);
+        _statistics.subtreeCount = rangeCount;
+    }
+};
+
+#endif//TRANSFORM_HIERARCHY_HPP
@@ -0,0 +1,118 @@
+#ifndef UNIFORM_BUFFER_HPP
+#define UNIFORM_BUFFER_HPP
+
+#include <GL/glew.h>
+#include <cstring>
+#include <vector>
+
+// A uniform buffer rewritten every frame : blocks are pushed on the CPU, uploaded in one
+// go, then bound by range for each draw. The buffer is split into one region per frame in
+// flight, each fenced once its frame is submitted, so that a frame never writes over data
+// that the GPU may still be reading, and never waits for the driver to copy the buffer.
+class UniformBuffer {
+private:
+    static const unsigned int FRAMES_IN_FLIGHT = 3;
+
+    GLuint _bufferId;
+    GLsizeiptr _regionSize;
+    GLint _alignment;
+    unsigned int _region;
+    GLsync _fences[FRAMES_IN_FLIGHT];
+
+    // The blocks of the current frame, waiting for upload()
+    std::vector<unsigned char> _staging;
+
+    // Regions start aligned too
+    void allocate(GLsizeiptr regionSize) {
+        _regionSize = (regionSize + _alignment - 1) / _alignment * _alignment;
+        glBindBuffer(GL_UNIFORM_BUFFER, _bufferId);
+        glBufferData(GL_UNIFORM_BUFFER, _regionSize * FRAMES_IN_FLIGHT, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void waitForRegion(unsigned int region) {
+        if (_fences[region] == nullptr) {
+            return;
+        }
+        while (glClientWaitSync(_fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(_fences[region]);
+        _fences[region] = nullptr;
+    }
+
+public:
+
+    // Copies a block for this frame and returns its offset, to give to bindRange.
+    // Offsets are aligned as glBindBufferRange needs.
+    GLintptr push(const void* data, GLsizeiptr size) {
+        GLintptr offset = static_cast<GLintptr>((_staging.size() + _alignment - 1) / _alignment * _alignment);
+        _staging.resize(offset + size);
+        memcpy(&_staging[offset], data, size);
+        return offset;
+    }
+
+    // Writes the blocks pushed this frame to the current region, growing the buffer if
+    // they don't fit
+    void upload() {
+        if (_staging.empty()) {
+            return;
+        }
+        if (static_cast<GLsizeiptr>(_staging.size()) > _regionSize) {
+            for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+                waitForRegion(i);
+            }
+            allocate(static_cast<GLsizeiptr>(_staging.size()) * 2);
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, _bufferId);
+        void* region = glMapBufferRange(
+            GL_UNIFORM_BUFFER,
+            _region * _regionSize,
+            static_cast<GLsizeiptr>(_staging.size()),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+        );
+        if (region != nullptr) {
+            memcpy(region, &_staging[0], _staging.size());
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // offset : as returned by push this frame
+    void bindRange(GLuint binding, GLintptr offset, GLsizeiptr size) const {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, _bufferId, _region * _regionSize + offset, size);
+    }
+
+    // Call once all the draws reading this frame's blocks are submitted
+    void endFrame() {
+        _fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        _region = (_region + 1) % FRAMES_IN_FLIGHT;
+        waitForRegion(_region);
+        _staging.clear();
+    }
+
+
+    // regionSize : bytes expected per frame, the buffer grows if needed
+    explicit UniformBuffer(GLsizeiptr regionSize) {
+        _alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &_alignment);
+        _region = 0;
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+            _fences[i] = nullptr;
+        }
+
+        glGenBuffers(1, &_bufferId);
+        allocate(regionSize > 0 ? regionSize : _alignment);
+    }
+
+    ~UniformBuffer() {
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+            if (_fences[i] != nullptr) {
+                glDeleteSync(_fences[i]);
+            }
+        }
+        glDeleteBuffers(1, &_bufferId);
+    }
+};
+
+#endif//UNIFORM_BUFFER_HPP
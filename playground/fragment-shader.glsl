@@ -9,22 +9,28 @@ in vec3 EyeDirection_cameraSpace;
 out vec4 color;
 
 uniform sampler2D myTextureSampler;
-uniform vec3 LightPosition_worldSpace;
-uniform vec3 LightColor;
+
+// See SceneUniforms.hpp
+layout(std140) uniform FrameData {
+    mat4 V;
+    mat4 P;
+    vec4 LightPosition_worldSpace;
+    vec4 LightColor;
+};
 
 void main() {
     vec3 materialDiffuseColor = texture(myTextureSampler, UV).rgb;
     vec3 materialAmbientColor = vec3(0.1, 0.1, 0.1) * materialDiffuseColor;
     vec3 materialSpecularColor = vec3(1, 1, 1);
 
-    float distanceToLight = length(LightPosition_worldSpace - Position_worldSpace);
+    float distanceToLight = length(LightPosition_worldSpace.xyz - Position_worldSpace);
 
     vec3 n = normalize(Normal_cameraSpace);
     vec3 l = normalize(LightDirection_cameraSpace);
 
     float cosTheta = clamp(dot(n, l), 0, 1);
 
-    vec3 diffuseColor = materialDiffuseColor * (LightColor * cosTheta / distanceToLight*distanceToLight);
+    vec3 diffuseColor = materialDiffuseColor * (LightColor.rgb * cosTheta / distanceToLight*distanceToLight);
 
 
     vec3 eyeVector = normalize(EyeDirection_cameraSpace);
@@ -32,7 +38,7 @@ void main() {
 
     float cosAlpha = clamp(dot(eyeVector, reflectionDirection), 0, 1);
 
-    vec3 specularColor = materialSpecularColor * LightColor * pow(cosAlpha, 2) / (distanceToLight * distanceToLight);
+    vec3 specularColor = materialSpecularColor * LightColor.rgb * pow(cosAlpha, 2) / (distanceToLight * distanceToLight);
 
     color.rgb =
         (materialAmbientColor + diffuseColor + specularColor);
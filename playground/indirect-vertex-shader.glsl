@@ -0,0 +1,66 @@
+#version 430 core
+
+// Positions may be quantized in the mesh bounding box, normals are octahedral encoded
+layout(location = 0) in vec3 vertexPosition_quantized;
+layout(location = 1) in vec2 vertexUV;
+layout(location = 2) in vec2 vertexNormal_octahedral;
+// Index of the draw in the multi-draw, see GeometryArena::enableDrawIds
+layout(location = 7) in uint drawId;
+
+out vec2 UV;
+out vec3 Normal_cameraSpace;
+out vec3 LightDirection_cameraSpace;
+out vec3 Position_worldSpace;
+out vec3 EyeDirection_cameraSpace;
+
+// See SceneUniforms.hpp
+layout(std140) uniform FrameData {
+    mat4 V;
+    mat4 P;
+    vec4 LightPosition_worldSpace;
+    vec4 LightColor;
+};
+
+// One ObjectData per draw, see DRAW_DATA_BINDING in SceneUniforms.hpp
+struct ObjectData {
+    mat4 M;
+    mat4 MVP;
+    vec4 PositionOffset;
+    vec4 PositionScale;
+};
+
+layout(std430, binding = 0) readonly buffer DrawData {
+    ObjectData objects[];
+};
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    mat4 M = objects[drawId].M;
+    mat4 MVP = objects[drawId].MVP;
+    vec4 PositionOffset = objects[drawId].PositionOffset;
+    vec4 PositionScale = objects[drawId].PositionScale;
+
+    vec3 vertexPosition_modelSpace = PositionOffset.xyz + vertexPosition_quantized * PositionScale.xyz;
+    vec3 vertexNormal_modelSpace = octDecode(vertexNormal_octahedral);
+
+    gl_Position = MVP * vec4(vertexPosition_modelSpace, 1);
+
+    Position_worldSpace = (M * vec4(vertexPosition_modelSpace, 1)).xyz;
+
+    vec3 vertexPosition_cameraSpace = (V * M * vec4(vertexPosition_modelSpace, 1)).xyz;
+    EyeDirection_cameraSpace = vec3(0, 0, 0) - vertexPosition_cameraSpace;
+
+    vec3 lightPosition_cameraSpace = (V * vec4(LightPosition_worldSpace.xyz, 1)).xyz;
+    LightDirection_cameraSpace = lightPosition_cameraSpace + EyeDirection_cameraSpace;
+
+    Normal_cameraSpace = (V * M * vec4(vertexNormal_modelSpace, 0)).xyz;
+
+    UV = vertexUV;
+}
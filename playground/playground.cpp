@@ -3,6 +3,8 @@
 #include <vector>
 #include <exception>
 #include <map>
+#include <cstdlib>
+#include <algorithm>
 
 #include "GL/glew.h"
 #include "GLFW/glfw3.h"
@@ -15,6 +17,7 @@
 #include "common/texture.hpp"
 #include "common/objloader.hpp"
 #include "common/vboindexer.hpp"
+#include "common/jobsystem.hpp"
 
 #include <ft2build.h>
 #include <glm/gtc/matrix_transform.hpp>
@@ -24,6 +27,11 @@
 #include "Texture.hpp"
 #include "Model.hpp"
 #include "Shader.hpp"
+#include "SceneUniforms.hpp"
+#include "UniformBuffer.hpp"
+#include "ShaderReloader.hpp"
+#include "InstanceBatcher.hpp"
+#include "RenderQueue.hpp"
 #include "FontTextureManager.hpp"
 
 using namespace glm;
@@ -95,13 +103,21 @@ int init(int width, int height) {
     }
 
     glfwWindowHint(GLFW_SAMPLES, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     
     glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
-    window = glfwCreateWindow(width, height, "GL Playground", nullptr, nullptr);
+    
+    // 4.5 for multi-draw indirect, see RenderQueue. Everything else runs on 3.3.
+    const int contextVersions[][2] = { { 4, 5 }, { 3, 3 } };
+    for (const auto& version : contextVersions) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        window = glfwCreateWindow(width, height, "GL Playground", nullptr, nullptr);
+        if (window != nullptr) {
+            break;
+        }
+    }
     if (window == nullptr) {
         fprintf(stderr, "Failed to open GLFW window.\n");
         glfwTerminate();
@@ -115,6 +131,7 @@ int init(int width, int height) {
         fprintf(stderr, "Failed to initialize GLEW\n");
         return -1;
     }
+    printf("OpenGL %s\n", glGetString(GL_VERSION));
 
     glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
     
@@ -131,9 +148,11 @@ int init(int width, int height) {
     return 0;
 }
 
-int main() {
+// playground [cube count]
+int main(int argc, char** argv) {
     int screen_width = 1920;
     int screen_height = 1080;
+    int cubeCount = argc > 1 ? atoi(argv[1]) : 20;
     
     int initResult = init(screen_width, screen_height);
     if (initResult != 0) {
@@ -142,10 +161,60 @@ int main() {
 
     /* ================================================ */
 
-    // Load meshes
+    double loadStartTime = glfwGetTime();
+
+    // Load shaders : the driver compiles them while the meshes and textures load
+    Shader* sceneShader = new Shader(
+        "/home/oma/Code/CPP-Workspace/ogl/playground/vertex-shader.glsl",
+        "/home/oma/Code/CPP-Workspace/ogl/playground/fragment-shader.glsl"
+    );
+    // Same, with the model matrices as a per-instance attribute
+    Shader* instancedSceneShader = new Shader(
+        "/home/oma/Code/CPP-Workspace/ogl/playground/instanced-vertex-shader.glsl",
+        "/home/oma/Code/CPP-Workspace/ogl/playground/fragment-shader.glsl"
+    );
+    // Same, with the ObjectData of each draw of a multi-draw in a storage buffer
+    Shader* indirectSceneShader = nullptr;
+    if (RenderQueue::isIndirectSupported()) {
+        indirectSceneShader = new Shader(
+            "/home/oma/Code/CPP-Workspace/ogl/playground/indirect-vertex-shader.glsl",
+            "/home/oma/Code/CPP-Workspace/ogl/playground/fragment-shader.glsl"
+        );
+    }
+    Shader* textShader = new Shader(
+        "/home/oma/Code/CPP-Workspace/ogl/playground/text-vertex-shader.glsl",
+        "/home/oma/Code/CPP-Workspace/ogl/playground/text-fragment-shader.glsl"
+    );
+
+    // What a new program starts without : set again each time a shader is reloaded
+    auto setUpSceneShader = [](const Shader& shader) {
+        shader.use();
+        // Set our "myTextureSampler" sampler to use Texture Unit 0
+        glUniform1i(shader.getUniformLocation("myTextureSampler"), 0);
+        shader.bindUniformBlock("FrameData", FRAME_UNIFORMS_BINDING);
+        shader.bindUniformBlock("ObjectData", OBJECT_UNIFORMS_BINDING);
+    };
+    sceneShader->setOnLinked(setUpSceneShader);
+    instancedSceneShader->setOnLinked(setUpSceneShader);
+    std::vector<Shader*> shaders = { sceneShader, instancedSceneShader, textShader };
+    if (indirectSceneShader != nullptr) {
+        indirectSceneShader->setOnLinked(setUpSceneShader);
+        shaders.push_back(indirectSceneShader);
+    }
+    glm::mat4 textProjectionMat = glm::ortho(0.0f, static_cast<float> (screen_width), 0.0f, static_cast<float> (screen_height));
+    textShader->setOnLinked([textProjectionMat](const Shader& shader) {
+        shader.use();
+        glUniformMatrix4fv(shader.getUniformLocation("projection"), 1, GL_FALSE, &textProjectionMat[0][0]);
+    });
+
+    Shader::compileBatch(shaders);
+    printf("Shaders submitted in %.1f ms\n", (glfwGetTime() - loadStartTime) * 1000.0);
+
+    // Load meshes, all in the same buffers
+    GeometryArena* geometryArena = new GeometryArena(VERTEX_FORMAT_QUANTIZED, sizeof(unsigned short));
     Mesh* cubeMesh = nullptr;
     try {
-        cubeMesh = new Mesh("/home/oma/Code/CPP-Workspace/ogl/playground/res/cube.obj");
+        cubeMesh = new Mesh("/home/oma/Code/CPP-Workspace/ogl/playground/res/cube.obj", VERTEX_FORMAT_QUANTIZED, geometryArena);
     }
     catch (LoadException &e) {
         fprintf(stderr, "[MESH LOAD ERROR]: %s", e.what());
@@ -154,7 +223,7 @@ int main() {
 
     Mesh* floorMesh = nullptr;
     try {
-        floorMesh = new Mesh("/home/oma/Code/CPP-Workspace/ogl/playground/res/floor.obj");
+        floorMesh = new Mesh("/home/oma/Code/CPP-Workspace/ogl/playground/res/floor.obj", VERTEX_FORMAT_QUANTIZED, geometryArena);
     }
     catch (LoadException &e) {
         fprintf(stderr, "[MESH LOAD ERROR]: %s", e.what());
@@ -162,66 +231,78 @@ int main() {
     }
 
 
-    // Load textures
-    Texture* cubeTexture = nullptr;
-    try {
-        cubeTexture = new Texture("/home/oma/Code/CPP-Workspace/ogl/playground/res/tile.bmp");
-    }
-    catch (LoadException &e) {
-        fprintf(stderr, "[TEXTURE LOAD ERROR]: %s", e.what());
-        return -1;
-    }
-
-    Texture* floorTexture = nullptr;
-    try {
-        floorTexture = new Texture("/home/oma/Code/CPP-Workspace/ogl/playground/res/tile_bw.bmp");
-    }
-    catch (LoadException &e) {
-        fprintf(stderr, "[TEXTURE LOAD ERROR]: %s", e.what());
-        return -1;
-    }
+    // Load textures : read on the job threads, grey until uploaded
+    TextureStreamer* textureStreamer = new TextureStreamer();
+    Texture* cubeTexture = new Texture(textureStreamer, "/home/oma/Code/CPP-Workspace/ogl/playground/res/tile.bmp");
+    Texture* floorTexture = new Texture(textureStreamer, "/home/oma/Code/CPP-Workspace/ogl/playground/res/tile_bw.png");
 
     // Create models
     
-    auto floorModel = new Model(floorMesh, floorTexture);
+    auto transforms = new TransformHierarchy();
+    
+    auto floorModel = new Model(floorMesh, floorTexture, sceneShader, transforms);
     
     auto models = std::vector<Model*>();
     
     models.push_back(floorModel);
     
-    for (int i = 0; i < 20; ++i) {
-        auto cubeModel = new Model(cubeMesh, cubeTexture);
-        cubeModel->setPosition(glm::vec3(-30.0f + i * 3, 1.0f, -1.0f));
+    // Rows of at least 20, going away from the camera
+    int cubesPerRow = std::max(20, static_cast<int>(sqrt(static_cast<double>(cubeCount))));
+    for (int i = 0; i < cubeCount; ++i) {
+        auto cubeModel = new Model(cubeMesh, cubeTexture, sceneShader, transforms);
+        cubeModel->setPosition(glm::vec3(-30.0f + (i % cubesPerRow) * 3, 1.0f, -1.0f - (i / cubesPerRow) * 3));
         models.push_back(cubeModel);
     }
     
     
-    Shader* sceneShader = new Shader(
-        "/home/oma/Code/CPP-Workspace/ogl/playground/vertex-shader.glsl",
-        "/home/oma/Code/CPP-Workspace/ogl/playground/fragment-shader.glsl"
-    );
-    GLuint textureSampler = glGetUniformLocation(sceneShader->getId(), "myTextureSampler");
-    GLuint mvpMatrixID = glGetUniformLocation(sceneShader->getId(), "MVP");
-    GLuint viewMatrixID = glGetUniformLocation(sceneShader->getId(), "V");
-    GLuint modelMatrixID = glGetUniformLocation(sceneShader->getId(), "M");
+    // First use : waits for whatever compilation is left
+    double shaderWaitStartTime = glfwGetTime();
+    for (Shader* shader : shaders) {
+        shader->getId();
+    }
+    printf("Waited %.1f ms for shaders\n", (glfwGetTime() - shaderWaitStartTime) * 1000.0);
+
+    // Edit and save a shader while the playground runs to see the result
+    ShaderReloader* shaderReloader = new ShaderReloader(shaders);
 
-    GLuint lightId = glGetUniformLocation(sceneShader->getId(), "LightPosition_worldSpace");
-    GLuint lightColorId = glGetUniformLocation(sceneShader->getId(), "LightColor");
     vec3 lightPosition(0, 5, 0);
 
+    // Everything the scene shader reads per frame and per model, uploaded once per frame
+    UniformBuffer* sceneUniforms = new UniformBuffer(
+        sizeof(FrameUniforms) + models.size() * 256
+    );
+
+    // Models that share a mesh, a level of detail and a texture are drawn together.
+    // B switches batching on and off, to compare.
+    InstanceBatcher* instanceBatcher = new InstanceBatcher();
+    instanceBatcher->setInstancedShader(sceneShader, instancedSceneShader);
+    bool batching = true;
+    bool batchingKeyDown = false;
+
+    // Every draw of the frame, sorted so that the draws sharing a shader, a texture and a
+    // mesh follow each other. What isn't batched goes to multi-draws when possible.
+    // I switches them on and off, to compare.
+    RenderQueue* renderQueue = new RenderQueue();
+    if (indirectSceneShader != nullptr) {
+        renderQueue->setIndirectShader(sceneShader, indirectSceneShader);
+    }
+    bool indirectKeyDown = false;
+
+    // World space boxes of the models, tested against the view frustum each frame
+    BoxArrays modelBounds;
+    resizeBoxArrays(modelBounds, models.size());
+    std::vector<unsigned char> modelVisibility(models.size());
+
+    FrameGraph frameGraph;
+    printf("Job system : %u threads\n", getJobThreadCount());
+
     /* ================================================ */
     
     FontTextureManager* fontTextureManager = new FontTextureManager(
         "/home/oma/Code/CPP-Workspace/ogl/playground/res/fonts/arial.ttf"
     );
     
-    Shader* textShader = new Shader(
-        "/home/oma/Code/CPP-Workspace/ogl/playground/text-vertex-shader.glsl",
-        "/home/oma/Code/CPP-Workspace/ogl/playground/text-fragment-shader.glsl"
-    );
-    glUseProgram(textShader->getId());
-    glm::mat4 textProjectionMat = glm::ortho(0.0f, static_cast<float> (screen_width), 0.0f, static_cast<float> (screen_height));
-    glUniformMatrix4fv(glGetUniformLocation(textShader->getId(), "projection"), 1, GL_FALSE, &textProjectionMat[0][0]);
+    printf("Scene loaded in %.1f ms\n", (glfwGetTime() - loadStartTime) * 1000.0);
     
     /* ================================================ */
     
@@ -229,10 +310,20 @@ int main() {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
+    // Meshlet culling skips back faces too : draw the same thing without it
+    glEnable(GL_CULL_FACE);
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     
     
     int fps = -1;
+    float frameTime = 0.0f;
+    size_t drawCount = 0;
+    RenderQueue::Statistics renderStatistics = renderQueue->getStatistics();
+    size_t culledCount = 0;
+    float cullTime = 0.0f;
+    TransformHierarchy::Statistics transformStatistics = {};
+    TextureStreamer::Statistics textureStatistics = {};
+    float transformTime = 0.0f;
     double lightTimeCounter = 0.0;
     double fpsTimeCounter = 0.0;
     double lastTime = glfwGetTime();
@@ -243,41 +334,104 @@ int main() {
 
         /* ==== UPDATE =================================== */
 
+        shaderReloader->update();
+        textureStreamer->update();
+
+        bool batchingKeyWasDown = batchingKeyDown;
+        batchingKeyDown = glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS;
+        if (batchingKeyDown && !batchingKeyWasDown) {
+            batching = !batching;
+        }
+        bool indirectKeyWasDown = indirectKeyDown;
+        indirectKeyDown = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+        if (indirectKeyDown && !indirectKeyWasDown) {
+            renderQueue->setIndirectEnabled(!renderQueue->isIndirectEnabled());
+        }
+
         computeMatricesFromInputs(deltaTime);
         mat4 projection = getProjectionMatrix();
         mat4 view = getViewMatrix();
-        
-        /* =============================================== */
+        vec3 cameraPosition = vec3(inverse(view)[3]);
+        float pixelsPerUnit = projection[1][1] * screen_height * 0.5f;
+        mat4 viewProjection = projection * view;
+
+        // Transforms, then the boxes of what moved, then culling, on the job threads while
+        // this one sets up the frame
+        Frustum viewFrustum;
+        extractFrustum(viewProjection, viewFrustum);
+        size_t visibleCount = 0;
+        float frameTransformTime = 0.0f;
+        float frameCullTime = 0.0f;
+        int transformTask = addFrameTask(frameGraph, [&]() {
+            double transformStartTime = glfwGetTime();
+            transforms->update();
+            frameTransformTime = static_cast<float>((glfwGetTime() - transformStartTime) * 1000.0);
+            for (size_t i = 0; i < models.size(); ++i) {
+                if (!models[i]->hasMoved()) {
+                    continue;
+                }
+                vec3 center;
+                vec3 extent;
+                models[i]->getBounds(center, extent);
+                setBox(modelBounds, i, center, extent);
+            }
+        });
+        int cullTask = addFrameTask(frameGraph, [&]() {
+            double cullStartTime = glfwGetTime();
+            visibleCount = cullBoxes(viewFrustum, modelBounds, &modelVisibility[0]);
+            frameCullTime = static_cast<float>((glfwGetTime() - cullStartTime) * 1000.0);
+        }, &transformTask, 1);
+        runFrameGraph(frameGraph);
 
-
-        /* ==== DRAW ===================================== */
-
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        sceneShader->use();
-        glUniformMatrix4fv(viewMatrixID, 1, GL_FALSE, &view[0][0]);
-    
         lightTimeCounter += deltaTime;
         lightPosition.x = 3 * cos(lightTimeCounter * 2);
         lightPosition.z = 3 * sin(lightTimeCounter * 2);
         //lightPosition.x = 30 * sin(lightTimeCounter * 0.8);
-        glUniform3f(lightId, lightPosition.x, lightPosition.y, lightPosition.z);
-
         vec3 lightColor(1, 1, 1);
-        glUniform3f(lightColorId, lightColor.r, lightColor.g, lightColor.b);
-
 
-        // Set our "myTextureSampler" sampler to use Texture Unit 0
-        glUniform1i(textureSampler, 0);
-
-        for (Model* m : models) {
-            m->update();
-            mat4 model = m->getModelMatrix();
-            mat4 mvp = projection * view * model;
-            glUniformMatrix4fv(modelMatrixID, 1, GL_FALSE, &model[0][0]);
-            glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
-            m->draw();
+        FrameUniforms frameUniforms;
+        frameUniforms.view = view;
+        frameUniforms.projection = projection;
+        frameUniforms.lightPosition_worldSpace = vec4(lightPosition, 1.0f);
+        frameUniforms.lightColor = vec4(lightColor, 1.0f);
+        GLintptr frameUniformsOffset = sceneUniforms->push(&frameUniforms, sizeof(frameUniforms));
+
+        waitForFrameTask(frameGraph, cullTask);
+
+        instanceBatcher->clear();
+        renderQueue->clear();
+        for (size_t i = 0; i < models.size(); ++i) {
+            if (!modelVisibility[i]) {
+                continue;
+            }
+            Model* m = models[i];
+            unsigned int lod = m->selectLod(cameraPosition, pixelsPerUnit);
+            m->getTexture()->requestResolution(m->getScreenSize(cameraPosition, pixelsPerUnit));
+            if (batching && instanceBatcher->canBatch(m, lod)) {
+                instanceBatcher->add(m, lod);
+                continue;
+            }
+            ObjectUniforms objectUniforms;
+            objectUniforms.model = m->getModelMatrix();
+            objectUniforms.mvp = viewProjection * objectUniforms.model;
+            objectUniforms.positionOffset = vec4(m->getMesh()->getPositionOffset(), 0.0f);
+            objectUniforms.positionScale = vec4(m->getMesh()->getPositionScale(), 0.0f);
+            renderQueue->addModel(m, lod, objectUniforms, *sceneUniforms, cameraPosition, viewProjection);
         }
+        instanceBatcher->upload(*sceneUniforms, viewProjection);
+        instanceBatcher->enqueue(*renderQueue, cameraPosition);
+        sceneUniforms->upload();
+        finishFrameGraph(frameGraph);
+
+        /* =============================================== */
+
+
+        /* ==== DRAW ===================================== */
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        
+        sceneUniforms->bindRange(FRAME_UNIFORMS_BINDING, frameUniformsOffset, sizeof(FrameUniforms));
+        renderQueue->submit(*sceneUniforms);
     
         
         /* ============================================== */
@@ -285,17 +439,100 @@ int main() {
         fpsTimeCounter += deltaTime;
         if (fpsTimeCounter > 1) {
             fps = static_cast<int>(1.0 / deltaTime);
+            frameTime = deltaTime * 1000.0f;
+            renderStatistics = renderQueue->getStatistics();
+            drawCount = renderStatistics.drawCount;
+            culledCount = models.size() - visibleCount;
+            cullTime = frameCullTime;
+            transformStatistics = transforms->getStatistics();
+            textureStatistics = textureStreamer->getStatistics();
+            transformTime = frameTransformTime;
             fpsTimeCounter = 0.0;
         }
         
+        char overlay[128];
+        snprintf(
+            overlay,
+            sizeof(overlay),
+            "FPS : %d  %.2f ms  Draws : %zu%s%s",
+            fps,
+            frameTime,
+            drawCount,
+            batching ? " (batched)" : "",
+            indirectSceneShader != nullptr && renderQueue->isIndirectEnabled() ? " (indirect)" : ""
+        );
         fontTextureManager->renderText(
             textShader,
-            "FPS : " + std::to_string(fps),
+            overlay,
             glm::vec2(10.0f, static_cast<float> (screen_height) - 50.0f),
             0.5f,
             glm::vec3(0.0f, 1.0f, 1.0f)
         );
+        snprintf(
+            overlay,
+            sizeof(overlay),
+            "Binds skipped : %zu programs  %zu textures  %zu meshes",
+            renderStatistics.programBindsSkipped,
+            renderStatistics.textureBindsSkipped,
+            renderStatistics.vertexArrayBindsSkipped
+        );
+        fontTextureManager->renderText(
+            textShader,
+            overlay,
+            glm::vec2(10.0f, static_cast<float> (screen_height) - 80.0f),
+            0.5f,
+            glm::vec3(0.0f, 1.0f, 1.0f)
+        );
+        snprintf(
+            overlay,
+            sizeof(overlay),
+            "Culled : %zu / %zu models  %.3f ms (%s)",
+            culledCount,
+            models.size(),
+            cullTime,
+            getCullingPathName(getCullingPath())
+        );
+        fontTextureManager->renderText(
+            textShader,
+            overlay,
+            glm::vec2(10.0f, static_cast<float> (screen_height) - 110.0f),
+            0.5f,
+            glm::vec3(0.0f, 1.0f, 1.0f)
+        );
+        snprintf(
+            overlay,
+            sizeof(overlay),
+            "Transforms : %zu / %zu updated  %.3f ms",
+            transformStatistics.updatedCount,
+            transformStatistics.nodeCount,
+            transformTime
+        );
+        fontTextureManager->renderText(
+            textShader,
+            overlay,
+            glm::vec2(10.0f, static_cast<float> (screen_height) - 140.0f),
+            0.5f,
+            glm::vec3(0.0f, 1.0f, 1.0f)
+        );
+        snprintf(
+            overlay,
+            sizeof(overlay),
+            "Textures : %zu pending  %.1f MB resident  max upload hitch %.3f ms%s",
+            textureStatistics.pendingCount,
+            textureStatistics.residentBytes / (1024.0f * 1024.0f),
+            textureStatistics.maxUploadTime,
+            textureStreamer->isStagingMapped() ? " (persistent PBO)" : ""
+        );
+        fontTextureManager->renderText(
+            textShader,
+            overlay,
+            glm::vec2(10.0f, static_cast<float> (screen_height) - 170.0f),
+            0.5f,
+            glm::vec3(0.0f, 1.0f, 1.0f)
+        );
         
+        sceneUniforms->endFrame();
+
         /* ============================================== */
         
         
@@ -324,13 +561,22 @@ int main() {
     for (Model* m : models) {
         delete m;
     }
+    delete transforms;
     delete cubeMesh;
     delete cubeTexture;
 
     delete floorMesh;
     delete floorTexture;
+    delete textureStreamer;
+    delete geometryArena;
     
+    delete renderQueue;
+    delete instanceBatcher;
+    delete sceneUniforms;
+    delete shaderReloader;
     delete sceneShader;
+    delete instancedSceneShader;
+    delete indirectSceneShader;
     delete textShader;
     
     delete fontTextureManager;
@@ -0,0 +1,115 @@
+// Bakes a texture into the block compressed .dds file loadDDS reads, with its mip chain :
+//
+//   texturebake [-bc1 | -bc3 | -bc7] [-box] [-linear] [-coverage reference] input output.dds
+//
+// Prints the PSNR of each level against the source.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+// Include GLEW, for the formats
+#include <GL/glew.h>
+
+#include <common/texture.hpp>
+#include <common/mipmap.hpp>
+#include <common/blockcompression.hpp>
+
+static void printUsage(){
+	printf(
+		"Usage : texturebake [options] input output.dds\n"
+		"  -bc1                 RGB, 4 bits per texel (default)\n"
+		"  -bc3                 RGBA, 8 bits per texel\n"
+		"  -bc7                 RGBA, 8 bits per texel, better quality\n"
+		"  -box                 box filtered mipmaps instead of Kaiser\n"
+		"  -linear              data rather than sRGB colors, such as normal maps\n"
+		"  -coverage reference  keep the alpha test coverage of level 0 in every level\n"
+	);
+}
+
+// DDS rows go down from the top, BMP ones up from the bottom
+static void flipRows(TextureData & data){
+	int channels = data.format == GL_RGB || data.format == GL_BGR ? 3 : 4;
+	std::vector<unsigned char> row;
+	for ( unsigned int level=0; level<getTextureLevelCount(data); level++ ){
+		unsigned int width  = data.width  >> level ? data.width  >> level : 1;
+		unsigned int height = data.height >> level ? data.height >> level : 1;
+		unsigned int stride = getTextureRowStride(width, channels);
+		unsigned char * pixels = &data.pixels[data.levelOffsets[level]];
+		row.resize(stride);
+		for ( unsigned int y=0; y<height/2; y++ ){
+			unsigned char * top = pixels + y * stride;
+			unsigned char * bottom = pixels + (height - 1 - y) * stride;
+			memcpy(&row[0], top, stride);
+			memcpy(top, bottom, stride);
+			memcpy(bottom, &row[0], stride);
+		}
+	}
+}
+
+int main( int argc, char * argv[] )
+{
+	BlockFormat format = BLOCK_FORMAT_BC1;
+	MipmapOptions mipmapOptions;
+	const char * inputPath = NULL;
+	const char * outputPath = NULL;
+	for ( int i=1; i<argc; i++ ){
+		if      ( strcmp(argv[i], "-bc1") == 0 )    format = BLOCK_FORMAT_BC1;
+		else if ( strcmp(argv[i], "-bc3") == 0 )    format = BLOCK_FORMAT_BC3;
+		else if ( strcmp(argv[i], "-bc7") == 0 )    format = BLOCK_FORMAT_BC7;
+		else if ( strcmp(argv[i], "-box") == 0 )    mipmapOptions.filter = MIPMAP_FILTER_BOX;
+		else if ( strcmp(argv[i], "-linear") == 0 ) mipmapOptions.srgb = false;
+		else if ( strcmp(argv[i], "-coverage") == 0 && i + 1 < argc ) mipmapOptions.alphaCoverage = (float)atof(argv[++i]);
+		else if ( argv[i][0] == '-' ){ printUsage(); return 1; }
+		else if ( inputPath == NULL )  inputPath = argv[i];
+		else if ( outputPath == NULL ) outputPath = argv[i];
+		else { printUsage(); return 1; }
+	}
+	if ( inputPath == NULL || outputPath == NULL ){
+		printUsage();
+		return 1;
+	}
+
+	TextureData source;
+	if ( !readTexture(inputPath, source) )
+		return 1;
+	if ( source.format == 0 ){
+		printf("%s is compressed already\n", inputPath);
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	if ( source.generateMipmaps && !buildMipmaps(source, mipmapOptions) ){
+		printf("%s : only 8 bit RGB and RGBA textures can be baked\n", inputPath);
+		return 1;
+	}
+	flipRows(source);
+	std::chrono::steady_clock::time_point mipmapTime = std::chrono::steady_clock::now();
+
+	TextureData compressed;
+	if ( !compressTexture(source, format, compressed) ){
+		printf("%s : only 8 bit RGB and RGBA textures can be baked\n", inputPath);
+		return 1;
+	}
+	std::chrono::steady_clock::time_point compressTime = std::chrono::steady_clock::now();
+
+	if ( !writeDDS(outputPath, compressed) )
+		return 1;
+
+	std::chrono::duration<double, std::milli> mipmapDuration = mipmapTime - startTime;
+	std::chrono::duration<double, std::milli> compressDuration = compressTime - mipmapTime;
+	printf("%s : %ux%u, %u levels, %s (%s)\n", outputPath, compressed.width, compressed.height,
+		getTextureLevelCount(compressed), getBlockFormatName(format), getMipmapPathName(mipmapOptions.path));
+	printf("  mipmaps %.1f ms, compression %.1f ms (%.1f megapixels/s)\n", mipmapDuration.count(), compressDuration.count(),
+		source.levelOffsets.back() / (double)(source.format == GL_RGB || source.format == GL_BGR ? 3 : 4) / 1000.0 / compressDuration.count());
+	printf("  %zu bytes, %.1fx smaller\n", compressed.pixels.size(), source.pixels.size() / (double)compressed.pixels.size());
+	for ( unsigned int level=0; level<getTextureLevelCount(compressed); level++ ){
+		unsigned int width  = compressed.width  >> level ? compressed.width  >> level : 1;
+		unsigned int height = compressed.height >> level ? compressed.height >> level : 1;
+		printf("  level %2u %5ux%-5u PSNR %.2f dB\n", level, width, height, computeCompressionPSNR(source, compressed, level));
+	}
+	return 0;
+}
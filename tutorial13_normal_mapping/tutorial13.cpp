@@ -93,7 +93,7 @@ int main( void )
 
 	// Load the texture
 	GLuint DiffuseTexture = loadDDS("diffuse.DDS");
-	GLuint NormalTexture = loadBMP_custom("normal.bmp");
+	GLuint NormalTexture = loadBMP_custom("normal.bmp", false);
 	GLuint SpecularTexture = loadDDS("specular.DDS");
 	
 	// Get a handle for our "myTextureSampler" uniform